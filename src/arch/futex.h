@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Minimal futex-style wait/wake on a 32-bit atomic word */
+#pragma once
+
+#include <stdatomic.h>
+
+#if defined(__linux__)
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* Sleep until *word is no longer @expected (or a spurious wakeup) */
+static inline void xfutex_wait(atomic_uint *word, unsigned expected) {
+	syscall(SYS_futex, (unsigned *)word, FUTEX_WAIT_PRIVATE,
+	        expected, NULL, NULL, 0);
+}
+
+static inline void xfutex_wake(atomic_uint *word, int n) {
+	syscall(SYS_futex, (unsigned *)word, FUTEX_WAKE_PRIVATE,
+	        n, NULL, NULL, 0);
+}
+
+#else
+
+#include "c11thread.h"
+
+/* No futex available, degrade to yielding until the word changes */
+static inline void xfutex_wait(atomic_uint *word, unsigned expected) {
+	while (atomic_load(word) == expected)
+		thrd_yield();
+}
+
+static inline void xfutex_wake(atomic_uint *word, int n) {
+	(void)word;
+	(void)n;
+}
+
+#endif
@@ -29,6 +29,7 @@ static inline void xsem_wait(struct xsem_t *sem) {
 
 	while(!sem->cnt)
 		cnd_wait(&sem->cnd, &sem->mtx);
+	sem->cnt--;
 
 	mtx_unlock(&sem->mtx);
 }
@@ -22,7 +22,7 @@
 
 bool client_is_expired(const struct client *client)
 {
-	return client->channel == NULL;
+	return client->fd < 0;
 }
 
 int client_get_uid(const struct client *client)
@@ -32,6 +32,13 @@ struct sockaddr;
 struct player_control;
 
 void client_manager_init(void);
+
+/**
+ * Starts the threads which run database queries.  Call this after
+ * daemonize().
+ */
+void client_manager_start(void);
+
 void client_manager_deinit(void);
 
 void client_new(struct player_control *player_control,
@@ -23,59 +23,132 @@
 
 #include <assert.h>
 
-static gboolean
-client_out_event(GIOChannel *source, GIOCondition condition,
-		 gpointer data)
+enum {
+	/**
+	 * The maximum number of reads in one client_event() call;
+	 * the rest is read on the next main loop iteration, so a
+	 * busy client cannot starve the others.
+	 */
+	CLIENT_MAX_READS = 16,
+};
+
+/**
+ * Is the client sending a response which the socket has not
+ * accepted completely yet?
+ */
+static bool
+client_is_busy(const struct client *client)
 {
-	struct client *client = data;
-
-	assert(!client_is_expired(client));
-
-	if (condition != G_IO_OUT) {
-		client_set_expired(client);
-		return false;
-	}
+	return client_has_deferred_output(client) ||
+		client_is_streaming(client);
+}
 
-	client_write_deferred(client);
+void
+client_update_watch(struct client *client)
+{
+	if (client_is_expired(client) || client_has_job(client))
+		return;
 
-	if (client_is_expired(client)) {
-		client_close(client);
-		return false;
-	}
+	reactor_set_events(&client->watch,
+			   client_has_deferred_output(client)
+			   ? REACTOR_WRITE : REACTOR_READ);
+}
 
-	g_timer_start(client->last_activity);
+/**
+ * Sends pending output, processes the input buffer and reads from
+ * the socket, until the client has to wait for the socket.
+ */
+static enum command_return
+client_run(struct client *client)
+{
+	unsigned reads = 0;
+	enum command_return ret;
 
-	if (g_queue_is_empty(client->deferred_send)) {
-		/* done sending deferred buffers exist: schedule
-		   read */
-		client->source_id = g_io_add_watch(client->channel,
-						   G_IO_IN|G_IO_ERR|G_IO_HUP,
-						   client_in_event, client);
-		return false;
+	if (client_has_job(client))
+		/* a worker thread owns the output queue; the client
+		   is scheduled again when the job is finished */
+		return COMMAND_RETURN_OK;
+
+	while (true) {
+		if (client_has_deferred_output(client)) {
+			client_write_deferred(client);
+			if (client_is_expired(client))
+				return COMMAND_RETURN_CLOSE;
+
+			if (client_has_deferred_output(client))
+				/* the socket is full; continue when it
+				   becomes writable */
+				return COMMAND_RETURN_OK;
+		}
+
+		if (client_is_streaming(client)) {
+			/* the socket has accepted all output: produce
+			   the next parts of the response */
+			client_stream_fill(client);
+			client_write_output(client);
+			if (client_is_expired(client))
+				return COMMAND_RETURN_CLOSE;
+
+			if (client_is_busy(client)) {
+				if (!client_has_deferred_output(client))
+					/* give the other clients a
+					   chance before the next parts */
+					reactor_schedule(&client->watch,
+							 REACTOR_WRITE);
+				return COMMAND_RETURN_OK;
+			}
+		}
+
+		/* the response is complete; process the commands
+		   which were received meanwhile */
+		ret = client_process_input(client);
+		if (ret == COMMAND_RETURN_KILL || ret == COMMAND_RETURN_CLOSE)
+			return ret;
+		if (client_is_expired(client))
+			return COMMAND_RETURN_CLOSE;
+
+		if (client_has_job(client))
+			return COMMAND_RETURN_OK;
+
+		if (client_is_busy(client))
+			continue;
+
+		if (!client->readable)
+			return COMMAND_RETURN_OK;
+
+		if (reads++ >= CLIENT_MAX_READS) {
+			reactor_schedule(&client->watch, REACTOR_READ);
+			return COMMAND_RETURN_OK;
+		}
+
+		ret = client_read(client);
+		if (ret != COMMAND_RETURN_OK)
+			return ret;
 	}
-
-	/* write more */
-	return true;
 }
 
-gboolean
-client_in_event(GIOChannel *source, GIOCondition condition,
-		gpointer data)
+void
+client_event(struct reactor_watch *watch, unsigned events)
 {
-	struct client *client = data;
-	enum command_return ret;
+	struct client *client = list_entry(watch, struct client, watch);
 
 	assert(!client_is_expired(client));
 
-	if (condition != G_IO_IN) {
-		client_set_expired(client);
-		return false;
+	if (events & REACTOR_HANGUP) {
+		if (client_has_job(client))
+			/* the worker thread still uses the socket */
+			client->hungup = true;
+		else
+			client_set_expired(client);
+		return;
 	}
 
-	g_timer_start(client->last_activity);
+	if (events & REACTOR_READ) {
+		client->readable = true;
+		g_timer_start(client->last_activity);
+	}
 
-	ret = client_read(client);
-	switch (ret) {
+	switch (client_run(client)) {
 	case COMMAND_RETURN_OK:
 	case COMMAND_RETURN_ERROR:
 		break;
@@ -83,26 +156,17 @@ client_in_event(GIOChannel *source, GIOCondition condition,
 	case COMMAND_RETURN_KILL:
 		client_close(client);
 		g_main_loop_quit(main_loop);
-		return false;
+		return;
 
 	case COMMAND_RETURN_CLOSE:
 		client_close(client);
-		return false;
+		return;
 	}
 
 	if (client_is_expired(client)) {
 		client_close(client);
-		return false;
-	}
-
-	if (!g_queue_is_empty(client->deferred_send)) {
-		/* deferred buffers exist: schedule write */
-		client->source_id = g_io_add_watch(client->channel,
-						   G_IO_OUT|G_IO_ERR|G_IO_HUP,
-						   client_out_event, client);
-		return false;
+		return;
 	}
 
-	/* read more */
-	return true;
+	client_update_watch(client);
 }
@@ -19,49 +19,65 @@
 
 #include "config.h"
 #include "client_internal.h"
+#include "fd_util.h"
+
+#include <assert.h>
+
+enum {
+	/**
+	 * The number of one-second slots in the timeout wheel.
+	 * Clients with a longer remaining time go around more than
+	 * once.
+	 */
+	CLIENT_TIMEOUT_SLOTS = 64,
+};
 
 static guint expire_source_id;
 
+/** clients which have been set "expired" */
+static LIST_HEAD(expired_clients);
+
+/**
+ * The timeout wheel: every second, the clients in the next slot are
+ * checked for inactivity, and those which are still active are moved
+ * to the slot where their timeout will be due.  Activity only
+ * restarts the client's timer and does not touch the wheel.
+ */
+static struct list_head timeout_wheel[CLIENT_TIMEOUT_SLOTS];
+static unsigned timeout_current;
+static unsigned num_timeout_clients;
+static guint timeout_source_id;
+
 void
 client_set_expired(struct client *client)
 {
-	if (!client_is_expired(client))
-		client_schedule_expire();
+	if (client_is_expired(client))
+		return;
 
-	if (client->source_id != 0) {
-		g_source_remove(client->source_id);
-		client->source_id = 0;
-	}
+	reactor_remove(&client->watch);
+	close_socket(client->fd);
+	client->fd = -1;
 
-	if (client->channel != NULL) {
-		g_io_channel_unref(client->channel);
-		client->channel = NULL;
-	}
+	list_add_tail(&client->expired_siblings, &expired_clients);
+	client_schedule_expire();
 }
 
 static void
-client_check_expired_callback(gpointer data, gpointer user_data)
+client_manager_expire(void)
 {
-	struct client *client = data;
+	struct client *client, *n;
+
+	list_for_each_entry_safe(client, n, &expired_clients,
+				 expired_siblings) {
+		if (client_has_job(client))
+			/* closed when the worker thread is done */
+			continue;
 
-	if (client_is_expired(client)) {
 		log_debug("[%u] expired", client->num);
 		client_close(client);
-	} else if (!client->idle_waiting && /* idle clients
-					       never expire */
-		   (int)g_timer_elapsed(client->last_activity, NULL) >
-		   client_timeout) {
-		log_debug("[%u] timeout", client->num);
-		client_close(client);
 	}
 }
 
-static void
-client_manager_expire(void)
-{
-	client_list_foreach(client_check_expired_callback, NULL);
-}
-
 /**
  * An idle event which calls client_manager_expire().
  */
@@ -82,9 +98,106 @@ client_schedule_expire(void)
 					      NULL);
 }
 
+/**
+ * Inserts the client into the wheel slot which is due in @seconds.
+ */
+static void
+client_timeout_insert(struct client *client, int seconds)
+{
+	if (seconds < 1)
+		seconds = 1;
+	else if (seconds >= CLIENT_TIMEOUT_SLOTS)
+		seconds = CLIENT_TIMEOUT_SLOTS - 1;
+
+	unsigned slot = (timeout_current + seconds) % CLIENT_TIMEOUT_SLOTS;
+	list_add_tail(&client->timeout_siblings, &timeout_wheel[slot]);
+}
+
+static void
+client_timeout_check(struct client *client)
+{
+	if (client_is_expired(client))
+		/* will be closed by client_manager_expire() */
+		return;
+
+	if (client->idle_waiting || client_has_job(client)) {
+		/* idle clients never expire, and busy ones are
+		   not inactive */
+		client_timeout_insert(client, client_timeout);
+		return;
+	}
+
+	int elapsed = (int)g_timer_elapsed(client->last_activity, NULL);
+	if (elapsed > client_timeout) {
+		log_debug("[%u] timeout", client->num);
+		client_close(client);
+		return;
+	}
+
+	client_timeout_insert(client, client_timeout - elapsed + 1);
+}
+
+static gboolean
+client_timeout_event(gpointer data)
+{
+	LIST_HEAD(due);
+
+	(void)data;
+
+	if (num_timeout_clients == 0) {
+		timeout_source_id = 0;
+		return false;
+	}
+
+	timeout_current = (timeout_current + 1) % CLIENT_TIMEOUT_SLOTS;
+	list_splice_init(&timeout_wheel[timeout_current], &due);
+
+	while (!list_empty(&due)) {
+		struct client *client =
+			list_first_entry(&due, struct client,
+					 timeout_siblings);
+
+		list_del_init(&client->timeout_siblings);
+		client_timeout_check(client);
+	}
+
+	return true;
+}
+
+void
+client_timeout_add(struct client *client)
+{
+	if (num_timeout_clients++ == 0) {
+		for (unsigned i = 0; i < CLIENT_TIMEOUT_SLOTS; ++i)
+			if (timeout_wheel[i].next == NULL)
+				INIT_LIST_HEAD(&timeout_wheel[i]);
+
+		if (timeout_source_id == 0)
+			timeout_source_id =
+				g_timeout_add_seconds(1, client_timeout_event,
+						      NULL);
+	}
+
+	client_timeout_insert(client, client_timeout + 1);
+}
+
+void
+client_timeout_remove(struct client *client)
+{
+	assert(num_timeout_clients > 0);
+
+	list_del_init(&client->timeout_siblings);
+	--num_timeout_clients;
+}
+
 void
 client_deinit_expire(void)
 {
 	if (expire_source_id != 0)
 		g_source_remove(expire_source_id);
+
+	if (timeout_source_id != 0) {
+		g_source_remove(timeout_source_id);
+		timeout_source_id = 0;
+	}
 }
@@ -50,6 +50,14 @@ void client_manager_init(void)
 		config_get_positive(CONF_MAX_OUTPUT_BUFFER_SIZE,
 				    CLIENT_MAX_OUTPUT_BUFFER_SIZE_DEFAULT / 1024)
 		* 1024;
+
+	client_output_pool_init();
+	client_worker_init();
+}
+
+void client_manager_start(void)
+{
+	client_worker_start();
 }
 
 static void client_close_all(void)
@@ -65,9 +73,13 @@ static void client_close_all(void)
 
 void client_manager_deinit(void)
 {
+	client_worker_deinit();
+
 	client_close_all();
 
 	client_max_connections = 0;
 
 	client_deinit_expire();
+
+	client_output_pool_deinit();
 }
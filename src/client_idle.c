@@ -24,6 +24,57 @@
 
 #include <assert.h>
 
+enum {
+	CLIENT_IDLE_FLAGS = sizeof(unsigned) * 8,
+};
+
+/**
+ * Incremented by each client_manager_idle_add() call.  Clients which
+ * are not waiting for "idle" are not touched; they collect the flags
+ * raised after their #idle_serial when they enter "idle".
+ */
+static unsigned idle_serial;
+
+/** the value of #idle_serial when each flag was last raised */
+static unsigned idle_flag_serials[CLIENT_IDLE_FLAGS];
+
+/** clients which are waiting for "idle" */
+static LIST_HEAD(idle_clients);
+
+void
+client_idle_init(struct client *client)
+{
+	client->idle_waiting = false;
+	client->idle_flags = 0;
+	client->idle_subscriptions = 0;
+	client->idle_serial = idle_serial;
+	INIT_LIST_HEAD(&client->idle_siblings);
+}
+
+/**
+ * Adds the flags raised since the client's last visit to its pending
+ * flags.
+ */
+static void
+client_idle_collect(struct client *client)
+{
+	if (client->idle_serial == idle_serial)
+		return;
+
+	for (unsigned i = 0; i < CLIENT_IDLE_FLAGS; ++i)
+		if ((int)(idle_flag_serials[i] - client->idle_serial) > 0)
+			client->idle_flags |= 1u << i;
+
+	client->idle_serial = idle_serial;
+}
+
+void
+client_idle_leave(struct client *client)
+{
+	client->idle_waiting = false;
+	list_del_init(&client->idle_siblings);
+}
+
 /**
  * Send "idle" response to this client.
  */
@@ -38,7 +89,7 @@ client_idle_notify(struct client *client)
 
 	flags = client->idle_flags;
 	client->idle_flags = 0;
-	client->idle_waiting = false;
+	client_idle_leave(client);
 
 	idle_names = idle_get_names();
 	for (i = 0; idle_names[i]; ++i) {
@@ -65,32 +116,37 @@ client_idle_add(struct client *client, unsigned flags)
 	}
 }
 
-static void
-client_idle_callback(gpointer data, gpointer user_data)
-{
-	struct client *client = data;
-	unsigned flags = GPOINTER_TO_UINT(user_data);
-
-	client_idle_add(client, flags);
-}
-
 void client_manager_idle_add(unsigned flags)
 {
+	struct client *client, *n;
+
 	assert(flags != 0);
 
-	client_list_foreach(client_idle_callback, GUINT_TO_POINTER(flags));
+	++idle_serial;
+	for (unsigned i = 0; i < CLIENT_IDLE_FLAGS; ++i)
+		if (flags & (1u << i))
+			idle_flag_serials[i] = idle_serial;
+
+	list_for_each_entry_safe(client, n, &idle_clients, idle_siblings) {
+		client_idle_collect(client);
+		client_idle_add(client, 0);
+	}
 }
 
 bool client_idle_wait(struct client *client, unsigned flags)
 {
 	assert(!client->idle_waiting);
 
+	client_idle_collect(client);
+
 	client->idle_waiting = true;
 	client->idle_subscriptions = flags;
 
 	if (client->idle_flags & client->idle_subscriptions) {
 		client_idle_notify(client);
 		return true;
-	} else
-		return false;
+	}
+
+	list_add_tail(&client->idle_siblings, &idle_clients);
+	return false;
 }
@@ -24,6 +24,9 @@
 #include "client.h"
 #include "client_message.h"
 #include "command.h"
+#include "client_stream.h"
+#include "reactor.h"
+#include "util/list.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -36,18 +39,60 @@ enum {
 	CLIENT_MAX_MESSAGES = 64,
 };
 
-struct deferred_buffer {
-	size_t size;
-	char data[sizeof(long)];
+enum {
+	/** size of one #client_output_page including its header */
+	CLIENT_OUTPUT_PAGE_SIZE = 16384,
+};
+
+/**
+ * One page of a client's output queue.  Responses are formatted
+ * directly into the free space at the end of the last page; pages
+ * are recycled through a global pool.
+ */
+struct client_output_page {
+	struct client_output_page *next;
+
+	/** the range of data which has not been sent yet */
+	size_t start, end;
+
+	char data[CLIENT_OUTPUT_PAGE_SIZE - 2 * sizeof(size_t) -
+		  sizeof(struct client_output_page *)];
 };
 
 struct client {
 	struct player_control *player_control;
 
-	GIOChannel *channel;
-	guint source_id;
+	/** the socket, or -1 if the client has expired */
+	int fd;
+
+	struct reactor_watch watch;
+
+	/**
+	 * Has the socket reported input which was not read yet?  It
+	 * is not read while the client is busy sending a response.
+	 */
+	bool readable;
+
+	/**
+	 * Has the socket hung up while a job was running?  The
+	 * worker thread may still use the socket, so the client
+	 * expires in client_job_complete().
+	 */
+	bool hungup;
+
+	/** in the list of all clients */
+	struct list_head siblings;
 
-	/** the buffer for reading lines from the #channel */
+	/** in the list of expired clients, see client_set_expired() */
+	struct list_head expired_siblings;
+
+	/** in a slot of the timeout wheel, see client_timeout_add() */
+	struct list_head timeout_siblings;
+
+	/** in the list of clients waiting for "idle" */
+	struct list_head idle_siblings;
+
+	/** the buffer for reading lines from the socket */
 	struct fifo_buffer *input;
 
 	unsigned permission;
@@ -63,12 +108,40 @@ struct client {
 	GSList *cmd_list;	/* for when in list mode */
 	int cmd_list_OK;	/* print OK after each command execution */
 	size_t cmd_list_size;	/* mem cmd_list consumes */
-	GQueue *deferred_send;	/* for output if client is slow */
-	size_t deferred_bytes;	/* mem deferred_send consumes */
 	unsigned int num;	/* client number */
 
-	char send_buf[16384];
-	size_t send_buf_used;	/* bytes used this instance */
+	/**
+	 * The output queue.  It is flushed with writev() when a few
+	 * pages have been filled and at the end of each command;
+	 * whatever the socket does not accept stays queued until
+	 * the client is writable again.
+	 */
+	struct client_output_page *output_head, *output_tail;
+
+	/** number of bytes in the output queue */
+	size_t output_bytes;
+
+	/** number of pages in the output queue */
+	unsigned output_pages;
+
+	/**
+	 * The response which is being streamed, see
+	 * client_stream_start().  No commands are processed until it
+	 * is complete.
+	 */
+	const struct client_stream_handler *stream;
+	void *stream_ctx;
+
+	/** the name of the streamed command, for the "ACK" */
+	const char *stream_command;
+
+	/**
+	 * The command which is running in a worker thread, see
+	 * client_worker_submit().  Until it is finished, the main
+	 * thread does not touch the input, the output queue or the
+	 * command list of this client, and does not free it.
+	 */
+	struct client_job *job;
 
 	/** is this client waiting for an "idle" response? */
 	bool idle_waiting;
@@ -77,6 +150,13 @@ struct client {
 	    the client enters "idle" */
 	unsigned idle_flags;
 
+	/**
+	 * The idle event serial when the pending flags were last
+	 * collected; events after that are added lazily, see
+	 * client_manager_idle_add().
+	 */
+	unsigned idle_serial;
+
 	/** idle flags that the client wants to receive */
 	unsigned idle_subscriptions;
 
@@ -155,25 +235,160 @@ void
 client_schedule_expire(void);
 
 /**
- * Removes a scheduled "expired" check.
+ * Removes a scheduled "expired" check and stops the timeout wheel.
  */
 void
 client_deinit_expire(void);
 
+/**
+ * Starts watching a new client for inactivity.
+ */
+void
+client_timeout_add(struct client *client);
+
+void
+client_timeout_remove(struct client *client);
+
+/**
+ * Initializes the idle state of a new client.
+ */
+void
+client_idle_init(struct client *client);
+
+/**
+ * Leaves "idle" mode without a response, e.g. on "noidle" or when
+ * the client is closed.
+ */
+void
+client_idle_leave(struct client *client);
+
+/**
+ * Receives data from the socket into the input buffer.  Clears
+ * #readable when the socket has no more data.
+ */
 enum command_return
 client_read(struct client *client);
 
+/**
+ * Processes the complete lines in the input buffer.  Stops at a
+ * command which streams its response.
+ */
+enum command_return
+client_process_input(struct client *client);
+
 enum command_return
 client_process_line(struct client *client, char *line);
 
+/**
+ * Runs a command in a worker thread.
+ *
+ * @param line the command, or NULL to run the client's command list
+ * @return false if there are no worker threads; the caller runs the
+ * command itself then
+ */
+bool
+client_worker_submit(struct client *client, const char *line);
+
+/**
+ * Does a worker thread run a command for this client?
+ */
+static inline bool
+client_has_job(const struct client *client)
+{
+	return client->job != NULL;
+}
+
+/**
+ * Called by the output code in a worker thread when the response
+ * exceeds #client_max_output_buffer_size.  The client is closed when
+ * the command is finished.
+ */
+void
+client_job_overflow(struct client *client);
+
+/**
+ * Executes a command in a worker thread, see client_worker_submit().
+ */
+enum command_return
+client_process_job(struct client *client, char *line);
+
+/**
+ * Completes a command which has run in a worker thread, in the main
+ * thread.
+ */
+enum command_return
+client_finish_job(struct client *client, char *line,
+		  enum command_return ret);
+
+void
+client_worker_init(void);
+
+void
+client_worker_start(void);
+
+void
+client_worker_deinit(void);
+
+/**
+ * Is a response being streamed to this client?
+ */
+static inline bool
+client_is_streaming(const struct client *client)
+{
+	return client->stream != NULL;
+}
+
+/**
+ * Produces the next parts of the streamed response, until the output
+ * queue is full enough.  Sends "OK" after the last part.
+ */
+void
+client_stream_fill(struct client *client);
+
+/**
+ * Discards the streamed response of a client which is being closed.
+ */
+void
+client_stream_cancel(struct client *client);
+
 void
 client_write_deferred(struct client *client);
 
 void
 client_write_output(struct client *client);
 
-gboolean
-client_in_event(GIOChannel *source, GIOCondition condition,
-		gpointer data);
+/**
+ * Does the client have output which the socket did not accept yet?
+ */
+static inline bool
+client_has_deferred_output(const struct client *client)
+{
+	return client->output_head != NULL;
+}
+
+/**
+ * Discards the output queue of a client which is being closed.
+ */
+void
+client_output_clear(struct client *client);
+
+void
+client_output_pool_init(void);
+
+/**
+ * Frees the pages in the global output page pool.
+ */
+void
+client_output_pool_deinit(void);
+
+/**
+ * Waits for the socket to become writable if the client has deferred
+ * output, or for input otherwise.
+ */
+void
+client_update_watch(struct client *client);
+
+void
+client_event(struct reactor_watch *watch, unsigned events);
 
 #endif
@@ -22,7 +22,7 @@
 
 #include <assert.h>
 
-static GList *clients;
+static LIST_HEAD(clients);
 static unsigned num_clients;
 
 bool
@@ -40,30 +40,33 @@ client_list_is_full(void)
 struct client *
 client_list_get_first(void)
 {
-	assert(clients != NULL);
+	assert(!list_empty(&clients));
 
-	return clients->data;
+	return list_first_entry(&clients, struct client, siblings);
 }
 
 void
 client_list_add(struct client *client)
 {
-	clients = g_list_prepend(clients, client);
+	list_add(&client->siblings, &clients);
 	++num_clients;
 }
 
 void
 client_list_foreach(GFunc func, gpointer user_data)
 {
-	g_list_foreach(clients, func, user_data);
+	struct client *client, *n;
+
+	list_for_each_entry_safe(client, n, &clients, siblings)
+		func(client, user_data);
 }
 
 void
 client_list_remove(struct client *client)
 {
 	assert(num_clients > 0);
-	assert(clients != NULL);
+	assert(!list_empty(&clients));
 
-	clients = g_list_remove(clients, client);
+	list_del(&client->siblings);
 	--num_clients;
 }
@@ -26,7 +26,6 @@
 #include "fifo_buffer.h"
 #include "resolver.h"
 #include "permission.h"
-#include "glib_socket.h"
 #include "macros.h"
 
 #include <assert.h>
@@ -89,19 +88,12 @@ client_new(struct player_control *player_control,
 	client = tmalloc(struct client, 1);
 	client->player_control = player_control;
 
-	client->channel = g_io_channel_new_socket(fd);
-	/* GLib is responsible for closing the file descriptor */
-	g_io_channel_set_close_on_unref(client->channel, true);
-	/* NULL encoding means the stream is binary safe; the MPD
-	   protocol is UTF-8 only, but we are doing this call anyway
-	   to prevent GLib from messing around with the stream */
-	g_io_channel_set_encoding(client->channel, NULL, NULL);
-	/* we prefer to do buffering */
-	g_io_channel_set_buffered(client->channel, false);
+	client->fd = fd;
+	client->readable = false;
+	client->hungup = false;
+	reactor_add(&client->watch, fd, REACTOR_READ, client_event);
 
-	client->source_id = g_io_add_watch(client->channel,
-					   G_IO_IN|G_IO_ERR|G_IO_HUP,
-					   client_in_event, client);
+	INIT_LIST_HEAD(&client->expired_siblings);
 
 	client->input = fifo_buffer_new(4096);
 
@@ -114,11 +106,16 @@ client_new(struct player_control *player_control,
 	client->cmd_list_OK = -1;
 	client->cmd_list_size = 0;
 
-	client->deferred_send = g_queue_new();
-	client->deferred_bytes = 0;
 	client->num = next_client_num++;
 
-	client->send_buf_used = 0;
+	client->output_head = client->output_tail = NULL;
+	client->output_bytes = 0;
+	client->output_pages = 0;
+
+	client->stream = NULL;
+	client->stream_ctx = NULL;
+
+	client_idle_init(client);
 
 	client->subscriptions = NULL;
 	client->messages = NULL;
@@ -127,6 +124,7 @@ client_new(struct player_control *player_control,
 	(void)send(fd, GREETING, sizeof(GREETING) - 1, 0);
 
 	client_list_add(client);
+	client_timeout_add(client);
 
 	remote = sockaddr_to_string(sa, sa_length);
 
@@ -138,19 +136,15 @@ client_new(struct player_control *player_control,
 	}
 }
 
-static void
-deferred_buffer_free(gpointer data, gpointer user_data)
-{
-	struct deferred_buffer *buffer = data;
-	free(buffer);
-}
-
 void
 client_close(struct client *client)
 {
 	client_list_remove(client);
+	client_timeout_remove(client);
+	client_idle_leave(client);
 
 	client_set_expired(client);
+	list_del_init(&client->expired_siblings);
 
 	g_timer_destroy(client->last_activity);
 
@@ -159,8 +153,8 @@ client_close(struct client *client)
 		client->cmd_list = NULL;
 	}
 
-	g_queue_foreach(client->deferred_send, deferred_buffer_free, NULL);
-	g_queue_free(client->deferred_send);
+	client_stream_cancel(client);
+	client_output_clear(client);
 
 	fifo_buffer_free(client->input);
 
@@ -48,6 +48,81 @@ client_process_command_list(struct client *client, bool list_ok, GSList *list)
 	return ret;
 }
 
+/**
+ * May all commands of this list run in a worker thread?
+ */
+static bool
+command_list_runs_in_worker(GSList *list)
+{
+	for (GSList *cur = list; cur != NULL; cur = g_slist_next(cur))
+		if (!command_runs_in_worker(cur->data, true))
+			return false;
+
+	return true;
+}
+
+/**
+ * Sends the result of a command after it has returned.
+ */
+static enum command_return
+client_command_done(struct client *client, enum command_return ret)
+{
+	if (ret == COMMAND_RETURN_CLOSE ||
+	    client_is_expired(client))
+		return COMMAND_RETURN_CLOSE;
+
+	if (client_is_streaming(client))
+		/* sends "OK" when complete */
+		client_stream_fill(client);
+	else if (ret == COMMAND_RETURN_OK)
+		command_success(client);
+
+	client_write_output(client);
+	return ret;
+}
+
+/**
+ * Sends the result of the command list after it has returned, and
+ * leaves command list mode.
+ */
+static enum command_return
+client_command_list_done(struct client *client, enum command_return ret)
+{
+	if (ret == COMMAND_RETURN_CLOSE ||
+	    client_is_expired(client))
+		return COMMAND_RETURN_CLOSE;
+
+	if (ret == COMMAND_RETURN_OK)
+		command_success(client);
+
+	client_write_output(client);
+	free_cmd_list(client->cmd_list);
+	client->cmd_list = NULL;
+	client->cmd_list_OK = -1;
+	return ret;
+}
+
+enum command_return
+client_process_job(struct client *client, char *line)
+{
+	if (line != NULL)
+		return command_process(client, 0, line);
+
+	return client_process_command_list(client, client->cmd_list_OK,
+					   client->cmd_list);
+}
+
+enum command_return
+client_finish_job(struct client *client, char *line,
+		  enum command_return ret)
+{
+	log_debug("[%u] worker returned %i", client->num, ret);
+
+	return line != NULL
+		? client_command_done(client, ret)
+		: client_command_list_done(client, ret);
+}
+
 enum command_return
 client_process_line(struct client *client, char *line)
 {
@@ -56,7 +131,7 @@ client_process_line(struct client *client, char *line)
 	if (strcmp(line, "noidle") == 0) {
 		if (client->idle_waiting) {
 			/* send empty idle response and leave idle mode */
-			client->idle_waiting = false;
+			client_idle_leave(client);
 			command_success(client);
 			client_write_output(client);
 		}
@@ -84,23 +159,18 @@ client_process_line(struct client *client, char *line)
 			   to restore the correct order */
 			client->cmd_list = g_slist_reverse(client->cmd_list);
 
+			if (command_list_runs_in_worker(client->cmd_list) &&
+			    client_worker_submit(client, NULL))
+				/* client_finish_job() sends the result */
+				return COMMAND_RETURN_OK;
+
 			ret = client_process_command_list(client,
 							  client->cmd_list_OK,
 							  client->cmd_list);
 			log_debug("[%u] process command "
 				"list returned %i", client->num, ret);
 
-			if (ret == COMMAND_RETURN_CLOSE ||
-			    client_is_expired(client))
-				return COMMAND_RETURN_CLOSE;
-
-			if (ret == COMMAND_RETURN_OK)
-				command_success(client);
-
-			client_write_output(client);
-			free_cmd_list(client->cmd_list);
-			client->cmd_list = NULL;
-			client->cmd_list_OK = -1;
+			ret = client_command_list_done(client, ret);
 		} else {
 			size_t len = strlen(line) + 1;
 			client->cmd_list_size += len;
@@ -124,6 +194,10 @@ client_process_line(struct client *client, char *line)
 		} else if (strcmp(line, CLIENT_LIST_OK_MODE_BEGIN) == 0) {
 			client->cmd_list_OK = 1;
 			ret = COMMAND_RETURN_OK;
+		} else if (command_runs_in_worker(line, false) &&
+			   client_worker_submit(client, line)) {
+			/* client_finish_job() sends the result */
+			ret = COMMAND_RETURN_OK;
 		} else {
 			log_debug("[%u] process command \"%s\"",
 				client->num, line);
@@ -131,14 +205,7 @@ client_process_line(struct client *client, char *line)
 			log_debug("[%u] command returned %i",
 				client->num, ret);
 
-			if (ret == COMMAND_RETURN_CLOSE ||
-			    client_is_expired(client))
-				return COMMAND_RETURN_CLOSE;
-
-			if (ret == COMMAND_RETURN_OK)
-				command_success(client);
-
-			client_write_output(client);
+			ret = client_command_done(client, ret);
 		}
 	}
 
@@ -23,6 +23,13 @@
 
 #include <assert.h>
 #include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#ifdef WIN32
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#endif
 
 static char *
 client_read_line(struct client *client)
@@ -45,16 +52,17 @@ client_read_line(struct client *client)
 	return g_strchomp(line);
 }
 
-static enum command_return
-client_input_received(struct client *client, size_t bytesRead)
+enum command_return
+client_process_input(struct client *client)
 {
 	char *line;
 
-	fifo_buffer_append(client->input, bytesRead);
-
-	/* process all lines */
+	/* process all lines; the ones after a streamed response or
+	   a command running in a worker thread remain in the buffer
+	   until it is complete */
 
-	while ((line = client_read_line(client)) != NULL) {
+	while (!client_is_streaming(client) && !client_has_job(client) &&
+	       (line = client_read_line(client)) != NULL) {
 		enum command_return ret = client_process_line(client, line);
 		free(line);
 
@@ -73,12 +81,10 @@ client_read(struct client *client)
 {
 	char *p;
 	size_t max_length;
-	GError *error = NULL;
-	GIOStatus status;
-	gsize bytes_read;
+	ssize_t nbytes;
 
 	assert(client != NULL);
-	assert(client->channel != NULL);
+	assert(client->fd >= 0);
 
 	p = fifo_buffer_write(client->input, &max_length);
 	if (p == NULL) {
@@ -86,28 +92,35 @@ client_read(struct client *client)
 		return COMMAND_RETURN_CLOSE;
 	}
 
-	status = g_io_channel_read_chars(client->channel, p, max_length,
-					 &bytes_read, &error);
-	switch (status) {
-	case G_IO_STATUS_NORMAL:
-		return client_input_received(client, bytes_read);
-
-	case G_IO_STATUS_AGAIN:
-		/* try again later, after select() */
+	nbytes = recv(client->fd, p, max_length, 0);
+	if (nbytes > 0) {
+		fifo_buffer_append(client->input, nbytes);
 		return COMMAND_RETURN_OK;
+	}
 
-	case G_IO_STATUS_EOF:
+	if (nbytes == 0)
 		/* peer disconnected */
 		return COMMAND_RETURN_CLOSE;
 
-	case G_IO_STATUS_ERROR:
+	switch (errno) {
+	case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+	case EWOULDBLOCK:
+#endif
+		/* try again when the socket reports new input */
+		client->readable = false;
+		return COMMAND_RETURN_OK;
+
+	case EINTR:
+		return COMMAND_RETURN_OK;
+
+	case ECONNRESET:
+		return COMMAND_RETURN_CLOSE;
+
+	default:
 		/* I/O error */
 		log_warning("failed to read from client %d: %s",
-			  client->num, error->message);
-		g_error_free(error);
+			    client->num, g_strerror(errno));
 		return COMMAND_RETURN_CLOSE;
 	}
-
-	/* unreachable */
-	return COMMAND_RETURN_CLOSE;
 }
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "client_stream.h"
+#include "client_internal.h"
+#include "protocol/result.h"
+#include "err.h"
+
+#include <assert.h>
+
+enum {
+	/**
+	 * Stop producing output when the output queue holds this
+	 * many bytes; produce more when the socket has accepted them.
+	 */
+	CLIENT_STREAM_HIGH_WATER = 4 * CLIENT_OUTPUT_PAGE_SIZE,
+
+	/**
+	 * The maximum number of parts produced per call, so other
+	 * clients are served even if this one reads as fast as we
+	 * write.
+	 */
+	CLIENT_STREAM_MAX_PARTS = 16,
+};
+
+bool
+client_stream_allowed(const struct client *client)
+{
+	/* a worker thread must not leave work for the main thread */
+	return client->cmd_list_OK < 0 && !client_has_job(client);
+}
+
+void
+client_stream_start(struct client *client,
+		    const struct client_stream_handler *handler, void *ctx)
+{
+	assert(client_stream_allowed(client));
+	assert(client->stream == NULL);
+	assert(handler != NULL);
+	assert(handler->fill != NULL);
+	assert(handler->free != NULL);
+
+	client->stream = handler;
+	client->stream_ctx = ctx;
+	client->stream_command = current_command;
+}
+
+static void
+client_stream_finish(struct client *client)
+{
+	const struct client_stream_handler *handler = client->stream;
+	void *ctx = client->stream_ctx;
+
+	client->stream = NULL;
+	client->stream_ctx = NULL;
+	handler->free(ctx);
+}
+
+void
+client_stream_fill(struct client *client)
+{
+	assert(client->stream != NULL);
+
+	for (unsigned i = 0; i < CLIENT_STREAM_MAX_PARTS; ++i) {
+		if (client_is_expired(client) ||
+		    client->output_bytes >= CLIENT_STREAM_HIGH_WATER)
+			return;
+
+		int ret = client->stream->fill(client, client->stream_ctx);
+		if (ret > 0)
+			continue;
+
+		client_stream_finish(client);
+
+		if (ret == MPD_SUCCESS)
+			command_success(client);
+		else {
+			/* streams are not allowed in command lists */
+			current_command = client->stream_command;
+			command_list_num = 0;
+			command_print_error(client, ret);
+		}
+
+		return;
+	}
+}
+
+void
+client_stream_cancel(struct client *client)
+{
+	if (client->stream != NULL)
+		client_stream_finish(client);
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_CLIENT_STREAM_H
+#define MPD_CLIENT_STREAM_H
+
+#include <stdbool.h>
+
+struct client;
+
+/**
+ * Produces a response which is too large to be generated at once.
+ * It is written in parts whenever the client's output queue runs low;
+ * meanwhile, no further commands are read from this client.
+ */
+struct client_stream_handler {
+	/**
+	 * Writes the next part of the response.
+	 *
+	 * @return a positive value if there is more, MPD_SUCCESS if
+	 * the response is complete, or a negative error code which is
+	 * sent to the client instead of "OK"
+	 */
+	int (*fill)(struct client *client, void *ctx);
+
+	/**
+	 * Frees the context, after the response is complete or when
+	 * the client is closed.
+	 */
+	void (*free)(void *ctx);
+};
+
+/**
+ * May the current command stream its response?  Commands in a command
+ * list or in a worker thread must complete synchronously.
+ */
+bool
+client_stream_allowed(const struct client *client);
+
+/**
+ * Streams the rest of the response to the current command.  The
+ * command returns COMMAND_RETURN_OK, and the "OK" (or the "ACK") is
+ * sent after the last part.
+ */
+void
+client_stream_start(struct client *client,
+		    const struct client_stream_handler *handler, void *ctx);
+
+#endif
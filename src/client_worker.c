@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Worker threads for commands which only read the database, so a
+ * slow query does not block the main thread, which serves all other
+ * clients.
+ *
+ * The database is shared with the workers under the #db_mutex, which
+ * the update thread already takes for each modification.  A worker
+ * does not hold it for a whole query: db_walk() and friends resume a
+ * db_cursor in slices and release the lock in between.  Commands
+ * touching the queue, the player or the client list stay in the main
+ * thread.  While a job runs, its client stops processing input; the
+ * response is buffered in the client's output queue and sent by the
+ * main thread when the job is finished.
+ */
+
+#define LOG_DOMAIN "client"
+
+#include "log.h"
+#include "config.h"
+#include "client_internal.h"
+#include "c11thread.h"
+#include "conf.h"
+#include "event_pipe.h"
+#include "mpd_error.h"
+
+#include <assert.h>
+
+enum {
+	CLIENT_WORKER_THREADS_DEFAULT = 2,
+	CLIENT_WORKER_THREADS_MAX = 64,
+};
+
+struct client_job {
+	struct list_head siblings;
+
+	struct client *client;
+
+	/** the command, or NULL for the client's command list */
+	char *line;
+
+	enum command_return result;
+
+	/** has the response exceeded the output buffer limit? */
+	bool overflow;
+};
+
+/** the configured number of threads */
+static unsigned max_worker_threads;
+
+static thrd_t *worker_threads;
+static unsigned num_worker_threads;
+
+/** protects #pending_jobs, #finished_jobs and #worker_quit */
+static mtx_t worker_mutex;
+static cnd_t worker_cond;
+
+static LIST_HEAD(pending_jobs);
+static LIST_HEAD(finished_jobs);
+static bool worker_quit;
+
+static int
+client_worker_thread(void *arg)
+{
+	(void)arg;
+
+	mtx_lock(&worker_mutex);
+
+	while (true) {
+		if (list_empty(&pending_jobs)) {
+			if (worker_quit)
+				break;
+
+			cnd_wait(&worker_cond, &worker_mutex);
+			continue;
+		}
+
+		struct client_job *job =
+			list_first_entry(&pending_jobs, struct client_job,
+					 siblings);
+		list_del(&job->siblings);
+		mtx_unlock(&worker_mutex);
+
+		job->result = client_process_job(job->client, job->line);
+
+		mtx_lock(&worker_mutex);
+		bool was_empty = list_empty(&finished_jobs);
+		list_add_tail(&job->siblings, &finished_jobs);
+
+		if (was_empty) {
+			mtx_unlock(&worker_mutex);
+			event_pipe_emit(PIPE_EVENT_CLIENT_JOB);
+			mtx_lock(&worker_mutex);
+		}
+	}
+
+	mtx_unlock(&worker_mutex);
+	return 0;
+}
+
+bool
+client_worker_submit(struct client *client, const char *line)
+{
+	assert(!client_has_job(client));
+	assert(!client_is_streaming(client));
+	assert(!client_has_deferred_output(client));
+
+	if (num_worker_threads == 0)
+		return false;
+
+	struct client_job *job = tmalloc(struct client_job, 1);
+	job->client = client;
+	job->line = line != NULL ? strdup(line) : NULL;
+	job->result = COMMAND_RETURN_ERROR;
+	job->overflow = false;
+
+	log_debug("[%u] process command \"%s\" in worker", client->num,
+		  line != NULL ? line : "command list");
+
+	client->job = job;
+
+	mtx_lock(&worker_mutex);
+	list_add_tail(&job->siblings, &pending_jobs);
+	cnd_signal(&worker_cond);
+	mtx_unlock(&worker_mutex);
+
+	return true;
+}
+
+void
+client_job_overflow(struct client *client)
+{
+	assert(client_has_job(client));
+
+	client->job->overflow = true;
+}
+
+static void
+client_job_free(struct client_job *job)
+{
+	free(job->line);
+	free(job);
+}
+
+/**
+ * Completes a finished job in the main thread.
+ */
+static void
+client_job_complete(struct client_job *job)
+{
+	struct client *client = job->client;
+
+	assert(client->job == job);
+	client->job = NULL;
+
+	if (job->overflow && !client_is_expired(client)) {
+		log_warning("[%u] output buffer size is larger than the "
+			    "max (%lu)", client->num,
+			    (unsigned long)client_max_output_buffer_size);
+		client_set_expired(client);
+	}
+
+	if (client->hungup)
+		/* deferred by client_event() */
+		client_set_expired(client);
+
+	if (!client_is_expired(client) &&
+	    client_finish_job(client, job->line,
+			      job->result) == COMMAND_RETURN_CLOSE)
+		client_set_expired(client);
+
+	client_job_free(job);
+
+	if (client_is_expired(client)) {
+		/* client_manager_expire() has skipped it while the
+		   job was running */
+		client_close(client);
+		return;
+	}
+
+	/* send the response and continue with the next commands in
+	   the input buffer */
+	reactor_schedule(&client->watch, REACTOR_WRITE);
+}
+
+static void
+client_worker_event(void)
+{
+	LIST_HEAD(finished);
+
+	mtx_lock(&worker_mutex);
+	list_splice_init(&finished_jobs, &finished);
+	mtx_unlock(&worker_mutex);
+
+	while (!list_empty(&finished)) {
+		struct client_job *job =
+			list_first_entry(&finished, struct client_job,
+					 siblings);
+		list_del(&job->siblings);
+		client_job_complete(job);
+	}
+}
+
+void
+client_worker_init(void)
+{
+	unsigned n = config_get_unsigned(CONF_COMMAND_THREADS,
+					 CLIENT_WORKER_THREADS_DEFAULT);
+	if (n > CLIENT_WORKER_THREADS_MAX)
+		MPD_ERROR("too many %s: %u", CONF_COMMAND_THREADS, n);
+
+	mtx_init(&worker_mutex, mtx_plain);
+	cnd_init(&worker_cond);
+	worker_quit = false;
+
+	event_pipe_register(PIPE_EVENT_CLIENT_JOB, client_worker_event);
+
+	max_worker_threads = n;
+}
+
+void
+client_worker_start(void)
+{
+	assert(worker_threads == NULL);
+
+	worker_threads = tmalloc(thrd_t, max_worker_threads > 0
+				 ? max_worker_threads : 1);
+	for (unsigned i = 0; i < max_worker_threads; ++i) {
+		if (thrd_create(&worker_threads[i], client_worker_thread,
+				NULL) != thrd_success) {
+			log_warning("Failed to start command thread");
+			break;
+		}
+
+		++num_worker_threads;
+	}
+}
+
+void
+client_worker_deinit(void)
+{
+	mtx_lock(&worker_mutex);
+	worker_quit = true;
+	cnd_broadcast(&worker_cond);
+	mtx_unlock(&worker_mutex);
+
+	/* the threads finish all pending jobs before they quit */
+	for (unsigned i = 0; i < num_worker_threads; ++i)
+		thrd_join(worker_threads[i], NULL);
+
+	free(worker_threads);
+	worker_threads = NULL;
+	num_worker_threads = 0;
+
+	/* the clients are about to be closed; discard the results */
+	while (!list_empty(&finished_jobs)) {
+		struct client_job *job =
+			list_first_entry(&finished_jobs, struct client_job,
+					 siblings);
+		list_del(&job->siblings);
+		job->client->job = NULL;
+		client_job_free(job);
+	}
+
+	cnd_destroy(&worker_cond);
+	mtx_destroy(&worker_mutex);
+}
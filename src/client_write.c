@@ -19,193 +19,334 @@
 
 #include "config.h"
 #include "client_internal.h"
+#include "c11thread.h"
 
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
 
-static size_t
-client_write_deferred_buffer(struct client *client,
-			     const struct deferred_buffer *buffer)
+#ifndef G_OS_WIN32
+#include <sys/uio.h>
+#else
+#include <winsock2.h>
+#endif
+
+enum {
+	/** the maximum number of unused pages kept in the pool */
+	CLIENT_OUTPUT_POOL_MAX = 64,
+
+	/**
+	 * Try to flush the output queue before it grows beyond this
+	 * number of pages.
+	 */
+	CLIENT_OUTPUT_FLUSH_PAGES = 4,
+
+	/** the maximum number of pages passed to one writev() call */
+	CLIENT_OUTPUT_IOV_MAX = 64,
+};
+
+/**
+ * Unused output pages.  The lock is needed because commands may
+ * produce output in a worker thread, see client_worker.c.
+ */
+static mtx_t output_pool_mutex;
+static struct client_output_page *output_pool;
+static unsigned output_pool_size;
+
+static struct client_output_page *
+output_page_get(void)
 {
-	GError *error = NULL;
-	GIOStatus status;
-	gsize bytes_written;
-
-	assert(client != NULL);
-	assert(client->channel != NULL);
-	assert(buffer != NULL);
-
-	status = g_io_channel_write_chars
-		(client->channel, buffer->data, buffer->size,
-		 &bytes_written, &error);
-	switch (status) {
-	case G_IO_STATUS_NORMAL:
-		return bytes_written;
-
-	case G_IO_STATUS_AGAIN:
-		return 0;
+	mtx_lock(&output_pool_mutex);
+	struct client_output_page *page = output_pool;
+	if (page != NULL) {
+		output_pool = page->next;
+		--output_pool_size;
+	}
+	mtx_unlock(&output_pool_mutex);
 
-	case G_IO_STATUS_EOF:
-		/* client has disconnected */
+	if (page == NULL)
+		page = g_new(struct client_output_page, 1);
 
-		client_set_expired(client);
-		return 0;
+	page->next = NULL;
+	page->start = page->end = 0;
+	return page;
+}
 
-	case G_IO_STATUS_ERROR:
-		/* I/O error */
+static void
+output_page_put(struct client_output_page *page)
+{
+	mtx_lock(&output_pool_mutex);
+	if (output_pool_size < CLIENT_OUTPUT_POOL_MAX) {
+		page->next = output_pool;
+		output_pool = page;
+		++output_pool_size;
+		page = NULL;
+	}
+	mtx_unlock(&output_pool_mutex);
 
-		client_set_expired(client);
-		log_warning("failed to flush buffer for %i: %s",
-			  client->num, error->message);
-		g_error_free(error);
-		return 0;
+	g_free(page);
+}
+
+void
+client_output_pool_init(void)
+{
+	mtx_init(&output_pool_mutex, mtx_plain);
+}
+
+void
+client_output_pool_deinit(void)
+{
+	while (output_pool != NULL) {
+		struct client_output_page *page = output_pool;
+		output_pool = page->next;
+		g_free(page);
 	}
 
-	/* unreachable */
-	return 0;
+	output_pool_size = 0;
+	mtx_destroy(&output_pool_mutex);
 }
 
 void
-client_write_deferred(struct client *client)
+client_output_clear(struct client *client)
 {
-	size_t ret;
+	while (client->output_head != NULL) {
+		struct client_output_page *page = client->output_head;
+		client->output_head = page->next;
+		output_page_put(page);
+	}
+
+	client->output_tail = NULL;
+	client->output_bytes = 0;
+	client->output_pages = 0;
+}
 
-	while (!g_queue_is_empty(client->deferred_send)) {
-		struct deferred_buffer *buf =
-			g_queue_peek_head(client->deferred_send);
+/**
+ * Removes the first @length bytes from the output queue.
+ */
+static void
+client_output_consume(struct client *client, size_t length)
+{
+	assert(length <= client->output_bytes);
 
-		assert(buf->size > 0);
-		assert(buf->size <= client->deferred_bytes);
+	client->output_bytes -= length;
 
-		ret = client_write_deferred_buffer(client, buf);
-		if (ret == 0)
-			break;
+	while (client->output_head != NULL) {
+		struct client_output_page *page = client->output_head;
+		size_t available = page->end - page->start;
 
-		if (ret < buf->size) {
-			assert(client->deferred_bytes >= (size_t)ret);
-			client->deferred_bytes -= ret;
-			buf->size -= ret;
-			memmove(buf->data, buf->data + ret, buf->size);
-			break;
-		} else {
-			size_t decr = sizeof(*buf) -
-				sizeof(buf->data) + buf->size;
-
-			assert(client->deferred_bytes >= decr);
-			client->deferred_bytes -= decr;
-			free(buf);
-			g_queue_pop_head(client->deferred_send);
+		if (length < available) {
+			page->start += length;
+			return;
 		}
 
-		g_timer_start(client->last_activity);
+		length -= available;
+		client->output_head = page->next;
+		if (client->output_head == NULL)
+			client->output_tail = NULL;
+		--client->output_pages;
+		output_page_put(page);
 	}
 
-	if (g_queue_is_empty(client->deferred_send)) {
-		log_debug("[%u] buffer empty %lu", client->num,
-			(unsigned long)client->deferred_bytes);
-		assert(client->deferred_bytes == 0);
-	}
+	assert(length == 0);
 }
 
-static void client_defer_output(struct client *client,
-				const void *data, size_t length)
+#ifndef G_OS_WIN32
+
+/**
+ * Sends as much of the output queue as the socket accepts with a
+ * single writev() call.
+ *
+ * @return the number of bytes written; 0 if the socket is full or on
+ * error (the client is expired then)
+ */
+static size_t
+client_output_send(struct client *client)
 {
-	size_t alloc;
-	struct deferred_buffer *buf;
-
-	assert(length > 0);
-
-	alloc = sizeof(*buf) - sizeof(buf->data) + length;
-	client->deferred_bytes += alloc;
-	if (client->deferred_bytes > client_max_output_buffer_size) {
-		log_warning("[%u] output buffer size (%lu) is "
-			  "larger than the max (%lu)",
-			  client->num,
-			  (unsigned long)client->deferred_bytes,
-			  (unsigned long)client_max_output_buffer_size);
-		/* cause client to close */
-		client_set_expired(client);
-		return;
+	struct iovec iov[CLIENT_OUTPUT_IOV_MAX];
+	unsigned n = 0;
+	ssize_t nbytes;
+
+	for (struct client_output_page *page = client->output_head;
+	     page != NULL && n < G_N_ELEMENTS(iov); page = page->next) {
+		iov[n].iov_base = page->data + page->start;
+		iov[n].iov_len = page->end - page->start;
+		++n;
 	}
 
-	buf = malloc(alloc);
-	buf->size = length;
-	memcpy(buf->data, data, length);
+	nbytes = writev(client->fd, iov, n);
+	if (nbytes >= 0)
+		return (size_t)nbytes;
 
-	g_queue_push_tail(client->deferred_send, buf);
+	switch (errno) {
+	case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+	case EWOULDBLOCK:
+#endif
+	case EINTR:
+		return 0;
+
+	case EPIPE:
+	case ECONNRESET:
+		/* client has disconnected */
+
+		client_set_expired(client);
+		return 0;
+
+	default:
+		/* I/O error */
+
+		client_set_expired(client);
+		log_warning("failed to write to %i: %s",
+			    client->num, g_strerror(errno));
+		return 0;
+	}
 }
 
-static void client_write_direct(struct client *client,
-				const char *data, size_t length)
+#else
+
+static size_t
+client_output_send(struct client *client)
 {
-	GError *error = NULL;
-	GIOStatus status;
-	gsize bytes_written;
-
-	assert(client != NULL);
-	assert(client->channel != NULL);
-	assert(data != NULL);
-	assert(length > 0);
-	assert(g_queue_is_empty(client->deferred_send));
-
-	status = g_io_channel_write_chars(client->channel, data, length,
-					  &bytes_written, &error);
-	switch (status) {
-	case G_IO_STATUS_NORMAL:
-	case G_IO_STATUS_AGAIN:
-		break;
-
-	case G_IO_STATUS_EOF:
+	const struct client_output_page *page = client->output_head;
+	int nbytes;
+
+	nbytes = send(client->fd, page->data + page->start,
+		      page->end - page->start, 0);
+	if (nbytes >= 0)
+		return (size_t)nbytes;
+
+	switch (WSAGetLastError()) {
+	case WSAEWOULDBLOCK:
+	case WSAEINTR:
+		return 0;
+
+	case WSAECONNRESET:
 		/* client has disconnected */
 
 		client_set_expired(client);
-		return;
+		return 0;
 
-	case G_IO_STATUS_ERROR:
+	default:
 		/* I/O error */
 
 		client_set_expired(client);
-		log_warning("failed to write to %i: %s",
-			  client->num, error->message);
-		g_error_free(error);
+		log_warning("failed to write to %i: error %d",
+			    client->num, WSAGetLastError());
+		return 0;
+	}
+}
+
+#endif
+
+/**
+ * Writes the output queue to the socket until it is empty or the
+ * socket is full.
+ */
+static void
+client_output_flush(struct client *client)
+{
+	if (client->output_bytes == 0) {
+		/* only empty pages left */
+		client_output_clear(client);
 		return;
 	}
 
-	if (bytes_written < length)
-		client_defer_output(client, data + bytes_written,
-				    length - bytes_written);
+	while (client->output_head != NULL && !client_is_expired(client)) {
+		size_t nbytes = client_output_send(client);
+		if (nbytes == 0)
+			break;
 
-	if (!g_queue_is_empty(client->deferred_send))
-		log_debug("[%u] buffer created", client->num);
+		client_output_consume(client, nbytes);
+		g_timer_start(client->last_activity);
+	}
+}
+
+/**
+ * Appends a new page to the output queue.  Flushes the queue first
+ * if it has grown large enough.
+ *
+ * @return the new page, or NULL if the client has been expired
+ */
+static struct client_output_page *
+client_output_append_page(struct client *client)
+{
+	struct client_output_page *page;
+
+	if (client_has_job(client)) {
+		/* in a worker thread, which must not touch the
+		   socket: the main thread sends the whole response
+		   when the command is finished */
+		if (client->output_bytes > client_max_output_buffer_size) {
+			client_job_overflow(client);
+			return NULL;
+		}
+	} else if (client->output_pages >= CLIENT_OUTPUT_FLUSH_PAGES) {
+		client_output_flush(client);
+		if (client_is_expired(client))
+			return NULL;
+
+		if (client->output_bytes > client_max_output_buffer_size) {
+			log_warning("[%u] output buffer size (%lu) is "
+				    "larger than the max (%lu)",
+				    client->num,
+				    (unsigned long)client->output_bytes,
+				    (unsigned long)client_max_output_buffer_size);
+			/* cause client to close */
+			client_set_expired(client);
+			return NULL;
+		}
+	}
+
+	page = output_page_get();
+	if (client->output_tail != NULL)
+		client->output_tail->next = page;
+	else
+		client->output_head = page;
+	client->output_tail = page;
+	++client->output_pages;
+	return page;
+}
+
+/**
+ * Returns the last page of the output queue if it has free space, or
+ * a new page.
+ */
+static struct client_output_page *
+client_output_writable_page(struct client *client)
+{
+	struct client_output_page *page = client->output_tail;
+
+	if (page != NULL && page->end < sizeof(page->data))
+		return page;
+
+	return client_output_append_page(client);
+}
+
+void
+client_write_deferred(struct client *client)
+{
+	client_output_flush(client);
+
+	if (!client_has_deferred_output(client))
+		log_debug("[%u] buffer empty", client->num);
 }
 
 void
 client_write_output(struct client *client)
 {
-	if (client_is_expired(client) || !client->send_buf_used)
-		return;
+	bool was_deferred = client_has_deferred_output(client);
 
-	if (!g_queue_is_empty(client->deferred_send)) {
-		client_defer_output(client, client->send_buf,
-				    client->send_buf_used);
+	if (client_is_expired(client) || client_has_job(client) ||
+	    client->output_bytes == 0)
+		return;
 
-		if (client_is_expired(client))
-			return;
+	client_output_flush(client);
 
-		/* try to flush the deferred buffers now; the current
-		   server command may take too long to finish, and
-		   meanwhile try to feed output to the client,
-		   otherwise it will time out.  One reason why
-		   deferring is slow might be that currently each
-		   client_write() allocates a new deferred buffer.
-		   This should be optimized after MPD 0.14. */
-		client_write_deferred(client);
-	} else
-		client_write_direct(client, client->send_buf,
-				    client->send_buf_used);
-
-	client->send_buf_used = 0;
+	if (!was_deferred && client_has_deferred_output(client)) {
+		log_debug("[%u] buffer created", client->num);
+		client_update_watch(client);
+	}
 }
 
 /**
@@ -217,22 +358,23 @@ static void client_write(struct client *client, const char *buffer, size_t bufle
 	if (client_is_expired(client))
 		return;
 
-	while (buflen > 0 && !client_is_expired(client)) {
+	while (buflen > 0) {
+		struct client_output_page *page;
 		size_t copylen;
 
-		assert(client->send_buf_used < sizeof(client->send_buf));
+		page = client_output_writable_page(client);
+		if (page == NULL)
+			return;
 
-		copylen = sizeof(client->send_buf) - client->send_buf_used;
+		copylen = sizeof(page->data) - page->end;
 		if (copylen > buflen)
 			copylen = buflen;
 
-		memcpy(client->send_buf + client->send_buf_used, buffer,
-		       copylen);
+		memcpy(page->data + page->end, buffer, copylen);
+		page->end += copylen;
+		client->output_bytes += copylen;
 		buflen -= copylen;
-		client->send_buf_used += copylen;
 		buffer += copylen;
-		if (client->send_buf_used >= sizeof(client->send_buf))
-			client_write_output(client);
 	}
 }
 
@@ -245,18 +387,50 @@ MPD_PRINTF(2, 0)
 void client_vprintf(struct client *client, const char *fmt, va_list args)
 {
 #ifndef G_OS_WIN32
+	struct client_output_page *page;
 	va_list tmp;
 	int length;
+	size_t space;
 	char *buffer;
 
+	if (client_is_expired(client))
+		return;
+
+	/* format directly into the output queue; the common case
+	   is a short line which fits into the last page */
+	page = client_output_writable_page(client);
+	if (page == NULL)
+		return;
+
+	space = sizeof(page->data) - page->end;
 	va_copy(tmp, args);
-	length = vsnprintf(NULL, 0, fmt, tmp);
+	length = vsnprintf(page->data + page->end, space, fmt, tmp);
 	va_end(tmp);
 
 	if (length <= 0)
 		/* wtf.. */
 		return;
 
+	if ((size_t)length < space) {
+		page->end += length;
+		client->output_bytes += length;
+		return;
+	}
+
+	if ((size_t)length < sizeof(page->data)) {
+		/* doesn't fit into the rest of this page; start a
+		   new one */
+		page = client_output_append_page(client);
+		if (page == NULL)
+			return;
+
+		vsnprintf(page->data, sizeof(page->data), fmt, args);
+		page->end = length;
+		client->output_bytes += length;
+		return;
+	}
+
+	/* larger than a page */
 	buffer = malloc(length + 1);
 	vsnprintf(buffer, length + 1, fmt, args);
 	client_write(client, buffer, length);
@@ -269,7 +443,7 @@ void client_vprintf(struct client *client, const char *fmt, va_list args)
 	   but WIN32 development is so painful, I'm not in the mood to
 	   do it properly now. */
 
-	static char buffer[4096];
+	char buffer[4096];
 	vsprintf(buffer, fmt, args);
 	client_write(client, buffer, strlen(buffer));
 #endif
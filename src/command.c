@@ -63,6 +63,7 @@
 #include "mapper.h"
 #include "song.h"
 #include "song_print.h"
+#include "input_prefetch.h"
 
 #ifdef ENABLE_STICKER
 #include "sticker.h"
@@ -94,6 +95,10 @@
 #define COMMAND_STATUS_MIXRAMPDELAY	"mixrampdelay"
 #define COMMAND_STATUS_AUDIO		"audio"
 #define COMMAND_STATUS_UPDATING_DB	"updating_db"
+#define COMMAND_STATUS_UPDATING_DIRECTORIES "updating_db_directories"
+#define COMMAND_STATUS_UPDATING_FILES	"updating_db_files"
+#define COMMAND_STATUS_PREFETCH_HITS	"prefetch_hits"
+#define COMMAND_STATUS_PREFETCH_MISSES	"prefetch_misses"
 
 /*
  * The most we ever use is for search/find, and that limits it to the
@@ -203,6 +208,14 @@ print_error2(struct client *client, int  r)
 	return COMMAND_RETURN_ERROR;
 }
 
+void
+command_print_error(struct client *client, int error)
+{
+	assert(error < 0);
+
+	print_error2(client, error);
+}
+
 static void
 print_spl_list(struct client *client, struct spl_list_head *list)
 {
@@ -391,9 +404,24 @@ handle_status(struct client *client,
 	}
 
 	if ((updateJobId = isUpdatingDB())) {
+		unsigned directories, files;
+		update_get_progress(&directories, &files);
+
 		client_printf(client,
-			      COMMAND_STATUS_UPDATING_DB ": %i\n",
-			      updateJobId);
+			      COMMAND_STATUS_UPDATING_DB ": %i\n"
+			      COMMAND_STATUS_UPDATING_DIRECTORIES ": %u\n"
+			      COMMAND_STATUS_UPDATING_FILES ": %u\n",
+			      updateJobId, directories, files);
+	}
+
+	if (input_prefetch_depth() > 0) {
+		unsigned hits, misses;
+		input_prefetch_stats(&hits, &misses);
+
+		client_printf(client,
+			      COMMAND_STATUS_PREFETCH_HITS ": %u\n"
+			      COMMAND_STATUS_PREFETCH_MISSES ": %u\n",
+			      hits, misses);
 	}
 
 	error = pc_get_error_message(client->player_control);
@@ -2176,6 +2204,38 @@ command_checked_lookup(struct client *client, unsigned permission,
 	return cmd;
 }
 
+/**
+ * Commands which only read the database.  Those marked "streamed"
+ * send their response in slices from the main thread (see
+ * client_stream.h) unless they are part of a command list, which is
+ * cheaper than buffering the whole response in a worker.
+ */
+static const struct {
+	const char *cmd;
+	bool streamed;
+} worker_commands[] = {
+	{ "count", false },
+	{ "find", true },
+	{ "list", false },
+	{ "listall", true },
+	{ "listallinfo", true },
+	{ "lsinfo", false },
+	{ "search", true },
+};
+
+bool
+command_runs_in_worker(const char *line, bool in_list)
+{
+	size_t length = strcspn(line, " \t");
+
+	for (unsigned i = 0; i < G_N_ELEMENTS(worker_commands); ++i)
+		if (strlen(worker_commands[i].cmd) == length &&
+		    memcmp(worker_commands[i].cmd, line, length) == 0)
+			return in_list || !worker_commands[i].streamed;
+
+	return false;
+}
+
 enum command_return
 command_process(struct client *client, unsigned num, char *line)
 {
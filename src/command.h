@@ -41,6 +41,21 @@ void command_finish(void);
 enum command_return
 command_process(struct client *client, unsigned num, char *line);
 
+/**
+ * May this command line run in a worker thread?  This is true for
+ * commands which only read the database.
+ *
+ * @param in_list true if the command is part of a command list
+ */
+bool
+command_runs_in_worker(const char *line, bool in_list);
+
 void command_success(struct client *client);
 
+/**
+ * Sends the "ACK" for a negative MPD error code.
+ */
+void
+command_print_error(struct client *client, int error);
+
 #endif
@@ -58,6 +58,9 @@ static struct config_entry config_entries[] = {
 	{ .name = CONF_FOLLOW_INSIDE_SYMLINKS, false, false },
 	{ .name = CONF_FOLLOW_OUTSIDE_SYMLINKS, false, false },
 	{ .name = CONF_DB_FILE, false, false },
+	{ .name = CONF_DB_FORMAT, false, false },
+	{ .name = CONF_DB_LOAD_THREADS, false, false },
+	{ .name = CONF_DB_SEARCH_INDEX, false, false },
 	{ .name = CONF_STICKER_FILE, false, false },
 	{ .name = CONF_LOG_FILE, false, false },
 	{ .name = CONF_PID_FILE, false, false },
@@ -83,6 +86,7 @@ static struct config_entry config_entries[] = {
 	{ .name = CONF_SAMPLERATE_CONVERTER, false, false },
 	{ .name = CONF_AUDIO_BUFFER_SIZE, false, false },
 	{ .name = CONF_BUFFER_BEFORE_PLAY, false, false },
+	{ .name = CONF_AUDIO_CHUNK_TIME, false, false },
 	{ .name = CONF_HTTP_PROXY_HOST, false, false },
 	{ .name = CONF_HTTP_PROXY_PORT, false, false },
 	{ .name = CONF_HTTP_PROXY_USER, false, false },
@@ -92,6 +96,9 @@ static struct config_entry config_entries[] = {
 	{ .name = CONF_MAX_PLAYLIST_LENGTH, false, false },
 	{ .name = CONF_MAX_COMMAND_LIST_SIZE, false, false },
 	{ .name = CONF_MAX_OUTPUT_BUFFER_SIZE, false, false },
+	{ .name = CONF_COMMAND_THREADS, false, false },
+	{ .name = CONF_PREFETCH_DEPTH, false, false },
+	{ .name = CONF_PREFETCH_BUFFER_SIZE, false, false },
 	{ .name = CONF_FS_CHARSET, false, false },
 	{ .name = CONF_ID3V1_ENCODING, false, false },
 	{ .name = CONF_METADATA_TO_USE, false, false },
@@ -102,6 +109,8 @@ static struct config_entry config_entries[] = {
 	{ .name = CONF_PLAYLIST_PLUGIN, true, true },
 	{ .name = CONF_AUTO_UPDATE, false, false },
 	{ .name = CONF_AUTO_UPDATE_DEPTH, false, false },
+	{ .name = CONF_UPDATE_THREADS, false, false },
+	{ .name = CONF_SCAN_CACHE, false, false },
 	{ .name = CONF_DESPOTIFY_USER, false, false },
 	{ .name = CONF_DESPOTIFY_PASSWORD, false, false},
 	{ .name = CONF_DESPOTIFY_HIGH_BITRATE, false, false },
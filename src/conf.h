@@ -32,6 +32,9 @@
 #define CONF_FOLLOW_INSIDE_SYMLINKS     "follow_inside_symlinks"
 #define CONF_FOLLOW_OUTSIDE_SYMLINKS    "follow_outside_symlinks"
 #define CONF_DB_FILE                    "db_file"
+#define CONF_DB_FORMAT                  "db_format"
+#define CONF_DB_LOAD_THREADS            "db_load_threads"
+#define CONF_DB_SEARCH_INDEX            "db_search_index"
 #define CONF_STICKER_FILE               "sticker_file"
 #define CONF_LOG_FILE                   "log_file"
 #define CONF_PID_FILE                   "pid_file"
@@ -57,6 +60,7 @@
 #define CONF_SAMPLERATE_CONVERTER       "samplerate_converter"
 #define CONF_AUDIO_BUFFER_SIZE          "audio_buffer_size"
 #define CONF_BUFFER_BEFORE_PLAY         "buffer_before_play"
+#define CONF_AUDIO_CHUNK_TIME           "audio_chunk_time"
 #define CONF_HTTP_PROXY_HOST            "http_proxy_host"
 #define CONF_HTTP_PROXY_PORT            "http_proxy_port"
 #define CONF_HTTP_PROXY_USER            "http_proxy_user"
@@ -66,6 +70,9 @@
 #define CONF_MAX_PLAYLIST_LENGTH        "max_playlist_length"
 #define CONF_MAX_COMMAND_LIST_SIZE      "max_command_list_size"
 #define CONF_MAX_OUTPUT_BUFFER_SIZE     "max_output_buffer_size"
+#define CONF_COMMAND_THREADS            "command_threads"
+#define CONF_PREFETCH_DEPTH             "prefetch_depth"
+#define CONF_PREFETCH_BUFFER_SIZE       "prefetch_buffer_size"
 #define CONF_FS_CHARSET                 "filesystem_charset"
 #define CONF_ID3V1_ENCODING             "id3v1_encoding"
 #define CONF_METADATA_TO_USE            "metadata_to_use"
@@ -76,6 +83,8 @@
 #define CONF_PLAYLIST_PLUGIN            "playlist_plugin"
 #define CONF_AUTO_UPDATE                "auto_update"
 #define CONF_AUTO_UPDATE_DEPTH          "auto_update_depth"
+#define CONF_UPDATE_THREADS             "update_threads"
+#define CONF_SCAN_CACHE                 "scan_cache"
 #define CONF_DESPOTIFY_USER             "despotify_user"
 #define CONF_DESPOTIFY_PASSWORD         "despotify_password"
 #define CONF_DESPOTIFY_HIGH_BITRATE     "despotify_high_bitrate"
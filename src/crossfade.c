@@ -113,7 +113,8 @@ unsigned cross_fade_calc(float duration, float total_time,
 	assert(duration >= 0);
 	assert(audio_format_valid(af));
 
-	chunks_f = (float)audio_format_time_to_size(af) / (float)CHUNK_SIZE;
+	chunks_f = (float)audio_format_time_to_size(af) /
+		(float)audio_chunk_size(af);
 
 	if (isnan(mixramp_delay) || !(mixramp_start) || !(mixramp_prev_end)) {
 		chunks = (chunks_f * duration + 0.5);
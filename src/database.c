@@ -27,9 +27,12 @@
 #include "db_plugin.h"
 #include "db/simple_db_plugin.h"
 #include "directory.h"
+#include "db_lock.h"
+#include "db_cursor.h"
 #include "stats.h"
 #include "conf.h"
 #include "glib_compat.h"
+#include "c11thread.h"
 
 #include <glib.h>
 
@@ -37,9 +40,15 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
+enum {
+	/** see db_walk_cursor() */
+	DB_WALK_SLICE = 256,
+};
+
 static struct db *db;
 static bool db_is_open;
 
@@ -55,6 +64,24 @@ db_init(const struct config_param *path)
 	struct config_param *param = config_new_param("database", path->line);
 	config_add_block_param(param, "path", path->value, path->line);
 
+	const struct config_param *format = config_get_param(CONF_DB_FORMAT);
+	if (format != NULL)
+		config_add_block_param(param, "format", format->value,
+				       format->line);
+
+	const struct config_param *threads =
+		config_get_param(CONF_DB_LOAD_THREADS);
+	if (threads != NULL)
+		config_add_block_param(param, "load_threads", threads->value,
+				       threads->line);
+
+	const struct config_param *search_index =
+		config_get_param(CONF_DB_SEARCH_INDEX);
+	if (search_index != NULL)
+		config_add_block_param(param, "search_index",
+				       search_index->value,
+				       search_index->line);
+
 	db = db_plugin_new(&simple_db_plugin, param);
 
 	config_param_free(param);
@@ -120,16 +147,68 @@ db_visit(const struct db_selection *selection,
 	return db_plugin_visit(db, selection, visitor, ctx);
 }
 
+/**
+ * Runs a cursor to its end.  The #db_mutex is released after every
+ * #DB_WALK_SLICE entries, so a slow query in a worker thread does not
+ * keep the main thread and the update thread waiting until it is
+ * finished.
+ */
+static int
+db_walk_cursor(struct db_cursor *cursor)
+{
+	int ret = MPD_SUCCESS;
+
+	while (ret == MPD_SUCCESS && !db_cursor_finished(cursor)) {
+		ret = db_cursor_step(cursor, DB_WALK_SLICE);
+
+		/* let the threads waiting for the lock have it */
+		thrd_yield();
+	}
+
+	db_cursor_free(cursor);
+	return ret;
+}
+
 int
 db_walk(const char *uri,
 	const struct db_visitor *visitor, void *ctx)
 {
+	struct db_cursor *cursor = db_cursor_new(uri, visitor, ctx);
+	if (cursor != NULL)
+		return db_walk_cursor(cursor);
+
+	/* not a directory: let the plugin visit the song, or report
+	   the error */
 	struct db_selection selection;
 	db_selection_init(&selection, uri, true);
 
 	return db_visit(&selection, visitor, ctx);
 }
 
+int
+db_walk_match(const char *uri, const struct locate_item_list *criteria,
+	      const struct db_visitor *visitor, void *ctx)
+{
+	struct db_cursor *cursor =
+		db_cursor_new_match(uri, criteria, visitor, ctx);
+	if (cursor != NULL)
+		return db_walk_cursor(cursor);
+
+	return db_walk(uri, visitor, ctx);
+}
+
+int
+db_walk_search(const char *uri, const struct locate_item_list *criteria,
+	       const struct db_visitor *visitor, void *ctx)
+{
+	struct db_cursor *cursor =
+		db_cursor_new_search(uri, criteria, visitor, ctx);
+	if (cursor != NULL)
+		return db_walk_cursor(cursor);
+
+	return db_walk(uri, visitor, ctx);
+}
+
 int
 db_save(void)
 {
@@ -31,6 +31,7 @@ struct config_param;
 struct directory;
 struct db_selection;
 struct db_visitor;
+struct locate_item_list;
 
 /**
  * Initialize the database library.
@@ -66,10 +67,35 @@ int
 db_visit(const struct db_selection *selection,
 	 const struct db_visitor *visitor, void *ctx);
 
+/**
+ * Walks the directory @uri (or visits the song @uri).  The caller
+ * must not hold the #db_mutex: the walk releases it every few hundred
+ * entries, so the database may change between two visitor calls, and
+ * objects passed to the visitor are only valid during the call.
+ */
 int
 db_walk(const char *uri,
 	const struct db_visitor *visitor, void *ctx);
 
+/**
+ * Walks the songs below @uri which may match the locate_song_match()
+ * @criteria.  The visitor is called for a superset of the matching
+ * songs, in database order, and must check them itself; the tag index
+ * is used to skip most of the others.  Only the song callback of the
+ * visitor is supported.
+ */
+int
+db_walk_match(const char *uri, const struct locate_item_list *criteria,
+	      const struct db_visitor *visitor, void *ctx);
+
+/**
+ * Like db_walk_match(), but for the casefolded locate_song_search()
+ * @criteria, narrowed down with the trigram index.
+ */
+int
+db_walk_search(const char *uri, const struct locate_item_list *criteria,
+	       const struct db_visitor *visitor, void *ctx);
+
 int
 db_save(void);
 
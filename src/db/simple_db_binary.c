@@ -0,0 +1,658 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define LOG_DOMAIN "database: simple_db"
+
+#include "config.h"
+#include "simple_db_binary.h"
+#include "db_error.h"
+#include "db_lock.h"
+#include "directory.h"
+#include "song.h"
+#include "tag.h"
+#include "tag_internal.h"
+#include "tag_pool.h"
+#include "playlist_vector.h"
+#include "path.h"
+
+#include <glib.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DB_BIN_MAGIC "MPDDBBIN"
+#define DB_BIN_VERSION 1
+#define DB_BIN_BYTE_ORDER 0x01020304u
+#define DB_BIN_NO_PARENT UINT32_MAX
+
+enum db_bin_song_flags {
+	DB_BIN_SONG_TAG = 1,
+	DB_BIN_SONG_PLAYLIST = 2,
+};
+
+struct db_bin_section {
+	uint64_t offset;
+	uint64_t count;
+};
+
+struct db_bin_header {
+	char magic[8];
+
+	/** #DB_BIN_BYTE_ORDER in host byte order of the writer */
+	uint32_t byte_order;
+	uint32_t version;
+
+	/** bit n is set if tag type n is not ignored */
+	uint64_t tag_mask;
+
+	/** string table offsets */
+	uint32_t fs_charset;
+	uint32_t mpd_version;
+
+	struct db_bin_section directories;
+	struct db_bin_section songs;
+	struct db_bin_section values;
+	struct db_bin_section items;
+	struct db_bin_section playlists;
+	struct db_bin_section strings;
+};
+
+/**
+ * Directories are stored in pre-order, the root first; a parent
+ * always has a lower index than its children.  The songs and
+ * playlists of a directory are contiguous ranges of their tables.
+ */
+struct db_bin_directory {
+	int64_t mtime;
+	uint32_t name;
+	uint32_t parent;
+	uint32_t first_song, num_songs;
+	uint32_t first_playlist, num_playlists;
+};
+
+struct db_bin_song {
+	int64_t mtime;
+	uint32_t uri;
+	uint32_t start_ms, end_ms;
+	int32_t time;
+	uint32_t first_item;
+	uint16_t num_items;
+	uint8_t flags;
+	uint8_t reserved;
+};
+
+/**
+ * A distinct (type, value) tag pair.  Songs refer to these through
+ * the item table, so each distinct value is interned only once on
+ * load.
+ */
+struct db_bin_value {
+	uint32_t type;
+	uint32_t value;
+};
+
+struct db_bin_playlist {
+	int64_t mtime;
+	uint32_t name;
+	uint32_t reserved;
+};
+
+static uint64_t
+db_bin_tag_mask(void)
+{
+	uint64_t mask = 0;
+
+	for (unsigned i = 0; i < TAG_NUM_OF_ITEM_TYPES; ++i)
+		if (!ignore_tag_items[i])
+			mask |= (uint64_t)1 << i;
+
+	return mask;
+}
+
+bool
+simple_db_binary_probe(const char *path_fs)
+{
+	char magic[sizeof(DB_BIN_MAGIC) - 1];
+
+	FILE *fp = fopen(path_fs, "rb");
+	if (fp == NULL)
+		return false;
+
+	bool ret = fread(magic, sizeof(magic), 1, fp) == 1 &&
+		memcmp(magic, DB_BIN_MAGIC, sizeof(magic)) == 0;
+	fclose(fp);
+	return ret;
+}
+
+/* Writer */
+
+struct db_bin_buffer {
+	char *data;
+	size_t size, capacity;
+};
+
+static size_t
+db_bin_append(struct db_bin_buffer *b, const void *p, size_t length)
+{
+	size_t offset = b->size;
+
+	if (b->size + length > b->capacity) {
+		b->capacity = MAX(b->capacity * 2, b->size + length);
+		b->data = realloc(b->data, b->capacity);
+	}
+
+	memcpy(b->data + b->size, p, length);
+	b->size += length;
+	return offset;
+}
+
+struct db_bin_writer {
+	struct db_bin_buffer directories, songs, values, items;
+	struct db_bin_buffer playlists, strings;
+
+	/** string -> offset + 1 */
+	GHashTable *string_table;
+
+	/** interned struct tag_item pointer -> value index + 1 */
+	GHashTable *value_table;
+};
+
+static uint32_t
+db_bin_string(struct db_bin_writer *w, const char *s)
+{
+	gpointer p = g_hash_table_lookup(w->string_table, s);
+	if (p != NULL)
+		return GPOINTER_TO_UINT(p) - 1;
+
+	uint32_t offset = db_bin_append(&w->strings, s, strlen(s) + 1);
+	g_hash_table_insert(w->string_table, (gpointer)(uintptr_t)s,
+			    GUINT_TO_POINTER(offset + 1));
+	return offset;
+}
+
+static uint32_t
+db_bin_value(struct db_bin_writer *w, const struct tag_item *item)
+{
+	/* tag items are interned by the tag pool, so the pointer
+	   identifies the (type, value) pair */
+	gpointer p = g_hash_table_lookup(w->value_table, item);
+	if (p != NULL)
+		return GPOINTER_TO_UINT(p) - 1;
+
+	struct db_bin_value value = {
+		.type = item->type,
+		.value = db_bin_string(w, item->value),
+	};
+
+	uint32_t index = db_bin_append(&w->values, &value, sizeof(value)) /
+		sizeof(value);
+	g_hash_table_insert(w->value_table, (gpointer)(uintptr_t)item,
+			    GUINT_TO_POINTER(index + 1));
+	return index;
+}
+
+static void
+db_bin_write_song(struct db_bin_writer *w, const struct song *song)
+{
+	struct db_bin_song s = {
+		.mtime = song->mtime,
+		.uri = db_bin_string(w, song->uri),
+		.start_ms = song->start_ms,
+		.end_ms = song->end_ms,
+		.time = -1,
+		.first_item = w->items.size / sizeof(uint32_t),
+	};
+
+	const struct tag *tag = song->tag;
+	if (tag != NULL) {
+		s.flags |= DB_BIN_SONG_TAG;
+		if (tag->has_playlist)
+			s.flags |= DB_BIN_SONG_PLAYLIST;
+		s.time = tag->time;
+		s.num_items = MIN(tag->num_items, UINT16_MAX);
+
+		for (unsigned i = 0; i < s.num_items; ++i) {
+			uint32_t v = db_bin_value(w, tag->items[i]);
+			db_bin_append(&w->items, &v, sizeof(v));
+		}
+	}
+
+	db_bin_append(&w->songs, &s, sizeof(s));
+}
+
+static void
+db_bin_write_directory(struct db_bin_writer *w,
+		       const struct directory *directory, uint32_t parent)
+{
+	struct db_bin_directory d = {
+		.mtime = directory->mtime,
+		.name = db_bin_string(w, directory_is_root(directory)
+				      ? "" : directory_get_name(directory)),
+		.parent = parent,
+		.first_song = w->songs.size / sizeof(struct db_bin_song),
+		.first_playlist =
+			w->playlists.size / sizeof(struct db_bin_playlist),
+	};
+
+	const struct song *song;
+	directory_for_each_song(song, directory) {
+		db_bin_write_song(w, song);
+		++d.num_songs;
+	}
+
+	const struct playlist_metadata *pm;
+	playlist_vector_for_each(pm, &directory->playlists) {
+		struct db_bin_playlist p = {
+			.mtime = pm->mtime,
+			.name = db_bin_string(w, pm->name),
+		};
+
+		db_bin_append(&w->playlists, &p, sizeof(p));
+		++d.num_playlists;
+	}
+
+	uint32_t index = db_bin_append(&w->directories, &d, sizeof(d)) /
+		sizeof(d);
+
+	const struct directory *child;
+	directory_for_each_child(child, directory)
+		db_bin_write_directory(w, child, index);
+}
+
+static uint64_t
+db_bin_section(struct db_bin_section *section, uint64_t offset,
+	       const struct db_bin_buffer *b, size_t record_size)
+{
+	section->offset = offset;
+	section->count = b->size / record_size;
+	return (offset + b->size + 7) & ~(uint64_t)7;
+}
+
+static bool
+db_bin_write_buffer(FILE *fp, const struct db_bin_buffer *b)
+{
+	static const char padding[8];
+
+	return fwrite(b->data, 1, b->size, fp) == b->size &&
+		fwrite(padding, 1, -b->size & 7, fp) == (-b->size & 7);
+}
+
+int
+simple_db_binary_save(const char *path_fs, const struct directory *root)
+{
+	struct db_bin_writer w;
+
+	memset(&w, 0, sizeof(w));
+	w.string_table = g_hash_table_new(g_str_hash, g_str_equal);
+	w.value_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	const char *charset = path_get_fs_charset();
+
+	struct db_bin_header header = {
+		.byte_order = DB_BIN_BYTE_ORDER,
+		.version = DB_BIN_VERSION,
+		.tag_mask = db_bin_tag_mask(),
+		.fs_charset = db_bin_string(&w, charset != NULL ? charset : ""),
+		.mpd_version = db_bin_string(&w, VERSION),
+	};
+	memcpy(header.magic, DB_BIN_MAGIC, sizeof(header.magic));
+
+	db_bin_write_directory(&w, root, DB_BIN_NO_PARENT);
+
+	uint64_t offset = (sizeof(header) + 7) & ~(uint64_t)7;
+	offset = db_bin_section(&header.directories, offset, &w.directories,
+				sizeof(struct db_bin_directory));
+	offset = db_bin_section(&header.songs, offset, &w.songs,
+				sizeof(struct db_bin_song));
+	offset = db_bin_section(&header.values, offset, &w.values,
+				sizeof(struct db_bin_value));
+	offset = db_bin_section(&header.items, offset, &w.items,
+				sizeof(uint32_t));
+	offset = db_bin_section(&header.playlists, offset, &w.playlists,
+				sizeof(struct db_bin_playlist));
+	db_bin_section(&header.strings, offset, &w.strings, 1);
+
+	int ret = MPD_SUCCESS;
+	FILE *fp = fopen(path_fs, "wb");
+	if (fp == NULL) {
+		log_err("unable to write to db file \"%s\": %s",
+			path_fs, strerror(errno));
+		ret = -DB_ACCESS;
+	} else {
+		struct db_bin_buffer hb = {
+			.data = (char *)&header,
+			.size = sizeof(header),
+		};
+
+		if (!db_bin_write_buffer(fp, &hb) ||
+		    !db_bin_write_buffer(fp, &w.directories) ||
+		    !db_bin_write_buffer(fp, &w.songs) ||
+		    !db_bin_write_buffer(fp, &w.values) ||
+		    !db_bin_write_buffer(fp, &w.items) ||
+		    !db_bin_write_buffer(fp, &w.playlists) ||
+		    !db_bin_write_buffer(fp, &w.strings) ||
+		    fclose(fp) != 0) {
+			log_err("Failed to write to database file: %s",
+				strerror(errno));
+			ret = -DB_ACCESS;
+		}
+	}
+
+	g_hash_table_destroy(w.value_table);
+	g_hash_table_destroy(w.string_table);
+	free(w.directories.data);
+	free(w.songs.data);
+	free(w.values.data);
+	free(w.items.data);
+	free(w.playlists.data);
+	free(w.strings.data);
+	return ret;
+}
+
+/* Loader */
+
+struct db_bin_file {
+	const char *base;
+	size_t size;
+	const struct db_bin_header *header;
+
+	const struct db_bin_directory *directories;
+	const struct db_bin_song *songs;
+	const struct db_bin_value *values;
+	const uint32_t *items;
+	const struct db_bin_playlist *playlists;
+	const char *strings;
+
+	/** the interned item of each value, NULL until first use */
+	struct tag_item **value_items;
+};
+
+static const void *
+db_bin_map_section(const struct db_bin_file *f,
+		   const struct db_bin_section *section, size_t record_size)
+{
+	if (section->offset % 8 != 0 || section->offset > f->size ||
+	    section->count > (f->size - section->offset) / record_size)
+		return NULL;
+
+	return f->base + section->offset;
+}
+
+static const char *
+db_bin_get_string(const struct db_bin_file *f, uint32_t offset)
+{
+	/* the string table is known to end with a null byte */
+	return offset < f->header->strings.count
+		? f->strings + offset : NULL;
+}
+
+static int
+db_bin_check_header(struct db_bin_file *f)
+{
+	const struct db_bin_header *h = f->header;
+
+	if (f->size < sizeof(*h) ||
+	    memcmp(h->magic, DB_BIN_MAGIC, sizeof(h->magic)) != 0 ||
+	    h->byte_order != DB_BIN_BYTE_ORDER) {
+		log_err("Database corrupted");
+		return -DB_CORRUPT;
+	}
+
+	if (h->version != DB_BIN_VERSION) {
+		log_err("Database format mismatch, "
+			"discarding database file");
+		return -DB_MALFORM;
+	}
+
+	f->directories = db_bin_map_section(f, &h->directories,
+					    sizeof(*f->directories));
+	f->songs = db_bin_map_section(f, &h->songs, sizeof(*f->songs));
+	f->values = db_bin_map_section(f, &h->values, sizeof(*f->values));
+	f->items = db_bin_map_section(f, &h->items, sizeof(*f->items));
+	f->playlists = db_bin_map_section(f, &h->playlists,
+					  sizeof(*f->playlists));
+	f->strings = db_bin_map_section(f, &h->strings, 1);
+
+	if (f->directories == NULL || f->songs == NULL ||
+	    f->values == NULL || f->items == NULL ||
+	    f->playlists == NULL || f->strings == NULL ||
+	    h->directories.count == 0 || h->strings.count == 0 ||
+	    f->strings[h->strings.count - 1] != 0 ||
+	    h->directories.count >= DB_BIN_NO_PARENT) {
+		log_err("Database corrupted");
+		return -DB_CORRUPT;
+	}
+
+	if (h->tag_mask != db_bin_tag_mask()) {
+		log_err("Tag list mismatch, "
+			"discarding database file");
+		return -DB_MALFORM;
+	}
+
+	const char *new_charset = db_bin_get_string(f, h->fs_charset);
+	const char *old_charset = path_get_fs_charset();
+	if (new_charset == NULL) {
+		log_err("Database corrupted");
+		return -DB_CORRUPT;
+	}
+
+	if (old_charset != NULL && strcmp(new_charset, old_charset) != 0) {
+		log_err("Existing database has charset "
+			"\"%s\" instead of \"%s\"; "
+			"discarding database file",
+			new_charset, old_charset);
+		return -DB_MALFORM;
+	}
+
+	return MPD_SUCCESS;
+}
+
+static struct tag_item *
+db_bin_get_item(struct db_bin_file *f, uint32_t index)
+{
+	if (index >= f->header->values.count)
+		return NULL;
+
+	struct tag_item *item = f->value_items[index];
+	if (item != NULL)
+		return tag_pool_dup_item(item);
+
+	const struct db_bin_value *v = &f->values[index];
+	const char *value = db_bin_get_string(f, v->value);
+	if (v->type >= TAG_NUM_OF_ITEM_TYPES || value == NULL)
+		return NULL;
+
+	/* the first song holding this value owns the reference the
+	   cache entry points to; songs are not freed during load */
+	item = tag_pool_get_item(v->type, value, strlen(value));
+	f->value_items[index] = item;
+	return item;
+}
+
+static struct song *
+db_bin_load_song(struct db_bin_file *f, const struct db_bin_song *s,
+		 struct directory *parent)
+{
+	const char *uri = db_bin_get_string(f, s->uri);
+	if (uri == NULL || *uri == 0 || strchr(uri, '/') != NULL)
+		return NULL;
+
+	struct song *song = song_file_new(uri, parent);
+	song->mtime = s->mtime;
+	song->start_ms = s->start_ms;
+	song->end_ms = s->end_ms;
+
+	if ((s->flags & DB_BIN_SONG_TAG) == 0)
+		return song;
+
+	struct tag *tag = song->tag = tag_new();
+	tag->time = s->time;
+	tag->has_playlist = (s->flags & DB_BIN_SONG_PLAYLIST) != 0;
+
+	if (s->num_items == 0)
+		return song;
+
+	if (s->first_item > f->header->items.count ||
+	    s->num_items > f->header->items.count - s->first_item) {
+		song_free(song);
+		return NULL;
+	}
+
+	tag->items = malloc(s->num_items * sizeof(tag->items[0]));
+	for (unsigned i = 0; i < s->num_items; ++i) {
+		struct tag_item *item =
+			db_bin_get_item(f, f->items[s->first_item + i]);
+		if (item == NULL) {
+			song_free(song);
+			return NULL;
+		}
+
+		tag->items[tag->num_items++] = item;
+	}
+
+	return song;
+}
+
+static int
+db_bin_load_directory(struct db_bin_file *f, uint32_t index,
+		      struct directory **directories)
+{
+	const struct db_bin_header *h = f->header;
+	const struct db_bin_directory *d = &f->directories[index];
+	struct directory *directory;
+
+	if (index == 0) {
+		if (d->parent != DB_BIN_NO_PARENT)
+			return -DB_CORRUPT;
+
+		directory = directories[0];
+	} else {
+		const char *name = db_bin_get_string(f, d->name);
+		if (d->parent >= index || name == NULL || *name == 0)
+			return -DB_CORRUPT;
+
+		directory = directory_new_child(directories[d->parent], name);
+		directories[index] = directory;
+	}
+
+	directory->mtime = d->mtime;
+
+	if (d->first_song > h->songs.count ||
+	    d->num_songs > h->songs.count - d->first_song ||
+	    d->first_playlist > h->playlists.count ||
+	    d->num_playlists > h->playlists.count - d->first_playlist)
+		return -DB_CORRUPT;
+
+	for (uint32_t i = 0; i < d->num_songs; ++i) {
+		struct song *song =
+			db_bin_load_song(f, &f->songs[d->first_song + i],
+					 directory);
+		if (song == NULL)
+			return -DB_CORRUPT;
+
+		directory_load_song(directory, song);
+	}
+
+	for (uint32_t i = 0; i < d->num_playlists; ++i) {
+		const struct db_bin_playlist *p =
+			&f->playlists[d->first_playlist + i];
+		const char *name = db_bin_get_string(f, p->name);
+		if (name == NULL)
+			return -DB_CORRUPT;
+
+		playlist_vector_update_or_add(&directory->playlists,
+					      name, p->mtime);
+	}
+
+	return MPD_SUCCESS;
+}
+
+int
+simple_db_binary_load(const char *path_fs, struct directory *root)
+{
+	assert(holding_db_lock());
+	assert(directory_is_empty(root));
+
+	int fd = open(path_fs, O_RDONLY);
+	if (fd < 0) {
+		log_err("Failed to open database file \"%s\": %s",
+			path_fs, strerror(errno));
+		return -DB_ERRNO;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct db_bin_header)) {
+		close(fd);
+		log_err("Database corrupted");
+		return -DB_CORRUPT;
+	}
+
+	struct db_bin_file f = {
+		.size = st.st_size,
+	};
+
+	void *base = mmap(NULL, f.size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		log_err("Failed to map database file \"%s\": %s",
+			path_fs, strerror(errno));
+		return -DB_ERRNO;
+	}
+
+	madvise(base, f.size, MADV_WILLNEED);
+
+	f.base = base;
+	f.header = base;
+
+	int ret = db_bin_check_header(&f);
+	if (ret != MPD_SUCCESS) {
+		munmap(base, f.size);
+		return ret;
+	}
+
+	log_debug("reading DB");
+
+	size_t num_directories = f.header->directories.count;
+	struct directory **directories =
+		malloc(num_directories * sizeof(directories[0]));
+	directories[0] = root;
+	f.value_items = calloc(f.header->values.count + 1,
+			       sizeof(f.value_items[0]));
+
+	for (size_t i = 0; i < num_directories; ++i) {
+		ret = db_bin_load_directory(&f, i, directories);
+		if (ret != MPD_SUCCESS) {
+			log_err("Database corrupted");
+			break;
+		}
+	}
+
+	free(f.value_items);
+	free(directories);
+	munmap(base, f.size);
+	return ret;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * Binary on-disk format of the simple database.  The file is a fixed
+ * header followed by flat, 8-byte aligned record tables which refer to
+ * each other by index, and to a deduplicated string table by offset.
+ * It is loaded with mmap(), no parsing or line reading involved.
+ *
+ * The mapping only lives during the load: the records are copied into
+ * the ordinary directory and song objects, because the update thread
+ * modifies those in place and the rest of MPD expects them.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+struct directory;
+
+/**
+ * Checks whether the file at @path_fs starts with the binary
+ * database magic.  Returns false if it cannot be read.
+ */
+bool
+simple_db_binary_probe(const char *path_fs);
+
+/**
+ * Writes the directory tree to @path_fs in the binary format.
+ *
+ * @return MPD_SUCCESS or a negative #mpd_err
+ */
+int
+simple_db_binary_save(const char *path_fs, const struct directory *root);
+
+/**
+ * Loads a binary database file into the (empty) root directory.
+ * Caller must lock the #db_mutex.
+ *
+ * @return MPD_SUCCESS or a negative #mpd_err
+ */
+int
+simple_db_binary_load(const char *path_fs, struct directory *root);
@@ -21,6 +21,7 @@
 
 #include "config.h"
 #include "simple_db_plugin.h"
+#include "simple_db_binary.h"
 #include "song.h"
 #include "db_internal.h"
 #include "db_error.h"
@@ -30,15 +31,20 @@
 #include "conf.h"
 #include "tag.h"
 #include "tag_internal.h"
+#include "tag_index.h"
+#include "trigram_index.h"
 #include "text_file.h"
 #include "directory.h"
 #include "string_util.h"
 #include "playlist_vector.h"
 #include "path.h"
+#include "c11thread.h"
 
 #include <sys/types.h>
 #include <stdio.h>
 #include <sys/stat.h>
+#include <stdatomic.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
@@ -62,12 +68,39 @@
 #define SONG_MTIME "mtime"
 #define SONG_END "song_end"
 #define PLAYLIST_META_BEGIN "playlist_begin: "
+#define DB_INDEX_BEGIN "index_begin"
+#define DB_INDEX_END "index_end"
+#define DB_INDEX_ROOT "index_root: "
+#define DB_INDEX_ENTRY "index: "
+#define DB_INDEX_SIZE "index_size: "
+
+/** length of the fixed-width last line of an indexed database */
+#define DB_INDEX_FOOTER_LENGTH (sizeof(DB_INDEX_SIZE) - 1 + 10 + 1)
 
 struct simple_db {
 	struct db base;
 
 	char *path;
 
+	/**
+	 * Save in the binary format (see simple_db_binary.h) instead
+	 * of the text format.  Both formats are accepted on load.
+	 */
+	bool binary;
+
+	/**
+	 * Number of threads loading the text database.  If this is
+	 * more than one, the saver appends an index of the top-level
+	 * directories, so their subtrees can be loaded in parallel.
+	 */
+	unsigned load_threads;
+
+	/**
+	 * Maintain a trigram index for "search", see
+	 * trigram_index.h.
+	 */
+	bool search_index;
+
 	struct directory *root;
 
 	time_t mtime;
@@ -77,6 +110,27 @@ enum {
 	DB_FORMAT = 1,
 };
 
+/**
+ * The offsets of the independently readable segments of an indexed
+ * text database.  It is appended to the database file as plain text
+ * after the (possibly compressed) data, which gzread() ignores as
+ * trailing garbage, and ends with a fixed-width line holding its size.
+ */
+struct simple_db_index {
+	/** offset of the root directory's own songs and playlists */
+	long root_offset;
+
+	unsigned num_entries;
+
+	struct simple_db_index_entry {
+		/** offset of the "directory:" line */
+		long offset;
+
+		/** the name of the top-level directory */
+		char *name;
+	} *entries;
+};
+
 #ifdef COMPRESS_DB
 typedef gzFile db_file;
 
@@ -113,6 +167,28 @@ static inline int db_error(db_file file){
 		return errno;
 	return errnum;
 }
+
+/**
+ * Starts a new segment which can be read without the preceding data,
+ * and returns its offset in the file.  With zlib, this completes the
+ * current gzip member; the next write starts a new one.
+ */
+static inline long db_segment(db_file file){
+	gzflush(file, Z_FINISH);
+	return gzoffset(file);
+}
+
+static inline db_file db_open_at(const char *path_fs, long offset){
+	int fd = open(path_fs, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	gzFile file = NULL;
+	if (lseek(fd, offset, SEEK_SET) < 0 ||
+	    (file = gzdopen(fd, "r")) == NULL)
+		close(fd);
+	return file;
+}
 #else
 typedef FILE *db_file;
 
@@ -139,6 +215,19 @@ static inline int db_close(db_file file){
 static inline int db_error(db_file file){
 	return ferror(file);
 }
+
+static inline long db_segment(db_file file){
+	return ftell(file);
+}
+
+static inline db_file db_open_at(const char *path_fs, long offset){
+	FILE *file = fopen(path_fs, "r");
+	if (file != NULL && fseek(file, offset, SEEK_SET) != 0) {
+		fclose(file);
+		file = NULL;
+	}
+	return file;
+}
 #endif
 
 static inline void
@@ -289,8 +378,11 @@ playlist_metadata_load(db_file fp, struct list_head *pv, const char *name,
 }
 
 static void
-simple_db_directory_save(db_file fp, const struct directory *directory)
+simple_db_directory_save(db_file fp, const struct directory *directory,
+			 struct simple_db_index *index)
 {
+	assert(index == NULL || directory_is_root(directory));
+
 	if (!directory_is_root(directory)) {
 		db_printf(fp, DIRECTORY_MTIME "%lu\n",
 			(unsigned long)directory->mtime);
@@ -303,15 +395,29 @@ simple_db_directory_save(db_file fp, const struct directory *directory)
 	directory_for_each_child(cur, directory) {
 		char *base = g_path_get_basename(cur->path);
 
+		if (index != NULL) {
+			index->entries = realloc(index->entries,
+						 (index->num_entries + 1) *
+						 sizeof(index->entries[0]));
+			index->entries[index->num_entries].offset =
+				db_segment(fp);
+			index->entries[index->num_entries].name =
+				g_strdup(base);
+			++index->num_entries;
+		}
+
 		db_printf(fp, DIRECTORY_DIR "%s\n", base);
 		g_free(base);
 
-		simple_db_directory_save(fp, cur);
+		simple_db_directory_save(fp, cur, NULL);
 
 		if (db_error(fp))
 			return;
 	}
 
+	if (index != NULL)
+		index->root_offset = db_segment(fp);
+
 	struct song *song;
 	directory_for_each_song(song, directory)
 		simple_db_song_save(fp, song);
@@ -339,6 +445,11 @@ simple_db_directory_load(db_file fp, struct directory *directory,
 					      line + sizeof(DIRECTORY_DIR) - 1, buffer);
 			if (IS_ERR(subdir))
 				return PTR_ERR(subdir);
+		} else if (directory_is_root(directory) &&
+			   strcmp(line, DB_INDEX_BEGIN) == 0) {
+			/* the index trailer of an uncompressed
+			   database */
+			break;
 		} else if (g_str_has_prefix(line, SONG_BEGIN)) {
 			const char *name = line + sizeof(SONG_BEGIN) - 1;
 			struct song *song;
@@ -353,7 +464,7 @@ simple_db_directory_load(db_file fp, struct directory *directory,
 			if (IS_ERR(song))
 				return PTR_ERR(song);
 
-			directory_add_song(directory, song);
+			directory_load_song(directory, song);
 		} else if (g_str_has_prefix(line, PLAYLIST_META_BEGIN)) {
 			/* duplicate the name, because
 			   playlist_metadata_load() will overwrite the
@@ -425,7 +536,8 @@ simple_db_directory_load_subdir(db_file fp, struct directory *parent, const char
 }
 
 static inline void
-simple_db_save_internal(db_file fp, const struct directory *music_root)
+simple_db_save_internal(db_file fp, const struct directory *music_root,
+			struct simple_db_index *index)
 {
 	assert(music_root != NULL);
 
@@ -440,25 +552,25 @@ simple_db_save_internal(db_file fp, const struct directory *music_root)
 
 	db_printf(fp, "%s\n", DIRECTORY_INFO_END);
 
-	simple_db_directory_save(fp, music_root);
+	simple_db_directory_save(fp, music_root, index);
 }
 
-static inline int
-simple_db_load_internal(db_file fp, struct directory *music_root)
+/**
+ * Reads and checks the "info" block at the beginning of a text
+ * database.
+ */
+static int
+simple_db_load_header(db_file fp, GString *buffer)
 {
-	GString *buffer = g_string_sized_new(1024);
 	char *line;
 	int format = 0;
 	bool found_charset = false, found_version = false;
 	bool tags[TAG_NUM_OF_ITEM_TYPES];
 
-	assert(music_root != NULL);
-
 	/* get initial info */
 	line = db_read_text_line(fp, buffer);
 	if (line == NULL || strcmp(DIRECTORY_INFO_BEGIN, line) != 0) {
 		log_err("Database corrupted");
-		g_string_free(buffer, true);
 		return -DB_CORRUPT;
 	}
 
@@ -471,7 +583,6 @@ simple_db_load_internal(db_file fp, struct directory *music_root)
 		} else if (g_str_has_prefix(line, DIRECTORY_MPD_VERSION)) {
 			if (found_version) {
 				log_err("Duplicate version line");
-				g_string_free(buffer, true);
 				return -DB_MALFORM;
 			}
 
@@ -480,7 +591,6 @@ simple_db_load_internal(db_file fp, struct directory *music_root)
 			const char *new_charset, *old_charset;
 			if (found_charset) {
 				log_err("Duplicate charset line");
-				g_string_free(buffer, true);
 				return -DB_MALFORM;
 			}
 
@@ -494,7 +604,6 @@ simple_db_load_internal(db_file fp, struct directory *music_root)
 					    "\"%s\" instead of \"%s\"; "
 					    "discarding database file",
 					    new_charset, old_charset);
-				g_string_free(buffer, true);
 				return -DB_MALFORM;
 			}
 		} else if (g_str_has_prefix(line, DB_TAG_PREFIX)) {
@@ -510,7 +619,6 @@ simple_db_load_internal(db_file fp, struct directory *music_root)
 			tags[tag] = true;
 		} else {
 			log_err("Malformed line: %s", line);
-			g_string_free(buffer, true);
 			return -DB_MALFORM;
 		}
 	}
@@ -529,16 +637,352 @@ simple_db_load_internal(db_file fp, struct directory *music_root)
 		}
 	}
 
+	return MPD_SUCCESS;
+}
+
+static inline int
+simple_db_load_internal(db_file fp, struct directory *music_root)
+{
+	GString *buffer = g_string_sized_new(1024);
+
+	assert(music_root != NULL);
+
+	int ret = simple_db_load_header(fp, buffer);
+	if (ret != MPD_SUCCESS) {
+		g_string_free(buffer, true);
+		return ret;
+	}
+
 	log_debug("reading DB");
 
 	db_lock();
-	int ret = simple_db_directory_load(fp, music_root, buffer);
+	ret = simple_db_directory_load(fp, music_root, buffer);
 	db_unlock();
 	g_string_free(buffer, true);
 
 	return ret;
 }
 
+static void
+simple_db_index_free(struct simple_db_index *index)
+{
+	for (unsigned i = 0; i < index->num_entries; ++i)
+		g_free(index->entries[i].name);
+	free(index->entries);
+}
+
+/**
+ * Appends the index trailer to a database file which was just
+ * written.
+ */
+static int
+simple_db_index_save(const char *path_fs, const struct simple_db_index *index)
+{
+	FILE *fp = fopen(path_fs, "a");
+	if (fp == NULL || fseek(fp, 0, SEEK_END) != 0) {
+		log_err("unable to write to db file \"%s\": %s",
+			    path_fs, strerror(errno));
+		if (fp != NULL)
+			fclose(fp);
+		return -DB_ACCESS;
+	}
+
+	long start = ftell(fp);
+
+	fprintf(fp, DB_INDEX_BEGIN "\n");
+	fprintf(fp, DB_INDEX_ROOT "%li\n", index->root_offset);
+	for (unsigned i = 0; i < index->num_entries; ++i)
+		fprintf(fp, DB_INDEX_ENTRY "%li %s\n",
+			index->entries[i].offset, index->entries[i].name);
+	fprintf(fp, DB_INDEX_END "\n");
+	fprintf(fp, DB_INDEX_SIZE "%010li\n", ftell(fp) - start);
+
+	if (ferror(fp) || fclose(fp) != 0) {
+		log_err("Failed to write to database file: %s",
+			    strerror(errno));
+		return -DB_ACCESS;
+	}
+
+	return MPD_SUCCESS;
+}
+
+/**
+ * Reads the index trailer of a text database.
+ *
+ * @return true if the file has a valid index
+ */
+static bool
+simple_db_index_load(const char *path_fs, struct simple_db_index *index)
+{
+	int fd = open(path_fs, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	char footer[DB_INDEX_FOOTER_LENGTH + 1];
+	if (fstat(fd, &st) < 0 ||
+	    st.st_size < (off_t)DB_INDEX_FOOTER_LENGTH ||
+	    pread(fd, footer, DB_INDEX_FOOTER_LENGTH,
+		  st.st_size - DB_INDEX_FOOTER_LENGTH) !=
+	    (ssize_t)DB_INDEX_FOOTER_LENGTH) {
+		close(fd);
+		return false;
+	}
+
+	footer[DB_INDEX_FOOTER_LENGTH] = 0;
+	if (!g_str_has_prefix(footer, DB_INDEX_SIZE)) {
+		close(fd);
+		return false;
+	}
+
+	off_t size = strtol(footer + sizeof(DB_INDEX_SIZE) - 1, NULL, 10);
+	off_t start = st.st_size - DB_INDEX_FOOTER_LENGTH - size;
+	if (size <= 0 || start < 0) {
+		close(fd);
+		return false;
+	}
+
+	char *data = malloc(size + 1);
+	bool success = pread(fd, data, size, start) == size;
+	close(fd);
+	data[size] = 0;
+
+	index->root_offset = -1;
+	index->num_entries = 0;
+	index->entries = NULL;
+
+	char *saveptr, *line = success ? strtok_r(data, "\n", &saveptr) : NULL;
+	if (line == NULL || strcmp(line, DB_INDEX_BEGIN) != 0)
+		success = false;
+
+	while (success && (line = strtok_r(NULL, "\n", &saveptr)) != NULL &&
+	       strcmp(line, DB_INDEX_END) != 0) {
+		char *endptr;
+
+		if (g_str_has_prefix(line, DB_INDEX_ROOT)) {
+			index->root_offset =
+				strtol(line + sizeof(DB_INDEX_ROOT) - 1,
+				       &endptr, 10);
+			success = *endptr == 0;
+		} else if (g_str_has_prefix(line, DB_INDEX_ENTRY)) {
+			long offset = strtol(line + sizeof(DB_INDEX_ENTRY) - 1,
+					     &endptr, 10);
+			if (*endptr != ' ' || endptr[1] == 0 ||
+			    offset < 0 || offset >= start) {
+				success = false;
+				break;
+			}
+
+			index->entries = realloc(index->entries,
+						 (index->num_entries + 1) *
+						 sizeof(index->entries[0]));
+			index->entries[index->num_entries].offset = offset;
+			index->entries[index->num_entries].name =
+				g_strdup(endptr + 1);
+			++index->num_entries;
+		} else
+			success = false;
+	}
+
+	free(data);
+
+	if (!success || line == NULL ||
+	    index->root_offset < 0 || index->root_offset >= start) {
+		simple_db_index_free(index);
+		return false;
+	}
+
+	return true;
+}
+
+struct simple_db_loader {
+	const char *path;
+	const struct simple_db_index *index;
+
+	/** the next index entry to be loaded */
+	atomic_uint next;
+
+	/** the first error which occurred in a worker */
+	atomic_int error;
+
+	/** the loaded top-level directory of each index entry */
+	struct directory **results;
+};
+
+struct simple_db_load_worker {
+	thrd_t thread;
+	struct simple_db_loader *loader;
+
+	/**
+	 * A detached root directory which receives the subtrees
+	 * loaded by this worker until they are moved to the real one.
+	 */
+	struct directory *root;
+};
+
+static int
+simple_db_load_segment(struct simple_db_loader *loader, unsigned i,
+		       struct directory *root, GString *buffer)
+{
+	const struct simple_db_index_entry *entry = &loader->index->entries[i];
+
+	db_file fp = db_open_at(loader->path, entry->offset);
+	if (fp == NULL) {
+		log_err("Failed to open database file \"%s\": %s",
+			    loader->path, strerror(errno));
+		return -DB_ERRNO;
+	}
+
+	const char *line = db_read_text_line(fp, buffer);
+	if (line == NULL || !g_str_has_prefix(line, DIRECTORY_DIR) ||
+	    strcmp(line + sizeof(DIRECTORY_DIR) - 1, entry->name) != 0) {
+		log_err("Database index does not match");
+		db_close(fp);
+		return -DB_CORRUPT;
+	}
+
+	struct directory *directory =
+		simple_db_directory_load_subdir(fp, root, entry->name, buffer);
+	db_close(fp);
+	if (IS_ERR(directory))
+		return PTR_ERR(directory);
+
+	loader->results[i] = directory;
+	return MPD_SUCCESS;
+}
+
+static int
+simple_db_load_worker_run(void *arg)
+{
+	struct simple_db_load_worker *worker = arg;
+	struct simple_db_loader *loader = worker->loader;
+	GString *buffer = g_string_sized_new(1024);
+	unsigned i;
+
+	/* the subtrees are not reachable from the database before
+	   they are moved to the real root */
+	db_lock_set_private(true);
+
+	while (atomic_load(&loader->error) == MPD_SUCCESS &&
+	       (i = atomic_fetch_add(&loader->next, 1)) <
+	       loader->index->num_entries) {
+		int ret = simple_db_load_segment(loader, i, worker->root,
+						 buffer);
+		if (ret != MPD_SUCCESS) {
+			int expected = MPD_SUCCESS;
+			atomic_compare_exchange_strong(&loader->error,
+						       &expected, ret);
+			break;
+		}
+	}
+
+	db_lock_set_private(false);
+	g_string_free(buffer, true);
+	return 0;
+}
+
+/**
+ * Loads an indexed text database: the top-level subtrees are parsed
+ * by a pool of worker threads into detached trees, while this thread
+ * loads the root directory's own entries.  Subtrees left over by
+ * worker threads which could not be started are loaded by this
+ * thread afterwards.  The subtrees are then moved to the root in
+ * file order.
+ */
+static int
+simple_db_load_parallel(struct simple_db *db,
+			const struct simple_db_index *index)
+{
+	GString *buffer = g_string_sized_new(1024);
+
+	db_file fp = db_open(db->path, "r");
+	if (fp == NULL) {
+		log_err("Failed to open database file \"%s\": %s",
+			    db->path, strerror(errno));
+		g_string_free(buffer, true);
+		return -DB_ERRNO;
+	}
+
+	int ret = simple_db_load_header(fp, buffer);
+	db_close(fp);
+	if (ret != MPD_SUCCESS) {
+		g_string_free(buffer, true);
+		return ret;
+	}
+
+	log_debug("reading DB with %u threads", db->load_threads);
+
+	struct simple_db_loader loader = {
+		.path = db->path,
+		.index = index,
+		.results = calloc(index->num_entries + 1,
+				  sizeof(loader.results[0])),
+	};
+	atomic_init(&loader.next, 0);
+	atomic_init(&loader.error, MPD_SUCCESS);
+
+	unsigned num_workers = MAX(MIN(db->load_threads,
+				       index->num_entries), 1u);
+	struct simple_db_load_worker *workers =
+		malloc(num_workers * sizeof(workers[0]));
+	for (unsigned i = 0; i < num_workers; ++i) {
+		workers[i].loader = &loader;
+		workers[i].root = directory_new_root();
+	}
+
+	unsigned num_threads = 0;
+	while (num_threads < num_workers) {
+		if (thrd_create(&workers[num_threads].thread,
+				simple_db_load_worker_run,
+				&workers[num_threads]) != thrd_success) {
+			log_warning("Failed to start database loader thread");
+			break;
+		}
+
+		++num_threads;
+	}
+
+	fp = db_open_at(db->path, index->root_offset);
+	if (fp != NULL) {
+		db_lock();
+		ret = simple_db_directory_load(fp, db->root, buffer);
+		db_unlock();
+		db_close(fp);
+	} else {
+		log_err("Failed to open database file \"%s\": %s",
+			    db->path, strerror(errno));
+		ret = -DB_ERRNO;
+	}
+
+	if (num_threads < num_workers && ret == MPD_SUCCESS)
+		/* load the subtrees left over by the threads which
+		   could not be started in this thread */
+		simple_db_load_worker_run(&workers[num_threads]);
+
+	for (unsigned i = 0; i < num_threads; ++i)
+		thrd_join(workers[i].thread, NULL);
+
+	if (ret == MPD_SUCCESS)
+		ret = atomic_load(&loader.error);
+
+	if (ret == MPD_SUCCESS) {
+		db_lock();
+		for (unsigned i = 0; i < index->num_entries; ++i)
+			directory_move_child(loader.results[i], db->root);
+		db_unlock();
+	}
+
+	/* on error, the partially loaded subtrees are still
+	   attached to the worker roots */
+	for (unsigned i = 0; i < num_workers; ++i)
+		directory_free(workers[i].root);
+
+	free(workers);
+	free(loader.results);
+	g_string_free(buffer, true);
+	return ret;
+}
+
 MPD_PURE
 static const struct directory *
 simple_db_lookup_directory(const struct simple_db *db, const char *uri)
@@ -567,6 +1011,24 @@ simple_db_init(const struct config_param *param)
 		return NULL;
 	}
 
+	const char *format = config_get_block_string(param, "format", "text");
+	if (strcmp(format, "binary") == 0)
+		db->binary = true;
+	else if (strcmp(format, "text") == 0)
+		db->binary = false;
+	else {
+		log_err("Unknown database format \"%s\"", format);
+		free(db->path);
+		free(db);
+		return NULL;
+	}
+
+	db->load_threads = config_get_block_unsigned(param, "load_threads", 1);
+	if (db->load_threads == 0)
+		db->load_threads = 1;
+
+	db->search_index = config_get_block_bool(param, "search_index", false);
+
 	return &db->base;
 }
 
@@ -654,6 +1116,34 @@ simple_db_load(struct simple_db *db)
 	assert(db->path != NULL);
 	assert(db->root != NULL);
 
+	if (simple_db_binary_probe(db->path)) {
+		db_lock();
+		int ret = simple_db_binary_load(db->path, db->root);
+		db_unlock();
+		if (ret != MPD_SUCCESS)
+			return ret;
+
+		struct stat st;
+		if (stat(db->path, &st) == 0)
+			db->mtime = st.st_mtime;
+
+		return MPD_SUCCESS;
+	}
+
+	struct simple_db_index index;
+	if (db->load_threads > 1 && simple_db_index_load(db->path, &index)) {
+		int ret = simple_db_load_parallel(db, &index);
+		simple_db_index_free(&index);
+		if (ret != MPD_SUCCESS)
+			return ret;
+
+		struct stat st;
+		if (stat(db->path, &st) == 0)
+			db->mtime = st.st_mtime;
+
+		return MPD_SUCCESS;
+	}
+
 	db_file fp = db_open(db->path, "r");
 	if (fp == NULL) {
 		log_err("Failed to open database file \"%s\": %s",
@@ -697,6 +1187,12 @@ simple_db_open(struct db *_db)
 		db->root = directory_new_root();
 	}
 
+	db_lock();
+	tag_index_build(db->root);
+	if (db->search_index)
+		trigram_index_enable(db->root);
+	db_unlock();
+
 	return MPD_SUCCESS;
 }
 
@@ -707,6 +1203,11 @@ simple_db_close(struct db *_db)
 
 	assert(db->root != NULL);
 
+	db_lock();
+	trigram_index_disable();
+	tag_index_clear(db->root);
+	db_unlock();
+
 	directory_free(db->root);
 }
 
@@ -796,6 +1297,18 @@ simple_db_save(struct db *_db)
 
 	log_debug("writing DB");
 
+	if (db->binary) {
+		int ret = simple_db_binary_save(db->path, music_root);
+		if (ret != MPD_SUCCESS)
+			return ret;
+
+		struct stat st;
+		if (stat(db->path, &st) == 0)
+			db->mtime = st.st_mtime;
+
+		return MPD_SUCCESS;
+	}
+
 	db_file fp = db_open(db->path, "w");
 	if (!fp) {
 		log_err("unable to write to db file \"%s\": %s",
@@ -803,17 +1316,31 @@ simple_db_save(struct db *_db)
 		return -DB_ACCESS;
 	}
 
-	simple_db_save_internal(fp, music_root);
+	struct simple_db_index index = {
+		.num_entries = 0,
+		.entries = NULL,
+	};
+
+	simple_db_save_internal(fp, music_root,
+				db->load_threads > 1 ? &index : NULL);
 
 	if (db_error(fp)) {
 		log_err("Failed to write to database file: %s",
 			    strerror(errno));
 		db_close(fp);
+		simple_db_index_free(&index);
 		return -DB_ACCESS;
 	}
 
 	db_close(fp);
 
+	if (db->load_threads > 1) {
+		int ret = simple_db_index_save(db->path, &index);
+		simple_db_index_free(&index);
+		if (ret != MPD_SUCCESS)
+			return ret;
+	}
+
 	struct stat st;
 	if (stat(db->path, &st) == 0)
 		db->mtime = st.st_mtime;
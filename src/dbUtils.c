@@ -88,7 +88,7 @@ find_add_song(struct song *song, void *ctx)
 	struct find_add_data *data = ctx;
 
 	if (!locate_song_match(song, data->criteria))
-		return true;
+		return MPD_SUCCESS;
 
 	int result =
 		playlist_append_song(&g_playlist, data->pc,
@@ -113,7 +113,7 @@ findAddIn(struct player_control *pc, const char *name,
 	data.pc = pc;
 	data.criteria = criteria;
 
-	return db_walk(name, &find_add_visitor, &data);
+	return db_walk_match(name, criteria, &find_add_visitor, &data);
 }
 
 static int
@@ -142,7 +142,7 @@ search_add_songs(struct player_control *pc, const char *uri,
 		.criteria = new_list,
 	};
 
-	int success = db_walk(uri, &searchadd_visitor, &data);
+	int success = db_walk_search(uri, new_list, &searchadd_visitor, &data);
 
 	locate_item_list_free(new_list);
 
@@ -180,7 +180,8 @@ search_add_to_playlist(const char *uri, const char *path_utf8,
 		.criteria = new_list,
 	};
 
-	int success = db_walk(uri, &searchaddpl_visitor, &data);
+	int success = db_walk_search(uri, new_list, &searchaddpl_visitor,
+				     &data);
 
 	locate_item_list_free(new_list);
 
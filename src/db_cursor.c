@@ -0,0 +1,555 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "db_cursor.h"
+#include "db_visitor.h"
+#include "db_lock.h"
+#include "database.h"
+#include "directory.h"
+#include "song.h"
+#include "playlist_vector.h"
+#include "tag_index.h"
+#include "trigram_index.h"
+#include "err.h"
+
+#include <glib.h>
+
+#include <assert.h>
+#include <string.h>
+
+enum db_cursor_phase {
+	DB_CURSOR_SONGS,
+	DB_CURSOR_PLAYLISTS,
+	DB_CURSOR_CHILDREN,
+};
+
+typedef bool (*db_candidates_t)(const struct locate_item_list *criteria,
+				struct song ***songs_r, unsigned *length_r);
+
+/**
+ * A directory on the path from the top directory down to the current
+ * one.
+ */
+struct db_cursor_level {
+	/** the directory, valid for db_cursor.generation */
+	struct directory *directory;
+
+	/** the name of the directory in its parent, NULL for the top */
+	char *name;
+
+	/** the names of the children which have been entered */
+	GHashTable *children;
+
+	/**
+	 * Has the database been modified while the walk was below this
+	 * directory?  Then its children list is walked again from the
+	 * beginning, skipping the children which have been entered.
+	 */
+	bool stale;
+};
+
+struct db_cursor {
+	const struct db_visitor *visitor;
+	void *ctx;
+
+	/**
+	 * The #db_generation when the pointers below were valid the
+	 * last time.
+	 */
+	unsigned generation;
+
+	/** the path of the top directory */
+	char *top_uri;
+
+	/**
+	 * The #db_cursor_level objects from the top directory down to
+	 * the current directory.
+	 */
+	GPtrArray *levels;
+
+	/**
+	 * The position of a tree walk: the current directory, which
+	 * of its lists is being visited, and the next entry in that
+	 * list.
+	 */
+	struct directory *directory;
+	enum db_cursor_phase phase;
+	struct list_head *position;
+
+	/**
+	 * The names of the songs or playlists of the current directory
+	 * visited so far (#DB_CURSOR_SONGS and #DB_CURSOR_PLAYLISTS
+	 * only).
+	 */
+	GHashTable *visited;
+
+	/**
+	 * Candidates from an index in database order, or NULL when
+	 * walking the tree.
+	 */
+	struct song **songs;
+	unsigned num_songs, next_song;
+
+	/**
+	 * The URIs of all songs visited so far when walking index
+	 * candidates, or NULL.  These are skipped by the tree walk
+	 * which takes over when the database is modified.
+	 */
+	GHashTable *visited_uris;
+
+	/** has the top directory been passed to the visitor? */
+	bool started;
+
+	bool finished;
+};
+
+static GHashTable *
+name_set_new(void)
+{
+	return g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+}
+
+/**
+ * Adds a name to the set.  Takes over the allocated string.
+ *
+ * @return false if the name was already in the set
+ */
+static bool
+name_set_add(GHashTable *set, char *name)
+{
+	if (g_hash_table_lookup(set, name) != NULL) {
+		g_free(name);
+		return false;
+	}
+
+	g_hash_table_insert(set, name, name);
+	return true;
+}
+
+static bool
+name_set_contains(GHashTable *set, const char *name)
+{
+	return g_hash_table_lookup(set, name) != NULL;
+}
+
+static struct db_cursor_level *
+db_cursor_current(const struct db_cursor *cursor)
+{
+	return g_ptr_array_index(cursor->levels, cursor->levels->len - 1);
+}
+
+static void
+db_cursor_push(struct db_cursor *cursor, struct directory *directory,
+	       const char *name)
+{
+	struct db_cursor_level *level = g_new(struct db_cursor_level, 1);
+
+	level->directory = directory;
+	level->name = g_strdup(name);
+	level->children = name_set_new();
+	level->stale = false;
+	g_ptr_array_add(cursor->levels, level);
+
+	cursor->directory = directory;
+}
+
+static void
+db_cursor_level_free(struct db_cursor_level *level)
+{
+	g_free(level->name);
+	g_hash_table_destroy(level->children);
+	g_free(level);
+}
+
+static void
+db_cursor_pop(struct db_cursor *cursor)
+{
+	db_cursor_level_free(g_ptr_array_remove_index(cursor->levels,
+						      cursor->levels->len - 1));
+
+	cursor->directory = db_cursor_current(cursor)->directory;
+}
+
+static struct list_head *
+db_cursor_list(const struct db_cursor *cursor)
+{
+	struct directory *directory = cursor->directory;
+
+	switch (cursor->phase) {
+	case DB_CURSOR_SONGS:
+		return &directory->songs;
+
+	case DB_CURSOR_PLAYLISTS:
+		return &directory->playlists;
+
+	case DB_CURSOR_CHILDREN:
+		return &directory->children;
+	}
+
+	assert(false);
+	return NULL;
+}
+
+/**
+ * Starts over with the current list after it may have been modified
+ * or reordered.  Entries which have been visited already are skipped
+ * by db_cursor_walk().
+ */
+static void
+db_cursor_rewind(struct db_cursor *cursor)
+{
+	cursor->position = db_cursor_list(cursor)->next;
+}
+
+static void
+db_cursor_set_phase(struct db_cursor *cursor, enum db_cursor_phase phase)
+{
+	cursor->phase = phase;
+	g_hash_table_remove_all(cursor->visited);
+	cursor->position = db_cursor_list(cursor)->next;
+}
+
+/**
+ * Finds the position in the modified database.  Index candidates are
+ * dropped, the rest is walked.
+ *
+ * @return false if the top directory does not exist anymore
+ */
+static bool
+db_cursor_relocate(struct db_cursor *cursor)
+{
+	g_free(cursor->songs);
+	cursor->songs = NULL;
+
+	struct db_cursor_level *level = g_ptr_array_index(cursor->levels, 0);
+	level->directory = db_get_directory(cursor->top_uri);
+	if (level->directory == NULL)
+		return false;
+
+	for (unsigned i = 1; i < cursor->levels->len; ++i) {
+		struct db_cursor_level *parent = level;
+
+		level = g_ptr_array_index(cursor->levels, i);
+		level->directory = directory_get_child(parent->directory,
+						       level->name);
+		if (level->directory == NULL) {
+			/* the directory has been deleted: continue
+			   with the next child of its parent */
+			while (cursor->levels->len > i)
+				db_cursor_pop(cursor);
+
+			cursor->phase = DB_CURSOR_CHILDREN;
+			g_hash_table_remove_all(cursor->visited);
+			break;
+		}
+	}
+
+	for (unsigned i = 0; i + 1 < cursor->levels->len; ++i) {
+		level = g_ptr_array_index(cursor->levels, i);
+		level->stale = true;
+	}
+
+	cursor->directory = db_cursor_current(cursor)->directory;
+	db_cursor_rewind(cursor);
+	return true;
+}
+
+/**
+ * Was this song visited as an index candidate before the cursor fell
+ * back to walking the tree?
+ */
+static bool
+db_cursor_song_seen(struct db_cursor *cursor, const struct song *song)
+{
+	if (cursor->visited_uris == NULL)
+		return false;
+
+	return !name_set_add(cursor->visited_uris, song_get_uri(song));
+}
+
+static int
+db_cursor_walk(struct db_cursor *cursor, unsigned max)
+{
+	const struct db_visitor *visitor = cursor->visitor;
+	int ret;
+
+	if (!cursor->started) {
+		cursor->started = true;
+
+		if (visitor->directory != NULL &&
+		    (ret = visitor->directory(cursor->directory,
+					      cursor->ctx)) != MPD_SUCCESS)
+			return ret;
+	}
+
+	while (max > 0) {
+		struct directory *directory = cursor->directory;
+
+		switch (cursor->phase) {
+		case DB_CURSOR_SONGS:
+			if (visitor->song == NULL ||
+			    cursor->position == &directory->songs) {
+				db_cursor_set_phase(cursor,
+						    DB_CURSOR_PLAYLISTS);
+				break;
+			}
+
+			struct song *song = list_entry(cursor->position,
+						       struct song, siblings);
+			cursor->position = cursor->position->next;
+			if (!name_set_add(cursor->visited, g_strdup(song->uri)) ||
+			    db_cursor_song_seen(cursor, song))
+				break;
+
+			--max;
+
+			if ((ret = visitor->song(song, cursor->ctx)) != MPD_SUCCESS)
+				return ret;
+			break;
+
+		case DB_CURSOR_PLAYLISTS:
+			if (visitor->playlist == NULL ||
+			    cursor->position == &directory->playlists) {
+				db_cursor_set_phase(cursor,
+						    DB_CURSOR_CHILDREN);
+				break;
+			}
+
+			const struct playlist_metadata *pm =
+				list_entry(cursor->position,
+					   struct playlist_metadata, siblings);
+			cursor->position = cursor->position->next;
+			if (!name_set_add(cursor->visited, g_strdup(pm->name)))
+				break;
+
+			--max;
+
+			if ((ret = visitor->playlist(pm, directory,
+						     cursor->ctx)) != MPD_SUCCESS)
+				return ret;
+			break;
+
+		case DB_CURSOR_CHILDREN:
+			if (cursor->position == &directory->children) {
+				if (cursor->levels->len == 1) {
+					cursor->finished = true;
+					return MPD_SUCCESS;
+				}
+
+				/* continue after this directory in its
+				   parent */
+				db_cursor_pop(cursor);
+
+				struct db_cursor_level *level =
+					db_cursor_current(cursor);
+				if (level->stale) {
+					level->stale = false;
+					db_cursor_rewind(cursor);
+				} else
+					cursor->position =
+						directory->siblings.next;
+				break;
+			}
+
+			struct directory *child =
+				list_entry(cursor->position,
+					   struct directory, siblings);
+			if (!name_set_add(db_cursor_current(cursor)->children,
+					  g_strdup(directory_get_name(child)))) {
+				/* entered before the list was modified */
+				cursor->position = cursor->position->next;
+				break;
+			}
+
+			--max;
+
+			if (visitor->directory != NULL &&
+			    (ret = visitor->directory(child,
+						      cursor->ctx)) != MPD_SUCCESS)
+				return ret;
+
+			db_cursor_push(cursor, child,
+				       directory_get_name(child));
+			db_cursor_set_phase(cursor, DB_CURSOR_SONGS);
+			break;
+		}
+	}
+
+	return MPD_SUCCESS;
+}
+
+static int
+db_cursor_visit_candidates(struct db_cursor *cursor, unsigned max)
+{
+	const struct db_visitor *visitor = cursor->visitor;
+
+	for (; max > 0 && cursor->next_song < cursor->num_songs; --max) {
+		struct song *song = cursor->songs[cursor->next_song++];
+
+		name_set_add(cursor->visited_uris, song_get_uri(song));
+
+		int ret = visitor->song(song, cursor->ctx);
+		if (ret != MPD_SUCCESS)
+			return ret;
+	}
+
+	if (cursor->next_song == cursor->num_songs)
+		cursor->finished = true;
+
+	return MPD_SUCCESS;
+}
+
+static struct db_cursor *
+db_cursor_alloc(struct directory *directory,
+		const struct db_visitor *visitor, void *ctx)
+{
+	struct db_cursor *cursor = g_new0(struct db_cursor, 1);
+
+	cursor->visitor = visitor;
+	cursor->ctx = ctx;
+	cursor->top_uri = g_strdup(directory_get_path(directory));
+	cursor->levels = g_ptr_array_new();
+	db_cursor_push(cursor, directory, NULL);
+	cursor->visited = name_set_new();
+	db_cursor_set_phase(cursor, DB_CURSOR_SONGS);
+	cursor->generation = atomic_load_explicit(&db_generation,
+						  memory_order_relaxed);
+
+	return cursor;
+}
+
+struct db_cursor *
+db_cursor_new(const char *uri, const struct db_visitor *visitor, void *ctx)
+{
+	db_lock();
+
+	struct directory *directory = db_get_directory(uri);
+	if (directory == NULL) {
+		db_unlock();
+		return NULL;
+	}
+
+	struct db_cursor *cursor = db_cursor_alloc(directory, visitor, ctx);
+	db_unlock();
+
+	return cursor;
+}
+
+static struct db_cursor *
+db_cursor_new_candidates(const char *uri,
+			 const struct locate_item_list *criteria,
+			 db_candidates_t candidates,
+			 const struct db_visitor *visitor, void *ctx)
+{
+	assert(visitor->directory == NULL);
+	assert(visitor->playlist == NULL);
+
+	if (*uri == 0) {
+		struct song **songs;
+		unsigned length;
+
+		db_lock();
+		struct directory *root = db_get_directory(uri);
+		if (root != NULL && candidates(criteria, &songs, &length)) {
+			struct db_cursor *cursor =
+				db_cursor_alloc(root, visitor, ctx);
+			cursor->songs = songs;
+			cursor->num_songs = length;
+			cursor->visited_uris = name_set_new();
+			cursor->started = true;
+			db_unlock();
+
+			return cursor;
+		}
+		db_unlock();
+	}
+
+	return db_cursor_new(uri, visitor, ctx);
+}
+
+struct db_cursor *
+db_cursor_new_match(const char *uri, const struct locate_item_list *criteria,
+		    const struct db_visitor *visitor, void *ctx)
+{
+	return db_cursor_new_candidates(uri, criteria, tag_index_candidates,
+					visitor, ctx);
+}
+
+struct db_cursor *
+db_cursor_new_search(const char *uri, const struct locate_item_list *criteria,
+		     const struct db_visitor *visitor, void *ctx)
+{
+	return db_cursor_new_candidates(uri, criteria,
+					trigram_index_candidates,
+					visitor, ctx);
+}
+
+void
+db_cursor_free(struct db_cursor *cursor)
+{
+	for (unsigned i = 0; i < cursor->levels->len; ++i)
+		db_cursor_level_free(g_ptr_array_index(cursor->levels, i));
+
+	g_ptr_array_free(cursor->levels, true);
+	g_hash_table_destroy(cursor->visited);
+	if (cursor->visited_uris != NULL)
+		g_hash_table_destroy(cursor->visited_uris);
+	g_free(cursor->songs);
+	g_free(cursor->top_uri);
+	g_free(cursor);
+}
+
+int
+db_cursor_step(struct db_cursor *cursor, unsigned max)
+{
+	int ret;
+
+	if (cursor->finished)
+		return MPD_SUCCESS;
+
+	db_lock();
+
+	unsigned generation = atomic_load_explicit(&db_generation,
+						   memory_order_relaxed);
+	if (generation != cursor->generation &&
+	    !db_cursor_relocate(cursor)) {
+		/* the top directory has been deleted */
+		cursor->finished = true;
+		db_unlock();
+		return -DB_NOENT;
+	}
+
+	ret = cursor->songs != NULL
+		? db_cursor_visit_candidates(cursor, max)
+		: db_cursor_walk(cursor, max);
+	if (ret != MPD_SUCCESS)
+		cursor->finished = true;
+
+	cursor->generation = generation;
+
+	db_unlock();
+
+	return ret;
+}
+
+bool
+db_cursor_finished(const struct db_cursor *cursor)
+{
+	return cursor->finished;
+}
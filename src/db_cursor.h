@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * A resumable walk over the database.  db_walk() holds the #db_mutex
+ * until it has visited everything; a cursor visits a limited number of
+ * entries per call instead, so a huge result can be produced in slices
+ * while other clients are served and the update thread makes progress.
+ *
+ * The database is not locked between two slices.  If it has been
+ * modified meanwhile, the cursor finds its position again by the names
+ * of the entries it has visited: every entry which exists during the
+ * whole walk is visited exactly once, entries which are added or
+ * removed meanwhile may or may not be.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+struct db_cursor;
+struct db_visitor;
+struct locate_item_list;
+
+/**
+ * Creates a cursor for a recursive walk of the directory @uri, which
+ * visits the same entries in the same order as db_walk().
+ *
+ * Caller must not lock the #db_mutex.
+ *
+ * @return the cursor, or NULL if @uri is not a directory in the
+ * database (use db_walk() to report the error then)
+ */
+struct db_cursor *
+db_cursor_new(const char *uri, const struct db_visitor *visitor, void *ctx);
+
+/**
+ * Like db_cursor_new(), but visits a superset of the songs matching
+ * @criteria like db_walk_match().  @criteria must remain valid until
+ * the cursor is freed.
+ */
+struct db_cursor *
+db_cursor_new_match(const char *uri, const struct locate_item_list *criteria,
+		    const struct db_visitor *visitor, void *ctx);
+
+/**
+ * Like db_cursor_new(), but visits a superset of the songs matching
+ * the casefolded search @criteria like db_walk_search().
+ */
+struct db_cursor *
+db_cursor_new_search(const char *uri, const struct locate_item_list *criteria,
+		     const struct db_visitor *visitor, void *ctx);
+
+void
+db_cursor_free(struct db_cursor *cursor);
+
+/**
+ * Visits up to @max more entries.  An error finishes the cursor.
+ *
+ * Caller must not lock the #db_mutex.
+ *
+ * @return MPD_SUCCESS, -DB_NOENT if the top directory has been
+ * deleted, or the error returned by the visitor
+ */
+int
+db_cursor_step(struct db_cursor *cursor, unsigned max);
+
+/**
+ * Has the cursor visited all entries?
+ */
+bool
+db_cursor_finished(const struct db_cursor *cursor);
@@ -22,6 +22,9 @@
 
 GStaticMutex db_mutex = G_STATIC_MUTEX_INIT;
 
+atomic_uint db_generation;
+
 #ifndef NDEBUG
 GThread *db_mutex_holder;
+_Thread_local bool db_private_tree;
 #endif
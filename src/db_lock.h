@@ -30,13 +30,28 @@
 #include <glib.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
 extern GStaticMutex db_mutex;
 
+/**
+ * Incremented whenever a directory, song or playlist is added to or
+ * removed from a directory tree.  Code which keeps pointers into the
+ * database across db_unlock() compares it to find out whether they
+ * may have become stale.
+ */
+extern atomic_uint db_generation;
+
 #ifndef NDEBUG
 
 extern GThread *db_mutex_holder;
 
+/**
+ * Set in threads which only build a detached directory tree, see
+ * db_lock_set_private().
+ */
+extern _Thread_local bool db_private_tree;
+
 /**
  * Does the current thread hold the database lock?
  */
@@ -44,11 +59,27 @@ MPD_PURE
 static inline bool
 holding_db_lock(void)
 {
-	return db_mutex_holder == g_thread_self();
+	return db_private_tree || db_mutex_holder == g_thread_self();
 }
 
 #endif
 
+/**
+ * Declares that the calling thread only creates and modifies a
+ * detached directory tree (one which is not reachable from the
+ * database yet), which does not need the database lock.  This only
+ * affects the debug assertions.
+ */
+static inline void
+db_lock_set_private(bool private_tree)
+{
+#ifndef NDEBUG
+	db_private_tree = private_tree;
+#else
+	(void)private_tree;
+#endif
+}
+
 /**
  * Obtain the global database lock.  This is needed before
  * dereferencing a #song or #directory.  It is not recursive.
@@ -79,3 +110,13 @@ db_unlock(void)
 
 	g_static_mutex_unlock(&db_mutex);
 }
+
+/**
+ * Called after a directory, song or playlist has been added to or
+ * removed from a directory tree, see #db_generation.
+ */
+static inline void
+db_modified(void)
+{
+	atomic_fetch_add_explicit(&db_generation, 1, memory_order_relaxed);
+}
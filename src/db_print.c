@@ -25,15 +25,22 @@
 #include "directory.h"
 #include "database.h"
 #include "client.h"
+#include "client_stream.h"
+#include "db_cursor.h"
 #include "song.h"
 #include "song_print.h"
 #include "playlist_vector.h"
 #include "tag.h"
+#include "tag_index.h"
+#include "db_lock.h"
 #include "strset.h"
 #include "macros.h"
+#include "err.h"
 
 #include <glib.h>
 
+#include <assert.h>
+
 typedef struct _ListCommandItem {
 	int8_t tagType;
 	const struct locate_item_list *criteria;
@@ -163,6 +170,102 @@ struct search_data {
 	const struct locate_item_list *criteria;
 };
 
+enum {
+	/** the number of entries per part of a streamed listing */
+	PRINT_STREAM_SLICE = 256,
+};
+
+/**
+ * A listing which is streamed to the client, see
+ * client_stream_start().
+ */
+struct print_stream {
+	struct db_cursor *cursor;
+
+	/** the visitor context for "find" and "search" */
+	struct search_data data;
+
+	/** the stream's own copy of the criteria, or NULL */
+	struct locate_item_list *criteria;
+};
+
+static int
+print_stream_fill(struct client *client, void *ctx)
+{
+	struct print_stream *stream = ctx;
+
+	(void)client;
+
+	/* the printing visitors do not fail, but the top directory
+	   may be deleted meanwhile */
+	int ret = db_cursor_step(stream->cursor, PRINT_STREAM_SLICE);
+	if (ret != MPD_SUCCESS)
+		return ret;
+
+	return db_cursor_finished(stream->cursor) ? MPD_SUCCESS : 1;
+}
+
+static void
+print_stream_free(void *ctx)
+{
+	struct print_stream *stream = ctx;
+
+	db_cursor_free(stream->cursor);
+	if (stream->criteria != NULL)
+		locate_item_list_free(stream->criteria);
+	g_free(stream);
+}
+
+static const struct client_stream_handler print_stream_handler = {
+	.fill = print_stream_fill,
+	.free = print_stream_free,
+};
+
+static struct print_stream *
+print_stream_new(struct client *client, struct locate_item_list *criteria)
+{
+	struct print_stream *stream = g_new(struct print_stream, 1);
+
+	stream->cursor = NULL;
+	stream->data.client = client;
+	stream->data.criteria = criteria;
+	stream->criteria = criteria;
+	return stream;
+}
+
+/**
+ * Starts streaming the listing if stream->cursor could be created.
+ * Otherwise, frees the stream, and the caller falls back to a
+ * synchronous walk.
+ */
+static bool
+print_stream_start(struct client *client, struct print_stream *stream)
+{
+	if (stream->cursor == NULL) {
+		print_stream_free(stream);
+		return false;
+	}
+
+	client_stream_start(client, &print_stream_handler, stream);
+	return true;
+}
+
+/**
+ * Streams a recursive listing of @uri to the client.  Returns false
+ * if the listing has to be printed synchronously instead.
+ */
+static bool
+print_stream_walk(struct client *client, const char *uri,
+		  const struct db_visitor *visitor)
+{
+	if (!client_stream_allowed(client))
+		return false;
+
+	struct print_stream *stream = print_stream_new(client, NULL);
+	stream->cursor = db_cursor_new(uri, visitor, client);
+	return print_stream_start(client, stream);
+}
+
 static int
 search_visitor_song(struct song *song, void *_data)
 {
@@ -182,6 +285,17 @@ int
 searchForSongsIn(struct client *client, const char *name,
 		 const struct locate_item_list *criteria)
 {
+	if (client_stream_allowed(client)) {
+		struct print_stream *stream =
+			print_stream_new(client,
+					 locate_item_list_casefold(criteria));
+		stream->cursor = db_cursor_new_search(name, stream->criteria,
+						      &search_visitor,
+						      &stream->data);
+		if (print_stream_start(client, stream))
+			return MPD_SUCCESS;
+	}
+
 	struct locate_item_list *new_list
 		= locate_item_list_casefold(criteria);
 	struct search_data data;
@@ -189,7 +303,7 @@ searchForSongsIn(struct client *client, const char *name,
 	data.client = client;
 	data.criteria = new_list;
 
-	int ret = db_walk(name, &search_visitor, &data);
+	int ret = db_walk_search(name, new_list, &search_visitor, &data);
 
 	locate_item_list_free(new_list);
 
@@ -215,12 +329,23 @@ int
 findSongsIn(struct client *client, const char *name,
 	    const struct locate_item_list *criteria)
 {
+	if (client_stream_allowed(client)) {
+		struct print_stream *stream =
+			print_stream_new(client,
+					 locate_item_list_dup(criteria));
+		stream->cursor = db_cursor_new_match(name, stream->criteria,
+						     &find_visitor,
+						     &stream->data);
+		if (print_stream_start(client, stream))
+			return MPD_SUCCESS;
+	}
+
 	struct search_data data;
 
 	data.client = client;
 	data.criteria = criteria;
 
-	return db_walk(name, &find_visitor, &data);
+	return db_walk_match(name, criteria, &find_visitor, &data);
 }
 
 static void printSearchStats(struct client *client, SearchStats *stats)
@@ -256,7 +381,7 @@ searchStatsForSongsIn(struct client *client, const char *name,
 	stats.numberOfSongs = 0;
 	stats.playTime = 0;
 
-	int ret = db_walk(name, &stats_visitor, &stats);
+	int ret = db_walk_match(name, criteria, &stats_visitor, &stats);
 	if (ret != MPD_SUCCESS)
 		return ret;
 
@@ -267,6 +392,9 @@ searchStatsForSongsIn(struct client *client, const char *name,
 int
 printAllIn(struct client *client, const char *uri_utf8)
 {
+	if (print_stream_walk(client, uri_utf8, &print_visitor))
+		return MPD_SUCCESS;
+
 	struct db_selection selection;
 	db_selection_init(&selection, uri_utf8, true);
 	return db_selection_print(client, &selection, false);
@@ -275,6 +403,9 @@ printAllIn(struct client *client, const char *uri_utf8)
 int
 printInfoForAllIn(struct client *client, const char *uri_utf8)
 {
+	if (print_stream_walk(client, uri_utf8, &print_info_visitor))
+		return MPD_SUCCESS;
+
 	struct db_selection selection;
 	db_selection_init(&selection, uri_utf8, true);
 	return db_selection_print(client, &selection, true);
@@ -344,6 +475,35 @@ static const struct db_visitor unique_tags_visitor = {
 	.song = unique_tags_visitor_song,
 };
 
+static void
+list_tags_add_value(const char *value, void *ctx)
+{
+	struct strset *set = ctx;
+	strset_add(set, value);
+}
+
+/**
+ * Collects all values of @type from the tag index, without scanning
+ * the songs.  Returns false if the index is not available.
+ */
+static bool
+list_tags_from_index(enum tag_type type, struct strset *set)
+{
+	db_lock();
+	if (!tag_index_active()) {
+		db_unlock();
+		return false;
+	}
+
+	tag_index_for_each_value(type, list_tags_add_value, set);
+	if (tag_index_count_missing(type) > 0)
+		/* like visitTag() */
+		strset_add(set, "");
+	db_unlock();
+
+	return true;
+}
+
 int
 listAllUniqueTags(struct client *client, int type,
 		  const struct locate_item_list *criteria)
@@ -358,7 +518,13 @@ listAllUniqueTags(struct client *client, int type,
 		data.set = strset_new();
 	}
 
-	int ret = db_walk("", &unique_tags_visitor, &data);
+	int ret;
+	if (type >= 0 && type < TAG_NUM_OF_ITEM_TYPES &&
+	    criteria->length == 0 && list_tags_from_index(type, data.set))
+		ret = MPD_SUCCESS;
+	else
+		ret = db_walk_match("", criteria,
+				    &unique_tags_visitor, &data);
 	if (ret != MPD_SUCCESS) {
 		freeListCommandItem(item);
 		return ret;
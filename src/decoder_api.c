@@ -358,8 +358,6 @@ decoder_data(struct decoder *decoder,
 	     const void *_data, size_t length,
 	     uint16_t kbit_rate)
 {
-
-	log_info("decoder_data %lu", thrd_current());
 	struct decoder_control *dc = decoder->dc;
 	const char *data = _data;
 	enum decoder_command cmd;
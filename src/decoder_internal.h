@@ -72,6 +72,12 @@ struct decoder {
 	/** the chunk currently being written to */
 	struct audio_chunk *chunk;
 
+	/**
+	 * The stream opened in advance by input_prefetch, until
+	 * decoder_input_stream_open() uses it.
+	 */
+	struct input_stream *prefetched;
+
 	struct replay_gain_info replay_gain_info;
 
 	/**
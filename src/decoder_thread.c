@@ -29,6 +29,7 @@
 #include "decoder_api.h"
 #include "replay_gain_ape.h"
 #include "input_stream.h"
+#include "input_prefetch.h"
 #include "pipe.h"
 #include "song.h"
 #include "tag.h"
@@ -59,10 +60,10 @@ decoder_command_finished_locked(struct decoder_control *dc)
 }
 
 /**
- * Opens the input stream with input_stream_open(), and waits until
- * the stream gets ready.  If a decoder STOP command is received
- * during that, it cancels the operation (but does not close the
- * stream).
+ * Opens the input stream with input_stream_open() (or takes the
+ * prefetched one), and waits until the stream gets ready.  If a
+ * decoder STOP command is received during that, it cancels the
+ * operation (but does not close the stream).
  *
  * Unlock the decoder before calling this function.
  *
@@ -70,9 +71,17 @@ decoder_command_finished_locked(struct decoder_control *dc)
  * #DECODE_COMMAND_STOP is received, NULL on error
  */
 static void
-decoder_input_stream_open(struct decoder_control *dc, const char *uri)
+decoder_input_stream_open(struct decoder *decoder, const char *uri)
 {
-	dc->is = input_stream_open(uri);
+	struct decoder_control *dc = decoder->dc;
+
+	if (decoder->prefetched != NULL) {
+		dc->is = decoder->prefetched;
+		decoder->prefetched = NULL;
+		input_prefetch_account(true);
+	} else
+		dc->is = input_stream_open(uri);
+
 	if (IS_ERR(dc->is)) {
 		log_warning("Can't open stream");
 
@@ -276,7 +285,7 @@ decoder_run_stream(struct decoder *decoder, const char *uri)
 	struct decoder_control *dc = decoder->dc;
 	bool success;
 
-	decoder_input_stream_open(dc, uri);
+	decoder_input_stream_open(decoder, uri);
 	if (IS_ERR_OR_NULL(dc->is)) {
 		decoder_lock_is(dc);
 		return false;
@@ -344,7 +353,7 @@ decoder_run_file(struct decoder *decoder, const char *path_fs)
 		} else if (plugin->stream_decode != NULL) {
 			bool success;
 
-			decoder_input_stream_open(dc, path_fs);
+			decoder_input_stream_open(decoder, path_fs);
 			if (IS_ERR_OR_NULL(dc->is))
 				continue;
 
@@ -387,6 +396,7 @@ decoder_run_song(struct decoder_control *dc,
 	decoder.stream_tag = NULL;
 	decoder.decoder_tag = NULL;
 	decoder.chunk = NULL;
+	decoder.prefetched = NULL;
 
 	mtx_lock(&dc->mutex);
 	dc->state = DECODE_STATE_START;
@@ -396,6 +406,8 @@ decoder_run_song(struct decoder_control *dc,
 
 	pcm_convert_init(&decoder.conv_state);
 
+	decoder.prefetched = input_prefetch_take(uri);
+
 	ret = song_is_file(song)
 		? decoder_run_file(&decoder, uri)
 		: decoder_run_stream(&decoder, uri);
@@ -404,6 +416,12 @@ decoder_run_song(struct decoder_control *dc,
 
 	pcm_convert_deinit(&decoder.conv_state);
 
+	if (decoder.prefetched != NULL) {
+		/* the decoder plugin has opened the file itself */
+		input_stream_close(decoder.prefetched);
+		input_prefetch_account(false);
+	}
+
 	/* flush the last chunk */
 
 	if (decoder.chunk != NULL)
@@ -22,6 +22,8 @@
 #include "directory.h"
 #include "song.h"
 #include "song_sort.h"
+#include "tag_index.h"
+#include "trigram_index.h"
 #include "playlist_vector.h"
 #include "path.h"
 #include "util/list_sort.h"
@@ -35,6 +37,12 @@
 #include <string.h>
 #include <stdlib.h>
 
+/**
+ * Lists with up to this many entries are scanned instead of being
+ * indexed.
+ */
+#define DIRECTORY_INDEX_MIN 16
+
 struct directory *
 directory_new(const char *path, struct directory *parent)
 {
@@ -61,6 +69,8 @@ void
 directory_free(struct directory *directory)
 {
 	playlist_vector_deinit(&directory->playlists);
+	name_index_deinit(&directory->song_index);
+	name_index_deinit(&directory->child_index);
 
 	struct song *song, *ns;
 	directory_for_each_song_safe(song, ns, directory)
@@ -71,10 +81,58 @@ directory_free(struct directory *directory)
 		directory_free(child);
 
 	free(directory);
+	db_modified();
 	/* this resets last dir returned */
 	/*directory_get_path(NULL); */
 }
 
+/**
+ * Adds a sub directory which has just been appended to the
+ * "children" list to the index.
+ */
+static void
+directory_index_child(struct directory *directory, struct directory *child)
+{
+	++directory->num_children;
+
+	if (name_index_is_enabled(&directory->child_index))
+		name_index_insert(&directory->child_index,
+				  directory_get_name(child), child);
+	else if (directory->num_children > DIRECTORY_INDEX_MIN) {
+		struct directory *i;
+		directory_for_each_child(i, directory)
+			name_index_insert(&directory->child_index,
+					  directory_get_name(i), i);
+	}
+}
+
+/**
+ * Removes a sub directory from the "children" list and from the
+ * index.
+ */
+static void
+directory_unlink_child(struct directory *directory, struct directory *child)
+{
+	list_del(&child->siblings);
+	name_index_remove(&directory->child_index,
+			  directory_get_name(child), child);
+	--directory->num_children;
+}
+
+static void
+directory_index_song(struct directory *directory, struct song *song)
+{
+	++directory->num_songs;
+
+	if (name_index_is_enabled(&directory->song_index))
+		name_index_insert(&directory->song_index, song->uri, song);
+	else if (directory->num_songs > DIRECTORY_INDEX_MIN) {
+		struct song *i;
+		directory_for_each_song(i, directory)
+			name_index_insert(&directory->song_index, i->uri, i);
+	}
+}
+
 void
 directory_delete(struct directory *directory)
 {
@@ -82,7 +140,9 @@ directory_delete(struct directory *directory)
 	assert(directory != NULL);
 	assert(directory->parent != NULL);
 
-	list_del(&directory->siblings);
+	directory_unlink_child(directory->parent, directory);
+	tag_index_remove_directory(directory);
+	trigram_index_invalidate();
 	directory_free(directory);
 }
 
@@ -122,22 +182,55 @@ directory_new_child(struct directory *parent, const char *name_utf8)
 	free(allocated);
 
 	list_add_tail(&directory->siblings, &parent->children);
+	directory_index_child(parent, directory);
+	db_modified();
 	return directory;
 }
 
-struct directory *
-directory_get_child(const struct directory *directory, const char *name)
+void
+directory_move_child(struct directory *directory, struct directory *parent)
 {
 	assert(holding_db_lock());
+	assert(directory->parent != NULL);
+
+	directory_unlink_child(directory->parent, directory);
+
+	list_add_tail(&directory->siblings, &parent->children);
+	directory->parent = parent;
+	directory_index_child(parent, directory);
+}
+
+/**
+ * Like directory_get_child(), but the name does not need to be null
+ * terminated.
+ */
+static struct directory *
+directory_get_child_n(const struct directory *directory,
+		      const char *name, size_t length)
+{
+	if (name_index_is_enabled(&directory->child_index))
+		return name_index_lookup(&directory->child_index,
+					 name, length);
 
 	struct directory *child;
-	directory_for_each_child(child, directory)
-		if (strcmp(directory_get_name(child), name) == 0)
+	directory_for_each_child(child, directory) {
+		const char *child_name = directory_get_name(child);
+		if (strncmp(child_name, name, length) == 0 &&
+		    child_name[length] == 0)
 			return child;
+	}
 
 	return NULL;
 }
 
+struct directory *
+directory_get_child(const struct directory *directory, const char *name)
+{
+	assert(holding_db_lock());
+
+	return directory_get_child_n(directory, name, strlen(name));
+}
+
 void
 directory_prune_empty(struct directory *directory)
 {
@@ -152,37 +245,42 @@ directory_prune_empty(struct directory *directory)
 	}
 }
 
-struct directory *
-directory_lookup_directory(struct directory *directory, const char *uri)
+/**
+ * Like directory_lookup_directory(), but looks only at the first
+ * @length bytes of the URI.
+ */
+static struct directory *
+directory_lookup_directory_n(struct directory *directory,
+			     const char *uri, size_t length)
 {
-	assert(holding_db_lock());
-	assert(uri != NULL);
-
-	if (isRootDirectory(uri))
+	if (length == 0 || (length == 1 && uri[0] == '/'))
+		/* the root directory, see isRootDirectory() */
 		return directory;
 
-	char *duplicated = strdup(uri), *name = duplicated;
+	const char *end = uri + length;
 
 	while (1) {
-		char *slash = strchr(name, '/');
-		if (slash == name) {
-			directory = NULL;
-			break;
-		}
-
-		if (slash != NULL)
-			*slash = '\0';
+		const char *slash = memchr(uri, '/', end - uri);
+		if (slash == uri)
+			return NULL;
 
-		directory = directory_get_child(directory, name);
+		const char *name_end = slash != NULL ? slash : end;
+		directory = directory_get_child_n(directory, uri,
+						  name_end - uri);
 		if (directory == NULL || slash == NULL)
-			break;
+			return directory;
 
-		name = slash + 1;
+		uri = slash + 1;
 	}
+}
 
-	free(duplicated);
+struct directory *
+directory_lookup_directory(struct directory *directory, const char *uri)
+{
+	assert(holding_db_lock());
+	assert(uri != NULL);
 
-	return directory;
+	return directory_lookup_directory_n(directory, uri, strlen(uri));
 }
 
 void
@@ -194,6 +292,22 @@ directory_add_song(struct directory *directory, struct song *song)
 	assert(song->parent == directory);
 
 	list_add_tail(&song->siblings, &directory->songs);
+	directory_index_song(directory, song);
+	tag_index_add_song(song);
+	trigram_index_invalidate();
+	db_modified();
+}
+
+void
+directory_load_song(struct directory *directory, struct song *song)
+{
+	assert(holding_db_lock());
+	assert(directory != NULL);
+	assert(song != NULL);
+	assert(song->parent == directory);
+
+	list_add_tail(&song->siblings, &directory->songs);
+	directory_index_song(directory, song);
 }
 
 void
@@ -206,6 +320,31 @@ directory_remove_song(struct directory *directory,
 	assert(song->parent == directory);
 
 	list_del(&song->siblings);
+	name_index_remove(&directory->song_index, song->uri, song);
+	--directory->num_songs;
+	tag_index_remove_song(song);
+	trigram_index_invalidate();
+	db_modified();
+}
+
+struct tag *
+directory_replace_song_tag(struct directory *directory, struct song *song,
+			   struct tag *tag, time_t mtime)
+{
+	assert(holding_db_lock());
+	assert(song->parent == directory);
+	(void)directory;
+
+	tag_index_remove_song(song);
+
+	struct tag *old = song->tag;
+	song->tag = tag;
+	song->mtime = mtime;
+
+	tag_index_add_song(song);
+	trigram_index_invalidate();
+
+	return old;
 }
 
 struct song *
@@ -215,6 +354,10 @@ directory_get_song(const struct directory *directory, const char *name_utf8)
 	assert(directory != NULL);
 	assert(name_utf8 != NULL);
 
+	if (name_index_is_enabled(&directory->song_index))
+		return name_index_lookup(&directory->song_index, name_utf8,
+					 strlen(name_utf8));
+
 	struct song *song;
 	directory_for_each_song(song, directory) {
 		assert(song->parent == directory);
@@ -229,31 +372,26 @@ directory_get_song(const struct directory *directory, const char *name_utf8)
 struct song *
 directory_lookup_song(struct directory *directory, const char *uri)
 {
-	char *duplicated, *base;
-
 	assert(holding_db_lock());
 	assert(directory != NULL);
 	assert(uri != NULL);
 
-	duplicated = strdup(uri);
-	base = strrchr(duplicated, '/');
+	const char *base = strrchr(uri, '/');
 
 	if (base != NULL) {
-		*base++ = 0;
-		directory = directory_lookup_directory(directory, duplicated);
-		if (directory == NULL) {
-			free(duplicated);
+		directory = directory_lookup_directory_n(directory, uri,
+							 base - uri);
+		if (directory == NULL)
 			return NULL;
-		}
+
+		++base;
 	} else
-		base = duplicated;
+		base = uri;
 
 	struct song *song = directory_get_song(directory, base);
 	assert(song == NULL || song->parent == directory);
 
-	free(duplicated);
 	return song;
-
 }
 
 static int
@@ -273,6 +411,10 @@ directory_sort(struct directory *directory)
 	list_sort(NULL, &directory->children, directory_cmp);
 	song_list_sort(&directory->songs);
 
+	/* a db_cursor must not continue from a list position in a
+	   reordered list */
+	db_modified();
+
 	struct directory *child;
 	directory_for_each_child(child, directory)
 		directory_sort(child);
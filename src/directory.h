@@ -21,6 +21,7 @@
 #pragma once
 
 #include "util/list.h"
+#include "name_index.h"
 #include "compiler.h"
 
 #include <glib.h>
@@ -49,6 +50,7 @@
 	list_for_each_entry_safe(pos, n, &directory->playlists, siblings)
 
 struct song;
+struct tag;
 struct db_visitor;
 
 struct directory {
@@ -78,6 +80,22 @@ struct directory {
 	 */
 	struct list_head songs;
 
+	/**
+	 * Hash indexes of #children (by directory_get_name()) and
+	 * #songs (by song.uri).  They are only built when the list
+	 * grows beyond a few entries; shorter lists are scanned.
+	 *
+	 * These attributes are protected with the global #db_mutex.
+	 */
+	struct name_index child_index, song_index;
+
+	/**
+	 * The number of entries in #children and #songs.
+	 *
+	 * These attributes are protected with the global #db_mutex.
+	 */
+	unsigned num_children, num_songs;
+
 	struct list_head playlists;
 
 	struct directory *parent;
@@ -191,6 +209,16 @@ directory_make_child(struct directory *directory, const char *name_utf8)
 	return child;
 }
 
+/**
+ * Moves a sub directory (with all its contents) to another parent.
+ * Its path is not changed, therefore both parents must be at the same
+ * level, e.g. two root directories.
+ *
+ * Caller must lock the #db_mutex.
+ */
+void
+directory_move_child(struct directory *directory, struct directory *parent);
+
 /**
  * Caller must lock the #db_mutex.
  */
@@ -214,6 +242,16 @@ directory_lookup_directory(struct directory *directory, const char *uri);
 void
 directory_add_song(struct directory *directory, struct song *song);
 
+/**
+ * Like directory_add_song(), but only links the song into the
+ * directory, without updating the tag index, the trigram index and
+ * #db_generation.  This is for loading a tree from the database file,
+ * possibly in a loader thread; the indexes are built from the whole
+ * tree afterwards.
+ */
+void
+directory_load_song(struct directory *directory, struct song *song);
+
 /**
  * Remove a song object from this directory (which effectively
  * invalidates the song object, because the "parent" attribute becomes
@@ -222,6 +260,16 @@ directory_add_song(struct directory *directory, struct song *song);
 void
 directory_remove_song(struct directory *directory, struct song *song);
 
+/**
+ * Replaces the tag and the modification time of a song in this
+ * directory, and returns the old tag, which the caller must free.
+ *
+ * Caller must lock the #db_mutex.
+ */
+struct tag *
+directory_replace_song_tag(struct directory *directory, struct song *song,
+			   struct tag *tag, time_t mtime);
+
 /**
  * Look up a song in this directory by its name.
  *
@@ -244,7 +292,8 @@ struct song *
 directory_lookup_song(struct directory *directory, const char *uri);
 
 /**
- * Sort all directory entries recursively.
+ * Sort all directory entries recursively.  This counts as a
+ * modification, see db_modified().
  *
  * Caller must lock the #db_mutex.
  */
@@ -47,6 +47,9 @@ enum pipe_event {
 	/** shutdown requested */
 	PIPE_EVENT_SHUTDOWN,
 
+	/** a worker thread has finished a client command */
+	PIPE_EVENT_CLIENT_JOB,
+
 	PIPE_EVENT_MAX
 };
 
@@ -26,19 +26,108 @@
 #include "input_plugin.h"
 #include "fd_util.h"
 #include "open.h"
+#include "conf.h"
 
 #include <sys/stat.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
 #include <glib.h>
 
+enum {
+	/** the default value for the "readahead" setting, in KiB */
+	DEFAULT_READAHEAD = 4096,
+};
+
+/**
+ * How far ahead of the decoder the kernel is asked to prefetch, in
+ * bytes.  0 disables prefetching.
+ */
+static off_t readahead_size;
+
+/**
+ * Map files into memory instead of reading them with read()?
+ */
+static bool file_mmap;
+
 struct file_input_stream {
 	struct input_stream base;
 
 	int fd;
+
+	/**
+	 * The whole file mapped into memory, or NULL if the file is
+	 * read with read().
+	 */
+	char *map;
+
+	/**
+	 * The end of the range which has been passed to the kernel
+	 * for prefetching.
+	 */
+	off_t prefetched;
 };
 
+static int
+input_file_init(const struct config_param *param)
+{
+	readahead_size = (off_t)config_get_block_unsigned(param, "readahead",
+							  DEFAULT_READAHEAD)
+		* 1024;
+	file_mmap = config_get_block_bool(param, "mmap", false);
+
+#ifdef WIN32
+	if (file_mmap) {
+		log_warning("mmap is not supported on this platform");
+		file_mmap = false;
+	}
+#endif
+
+	return MPD_SUCCESS;
+}
+
+/**
+ * Asks the kernel to load the next #readahead_size bytes in the
+ * background, so the decoder does not block on slow storage.  The
+ * hint is renewed when half of the window has been consumed.
+ */
+static void
+input_file_prefetch(struct file_input_stream *fis)
+{
+	const off_t offset = fis->base.offset;
+
+	if (readahead_size == 0 ||
+	    fis->prefetched - offset > readahead_size / 2)
+		return;
+
+	off_t start = fis->prefetched > offset ? fis->prefetched : offset;
+	off_t end = offset + readahead_size;
+	if (end > fis->base.size)
+		end = fis->base.size;
+	if (start >= end)
+		return;
+
+	fis->prefetched = end;
+
+#ifndef WIN32
+	if (fis->map != NULL) {
+		/* madvise() wants a page aligned address */
+		const off_t page = sysconf(_SC_PAGESIZE);
+		start -= start % page;
+		madvise(fis->map + start, end - start,
+			MADV_WILLNEED);
+		return;
+	}
+#endif
+
+#ifdef POSIX_FADV_WILLNEED
+	posix_fadvise(fis->fd, start, end - start, POSIX_FADV_WILLNEED);
+#endif
+}
+
 static struct input_stream *
 input_file_open(const char *filename)
 {
@@ -83,6 +172,23 @@ input_file_open(const char *filename)
 	fis->base.ready = true;
 
 	fis->fd = fd;
+	fis->map = NULL;
+	fis->prefetched = 0;
+
+#ifndef WIN32
+	if (file_mmap && st.st_size > 0) {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED,
+				 fd, 0);
+		if (map != MAP_FAILED) {
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+			fis->map = map;
+		} else
+			log_debug("Failed to map \"%s\": %s",
+				  filename, strerror(errno));
+	}
+#endif
+
+	input_file_prefetch(fis);
 
 	return &fis->base;
 }
@@ -92,13 +198,33 @@ input_file_seek(struct input_stream *is, off64_t offset, int whence)
 {
 	struct file_input_stream *fis = (struct file_input_stream *)is;
 
-	offset = (goffset)lseek(fis->fd, (off_t)offset, whence);
-	if (offset < 0) {
-		log_err("Failed to seek: %s", strerror(errno));
-		return -MPD_ACCESS;
+	if (fis->map != NULL) {
+		switch (whence) {
+		case SEEK_CUR:
+			offset += is->offset;
+			break;
+
+		case SEEK_END:
+			offset += is->size;
+			break;
+		}
+
+		if (offset < 0 || offset > is->size)
+			return -MPD_INVAL;
+	} else {
+		offset = (goffset)lseek(fis->fd, (off_t)offset, whence);
+		if (offset < 0) {
+			log_err("Failed to seek: %s", strerror(errno));
+			return -MPD_ACCESS;
+		}
 	}
 
 	is->offset = offset;
+
+	/* start a new prefetch window at the new position */
+	fis->prefetched = offset;
+	input_file_prefetch(fis);
+
 	return MPD_SUCCESS;
 }
 
@@ -108,13 +234,24 @@ input_file_read(struct input_stream *is, void *ptr, size_t size)
 	struct file_input_stream *fis = (struct file_input_stream *)is;
 	ssize_t nbytes;
 
-	nbytes = read(fis->fd, ptr, size);
-	if (nbytes < 0) {
-		log_err("Failed to read: %s", strerror(errno));
-		return -MPD_ACCESS;
+	if (fis->map != NULL) {
+		/* copy straight from the page cache, without a
+		   system call */
+		if ((off_t)size > is->size - is->offset)
+			size = is->size - is->offset;
+
+		memcpy(ptr, fis->map + is->offset, size);
+		nbytes = size;
+	} else {
+		nbytes = read(fis->fd, ptr, size);
+		if (nbytes < 0) {
+			log_err("Failed to read: %s", strerror(errno));
+			return -MPD_ACCESS;
+		}
 	}
 
 	is->offset += nbytes;
+	input_file_prefetch(fis);
 	return (size_t)nbytes;
 }
 
@@ -123,6 +260,11 @@ input_file_close(struct input_stream *is)
 {
 	struct file_input_stream *fis = (struct file_input_stream *)is;
 
+#ifndef WIN32
+	if (fis->map != NULL)
+		munmap(fis->map, is->size);
+#endif
+
 	close(fis->fd);
 	input_stream_deinit(&fis->base);
 	g_free(fis);
@@ -136,6 +278,7 @@ input_file_eof(struct input_stream *is)
 
 const struct input_plugin input_plugin_file = {
 	.name = "file",
+	.init = input_file_init,
 	.open = input_file_open,
 	.close = input_file_close,
 	.read = input_file_read,
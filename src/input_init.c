@@ -84,6 +84,8 @@ input_stream_global_init(void)
 					   plugin->name);
 				return ret;
 			}
+
+			input_plugins_enabled[i] = true;
 		}
 	}
 
@@ -0,0 +1,610 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * A background thread opens the streams of the next songs, waits
+ * until they are ready and reads their first bytes into a buffer.
+ * The decoder takes the stream with input_prefetch_take() when it
+ * starts the song.
+ *
+ * The buffered bytes are served by temporarily replacing the
+ * stream's plugin with a copy of #prefetch_plugin, which is embedded
+ * in a struct prefetch_buffer.  The stream object itself, and thus
+ * the mutex and cond its plugin signals, stays the same.  The original
+ * plugin is restored when the buffer has been consumed or the stream
+ * seeks past it.
+ */
+
+#define LOG_DOMAIN "input_prefetch"
+
+#include "log.h"
+#include "config.h"
+#include "input_prefetch.h"
+#include "input_stream.h"
+#include "input_plugin.h"
+#include "conf.h"
+#include "c11thread.h"
+#include "list.h"
+#include "mpd_error.h"
+
+#include <glib.h>
+
+#include <assert.h>
+#include <stdio.h> /* for SEEK_SET */
+#include <string.h>
+
+enum {
+	PREFETCH_DEPTH_DEFAULT = 1,
+	PREFETCH_DEPTH_MAX = 16,
+
+	/** the default buffer size, in KiB */
+	PREFETCH_BUFFER_SIZE_DEFAULT = 256,
+
+	/**
+	 * The buffer is filled in pieces of this size, so a claim by
+	 * the decoder is noticed quickly.
+	 */
+	PREFETCH_READ_SIZE = 16 * 1024,
+};
+
+enum prefetch_state {
+	/** waiting for the prefetch thread */
+	PREFETCH_PENDING,
+
+	/** the prefetch thread is opening the stream */
+	PREFETCH_OPENING,
+
+	/** the stream is ready, see prefetch_entry.is */
+	PREFETCH_READY,
+
+	/** the stream could not be opened */
+	PREFETCH_FAILED,
+};
+
+struct prefetch_entry {
+	struct list_head siblings;
+
+	char *uri;
+
+	enum prefetch_state state;
+
+	/**
+	 * The entry has been unscheduled or taken while being opened;
+	 * the prefetch thread closes it when it is done.
+	 */
+	bool dropped;
+
+	struct input_stream *is;
+};
+
+struct prefetch_buffer {
+	/** the plugin of the stream while the buffer is installed */
+	struct input_plugin plugin;
+
+	/** the plugin which implements the stream */
+	const struct input_plugin *orig;
+
+	/** the stream's "seekable" attribute */
+	bool seekable;
+
+	/** the read position within the buffer */
+	size_t head;
+
+	/**
+	 * The number of bytes in the buffer, which is also the
+	 * position of the underlying stream.  The origin of the
+	 * buffer is offset 0.
+	 */
+	size_t tail;
+
+	char buffer[];
+};
+
+static unsigned prefetch_depth;
+static size_t prefetch_buffer_size;
+
+static mtx_t prefetch_mutex;
+static cnd_t prefetch_cond;
+static thrd_t prefetch_thread;
+static bool prefetch_started, prefetch_quit;
+
+/** the scheduled entries, in playing order */
+static LIST_HEAD(prefetch_entries);
+
+/** entries which the prefetch thread shall close */
+static LIST_HEAD(prefetch_garbage);
+
+static unsigned prefetch_hits, prefetch_misses;
+
+/*
+ * The buffer plugin
+ *
+ */
+
+static struct prefetch_buffer *
+prefetch_buffer_get(struct input_stream *is)
+{
+	/* the plugin is only const for the stream, the buffer owns
+	   it */
+	union {
+		const struct input_plugin *in;
+		struct input_plugin *out;
+	} u = { .in = is->plugin };
+
+	return container_of(u.out, struct prefetch_buffer, plugin);
+}
+
+/**
+ * Gives the stream back to its plugin.
+ */
+static void
+prefetch_buffer_detach(struct input_stream *is)
+{
+	struct prefetch_buffer *pb = prefetch_buffer_get(is);
+
+	is->plugin = pb->orig;
+	is->seekable = pb->seekable;
+	is->offset = pb->tail;
+	g_free(pb);
+}
+
+static void
+prefetch_buffer_close(struct input_stream *is)
+{
+	prefetch_buffer_detach(is);
+	input_stream_close(is);
+}
+
+static int
+prefetch_buffer_check(struct input_stream *is)
+{
+	struct prefetch_buffer *pb = prefetch_buffer_get(is);
+
+	return pb->orig->check != NULL
+		? pb->orig->check(is)
+		: MPD_SUCCESS;
+}
+
+static void
+prefetch_buffer_update(struct input_stream *is)
+{
+	struct prefetch_buffer *pb = prefetch_buffer_get(is);
+
+	if (pb->orig->update != NULL)
+		pb->orig->update(is);
+}
+
+static struct tag *
+prefetch_buffer_tag(struct input_stream *is)
+{
+	struct prefetch_buffer *pb = prefetch_buffer_get(is);
+
+	return pb->orig->tag != NULL
+		? pb->orig->tag(is)
+		: NULL;
+}
+
+static bool
+prefetch_buffer_available(G_GNUC_UNUSED struct input_stream *is)
+{
+	/* the buffer is never empty while installed */
+	return true;
+}
+
+static ssize_t
+prefetch_buffer_read(struct input_stream *is, void *ptr, size_t size)
+{
+	struct prefetch_buffer *pb = prefetch_buffer_get(is);
+
+	assert(pb->head < pb->tail);
+	assert(pb->head == (size_t)is->offset);
+
+	if (size > pb->tail - pb->head)
+		size = pb->tail - pb->head;
+
+	memcpy(ptr, pb->buffer + pb->head, size);
+	pb->head += size;
+	is->offset = pb->head;
+
+	if (pb->head == pb->tail)
+		/* the underlying stream continues here */
+		prefetch_buffer_detach(is);
+
+	return size;
+}
+
+static bool
+prefetch_buffer_eof(G_GNUC_UNUSED struct input_stream *is)
+{
+	return false;
+}
+
+static int
+prefetch_buffer_seek(struct input_stream *is, off64_t offset, int whence)
+{
+	struct prefetch_buffer *pb = prefetch_buffer_get(is);
+
+	if (whence == SEEK_CUR) {
+		offset += is->offset;
+		whence = SEEK_SET;
+	}
+
+	if (whence == SEEK_SET && offset >= 0 &&
+	    offset < (off64_t)pb->tail) {
+		/* buffered seek */
+		pb->head = offset;
+		is->offset = offset;
+		return MPD_SUCCESS;
+	}
+
+	prefetch_buffer_detach(is);
+	return input_stream_seek(is, offset, whence);
+}
+
+static const struct input_plugin prefetch_plugin = {
+	.close = prefetch_buffer_close,
+	.check = prefetch_buffer_check,
+	.update = prefetch_buffer_update,
+	.tag = prefetch_buffer_tag,
+	.available = prefetch_buffer_available,
+	.read = prefetch_buffer_read,
+	.eof = prefetch_buffer_eof,
+	.seek = prefetch_buffer_seek,
+};
+
+/*
+ * The prefetch thread
+ *
+ */
+
+static bool
+prefetch_entry_cancelled(const struct prefetch_entry *entry)
+{
+	mtx_lock(&prefetch_mutex);
+	bool cancelled = entry->dropped || prefetch_quit;
+	mtx_unlock(&prefetch_mutex);
+
+	return cancelled;
+}
+
+/**
+ * Reads the beginning of the stream into a buffer, and installs the
+ * buffer plugin.  Stops early when the entry is dropped.
+ */
+static void
+prefetch_fill(const struct prefetch_entry *entry, struct input_stream *is)
+{
+	size_t size = prefetch_buffer_size;
+	if (is->size >= 0 && (off_t)size > is->size)
+		size = is->size;
+
+	if (size == 0 || is->offset != 0)
+		return;
+
+	struct prefetch_buffer *pb = g_malloc(sizeof(*pb) + size);
+	pb->tail = 0;
+
+	while (pb->tail < size && !prefetch_entry_cancelled(entry)) {
+		size_t length = size - pb->tail;
+		if (length > PREFETCH_READ_SIZE)
+			length = PREFETCH_READ_SIZE;
+
+		input_stream_lock(is);
+		ssize_t nbytes = input_stream_eof(is)
+			? 0
+			: input_stream_read(is, pb->buffer + pb->tail, length);
+		input_stream_unlock(is);
+
+		if (nbytes <= 0)
+			/* errors are reported to the decoder when it
+			   reads past the buffer */
+			break;
+
+		pb->tail += nbytes;
+	}
+
+	if (pb->tail == 0) {
+		g_free(pb);
+		return;
+	}
+
+	pb = g_realloc(pb, sizeof(*pb) + pb->tail);
+	pb->plugin = prefetch_plugin;
+	pb->plugin.name = is->plugin->name;
+	pb->head = 0;
+
+	input_stream_lock(is);
+	pb->orig = is->plugin;
+	pb->seekable = is->seekable;
+
+	/* seeking within the buffer always works, which helps
+	   probing decoder plugins on streams which cannot seek */
+	is->seekable = true;
+	is->offset = 0;
+	is->plugin = &pb->plugin;
+	input_stream_unlock(is);
+}
+
+static struct input_stream *
+prefetch_open(const struct prefetch_entry *entry)
+{
+	struct input_stream *is = input_stream_open(entry->uri);
+	if (IS_ERR_OR_NULL(is)) {
+		log_debug("Failed to prefetch \"%s\"", entry->uri);
+		return NULL;
+	}
+
+	input_stream_lock(is);
+	input_stream_wait_ready(is);
+	int ret = input_stream_check(is);
+	input_stream_unlock(is);
+
+	if (ret != MPD_SUCCESS) {
+		log_debug("Failed to prefetch \"%s\"", entry->uri);
+		input_stream_close(is);
+		return NULL;
+	}
+
+	prefetch_fill(entry, is);
+	return is;
+}
+
+static void
+prefetch_entry_free(struct prefetch_entry *entry)
+{
+	if (entry->is != NULL)
+		input_stream_close(entry->is);
+
+	g_free(entry->uri);
+	g_free(entry);
+}
+
+static struct prefetch_entry *
+prefetch_find(const char *uri)
+{
+	struct prefetch_entry *entry;
+
+	list_for_each_entry(entry, &prefetch_entries, siblings)
+		if (strcmp(entry->uri, uri) == 0)
+			return entry;
+
+	return NULL;
+}
+
+static struct prefetch_entry *
+prefetch_next_pending(void)
+{
+	struct prefetch_entry *entry;
+
+	list_for_each_entry(entry, &prefetch_entries, siblings)
+		if (entry->state == PREFETCH_PENDING)
+			return entry;
+
+	return NULL;
+}
+
+static int
+prefetch_task(G_GNUC_UNUSED void *arg)
+{
+	mtx_lock(&prefetch_mutex);
+
+	while (!prefetch_quit) {
+		if (!list_empty(&prefetch_garbage)) {
+			struct prefetch_entry *entry =
+				list_first_entry(&prefetch_garbage,
+						 struct prefetch_entry,
+						 siblings);
+			list_del(&entry->siblings);
+
+			mtx_unlock(&prefetch_mutex);
+			prefetch_entry_free(entry);
+			mtx_lock(&prefetch_mutex);
+			continue;
+		}
+
+		struct prefetch_entry *entry = prefetch_next_pending();
+		if (entry == NULL) {
+			cnd_wait(&prefetch_cond, &prefetch_mutex);
+			continue;
+		}
+
+		entry->state = PREFETCH_OPENING;
+		mtx_unlock(&prefetch_mutex);
+
+		struct input_stream *is = prefetch_open(entry);
+
+		mtx_lock(&prefetch_mutex);
+		entry->is = is;
+		entry->state = is != NULL ? PREFETCH_READY : PREFETCH_FAILED;
+
+		if (entry->dropped)
+			list_add_tail(&entry->siblings, &prefetch_garbage);
+	}
+
+	mtx_unlock(&prefetch_mutex);
+	return 0;
+}
+
+/*
+ * Public API
+ *
+ */
+
+void
+input_prefetch_init(void)
+{
+	prefetch_depth = config_get_unsigned(CONF_PREFETCH_DEPTH,
+					     PREFETCH_DEPTH_DEFAULT);
+	if (prefetch_depth > PREFETCH_DEPTH_MAX)
+		MPD_ERROR("%s is too large: %u",
+			  CONF_PREFETCH_DEPTH, prefetch_depth);
+
+	prefetch_buffer_size =
+		(size_t)config_get_unsigned(CONF_PREFETCH_BUFFER_SIZE,
+					    PREFETCH_BUFFER_SIZE_DEFAULT)
+		* 1024;
+
+	mtx_init(&prefetch_mutex, mtx_plain);
+	cnd_init(&prefetch_cond);
+}
+
+void
+input_prefetch_start(void)
+{
+	if (prefetch_depth == 0)
+		return;
+
+	prefetch_quit = false;
+	if (thrd_create(&prefetch_thread, prefetch_task, NULL) != thrd_success)
+		MPD_ERROR("Failed to spawn the prefetch thread");
+
+	prefetch_started = true;
+}
+
+void
+input_prefetch_deinit(void)
+{
+	if (prefetch_started) {
+		mtx_lock(&prefetch_mutex);
+		prefetch_quit = true;
+		cnd_broadcast(&prefetch_cond);
+		mtx_unlock(&prefetch_mutex);
+
+		thrd_join(prefetch_thread, NULL);
+		prefetch_started = false;
+	}
+
+	struct prefetch_entry *entry, *n;
+	list_splice_init(&prefetch_entries, &prefetch_garbage);
+	list_for_each_entry_safe(entry, n, &prefetch_garbage, siblings) {
+		list_del(&entry->siblings);
+		prefetch_entry_free(entry);
+	}
+
+	cnd_destroy(&prefetch_cond);
+	mtx_destroy(&prefetch_mutex);
+}
+
+unsigned
+input_prefetch_depth(void)
+{
+	return prefetch_started ? prefetch_depth : 0;
+}
+
+void
+input_prefetch_schedule(const char *const *uris, unsigned n)
+{
+	if (!prefetch_started)
+		return;
+
+	if (n > prefetch_depth)
+		n = prefetch_depth;
+
+	LIST_HEAD(scheduled);
+
+	mtx_lock(&prefetch_mutex);
+
+	for (unsigned i = 0; i < n; ++i) {
+		struct prefetch_entry *entry = prefetch_find(uris[i]);
+		if (entry == NULL) {
+			entry = g_new(struct prefetch_entry, 1);
+			entry->uri = g_strdup(uris[i]);
+			entry->state = PREFETCH_PENDING;
+			entry->dropped = false;
+			entry->is = NULL;
+			list_add_tail(&entry->siblings, &scheduled);
+		} else
+			list_move_tail(&entry->siblings, &scheduled);
+	}
+
+	/* close what is no longer needed */
+
+	struct prefetch_entry *entry, *next;
+	list_for_each_entry_safe(entry, next, &prefetch_entries, siblings) {
+		if (entry->state == PREFETCH_OPENING) {
+			list_del_init(&entry->siblings);
+			entry->dropped = true;
+		} else
+			list_move_tail(&entry->siblings, &prefetch_garbage);
+	}
+
+	list_splice_init(&scheduled, &prefetch_entries);
+
+	cnd_broadcast(&prefetch_cond);
+	mtx_unlock(&prefetch_mutex);
+}
+
+struct input_stream *
+input_prefetch_take(const char *uri)
+{
+	if (!prefetch_started)
+		return NULL;
+
+	mtx_lock(&prefetch_mutex);
+
+	struct prefetch_entry *entry = prefetch_find(uri);
+	if (entry == NULL) {
+		++prefetch_misses;
+		mtx_unlock(&prefetch_mutex);
+		return NULL;
+	}
+
+	list_del_init(&entry->siblings);
+
+	if (entry->state == PREFETCH_OPENING) {
+		/* don't wait for the prefetch thread: it may be
+		   stuck on a slow server, and the decoder must be
+		   able to honor a STOP command meanwhile; the
+		   thread closes the stream when it is done */
+		entry->dropped = true;
+		++prefetch_misses;
+		mtx_unlock(&prefetch_mutex);
+		return NULL;
+	}
+
+	if (entry->state != PREFETCH_READY)
+		++prefetch_misses;
+
+	mtx_unlock(&prefetch_mutex);
+
+	struct input_stream *is = entry->is;
+	entry->is = NULL;
+	prefetch_entry_free(entry);
+
+	return is;
+}
+
+void
+input_prefetch_account(bool used)
+{
+	mtx_lock(&prefetch_mutex);
+	if (used)
+		++prefetch_hits;
+	else
+		++prefetch_misses;
+	mtx_unlock(&prefetch_mutex);
+}
+
+void
+input_prefetch_stats(unsigned *hits_r, unsigned *misses_r)
+{
+	mtx_lock(&prefetch_mutex);
+	*hits_r = prefetch_hits;
+	*misses_r = prefetch_misses;
+	mtx_unlock(&prefetch_mutex);
+}
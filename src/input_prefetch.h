@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * Opens the input streams of the next songs in the queue while the
+ * current one plays, so the decoder does not have to wait for the
+ * connection, the headers and the first bytes when it moves on.
+ */
+
+#ifndef MPD_INPUT_PREFETCH_H
+#define MPD_INPUT_PREFETCH_H
+
+#include <stdbool.h>
+
+struct input_stream;
+
+/**
+ * Reads the configuration.  Call after input_stream_global_init().
+ */
+void
+input_prefetch_init(void);
+
+/**
+ * Starts the prefetch thread.  Call after daemonizing.
+ */
+void
+input_prefetch_start(void);
+
+/**
+ * Stops the prefetch thread and closes all streams it has opened.
+ */
+void
+input_prefetch_deinit(void);
+
+/**
+ * How many songs are prefetched?  0 if prefetching is disabled.
+ */
+unsigned
+input_prefetch_depth(void);
+
+/**
+ * Replaces the list of URIs to be prefetched.  Streams which are
+ * not in the new list are closed; streams which are already open
+ * are kept.  Only the first input_prefetch_depth() URIs are used.
+ *
+ * @param uris absolute file names or URIs, as passed to
+ * input_stream_open()
+ */
+void
+input_prefetch_schedule(const char *const *uris, unsigned n);
+
+/**
+ * Takes the prefetched stream for this URI.  The stream is ready,
+ * and positioned at the beginning; the caller owns it, closes it
+ * with input_stream_close(), and reports with
+ * input_prefetch_account() whether it was used.  A stream which is
+ * still being opened is not waited for; it is closed by the prefetch
+ * thread.
+ *
+ * @return the stream, or NULL if this URI has not been prefetched
+ * (or not yet)
+ */
+struct input_stream *
+input_prefetch_take(const char *uri);
+
+/**
+ * Counts a stream returned by input_prefetch_take() as a hit if it
+ * was handed to a decoder, or as a miss if it was closed unused.
+ */
+void
+input_prefetch_account(bool used);
+
+/**
+ * Returns how many prefetched streams were handed to a decoder
+ * (hits), and how many decoders had to open the stream themselves
+ * (misses).
+ */
+void
+input_prefetch_stats(unsigned *hits_r, unsigned *misses_r);
+
+#endif
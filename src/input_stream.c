@@ -39,7 +39,11 @@ input_stream_open(const char *url)
 		struct input_stream *is;
 
 		is = input_plugins[i]->open(url);
-		if (!IS_ERR_OR_NULL(is)) {
+		if (is == NULL)
+			/* not supported by this plugin */
+			continue;
+
+		if (!IS_ERR(is)) {
 			assert(is->plugin != NULL);
 			assert(is->plugin->close != NULL);
 			assert(is->plugin->read != NULL);
@@ -22,10 +22,13 @@
 #include "path.h"
 #include "tag.h"
 #include "song.h"
+#include "directory.h"
+#include "tag_pool.h"
 
 #include <glib.h>
 
 #include <stdlib.h>
+#include <string.h>
 
 #define LOCATE_TAG_FILE_KEY     "file"
 #define LOCATE_TAG_FILE_KEY_OLD "filename"
@@ -103,6 +106,19 @@ locate_item_list_parse(char *argv[], int argc)
 	return list;
 }
 
+struct locate_item_list *
+locate_item_list_dup(const struct locate_item_list *list)
+{
+	struct locate_item_list *new_list = locate_item_list_new(list->length);
+
+	for (unsigned i = 0; i < list->length; i++){
+		new_list->items[i].needle = strdup(list->items[i].needle);
+		new_list->items[i].tag = list->items[i].tag;
+	}
+
+	return new_list;
+}
+
 struct locate_item_list *
 locate_item_list_casefold(const struct locate_item_list *list)
 {
@@ -124,19 +140,68 @@ locate_item_free(struct locate_item *item)
 	free(item);
 }
 
+/**
+ * Builds the casefolded URI of the song (see song_get_uri()) in the
+ * buffer, without allocating memory.  This only works for plain ASCII
+ * URIs, where casefolding is the same as g_ascii_tolower().  Returns
+ * NULL if the URI is not ASCII or does not fit.
+ */
+static const char *
+song_get_uri_folded_ascii(const struct song *song, char *buffer, size_t size)
+{
+	size_t length = 0;
+
+	if (song_in_database(song) && !directory_is_root(song->parent)) {
+		const char *path = directory_get_path(song->parent);
+		length = strlen(path);
+		if (length + 1 >= size)
+			return NULL;
+
+		memcpy(buffer, path, length);
+		buffer[length++] = '/';
+	}
+
+	size_t uri_length = strlen(song->uri);
+	if (length + uri_length >= size)
+		return NULL;
+
+	memcpy(buffer + length, song->uri, uri_length + 1);
+
+	for (char *p = buffer; *p != 0; ++p) {
+		if ((unsigned char)*p >= 0x80)
+			return NULL;
+
+		*p = g_ascii_tolower(*p);
+	}
+
+	return buffer;
+}
+
+static bool
+locate_uri_search(const struct song *song, const char *str)
+{
+	char buffer[MPD_PATH_MAX];
+	const char *folded = song_get_uri_folded_ascii(song, buffer,
+							sizeof(buffer));
+	if (folded != NULL)
+		return strstr(folded, str) != NULL;
+
+	char *uri = song_get_uri(song);
+	char *p = g_utf8_casefold(uri, -1);
+	free(uri);
+
+	bool ret = strstr(p, str) != NULL;
+	g_free(p);
+	return ret;
+}
+
 static bool
 locate_tag_search(const struct song *song, enum tag_type type, const char *str)
 {
 	bool ret = false;
 
 	if (type == LOCATE_TAG_FILE_TYPE || (int)type == LOCATE_TAG_ANY_TYPE) {
-		char *uri = song_get_uri(song);
-		char *p = g_utf8_casefold(uri, -1);
-		free(uri);
-
-		if (strstr(p, str))
-			ret = true;
-		g_free(p);
+		ret = locate_uri_search(song, str);
 		if (ret == 1 || type == LOCATE_TAG_FILE_TYPE)
 			return ret;
 	}
@@ -154,10 +219,11 @@ locate_tag_search(const struct song *song, enum tag_type type, const char *str)
 			continue;
 		}
 
-		char *duplicate = g_utf8_casefold(song->tag->items[i]->value, -1);
-		if (*str && strstr(duplicate, str))
+		/* the pool keeps a casefolded copy of each value */
+		const char *folded =
+			tag_pool_item_folded(song->tag->items[i]);
+		if (*str && strstr(folded, str))
 			ret = true;
-		g_free(duplicate);
 	}
 
 	/** If the search critieron was not visited during the sweep
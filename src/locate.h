@@ -61,6 +61,12 @@ locate_item_list_new(unsigned length);
 struct locate_item_list *
 locate_item_list_parse(char *argv[], int argc);
 
+/**
+ * Duplicate the struct locate_item_list object.
+ */
+struct locate_item_list *
+locate_item_list_dup(const struct locate_item_list *list);
+
 /**
  * Duplicate the struct locate_item_list object and convert all
  * needles with g_utf8_casefold().
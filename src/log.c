@@ -23,8 +23,11 @@
 #include "utils.h"
 #include "fd_util.h"
 #include "mpd_error.h"
+#include "c11thread.h"
+#include "futex.h"
 
 #include <assert.h>
+#include <stdatomic.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <string.h>
@@ -45,7 +48,7 @@
 #define LOG_DATE_BUF_SIZE 16
 #define LOG_DATE_LEN (LOG_DATE_BUF_SIZE - 1)
 
-static int log_threshold = LOG_INFO;
+int log_threshold = LOG_INFO;
 
 static const char *log_charset;
 
@@ -55,6 +58,220 @@ static char *out_filename;
 
 void (*log_handler)(int log_level, const char *str);
 
+#ifdef __linux__
+
+/**
+ * Once the daemon is set up, messages are not written by the thread
+ * which logs them.  They are copied into a lock-free ring instead, and
+ * a dedicated writer thread passes them to the real handler, so the
+ * decoder, output and player threads never block on log file or
+ * syslog I/O.  If the ring is full, messages are dropped and counted.
+ */
+#define LOG_RING_SIZE 512
+
+struct log_record {
+	/**
+	 * Bounded MPMC queue sequence number (Dmitry Vyukov's
+	 * design): equals the position when the record is free for
+	 * the producer at that position, position + 1 when it has
+	 * been published.
+	 */
+	atomic_size_t sequence;
+
+	int level;
+	char text[LOG_LINE_MAX];
+};
+
+static struct log_record log_ring[LOG_RING_SIZE];
+static atomic_size_t log_ring_head;
+static size_t log_ring_tail;
+
+static atomic_uint log_dropped;
+
+/** the handler which does the I/O, called by the writer thread */
+static void (*log_sync_handler)(int log_level, const char *str);
+
+static thrd_t log_writer;
+static bool log_writer_running;
+static atomic_bool log_writer_quit;
+
+/** futex word the writer sleeps on, bumped by producers */
+static atomic_uint log_wakeup;
+static atomic_bool log_writer_sleeping;
+
+static void
+async_log_func(int log_level, const char *str)
+{
+	size_t position = atomic_load_explicit(&log_ring_head,
+					       memory_order_relaxed);
+	struct log_record *record;
+
+	while (true) {
+		record = &log_ring[position % LOG_RING_SIZE];
+		size_t sequence = atomic_load_explicit(&record->sequence,
+						       memory_order_acquire);
+
+		if (sequence == position) {
+			if (atomic_compare_exchange_weak_explicit(&log_ring_head,
+								  &position,
+								  position + 1,
+								  memory_order_relaxed,
+								  memory_order_relaxed))
+				break;
+		} else if (sequence < position) {
+			/* full; never block the caller */
+			atomic_fetch_add_explicit(&log_dropped, 1,
+						  memory_order_relaxed);
+			return;
+		} else
+			position = atomic_load_explicit(&log_ring_head,
+							memory_order_relaxed);
+	}
+
+	record->level = log_level;
+	size_t length = strlen(str);
+	if (length >= sizeof(record->text))
+		length = sizeof(record->text) - 1;
+	memcpy(record->text, str, length);
+	record->text[length] = 0;
+
+	atomic_store_explicit(&record->sequence, position + 1,
+			      memory_order_release);
+
+	/* only the first producer after the writer went to sleep
+	   pays for the system call */
+	if (atomic_load(&log_writer_sleeping) &&
+	    atomic_exchange(&log_writer_sleeping, false)) {
+		atomic_fetch_add(&log_wakeup, 1);
+		xfutex_wake(&log_wakeup, 1);
+	}
+}
+
+/**
+ * Writes all published records.  Returns false if the ring was empty.
+ */
+static bool
+log_ring_drain(void)
+{
+	bool found = false;
+
+	while (true) {
+		struct log_record *record =
+			&log_ring[log_ring_tail % LOG_RING_SIZE];
+		size_t sequence = atomic_load_explicit(&record->sequence,
+						       memory_order_acquire);
+		if (sequence != log_ring_tail + 1)
+			break;
+
+		log_sync_handler(record->level, record->text);
+
+		atomic_store_explicit(&record->sequence,
+				      log_ring_tail + LOG_RING_SIZE,
+				      memory_order_release);
+		++log_ring_tail;
+		found = true;
+	}
+
+	unsigned dropped = atomic_exchange(&log_dropped, 0);
+	if (dropped > 0) {
+		char buffer[64];
+		snprintf(buffer, sizeof(buffer),
+			 "log: %u messages dropped", dropped);
+		log_sync_handler(LOG_WARNING, buffer);
+	}
+
+	return found;
+}
+
+static bool
+log_ring_empty(void)
+{
+	const struct log_record *record =
+		&log_ring[log_ring_tail % LOG_RING_SIZE];
+	return atomic_load(&record->sequence) != log_ring_tail + 1 &&
+		atomic_load(&log_dropped) == 0;
+}
+
+static int
+log_writer_thread(void *arg)
+{
+	(void)arg;
+
+	while (true) {
+		if (log_ring_drain())
+			continue;
+
+		if (atomic_load(&log_writer_quit))
+			break;
+
+		unsigned wakeup = atomic_load(&log_wakeup);
+		atomic_store(&log_writer_sleeping, true);
+		if (log_ring_empty() && !atomic_load(&log_writer_quit))
+			xfutex_wait(&log_wakeup, wakeup);
+		atomic_store(&log_writer_sleeping, false);
+	}
+
+	return 0;
+}
+
+static void
+log_async_stop(void);
+
+static void
+log_async_start(void)
+{
+	assert(!log_writer_running);
+
+	for (size_t i = 0; i < LOG_RING_SIZE; ++i)
+		atomic_init(&log_ring[i].sequence, i);
+	atomic_init(&log_ring_head, 0);
+	log_ring_tail = 0;
+	atomic_store(&log_writer_quit, false);
+
+	log_sync_handler = log_handler;
+	if (thrd_create(&log_writer, log_writer_thread, NULL) != thrd_success)
+		/* keep logging synchronously */
+		return;
+
+	log_writer_running = true;
+	log_handler = async_log_func;
+
+	/* don't lose the last messages if the daemon exits early */
+	atexit(log_async_stop);
+}
+
+static void
+log_async_stop(void)
+{
+	if (!log_writer_running)
+		return;
+
+	atomic_store(&log_writer_quit, true);
+	atomic_fetch_add(&log_wakeup, 1);
+	xfutex_wake(&log_wakeup, 1);
+	thrd_join(log_writer, NULL);
+
+	log_handler = log_sync_handler;
+	log_writer_running = false;
+
+	/* messages logged while the writer was exiting */
+	log_ring_drain();
+}
+
+#else
+
+static inline void
+log_async_start(void)
+{
+}
+
+static inline void
+log_async_stop(void)
+{
+}
+
+#endif
+
 static void redirect_logs(int fd)
 {
 	assert(fd >= 0);
@@ -252,6 +469,7 @@ close_log_files(void)
 void
 log_deinit(void)
 {
+	log_async_stop();
 	close_log_files();
 	free(out_filename);
 	out_filename = NULL;
@@ -276,6 +494,10 @@ void setup_log_output(bool use_stdout)
 		stdout_mode = false;
 		log_charset = NULL;
 	}
+
+	/* the daemon has forked (if at all); from now on, the I/O is
+	   done by a dedicated thread */
+	log_async_start();
 }
 
 int cycle_log_files(void)
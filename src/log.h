@@ -60,6 +60,18 @@
 
 extern void (*log_handler)(int log_level, const char *str);
 
+/**
+ * Messages with a level above this are discarded, before they are
+ * formatted.
+ */
+extern int log_threshold;
+
+/**
+ * Maximum length of one formatted message (including the domain
+ * prefix); longer messages are truncated.
+ */
+#define LOG_LINE_MAX 1024
+
 void
 log_early_init(bool verbose);
 
@@ -73,35 +85,38 @@ void setup_log_output(bool use_stdout);
 
 int cycle_log_files(void);
 
+static inline bool
+log_enabled(int log_level)
+{
+	return log_level <= log_threshold;
+}
+
 static inline void log_metav(int log_level, const char *fmt, va_list args) {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wformat-nonliteral"
-	char *buf;
-	vasprintf(&buf, fmt, args);
-
-	char *buf2 = (char *)malloc(strlen(buf)+strlen(LOG_PREFIX)+1);
-	strcpy(buf2, LOG_PREFIX);
-	strcpy(buf2+strlen(LOG_PREFIX), buf);
-
-	log_handler(log_level, buf2);
-	free(buf);
-	free(buf2);
+	if (!log_enabled(log_level))
+		return;
+
+	/* format on the stack; the handler copies the message if it
+	   needs to keep it */
+	char buffer[LOG_LINE_MAX];
+	size_t prefix_length = strlen(LOG_PREFIX);
+	memcpy(buffer, LOG_PREFIX, prefix_length);
+	vsnprintf(buffer + prefix_length, sizeof(buffer) - prefix_length,
+		  fmt, args);
+
+	log_handler(log_level, buffer);
 #pragma GCC diagnostic pop
 }
 static inline void __attribute__ ((format(printf, 2, 3)))
 log_meta(int log_level, const char *fmt, ...){
-	char *buf;
+	if (!log_enabled(log_level))
+		return;
+
 	va_list args;
 	va_start(args, fmt);
-
-	vasprintf(&buf, fmt, args);
-	char *buf2 = (char *)malloc(strlen(buf)+strlen(LOG_PREFIX)+1);
-	strcpy(buf2, LOG_PREFIX);
-	strcpy(buf2+strlen(LOG_PREFIX), buf);
-
-	log_handler(log_level, buf2);
-	free(buf);
-	free(buf2);
+	log_metav(log_level, fmt, args);
+	va_end(args);
 }
 
 #define log_debug(...) log_meta(LOG_DEBUG, __VA_ARGS__)
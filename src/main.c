@@ -37,7 +37,7 @@
 #include "conf.h"
 #include "path.h"
 #include "mapper.h"
-#include "chunk.h"
+#include "pipe.h"
 #include "player_control.h"
 #include "stats.h"
 #include "sig_handlers.h"
@@ -50,12 +50,14 @@
 #include "replay_gain_config.h"
 #include "decoder_list.h"
 #include "input_init.h"
+#include "input_prefetch.h"
 #include "playlist_list.h"
 #include "state_file.h"
 #include "tag.h"
 #include "dbUtils.h"
 #include "zeroconf.h"
 #include "event_pipe.h"
+#include "reactor.h"
 #include "tag_pool.h"
 #include "mpd_error.h"
 #include "c11thread.h"
@@ -235,8 +237,7 @@ initialize_decoder_and_player(void)
 	char *test;
 	size_t buffer_size;
 	float perc;
-	unsigned buffered_chunks;
-	unsigned buffered_before_play;
+	size_t buffered_before_play;
 
 	param = config_get_param(CONF_AUDIO_BUFFER_SIZE);
 	if (param != NULL) {
@@ -250,9 +251,10 @@ initialize_decoder_and_player(void)
 
 	buffer_size *= 1024;
 
-	buffered_chunks = buffer_size / CHUNK_SIZE;
-
-	if (buffered_chunks >= 1 << 15)
+	/* the chunk size depends on the audio format; check the
+	   number of the smallest chunks, the player converts the
+	   sizes to chunks of the actual format */
+	if (buffer_size / CHUNK_SIZE >= 1 << 15)
 		MPD_ERROR("buffer size \"%li\" is too big\n", (long)buffer_size);
 
 	param = config_get_param(CONF_BUFFER_BEFORE_PLAY);
@@ -266,11 +268,14 @@ initialize_decoder_and_player(void)
 	} else
 		perc = DEFAULT_BUFFER_BEFORE_PLAY;
 
-	buffered_before_play = (perc / 100) * buffered_chunks;
-	if (buffered_before_play > buffered_chunks)
-		buffered_before_play = buffered_chunks;
+	buffered_before_play = (perc / 100) * buffer_size;
+	if (buffered_before_play > buffer_size)
+		buffered_before_play = buffer_size;
+
+	audio_chunk_time = config_get_positive(CONF_AUDIO_CHUNK_TIME,
+					       DEFAULT_CHUNK_TIME);
 
-	global_player_control = pc_new(buffered_chunks, buffered_before_play);
+	global_player_control = pc_new(buffer_size, buffered_before_play);
 }
 
 /**
@@ -351,6 +356,8 @@ int mpd_main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
+	reactor_init();
+
 	ret = listen_global_init();
 	if (ret != MPD_SUCCESS) {
 		log_warning("Failed to init listen");
@@ -407,6 +414,8 @@ int mpd_main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
+	input_prefetch_init();
+
 	playlist_list_global_init();
 
 	daemonize(options.daemon);
@@ -421,6 +430,9 @@ int mpd_main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
+	client_manager_start();
+	input_prefetch_start();
+
 	initZeroconf();
 
 	player_create(global_player_control);
@@ -469,6 +481,7 @@ int mpd_main(int argc, char *argv[])
 	finishZeroconf();
 	client_manager_deinit();
 	listen_global_finish();
+	reactor_deinit();
 	playlist_global_finish();
 
 	start = clock();
@@ -483,6 +496,7 @@ int mpd_main(int argc, char *argv[])
 	event_pipe_deinit();
 
 	playlist_list_global_finish();
+	input_prefetch_deinit();
 	input_stream_global_finish();
 	audio_output_all_finish();
 	volume_finish();
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "name_index.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** initial number of buckets, must be a power of two */
+#define NAME_INDEX_MIN_BUCKETS 64
+
+/**
+ * FNV-1a with a final avalanche step, because the bucket is selected
+ * by the lower bits.
+ */
+static inline uint32_t
+calc_hash(const char *p, size_t length)
+{
+	uint32_t hash = 2166136261u;
+
+	while (length-- > 0) {
+		hash ^= (unsigned char)*p++;
+		hash *= 16777619u;
+	}
+
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35u;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+/**
+ * Doubles the bucket array (or allocates the initial one).
+ */
+static void
+name_index_grow(struct name_index *index)
+{
+	struct name_index_bucket *old = index->buckets;
+	size_t old_size = old != NULL ? index->mask + 1 : 0;
+	size_t size = old != NULL ? old_size * 2 : NAME_INDEX_MIN_BUCKETS;
+
+	index->buckets = calloc(size, sizeof(index->buckets[0]));
+	index->mask = size - 1;
+
+	for (size_t i = 0; i < old_size; ++i) {
+		if (old[i].item == NULL)
+			continue;
+
+		size_t j = old[i].hash & index->mask;
+		while (index->buckets[j].item != NULL)
+			j = (j + 1) & index->mask;
+		index->buckets[j] = old[i];
+	}
+
+	free(old);
+}
+
+void
+name_index_deinit(struct name_index *index)
+{
+	free(index->buckets);
+	name_index_init(index);
+}
+
+void
+name_index_insert(struct name_index *index, const char *name, void *item)
+{
+	assert(name != NULL);
+	assert(item != NULL);
+
+	/* keep the load factor below 3/4 */
+	if (index->buckets == NULL ||
+	    (index->count + 1) * 4 > (index->mask + 1) * 3)
+		name_index_grow(index);
+
+	size_t length = strlen(name);
+	uint32_t hash = calc_hash(name, length);
+	size_t i = hash & index->mask;
+	while (index->buckets[i].item != NULL)
+		i = (i + 1) & index->mask;
+
+	index->buckets[i].hash = hash;
+	index->buckets[i].length = length;
+	index->buckets[i].name = name;
+	index->buckets[i].item = item;
+	++index->count;
+}
+
+void
+name_index_remove(struct name_index *index, const char *name,
+		  const void *item)
+{
+	if (index->buckets == NULL)
+		return;
+
+	struct name_index_bucket *buckets = index->buckets;
+	size_t mask = index->mask;
+	size_t i = calc_hash(name, strlen(name)) & mask;
+
+	while (buckets[i].item != item) {
+		if (buckets[i].item == NULL)
+			return;
+
+		i = (i + 1) & mask;
+	}
+
+	/* shift following members of the probe sequence back, so
+	   lookups never need tombstones */
+	size_t j = i;
+	while (true) {
+		j = (j + 1) & mask;
+		if (buckets[j].item == NULL)
+			break;
+
+		/* move the bucket at j into the hole at i unless its
+		   home position lies cyclically within (i, j] */
+		size_t home = buckets[j].hash & mask;
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			buckets[i] = buckets[j];
+			i = j;
+		}
+	}
+
+	buckets[i].item = NULL;
+	--index->count;
+}
+
+void *
+name_index_lookup(const struct name_index *index,
+		  const char *name, size_t length)
+{
+	if (index->buckets == NULL)
+		return NULL;
+
+	uint32_t hash = calc_hash(name, length);
+	for (size_t i = hash & index->mask; index->buckets[i].item != NULL;
+	     i = (i + 1) & index->mask) {
+		const struct name_index_bucket *b = &index->buckets[i];
+		if (b->hash == hash && b->length == length &&
+		    memcmp(b->name, name, length) == 0)
+			return b->item;
+	}
+
+	return NULL;
+}
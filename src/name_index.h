@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * An open-addressing hash table which maps names to objects.  The
+ * names are not copied; they must be owned by the objects and stay
+ * unchanged while the object is in the index.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct name_index_bucket {
+	uint32_t hash;
+	uint32_t length;
+	const char *name;
+
+	/** the object; NULL if this bucket is empty */
+	void *item;
+};
+
+struct name_index {
+	/** the bucket array; NULL until the first insertion */
+	struct name_index_bucket *buckets;
+
+	/** number of buckets minus one */
+	size_t mask;
+
+	/** number of occupied buckets */
+	size_t count;
+};
+
+static inline void
+name_index_init(struct name_index *index)
+{
+	index->buckets = NULL;
+	index->mask = 0;
+	index->count = 0;
+}
+
+void
+name_index_deinit(struct name_index *index);
+
+static inline bool
+name_index_is_enabled(const struct name_index *index)
+{
+	return index->buckets != NULL;
+}
+
+/**
+ * Adds an object.  If another object with the same name exists
+ * already, both are in the index, and lookups may return either.
+ */
+void
+name_index_insert(struct name_index *index, const char *name, void *item);
+
+/**
+ * Removes an object which was added with name_index_insert().  Does
+ * nothing if it is not in the index.
+ */
+void
+name_index_remove(struct name_index *index, const char *name,
+		  const void *item);
+
+/**
+ * Looks up an object by its name, which does not need to be null
+ * terminated.
+ *
+ * @return the object or NULL
+ */
+void *
+name_index_lookup(const struct name_index *index,
+		  const char *name, size_t length);
@@ -24,6 +24,7 @@
 #include "httpd.h"
 #include "httpd_internal.h"
 #include "httpd_client.h"
+#include "httpd_sender.h"
 #include "output_api.h"
 #include "encoder_plugin.h"
 #include "encoder_list.h"
@@ -149,6 +150,10 @@ httpd_output_init(const struct config_param *param)
 	httpd->metadata = NULL;
 	httpd->unflushed_input = 0;
 
+	httpd->ring_tail = httpd->ring_head = 0;
+	httpd->ring_size = 0;
+	httpd->sender_running = false;
+
 	/* initialize encoder */
 
 	httpd->encoder = encoder_init(encoder_plugin, param);
@@ -256,6 +261,55 @@ httpd_listen_in_event(int fd, const struct sockaddr *address,
 	g_mutex_unlock(httpd->mutex);
 }
 
+/**
+ * Removes the oldest page from the ring.
+ *
+ * Caller must lock the mutex.
+ */
+static void
+httpd_output_ring_shift(struct httpd_output *httpd)
+{
+	assert(httpd->ring_tail < httpd->ring_head);
+
+	struct page *page = httpd->ring[httpd->ring_tail % HTTPD_RING_PAGES];
+	httpd->ring_size -= page->size;
+	++httpd->ring_tail;
+	page_unref(page);
+}
+
+/**
+ * Removes all pages from the ring.
+ *
+ * Caller must lock the mutex.
+ */
+static void
+httpd_output_ring_clear(struct httpd_output *httpd)
+{
+	while (httpd->ring_tail < httpd->ring_head)
+		httpd_output_ring_shift(httpd);
+}
+
+/**
+ * Appends a page to the ring, dropping the oldest pages if it is
+ * full.  Clients which have not sent those yet skip to the newest
+ * page, see httpd_client_write().
+ *
+ * Caller must lock the mutex.
+ */
+static void
+httpd_output_ring_push(struct httpd_output *httpd, struct page *page)
+{
+	while (httpd->ring_head - httpd->ring_tail >= HTTPD_RING_PAGES ||
+	       (httpd->ring_tail < httpd->ring_head &&
+		httpd->ring_size + page->size > HTTPD_RING_BYTES))
+		httpd_output_ring_shift(httpd);
+
+	page_ref(page);
+	httpd->ring[httpd->ring_head % HTTPD_RING_PAGES] = page;
+	httpd->ring_size += page->size;
+	++httpd->ring_head;
+}
+
 /**
  * Reads data from the encoder (as much as available) and returns it
  * as a new #page object.
@@ -343,6 +397,18 @@ httpd_output_open(struct audio_output *ao, struct audio_format *audio_format)
 
 	httpd->clients = NULL;
 	httpd->clients_cnt = 0;
+	httpd->ring_tail = httpd->ring_head = 0;
+	httpd->ring_size = 0;
+
+	ret = httpd_sender_start(httpd);
+	if (ret != MPD_SUCCESS) {
+		if (httpd->header != NULL)
+			page_unref(httpd->header);
+		encoder_close(httpd->encoder);
+		g_mutex_unlock(httpd->mutex);
+		return ret;
+	}
+
 	httpd->timer = timer_new(audio_format);
 
 	httpd->open = true;
@@ -372,6 +438,16 @@ httpd_output_close(struct audio_output *ao)
 
 	g_list_foreach(httpd->clients, httpd_client_delete, NULL);
 	g_list_free(httpd->clients);
+	httpd->clients = NULL;
+
+	g_mutex_unlock(httpd->mutex);
+
+	/* this frees the clients the sender thread was looking at */
+	httpd_sender_stop(httpd);
+
+	g_mutex_lock(httpd->mutex);
+
+	httpd_output_ring_clear(httpd);
 
 	if (httpd->header != NULL)
 		page_unref(httpd->header);
@@ -392,14 +468,6 @@ httpd_output_remove_client(struct httpd_output *httpd,
 	httpd->clients_cnt--;
 }
 
-void
-httpd_output_send_header(struct httpd_output *httpd,
-			 struct httpd_client *client)
-{
-	if (httpd->header != NULL)
-		httpd_client_send(client, httpd->header);
-}
-
 static unsigned
 httpd_output_delay(struct audio_output *ao)
 {
@@ -423,28 +491,9 @@ httpd_output_delay(struct audio_output *ao)
 		: 0;
 }
 
-static void
-httpd_client_check_queue(gpointer data, gpointer user_data)
-{
-	struct httpd_client *client = data;
-
-	if (httpd_client_queue_size(client) > 256 * 1024) {
-		log_debug("client is too slow, flushing its queue");
-		httpd_client_cancel(client);
-	}
-}
-
-static void
-httpd_client_send_page(gpointer data, gpointer user_data)
-{
-	struct httpd_client *client = data;
-	struct page *page = user_data;
-
-	httpd_client_send(client, page);
-}
-
 /**
- * Broadcasts a page struct to all clients.
+ * Broadcasts a page struct to all clients: it is appended to the
+ * ring, and the sender thread writes it to each client.
  */
 static void
 httpd_output_broadcast_page(struct httpd_output *httpd, struct page *page)
@@ -452,7 +501,8 @@ httpd_output_broadcast_page(struct httpd_output *httpd, struct page *page)
 	assert(page != NULL);
 
 	g_mutex_lock(httpd->mutex);
-	g_list_foreach(httpd->clients, httpd_client_send_page, page);
+	httpd_output_ring_push(httpd, page);
+	httpd_sender_wake(httpd);
 	g_mutex_unlock(httpd->mutex);
 }
 
@@ -464,10 +514,6 @@ httpd_output_encoder_to_clients(struct httpd_output *httpd)
 {
 	struct page *page;
 
-	g_mutex_lock(httpd->mutex);
-	g_list_foreach(httpd->clients, httpd_client_check_queue, NULL);
-	g_mutex_unlock(httpd->mutex);
-
 	while ((page = httpd_output_read_page(httpd)) != NULL) {
 		httpd_output_broadcast_page(httpd, page);
 		page_unref(page);
@@ -554,9 +600,14 @@ httpd_output_tag(struct audio_output *ao, const struct tag *tag)
 
 		struct page *page = httpd_output_read_page(httpd);
 		if (page != NULL) {
+			/* clients pick up the header in the main
+			   thread */
+			g_mutex_lock(httpd->mutex);
 			if (httpd->header != NULL)
 				page_unref(httpd->header);
 			httpd->header = page;
+			g_mutex_unlock(httpd->mutex);
+
 			httpd_output_broadcast_page(httpd, page);
 		}
 	} else {
@@ -592,6 +643,7 @@ httpd_output_cancel(struct audio_output *ao)
 	struct httpd_output *httpd = (struct httpd_output *)ao;
 
 	g_mutex_lock(httpd->mutex);
+	httpd_output_ring_clear(httpd);
 	g_list_foreach(httpd->clients, httpd_client_cancel_callback, NULL);
 	g_mutex_unlock(httpd->mutex);
 }
@@ -21,6 +21,7 @@
 #include "log.h"
 #include "httpd_client.h"
 #include "httpd_internal.h"
+#include "httpd_sender.h"
 #include "fifo_buffer.h"
 #include "page.h"
 #include "icy_server.h"
@@ -29,10 +30,19 @@
 #include <stdbool.h>
 #include <assert.h>
 #include <string.h>
+#include <errno.h>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "httpd_output"
 
+enum {
+	/** the maximum number of buffers passed to one writev() call */
+	HTTPD_CLIENT_IOV_MAX = 32,
+};
+
 struct httpd_client {
 	/**
 	 * The httpd output object this client is connected to.
@@ -44,6 +54,12 @@ struct httpd_client {
 	 */
 	GIOChannel *channel;
 
+	/**
+	 * The file descriptor of #channel, which is written to
+	 * directly by the sender thread.
+	 */
+	int fd;
+
 	/**
 	 * The GLib main loop source id for reading from the socket,
 	 * and to detect errors.
@@ -51,11 +67,22 @@ struct httpd_client {
 	guint read_source_id;
 
 	/**
-	 * The GLib main loop source id for writing to the socket.  If
-	 * 0, then there is no event source currently (because there
-	 * are no queued pages).
+	 * Has this client been passed to httpd_sender_add()?
+	 */
+	bool attached;
+
+	/**
+	 * Did the last write fail with EAGAIN?  The sender thread
+	 * does not write to this client until the socket becomes
+	 * writable again.
+	 */
+	bool blocked;
+
+	/**
+	 * Did a write fail?  The client is closed by the main loop,
+	 * which notices the shut down socket.
 	 */
-	guint write_source_id;
+	bool failed;
 
 	/**
 	 * For buffered reading.  This pointer is only valid while the
@@ -78,20 +105,33 @@ struct httpd_client {
 	} state;
 
 	/**
-	 * A queue of #page objects to be sent to the client.
+	 * The encoder header, which is sent before the first page
+	 * from the ring.  NULL after it has been sent.
 	 */
-	GQueue *pages;
+	struct page *header;
 
 	/**
-	 * The #page which is currently being sent to the client.
+	 * The amount of bytes which were already sent from #header.
 	 */
-	struct page *current_page;
+	size_t header_position;
+
+	/**
+	 * The number of the next page from httpd_output.ring to be
+	 * sent to the client.
+	 */
+	uint64_t next_page;
 
 	/**
 	 * The amount of bytes which were already sent from
-	 * #current_page.
+	 * #next_page.
 	 */
-	size_t current_position;
+	size_t position;
+
+	/**
+	 * A reference to #next_page while it is partially sent, so
+	 * that the ring may drop it meanwhile.
+	 */
+	struct page *current_page;
 
         /**
          * If DLNA streaming was an option.
@@ -122,12 +162,20 @@ struct httpd_client {
 	guint metaint;
 
 	/**
-	 * The metadata as #page which is currently being sent to the client.
+	 * The most recent metadata as #page.
 	 */
 	struct page *metadata;
 
+	/**
+	 * The metadata block which is currently being sent to the
+	 * client; NULL if it is the empty block or if no block is
+	 * being sent.
+	 */
+	struct page *metadata_block;
+
 	/*
-	 * The amount of bytes which were already sent from the metadata.
+	 * The amount of bytes which were already sent from the
+	 * metadata block.
 	 */
 	size_t metadata_current_position;
 
@@ -138,13 +186,11 @@ struct httpd_client {
 	guint metadata_fill;
 };
 
-static void
-httpd_client_unref_page(gpointer data, gpointer user_data)
-{
-	struct page *page = data;
-
-	page_unref(page);
-}
+/**
+ * The metadata block which is sent when the metadata has not
+ * changed: a single zero length byte.
+ */
+static unsigned char icy_empty_block[1];
 
 void
 httpd_client_free(struct httpd_client *client)
@@ -152,14 +198,14 @@ httpd_client_free(struct httpd_client *client)
 	assert(client != NULL);
 
 	if (client->state == RESPONSE) {
-		if (client->write_source_id != 0)
-			g_source_remove(client->write_source_id);
+		if (client->header != NULL)
+			page_unref(client->header);
 
 		if (client->current_page != NULL)
 			page_unref(client->current_page);
 
-		g_queue_foreach(client->pages, httpd_client_unref_page, NULL);
-		g_queue_free(client->pages);
+		if (client->metadata_block != NULL)
+			page_unref(client->metadata_block);
 	} else
 		fifo_buffer_free(client->input);
 
@@ -167,8 +213,18 @@ httpd_client_free(struct httpd_client *client)
 		page_unref (client->metadata);
 
 	g_source_remove(client->read_source_id);
+
+	if (client->attached && !client->failed)
+		httpd_sender_remove(client->httpd, client->fd);
+
 	g_io_channel_unref(client->channel);
-	g_free(client);
+
+	if (client->attached) {
+		/* the sender thread may still look at it */
+		client->failed = true;
+		httpd_sender_dispose(client->httpd, client);
+	} else
+		g_free(client);
 }
 
 /**
@@ -192,12 +248,34 @@ httpd_client_begin_response(struct httpd_client *client)
 	assert(client != NULL);
 	assert(client->state != RESPONSE);
 
+	struct httpd_output *httpd = client->httpd;
+
 	client->state = RESPONSE;
-	client->write_source_id = 0;
-	client->pages = g_queue_new();
+
+	client->header = httpd->header;
+	if (client->header != NULL)
+		page_ref(client->header);
+	client->header_position = 0;
+
+	/* start with the next page the encoder produces */
+	client->next_page = httpd->ring_head;
+	client->position = 0;
 	client->current_page = NULL;
+	client->metadata_block = NULL;
+}
 
-	httpd_output_send_header(client->httpd, client);
+/**
+ * Hands the client over to the sender thread, after the response
+ * headers have been sent.
+ */
+static void
+httpd_client_attach(struct httpd_client *client)
+{
+	assert(client->state == RESPONSE);
+	assert(!client->attached);
+
+	client->attached = true;
+	httpd_sender_add(client->httpd, client, client->fd);
 }
 
 /**
@@ -345,6 +423,7 @@ httpd_client_send_response(struct httpd_client *client)
 	switch (status) {
 	case G_IO_STATUS_NORMAL:
 	case G_IO_STATUS_AGAIN:
+		httpd_client_attach(client);
 		return true;
 
 	case G_IO_STATUS_EOF:
@@ -490,6 +569,10 @@ httpd_client_new(struct httpd_output *httpd, int fd, bool metadata_supported)
 	client->httpd = httpd;
 
 	client->channel = g_io_channel_new_socket(fd);
+	client->fd = fd;
+	client->attached = false;
+	client->blocked = false;
+	client->failed = false;
 
 	/* GLib is responsible for closing the file descriptor */
 	g_io_channel_set_close_on_unref(client->channel, true);
@@ -517,236 +600,281 @@ httpd_client_new(struct httpd_output *httpd, int fd, bool metadata_supported)
 	return client;
 }
 
-static void
-httpd_client_add_page_size(gpointer data, gpointer user_data)
-{
-	struct page *page = data;
-	size_t *size = user_data;
-
-	*size += page->size;
-}
-
-size_t
-httpd_client_queue_size(const struct httpd_client *client)
-{
-	size_t size = 0;
-
-	if (client->state != RESPONSE)
-		return 0;
-
-	g_queue_foreach(client->pages, httpd_client_add_page_size, &size);
-	return size;
-}
-
 void
 httpd_client_cancel(struct httpd_client *client)
 {
 	if (client->state != RESPONSE)
 		return;
 
-	g_queue_foreach(client->pages, httpd_client_unref_page, NULL);
-	g_queue_clear(client->pages);
-
-	if (client->write_source_id != 0 && client->current_page == NULL) {
-		g_source_remove(client->write_source_id);
-		client->write_source_id = 0;
-	}
+	/* skip the pages which are already in the ring; the page
+	   which is partially sent is completed */
+	if (client->current_page == NULL)
+		client->next_page = client->httpd->ring_head;
 }
 
-static GIOStatus
-write_page_to_channel(GIOChannel *channel,
-		      const struct page *page, size_t position,
-		      gsize *bytes_written_r, GError **error)
-{
-	assert(channel != NULL);
-	assert(page != NULL);
-	assert(position < page->size);
-
-	return g_io_channel_write_chars(channel,
-					(const gchar*)page->data + position,
-					page->size - position,
-					bytes_written_r, error);
-}
+/**
+ * The buffers of one writev() call, and what they refer to.
+ */
+struct httpd_client_iov {
+	struct iovec iov[HTTPD_CLIENT_IOV_MAX];
 
-static GIOStatus
-write_n_bytes_to_channel(GIOChannel *channel, const struct page *page,
-			 size_t position, gint n,
-			 gsize *bytes_written_r, GError **error)
-{
-	GIOStatus status;
+	enum {
+		SEGMENT_HEADER,
+		SEGMENT_METADATA,
+		SEGMENT_DATA,
+	} kind[HTTPD_CLIENT_IOV_MAX];
 
-	assert(channel != NULL);
-	assert(page != NULL);
-	assert(position < page->size);
+	/**
+	 * The page of each buffer; NULL for the empty metadata
+	 * block.
+	 */
+	struct page *page[HTTPD_CLIENT_IOV_MAX];
 
-	if (n == -1) {
-		status =  write_page_to_channel (channel, page, position,
-						 bytes_written_r, error);
-	} else {
-		status = g_io_channel_write_chars(channel,
-						  (const gchar*)page->data + position,
-						  n, bytes_written_r, error);
-	}
+	unsigned n;
 
-	return status;
-}
+	/** the total size of all buffers */
+	size_t size;
+};
 
-static gint
-bytes_left_till_metadata (struct httpd_client *client)
+static void
+httpd_client_iov_add(struct httpd_client_iov *v, int kind,
+		     struct page *page, unsigned char *data, size_t length)
 {
-	assert(client != NULL);
-
-	if (client->metadata_requested &&
-	    client->current_page->size - client->current_position
-	    > client->metaint - client->metadata_fill)
-		return client->metaint - client->metadata_fill;
-
-	return -1;
+	assert(v->n < HTTPD_CLIENT_IOV_MAX);
+	assert(length > 0);
+
+	v->iov[v->n].iov_base = data;
+	v->iov[v->n].iov_len = length;
+	v->kind[v->n] = kind;
+	v->page[v->n] = page;
+	++v->n;
+	v->size += length;
 }
 
-static gboolean
-httpd_client_out_event(GIOChannel *source,
-		       GIOCondition condition, gpointer data)
+/**
+ * Collects the data which is ready to be sent: the rest of the
+ * header, and the pages from the ring with the ICY metadata blocks
+ * in between.  Does not modify the client, see
+ * httpd_client_consume().
+ *
+ * Caller must lock the mutex.
+ */
+static void
+httpd_client_fill_iov(const struct httpd_client *client,
+		      struct httpd_client_iov *v)
 {
-	struct httpd_client *client = data;
-	struct httpd_output *httpd = client->httpd;
-	GError *error = NULL;
-	GIOStatus status;
-	gsize bytes_written;
-	gint bytes_to_write;
+	v->n = 0;
+	v->size = 0;
+
+	if (client->header != NULL)
+		httpd_client_iov_add(v, SEGMENT_HEADER, client->header,
+				     client->header->data +
+				     client->header_position,
+				     client->header->size -
+				     client->header_position);
+
+	uint64_t n = client->next_page;
+	size_t position = client->position;
+	guint fill = client->metadata_fill;
+	size_t metadata_position = client->metadata_current_position;
+	struct page *page = client->current_page != NULL
+		? client->current_page
+		: httpd_output_ring_page(client->httpd, n);
+
+	while (page != NULL && v->n < HTTPD_CLIENT_IOV_MAX) {
+		if (client->metadata_requested && fill >= client->metaint) {
+			struct page *block = metadata_position > 0
+				? client->metadata_block
+				: (!client->metadata_sent
+				   ? client->metadata : NULL);
+
+			if (block != NULL)
+				httpd_client_iov_add(v, SEGMENT_METADATA, block,
+						     block->data +
+						     metadata_position,
+						     block->size -
+						     metadata_position);
+			else
+				httpd_client_iov_add(v, SEGMENT_METADATA, NULL,
+						     icy_empty_block,
+						     sizeof(icy_empty_block));
+
+			fill = 0;
+			metadata_position = 0;
+			continue;
+		}
 
-	g_mutex_lock(httpd->mutex);
+		size_t length = page->size - position;
+		if (client->metadata_requested &&
+		    length > client->metaint - fill)
+			length = client->metaint - fill;
 
-	assert(condition == G_IO_OUT);
-	assert(client->state == RESPONSE);
+		httpd_client_iov_add(v, SEGMENT_DATA, page,
+				     page->data + position, length);
 
-	if (client->write_source_id == 0) {
-		/* another thread has removed the event source while
-		   this thread was waiting for httpd->mutex */
-		g_mutex_unlock(httpd->mutex);
-		return false;
-	}
-
-	if (client->current_page == NULL) {
-		client->current_page = g_queue_pop_head(client->pages);
-		client->current_position = 0;
+		fill += length;
+		position += length;
+		if (position == page->size) {
+			position = 0;
+			page = httpd_output_ring_page(client->httpd, ++n);
+		}
 	}
+}
 
-	bytes_to_write = bytes_left_till_metadata(client);
-
-	if (bytes_to_write == 0) {
-		gint metadata_to_write;
+/**
+ * Advances the client's cursors after writev() has sent the
+ * specified number of bytes from the buffers collected by
+ * httpd_client_fill_iov().
+ */
+static void
+httpd_client_consume(struct httpd_client *client,
+		     const struct httpd_client_iov *v, size_t nbytes)
+{
+	for (unsigned i = 0; i < v->n && nbytes > 0; ++i) {
+		struct page *page = v->page[i];
+		size_t length = v->iov[i].iov_len;
+		if (length > nbytes)
+			length = nbytes;
+		nbytes -= length;
+
+		switch (v->kind[i]) {
+		case SEGMENT_HEADER:
+			client->header_position += length;
+			if (client->header_position == page->size) {
+				page_unref(page);
+				client->header = NULL;
+			}
 
-		metadata_to_write = client->metadata_current_position;
+			break;
 
-		if (!client->metadata_sent) {
-			status = write_page_to_channel(source,
-						       client->metadata,
-						       metadata_to_write,
-						       &bytes_written, &error);
+		case SEGMENT_METADATA:
+			if (client->metadata_current_position == 0 &&
+			    page != NULL) {
+				/* keep this block even if new metadata
+				   arrives before it is complete */
+				page_ref(page);
+				client->metadata_block = page;
+				client->metadata_sent = true;
+			}
 
-			client->metadata_current_position += bytes_written;
+			client->metadata_current_position += length;
+			if (client->metadata_current_position ==
+			    (page != NULL
+			     ? page->size : sizeof(icy_empty_block))) {
+				if (client->metadata_block != NULL) {
+					page_unref(client->metadata_block);
+					client->metadata_block = NULL;
+				}
 
-			if (client->metadata->size
-			    - client->metadata_current_position == 0) {
-				client->metadata_fill = 0;
 				client->metadata_current_position = 0;
-				client->metadata_sent = true;
+				client->metadata_fill = 0;
 			}
-		} else {
-			struct page *empty_meta;
-			guchar empty_data = 0;
 
-			empty_meta = page_new_copy(&empty_data, 1);
+			break;
 
-			status = write_page_to_channel(source,
-						       empty_meta,
-						       metadata_to_write,
-						       &bytes_written, &error);
+		case SEGMENT_DATA:
+			client->position += length;
+			if (client->metadata_requested)
+				client->metadata_fill += length;
 
-			client->metadata_current_position += bytes_written;
+			if (client->position == page->size) {
+				if (client->current_page != NULL) {
+					page_unref(client->current_page);
+					client->current_page = NULL;
+				}
 
-			if (empty_meta->size
-			    - client->metadata_current_position == 0) {
-				client->metadata_fill = 0;
-				client->metadata_current_position = 0;
+				client->position = 0;
+				++client->next_page;
+			} else if (client->current_page == NULL) {
+				page_ref(page);
+				client->current_page = page;
 			}
-		}
 
-		bytes_written = 0;
-	} else {
-		status = write_n_bytes_to_channel(source, client->current_page,
-						  client->current_position, bytes_to_write,
-						  &bytes_written, &error);
+			break;
+		}
 	}
+}
 
-	switch (status) {
-	case G_IO_STATUS_NORMAL:
-		client->current_position += bytes_written;
-		assert(client->current_position <= client->current_page->size);
+/**
+ * Stops writing to the client after an error.  The main loop sees
+ * the socket being shut down and closes the client.
+ */
+static void
+httpd_client_fail(struct httpd_client *client)
+{
+	client->failed = true;
+	httpd_sender_remove(client->httpd, client->fd);
+	shutdown(client->fd, SHUT_RDWR);
+}
 
-		if (client->metadata_requested)
-			client->metadata_fill += bytes_written;
+void
+httpd_client_write(struct httpd_client *client)
+{
+	struct httpd_output *httpd = client->httpd;
+	struct httpd_client_iov v;
 
-		if (client->current_position >= client->current_page->size) {
-			page_unref(client->current_page);
-			client->current_page = NULL;
+	if (!client->attached || client->blocked || client->failed)
+		return;
 
-			if (g_queue_is_empty(client->pages)) {
-				/* all pages are sent: remove the
-				   event source */
-				client->write_source_id = 0;
+	while (true) {
+		if (client->current_page == NULL &&
+		    client->next_page < httpd->ring_tail) {
+			log_debug("client is too slow, skipping %u pages",
+				  (unsigned)(httpd->ring_head -
+					     client->next_page));
+			client->next_page = httpd->ring_head;
+		}
 
-				g_mutex_unlock(httpd->mutex);
-				return false;
+		httpd_client_fill_iov(client, &v);
+		if (v.n == 0)
+			return;
+
+		ssize_t nbytes = writev(client->fd, v.iov, v.n);
+		if (nbytes < 0) {
+			switch (errno) {
+			case EINTR:
+				continue;
+
+			case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+			case EWOULDBLOCK:
+#endif
+				/* wait for the sender thread to
+				   report the socket as writable */
+				client->blocked = true;
+				return;
+
+			case EPIPE:
+			case ECONNRESET:
+				/* client has disconnected */
+				httpd_client_fail(client);
+				return;
+
+			default:
+				log_warning("failed to write to client: %s",
+					    g_strerror(errno));
+				httpd_client_fail(client);
+				return;
 			}
 		}
 
-		g_mutex_unlock(httpd->mutex);
-		return true;
-
-	case G_IO_STATUS_AGAIN:
-		g_mutex_unlock(httpd->mutex);
-		return true;
-
-	case G_IO_STATUS_EOF:
-		/* client has disconnected */
-
-		httpd_client_close(client);
-		g_mutex_unlock(httpd->mutex);
-		return false;
-
-	case G_IO_STATUS_ERROR:
-		/* I/O error */
-
-		log_warning("failed to write to client: %s", error->message);
-		g_error_free(error);
-
-		httpd_client_close(client);
-		g_mutex_unlock(httpd->mutex);
-		return false;
+		httpd_client_consume(client, &v, (size_t)nbytes);
 	}
-
-	/* unreachable */
-	httpd_client_close(client);
-	g_mutex_unlock(httpd->mutex);
-	return false;
 }
 
 void
-httpd_client_send(struct httpd_client *client, struct page *page)
+httpd_client_writable(struct httpd_client *client)
 {
-	if (client->state != RESPONSE)
-		/* the client is still writing the HTTP request */
-		return;
-
-	page_ref(page);
-	g_queue_push_tail(client->pages, page);
+	client->blocked = false;
+	httpd_client_write(client);
+}
 
-	if (client->write_source_id == 0)
-		client->write_source_id =
-			g_io_add_watch(client->channel, G_IO_OUT,
-				       httpd_client_out_event, client);
+int
+httpd_client_blocked_fd(const struct httpd_client *client)
+{
+	return client->attached && client->blocked && !client->failed
+		? client->fd
+		: -1;
 }
 
 void
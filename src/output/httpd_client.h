@@ -45,22 +45,31 @@ void
 httpd_client_free(struct httpd_client *client);
 
 /**
- * Returns the total size of this client's page queue.
+ * Skips the pages which are currently in the ring.
  */
-size_t
-httpd_client_queue_size(const struct httpd_client *client);
+void
+httpd_client_cancel(struct httpd_client *client);
 
 /**
- * Clears the page queue.
+ * Writes as much pending data to the socket as it accepts.  This is
+ * called by the sender thread with the mutex locked.
  */
 void
-httpd_client_cancel(struct httpd_client *client);
+httpd_client_write(struct httpd_client *client);
 
 /**
- * Appends a page to the client's queue.
+ * The sender thread has noticed that the socket has become writable
+ * again.
  */
 void
-httpd_client_send(struct httpd_client *client, struct page *page);
+httpd_client_writable(struct httpd_client *client);
+
+/**
+ * Returns the socket if the client waits for it to become writable,
+ * or -1.  Used by the sender thread on systems without epoll.
+ */
+int
+httpd_client_blocked_fd(const struct httpd_client *client);
 
 /**
  * Sends the passed metadata.
@@ -27,13 +27,26 @@
 
 #include "output_internal.h"
 #include "timer.h"
+#include "c11thread.h"
 
 #include <glib.h>
 
 #include <stdbool.h>
+#include <stdint.h>
 
 struct httpd_client;
 
+enum {
+	/** the maximum number of pages in httpd_output.ring */
+	HTTPD_RING_PAGES = 512,
+
+	/**
+	 * The maximum number of bytes in httpd_output.ring.  A client
+	 * which falls further behind skips to the newest data.
+	 */
+	HTTPD_RING_BYTES = 256 * 1024,
+};
+
 struct httpd_output {
 	struct audio_output base;
 
@@ -62,8 +75,8 @@ struct httpd_output {
 	const char *content_type;
 
 	/**
-	 * This mutex protects the listener socket and the client
-	 * list.
+	 * This mutex protects the listener socket, the client list
+	 * and the page ring.
 	 */
 	GMutex *mutex;
 
@@ -107,6 +120,50 @@ struct httpd_output {
 	 */
 	GList *clients;
 
+	/**
+	 * The encoded pages which are shared by all clients.  Page
+	 * number n is stored in ring[n % HTTPD_RING_PAGES]; each
+	 * client only keeps the number of the next page it sends.
+	 */
+	struct page *ring[HTTPD_RING_PAGES];
+
+	/**
+	 * The number of the oldest page in the ring, and the number
+	 * the next page will get.
+	 */
+	uint64_t ring_tail, ring_head;
+
+	/**
+	 * The total size of all pages in the ring.
+	 */
+	size_t ring_size;
+
+	/**
+	 * The thread which writes the ring to the clients, see
+	 * httpd_sender.c.
+	 */
+	thrd_t sender;
+
+	bool sender_running, sender_quit;
+
+	/**
+	 * The epoll descriptor of the sender thread; -1 on systems
+	 * without epoll.
+	 */
+	int sender_fd;
+
+	/**
+	 * A pipe which wakes up the sender thread.
+	 */
+	int sender_wake[2];
+
+	/**
+	 * Clients which have been freed while the sender thread may
+	 * still hold a pointer to them; the sender thread disposes of
+	 * them.
+	 */
+	GSList *sender_garbage;
+
 	/**
 	 * A temporary buffer for the httpd_output_read_page()
 	 * function.
@@ -128,11 +185,18 @@ httpd_output_remove_client(struct httpd_output *httpd,
 			   struct httpd_client *client);
 
 /**
- * Sends the encoder header to the client.  This is called right after
- * the response headers have been sent.
+ * Returns the page with the specified number from the ring, or NULL
+ * if it has not been encoded yet or was already dropped.
+ *
+ * Caller must lock the mutex.
  */
-void
-httpd_output_send_header(struct httpd_output *httpd,
-			 struct httpd_client *client);
+static inline struct page *
+httpd_output_ring_page(const struct httpd_output *httpd, uint64_t n)
+{
+	if (n < httpd->ring_tail || n >= httpd->ring_head)
+		return NULL;
+
+	return httpd->ring[n % HTTPD_RING_PAGES];
+}
 
 #endif
@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define LOG_DOMAIN "output: httpd"
+
+#include "log.h"
+#include "config.h"
+#include "httpd_sender.h"
+#include "httpd_internal.h"
+#include "httpd_client.h"
+#include "fd_util.h"
+#include "err.h"
+
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+enum {
+	/** the maximum number of events per epoll_wait() call */
+	HTTPD_SENDER_MAX_EVENTS = 256,
+};
+
+static void
+httpd_sender_drain_wake(struct httpd_output *httpd)
+{
+	char buffer[256];
+
+	while (read(httpd->sender_wake[0], buffer, sizeof(buffer)) > 0) {
+	}
+}
+
+static void
+httpd_sender_write_callback(gpointer data, gpointer user_data)
+{
+	struct httpd_client *client = data;
+
+	httpd_client_write(client);
+}
+
+static void
+httpd_sender_free_callback(gpointer data, gpointer user_data)
+{
+	g_free(data);
+}
+
+static void
+httpd_sender_free_garbage(struct httpd_output *httpd)
+{
+	g_slist_foreach(httpd->sender_garbage, httpd_sender_free_callback,
+			NULL);
+	g_slist_free(httpd->sender_garbage);
+	httpd->sender_garbage = NULL;
+}
+
+#ifdef __linux__
+
+static int
+httpd_sender_open(struct httpd_output *httpd)
+{
+	httpd->sender_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (httpd->sender_fd < 0) {
+		log_err("epoll_create1() failed: %s", strerror(errno));
+		return -MPD_UNKNOWN;
+	}
+
+	/* the wake pipe is registered with a NULL pointer */
+	struct epoll_event event = {
+		.events = EPOLLIN,
+		.data.ptr = NULL,
+	};
+
+	if (epoll_ctl(httpd->sender_fd, EPOLL_CTL_ADD,
+		      httpd->sender_wake[0], &event) < 0) {
+		log_err("epoll_ctl() failed: %s", strerror(errno));
+		close(httpd->sender_fd);
+		return -MPD_UNKNOWN;
+	}
+
+	return MPD_SUCCESS;
+}
+
+static void
+httpd_sender_close(struct httpd_output *httpd)
+{
+	close(httpd->sender_fd);
+}
+
+void
+httpd_sender_add(struct httpd_output *httpd, struct httpd_client *client,
+		 int fd)
+{
+	/* edge-triggered: an event is only reported after a write
+	   has failed with EAGAIN and the socket becomes writable
+	   again */
+	struct epoll_event event = {
+		.events = EPOLLOUT | EPOLLET,
+		.data.ptr = client,
+	};
+
+	if (epoll_ctl(httpd->sender_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+		log_warning("epoll_ctl() failed: %s", strerror(errno));
+}
+
+void
+httpd_sender_remove(struct httpd_output *httpd, int fd)
+{
+	epoll_ctl(httpd->sender_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+/**
+ * Waits for the wake pipe or for blocked clients to become writable,
+ * and continues writing to those clients.  Caller must lock the
+ * mutex; it is released while waiting.
+ *
+ * @return true if the sender was woken up through the pipe
+ */
+static bool
+httpd_sender_wait(struct httpd_output *httpd)
+{
+	struct epoll_event events[HTTPD_SENDER_MAX_EVENTS];
+	bool woken = false;
+
+	g_mutex_unlock(httpd->mutex);
+	int n = epoll_wait(httpd->sender_fd, events, G_N_ELEMENTS(events), -1);
+	g_mutex_lock(httpd->mutex);
+
+	if (n < 0 && errno != EINTR)
+		log_warning("epoll_wait() failed: %s", strerror(errno));
+
+	/* clients which were removed meanwhile are still allocated
+	   (see httpd_sender_dispose()), and ignore the event */
+	for (int i = 0; i < n; ++i) {
+		struct httpd_client *client = events[i].data.ptr;
+
+		if (client == NULL) {
+			httpd_sender_drain_wake(httpd);
+			woken = true;
+		} else
+			httpd_client_writable(client);
+	}
+
+	return woken;
+}
+
+#else
+
+static int
+httpd_sender_open(struct httpd_output *httpd)
+{
+	httpd->sender_fd = -1;
+	return MPD_SUCCESS;
+}
+
+static void
+httpd_sender_close(struct httpd_output *httpd)
+{
+}
+
+void
+httpd_sender_add(struct httpd_output *httpd, struct httpd_client *client,
+		 int fd)
+{
+	(void)client;
+	(void)fd;
+
+	/* the client list is scanned by httpd_sender_wait() */
+	httpd_sender_wake(httpd);
+}
+
+void
+httpd_sender_remove(struct httpd_output *httpd, int fd)
+{
+}
+
+static bool
+httpd_sender_wait(struct httpd_output *httpd)
+{
+	unsigned max = httpd->clients_cnt + 1;
+	struct pollfd *fds = g_new(struct pollfd, max);
+	struct httpd_client **clients = g_new(struct httpd_client *, max);
+	unsigned n = 0;
+	bool woken = false;
+
+	fds[n].fd = httpd->sender_wake[0];
+	fds[n].events = POLLIN;
+	clients[n++] = NULL;
+
+	for (GList *i = httpd->clients; i != NULL && n < max; i = i->next) {
+		int fd = httpd_client_blocked_fd(i->data);
+		if (fd >= 0) {
+			fds[n].fd = fd;
+			fds[n].events = POLLOUT;
+			clients[n++] = i->data;
+		}
+	}
+
+	g_mutex_unlock(httpd->mutex);
+	int ret = poll(fds, n, -1);
+	g_mutex_lock(httpd->mutex);
+
+	if (ret < 0 && errno != EINTR)
+		log_warning("poll() failed: %s", strerror(errno));
+
+	for (unsigned i = 0; ret > 0 && i < n; ++i) {
+		if (fds[i].revents == 0)
+			continue;
+
+		if (clients[i] == NULL) {
+			httpd_sender_drain_wake(httpd);
+			woken = true;
+		} else
+			httpd_client_writable(clients[i]);
+	}
+
+	g_free(clients);
+	g_free(fds);
+	return woken;
+}
+
+#endif
+
+static int
+httpd_sender_thread(void *arg)
+{
+	struct httpd_output *httpd = arg;
+
+	g_mutex_lock(httpd->mutex);
+
+	while (!httpd->sender_quit) {
+		if (httpd_sender_wait(httpd))
+			/* new pages in the ring: write them to all
+			   clients which are not waiting for their
+			   socket anyway */
+			g_list_foreach(httpd->clients,
+				       httpd_sender_write_callback, NULL);
+
+		httpd_sender_free_garbage(httpd);
+	}
+
+	g_mutex_unlock(httpd->mutex);
+	return 0;
+}
+
+int
+httpd_sender_start(struct httpd_output *httpd)
+{
+	assert(!httpd->sender_running);
+
+	if (pipe_cloexec_nonblock(httpd->sender_wake) < 0) {
+		log_err("Failed to create pipe: %s", strerror(errno));
+		return -MPD_UNKNOWN;
+	}
+
+	int ret = httpd_sender_open(httpd);
+	if (ret != MPD_SUCCESS) {
+		close(httpd->sender_wake[0]);
+		close(httpd->sender_wake[1]);
+		return ret;
+	}
+
+	httpd->sender_quit = false;
+	httpd->sender_garbage = NULL;
+
+	if (thrd_create(&httpd->sender, httpd_sender_thread,
+			httpd) != thrd_success) {
+		log_err("Failed to start the httpd sender thread");
+		httpd_sender_close(httpd);
+		close(httpd->sender_wake[0]);
+		close(httpd->sender_wake[1]);
+		return -MPD_UNKNOWN;
+	}
+
+	httpd->sender_running = true;
+	return MPD_SUCCESS;
+}
+
+void
+httpd_sender_stop(struct httpd_output *httpd)
+{
+	if (!httpd->sender_running)
+		return;
+
+	g_mutex_lock(httpd->mutex);
+	httpd->sender_quit = true;
+	httpd_sender_wake(httpd);
+	g_mutex_unlock(httpd->mutex);
+
+	thrd_join(httpd->sender, NULL);
+	httpd->sender_running = false;
+
+	httpd_sender_free_garbage(httpd);
+	httpd_sender_close(httpd);
+	close(httpd->sender_wake[0]);
+	close(httpd->sender_wake[1]);
+}
+
+void
+httpd_sender_wake(struct httpd_output *httpd)
+{
+	static const char dummy = 0;
+
+	/* if the pipe is full, the thread is going to wake up
+	   anyway */
+	if (write(httpd->sender_wake[1], &dummy, 1) < 0 && errno != EAGAIN)
+		log_warning("Failed to wake up the httpd sender: %s",
+			    strerror(errno));
+}
+
+void
+httpd_sender_dispose(struct httpd_output *httpd, struct httpd_client *client)
+{
+	if (httpd->sender_running)
+		httpd->sender_garbage =
+			g_slist_prepend(httpd->sender_garbage, client);
+	else
+		g_free(client);
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * The sender thread of the "httpd" audio output plugin.  It writes
+ * the shared page ring to all clients which have received their
+ * response headers, so the output thread only appends each encoded
+ * page once.
+ */
+
+#ifndef MPD_OUTPUT_HTTPD_SENDER_H
+#define MPD_OUTPUT_HTTPD_SENDER_H
+
+struct httpd_output;
+struct httpd_client;
+
+/**
+ * Starts the sender thread.
+ *
+ * @return MPD_SUCCESS or a negative error code
+ */
+int
+httpd_sender_start(struct httpd_output *httpd);
+
+/**
+ * Stops the sender thread, and frees the clients passed to
+ * httpd_sender_dispose().  Caller must not lock the mutex.
+ */
+void
+httpd_sender_stop(struct httpd_output *httpd);
+
+/**
+ * Wakes up the sender thread after a page was added to the ring.
+ */
+void
+httpd_sender_wake(struct httpd_output *httpd);
+
+/**
+ * Lets the sender thread write to this client, and notify it when
+ * the socket becomes writable.  Caller must lock the mutex.
+ */
+void
+httpd_sender_add(struct httpd_output *httpd, struct httpd_client *client,
+		 int fd);
+
+/**
+ * Undoes httpd_sender_add().  This must be called before the socket
+ * is closed.  Caller must lock the mutex.
+ */
+void
+httpd_sender_remove(struct httpd_output *httpd, int fd);
+
+/**
+ * Frees a client which was removed with httpd_sender_remove().  The
+ * sender thread may still be looking at it, therefore this is
+ * deferred until the thread does not.  Caller must lock the mutex.
+ */
+void
+httpd_sender_dispose(struct httpd_output *httpd, struct httpd_client *client);
+
+#endif
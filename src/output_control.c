@@ -152,7 +152,13 @@ audio_output_open(struct audio_output *ao,
 		       (ao->always_on && ao->pause));
 
 		if (ao->pause) {
-			ao->chunk = NULL;
+			/* the thread is in ao_pause() and does not use
+			   the chunk */
+			if (ao->chunk != NULL) {
+				audio_pipe_release(ao->pipe, ao->chunk);
+				ao->chunk = NULL;
+			}
+
 			ao->pipe = mp;
 
 			/* unpause with the CANCEL command; this is a
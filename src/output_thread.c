@@ -198,14 +198,26 @@ ao_open(struct audio_output *ao)
 					       &af_string));
 }
 
+/**
+ * Drops the reference to the current chunk, if any.
+ */
+static void
+ao_release_chunk(struct audio_output *ao)
+{
+	if (ao->chunk != NULL) {
+		audio_pipe_release(ao->pipe, ao->chunk);
+		ao->chunk = NULL;
+	}
+}
+
 static void
 ao_close(struct audio_output *ao, bool drain)
 {
 	assert(ao->open);
 
+	ao_release_chunk(ao);
 	ao->pipe = NULL;
 
-	ao->chunk = NULL;
 	ao->open = false;
 
 	g_mutex_unlock(ao->mutex);
@@ -238,9 +250,9 @@ ao_reopen_filter(struct audio_output *ao)
 		   but we cannot call this function because we must
 		   not call filter_close(ao->filter) again */
 
+		ao_release_chunk(ao);
 		ao->pipe = NULL;
 
-		ao->chunk = NULL;
 		ao->open = false;
 		ao->fail_timer = g_timer_new();
 
@@ -502,7 +514,7 @@ ao_play(struct audio_output *ao)
 		}
 
 		assert(ao->chunk == chunk);
-		chunk = chunk->next;
+		chunk = audio_pipe_next(ao->pipe, chunk);
 	}
 
 	ao->chunk_finished = true;
@@ -603,7 +615,9 @@ static gpointer audio_output_task(gpointer arg)
 		case AO_COMMAND_DRAIN:
 			if (ao->open) {
 				assert(ao->chunk == NULL);
-				assert(audio_pipe_get_head(ao->pipe) == NULL);
+				/* not audio_pipe_get_head(), which takes a
+				   reference */
+				assert(audio_pipe_empty(ao->pipe));
 
 				g_mutex_unlock(ao->mutex);
 				ao_plugin_drain(ao);
@@ -614,7 +628,7 @@ static gpointer audio_output_task(gpointer arg)
 			continue;
 
 		case AO_COMMAND_CANCEL:
-			ao->chunk = NULL;
+			ao_release_chunk(ao);
 
 			if (ao->open) {
 				g_mutex_unlock(ao->mutex);
@@ -626,7 +640,7 @@ static gpointer audio_output_task(gpointer arg)
 			continue;
 
 		case AO_COMMAND_KILL:
-			ao->chunk = NULL;
+			ao_release_chunk(ao);
 			ao_command_finished(ao);
 			g_mutex_unlock(ao->mutex);
 			return NULL;
@@ -23,10 +23,15 @@
 #include "pcm_buffer.h"
 #include "pcm_pack.h"
 #include "pcm_utils.h"
+#include "pcm_simd.h"
 
 static void
 pcm_convert_8_to_16(int16_t *out, const int8_t *in, const int8_t *in_end)
 {
+	size_t n = pcm_simd_8_to_16(out, in, in_end - in);
+	out += n;
+	in += n;
+
 	while (in < in_end) {
 		*out++ = *in++ << 8;
 	}
@@ -49,6 +54,10 @@ pcm_convert_32_to_16(struct pcm_dither *dither,
 static void
 pcm_convert_float_to_16(int16_t *out, const float *in, const float *in_end)
 {
+	size_t n = pcm_simd_float_to_16(out, in, in_end - in);
+	out += n;
+	in += n;
+
 	const unsigned OUT_BITS = 16;
 	const float factor = 1 << (OUT_BITS - 1);
 
@@ -157,6 +166,10 @@ pcm_convert_8_to_24(int32_t *out, const int8_t *in, const int8_t *in_end)
 static void
 pcm_convert_16_to_24(int32_t *out, const int16_t *in, const int16_t *in_end)
 {
+	size_t n = pcm_simd_16_to_24(out, in, in_end - in);
+	out += n;
+	in += n;
+
 	while (in < in_end)
 		*out++ = *in++ << 8;
 }
@@ -166,6 +179,10 @@ pcm_convert_32_to_24(int32_t *restrict out,
 		     const int32_t *restrict in,
 		     const int32_t *restrict in_end)
 {
+	size_t n = pcm_simd_32_to_24(out, in, in_end - in);
+	out += n;
+	in += n;
+
 	while (in < in_end)
 		*out++ = *in++ >> 8;
 }
@@ -173,6 +190,10 @@ pcm_convert_32_to_24(int32_t *restrict out,
 static void
 pcm_convert_float_to_24(int32_t *out, const float *in, const float *in_end)
 {
+	size_t n = pcm_simd_float_to_24(out, in, in_end - in);
+	out += n;
+	in += n;
+
 	const unsigned OUT_BITS = 24;
 	const float factor = 1 << (OUT_BITS - 1);
 
@@ -272,6 +293,10 @@ pcm_convert_8_to_32(int32_t *out, const int8_t *in, const int8_t *in_end)
 static void
 pcm_convert_16_to_32(int32_t *out, const int16_t *in, const int16_t *in_end)
 {
+	size_t n = pcm_simd_16_to_32(out, in, in_end - in);
+	out += n;
+	in += n;
+
 	while (in < in_end)
 		*out++ = *in++ << 16;
 }
@@ -281,6 +306,10 @@ pcm_convert_24_to_32(int32_t *restrict out,
 		     const int32_t *restrict in,
 		     const int32_t *restrict in_end)
 {
+	size_t n = pcm_simd_24_to_32(out, in, in_end - in);
+	out += n;
+	in += n;
+
 	while (in < in_end)
 		*out++ = *in++ << 8;
 }
@@ -381,6 +410,10 @@ pcm_convert_8_to_float(float *out, const int8_t *in, const int8_t *in_end)
 static void
 pcm_convert_16_to_float(float *out, const int16_t *in, const int16_t *in_end)
 {
+	size_t n = pcm_simd_16_to_float(out, in, in_end - in);
+	out += n;
+	in += n;
+
 	enum { in_bits = sizeof(*in) * 8 };
 	static const float factor = 2.0f / (1 << in_bits);
 	while (in < in_end)
@@ -390,6 +423,10 @@ pcm_convert_16_to_float(float *out, const int16_t *in, const int16_t *in_end)
 static void
 pcm_convert_24_to_float(float *out, const int32_t *in, const int32_t *in_end)
 {
+	size_t n = pcm_simd_24_to_float(out, in, in_end - in);
+	out += n;
+	in += n;
+
 	enum { in_bits = 24 };
 	static const float factor = 2.0f / (1 << in_bits);
 	while (in < in_end)
@@ -399,6 +436,10 @@ pcm_convert_24_to_float(float *out, const int32_t *in, const int32_t *in_end)
 static void
 pcm_convert_32_to_float(float *out, const int32_t *in, const int32_t *in_end)
 {
+	size_t n = pcm_simd_32_to_float(out, in, in_end - in);
+	out += n;
+	in += n;
+
 	enum { in_bits = sizeof(*in) * 8 };
 	static const float factor = 0.5f / (1 << (in_bits - 2));
 	while (in < in_end)
@@ -0,0 +1,542 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Vectorized versions of the sample conversions in pcm_format.c.  The
+ * scaling factors must stay identical to the scalar code.
+ */
+
+#include "pcm_simd.h"
+
+#if defined(PCM_SIMD_X86)
+#include <immintrin.h>
+#elif defined(PCM_SIMD_NEON)
+#include <arm_neon.h>
+#endif
+
+#define FACTOR_16_TO_FLOAT (2.0f / (1 << 16))
+#define FACTOR_24_TO_FLOAT (2.0f / (1 << 24))
+#define FACTOR_32_TO_FLOAT (0.5f / (1 << 30))
+#define FACTOR_FLOAT_TO_16 ((float)(1 << 15))
+#define FACTOR_FLOAT_TO_24 ((float)(1 << 23))
+
+#if defined(PCM_SIMD_X86)
+
+#define AVX2 __attribute__((target("avx2")))
+#define SSE2 __attribute__((target("sse2")))
+
+/* 8 -> 16 */
+
+AVX2 static size_t
+avx2_8_to_16(int16_t *out, const int8_t *in, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		__m256i w = _mm256_slli_epi16(_mm256_cvtepi8_epi16(v), 8);
+		_mm256_storeu_si256((__m256i *)(out + i), w);
+	}
+	return i;
+}
+
+SSE2 static size_t
+sse2_8_to_16(int16_t *out, const int8_t *in, size_t n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		/* interleaving with zero bytes shifts each sample into
+		 * the high byte */
+		_mm_storeu_si128((__m128i *)(out + i),
+				 _mm_unpacklo_epi8(zero, v));
+		_mm_storeu_si128((__m128i *)(out + i + 8),
+				 _mm_unpackhi_epi8(zero, v));
+	}
+	return i;
+}
+
+/* 16 -> 24/32 */
+
+AVX2 static size_t
+avx2_16_to_32_shift(int32_t *out, const int16_t *in, size_t n, int shift)
+{
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		__m256i w = _mm256_cvtepi16_epi32(v);
+		w = _mm256_sll_epi32(w, _mm_cvtsi32_si128(shift));
+		_mm256_storeu_si256((__m256i *)(out + i), w);
+	}
+	return i;
+}
+
+SSE2 static size_t
+sse2_16_to_32_shift(int32_t *out, const int16_t *in, size_t n, int shift)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i count = _mm_cvtsi32_si128(16 - shift);
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		/* the sample lands in the upper half of each 32 bit
+		 * lane, an arithmetic shift moves it back down */
+		__m128i lo = _mm_sra_epi32(_mm_unpacklo_epi16(zero, v), count);
+		__m128i hi = _mm_sra_epi32(_mm_unpackhi_epi16(zero, v), count);
+		_mm_storeu_si128((__m128i *)(out + i), lo);
+		_mm_storeu_si128((__m128i *)(out + i + 4), hi);
+	}
+	return i;
+}
+
+/* 24 <-> 32 */
+
+AVX2 static size_t
+avx2_24_to_32(int32_t *out, const int32_t *in, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+		_mm256_storeu_si256((__m256i *)(out + i),
+				    _mm256_slli_epi32(v, 8));
+	}
+	return i;
+}
+
+SSE2 static size_t
+sse2_24_to_32(int32_t *out, const int32_t *in, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_slli_epi32(v, 8));
+	}
+	return i;
+}
+
+AVX2 static size_t
+avx2_32_to_24(int32_t *out, const int32_t *in, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+		_mm256_storeu_si256((__m256i *)(out + i),
+				    _mm256_srai_epi32(v, 8));
+	}
+	return i;
+}
+
+SSE2 static size_t
+sse2_32_to_24(int32_t *out, const int32_t *in, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_srai_epi32(v, 8));
+	}
+	return i;
+}
+
+/* integer -> float */
+
+AVX2 static size_t
+avx2_16_to_float(float *out, const int16_t *in, size_t n)
+{
+	const __m256 factor = _mm256_set1_ps(FACTOR_16_TO_FLOAT);
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		__m256 f = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(v));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(f, factor));
+	}
+	return i;
+}
+
+SSE2 static size_t
+sse2_16_to_float(float *out, const int16_t *in, size_t n)
+{
+	const __m128 factor = _mm_set1_ps(FACTOR_16_TO_FLOAT);
+	const __m128i zero = _mm_setzero_si128();
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(zero, v), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(zero, v), 16);
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), factor));
+		_mm_storeu_ps(out + i + 4,
+			      _mm_mul_ps(_mm_cvtepi32_ps(hi), factor));
+	}
+	return i;
+}
+
+AVX2 static size_t
+avx2_32_to_float_scaled(float *out, const int32_t *in, size_t n, float s)
+{
+	const __m256 factor = _mm256_set1_ps(s);
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+		_mm256_storeu_ps(out + i,
+				 _mm256_mul_ps(_mm256_cvtepi32_ps(v), factor));
+	}
+	return i;
+}
+
+SSE2 static size_t
+sse2_32_to_float_scaled(float *out, const int32_t *in, size_t n, float s)
+{
+	const __m128 factor = _mm_set1_ps(s);
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(v), factor));
+	}
+	return i;
+}
+
+/* float -> integer; cvttps truncates like the scalar cast, and yields
+ * INT32_MIN on overflow just like cvttss2si does */
+
+AVX2 static size_t
+avx2_float_to_16(int16_t *out, const float *in, size_t n)
+{
+	const __m256 factor = _mm256_set1_ps(FACTOR_FLOAT_TO_16);
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m256i a = _mm256_cvttps_epi32(
+			_mm256_mul_ps(_mm256_loadu_ps(in + i), factor));
+		__m256i b = _mm256_cvttps_epi32(
+			_mm256_mul_ps(_mm256_loadu_ps(in + i + 8), factor));
+		/* packs works per 128 bit lane, restore the order */
+		__m256i w = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b),
+						     0xd8);
+		_mm256_storeu_si256((__m256i *)(out + i), w);
+	}
+	return i;
+}
+
+SSE2 static size_t
+sse2_float_to_16(int16_t *out, const float *in, size_t n)
+{
+	const __m128 factor = _mm_set1_ps(FACTOR_FLOAT_TO_16);
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i a = _mm_cvttps_epi32(
+			_mm_mul_ps(_mm_loadu_ps(in + i), factor));
+		__m128i b = _mm_cvttps_epi32(
+			_mm_mul_ps(_mm_loadu_ps(in + i + 4), factor));
+		/* signed saturation is the same as pcm_clamp_16() */
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(a, b));
+	}
+	return i;
+}
+
+AVX2 static size_t
+avx2_float_to_24(int32_t *out, const float *in, size_t n)
+{
+	const __m256 factor = _mm256_set1_ps(FACTOR_FLOAT_TO_24);
+	const __m256i min = _mm256_set1_epi32(-(1 << 23));
+	const __m256i max = _mm256_set1_epi32((1 << 23) - 1);
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_cvttps_epi32(
+			_mm256_mul_ps(_mm256_loadu_ps(in + i), factor));
+		v = _mm256_min_epi32(_mm256_max_epi32(v, min), max);
+		_mm256_storeu_si256((__m256i *)(out + i), v);
+	}
+	return i;
+}
+
+SSE2 static size_t
+sse2_float_to_24(int32_t *out, const float *in, size_t n)
+{
+	const __m128 factor = _mm_set1_ps(FACTOR_FLOAT_TO_24);
+	const __m128i min = _mm_set1_epi32(-(1 << 23));
+	const __m128i max = _mm_set1_epi32((1 << 23) - 1);
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i v = _mm_cvttps_epi32(
+			_mm_mul_ps(_mm_loadu_ps(in + i), factor));
+		/* no pminsd/pmaxsd before SSE4.1 */
+		__m128i over = _mm_cmpgt_epi32(v, max);
+		v = _mm_or_si128(_mm_andnot_si128(over, v),
+				 _mm_and_si128(over, max));
+		__m128i under = _mm_cmplt_epi32(v, min);
+		v = _mm_or_si128(_mm_andnot_si128(under, v),
+				 _mm_and_si128(under, min));
+		_mm_storeu_si128((__m128i *)(out + i), v);
+	}
+	return i;
+}
+
+#elif defined(PCM_SIMD_NEON)
+
+static size_t
+neon_8_to_16(int16_t *out, const int8_t *in, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8)
+		vst1q_s16(out + i, vshll_n_s8(vld1_s8(in + i), 8));
+	return i;
+}
+
+static size_t
+neon_16_to_24(int32_t *out, const int16_t *in, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4)
+		vst1q_s32(out + i, vshll_n_s16(vld1_s16(in + i), 8));
+	return i;
+}
+
+static size_t
+neon_16_to_32(int32_t *out, const int16_t *in, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4)
+		vst1q_s32(out + i, vshll_n_s16(vld1_s16(in + i), 16));
+	return i;
+}
+
+static size_t
+neon_24_to_32(int32_t *out, const int32_t *in, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4)
+		vst1q_s32(out + i, vshlq_n_s32(vld1q_s32(in + i), 8));
+	return i;
+}
+
+static size_t
+neon_32_to_24(int32_t *out, const int32_t *in, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4)
+		vst1q_s32(out + i, vshrq_n_s32(vld1q_s32(in + i), 8));
+	return i;
+}
+
+static size_t
+neon_16_to_float(float *out, const int16_t *in, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		float32x4_t f = vcvtq_f32_s32(vmovl_s16(vld1_s16(in + i)));
+		vst1q_f32(out + i, vmulq_n_f32(f, FACTOR_16_TO_FLOAT));
+	}
+	return i;
+}
+
+static size_t
+neon_32_to_float_scaled(float *out, const int32_t *in, size_t n, float s)
+{
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		float32x4_t f = vcvtq_f32_s32(vld1q_s32(in + i));
+		vst1q_f32(out + i, vmulq_n_f32(f, s));
+	}
+	return i;
+}
+
+/* vcvtq saturates like the scalar fcvtzs/vcvt does on ARM */
+
+static size_t
+neon_float_to_16(int16_t *out, const float *in, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		float32x4_t f = vmulq_n_f32(vld1q_f32(in + i),
+					    FACTOR_FLOAT_TO_16);
+		vst1_s16(out + i, vqmovn_s32(vcvtq_s32_f32(f)));
+	}
+	return i;
+}
+
+static size_t
+neon_float_to_24(int32_t *out, const float *in, size_t n)
+{
+	const int32x4_t min = vdupq_n_s32(-(1 << 23));
+	const int32x4_t max = vdupq_n_s32((1 << 23) - 1);
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		float32x4_t f = vmulq_n_f32(vld1q_f32(in + i),
+					    FACTOR_FLOAT_TO_24);
+		int32x4_t v = vcvtq_s32_f32(f);
+		vst1q_s32(out + i, vminq_s32(vmaxq_s32(v, min), max));
+	}
+	return i;
+}
+
+#endif
+
+size_t
+pcm_simd_8_to_16(int16_t *out, const int8_t *in, size_t n)
+{
+#if defined(PCM_SIMD_X86)
+	unsigned features = pcm_simd_features();
+	if (features & PCM_SIMD_AVX2)
+		return avx2_8_to_16(out, in, n);
+	if (features & PCM_SIMD_SSE2)
+		return sse2_8_to_16(out, in, n);
+#elif defined(PCM_SIMD_NEON)
+	if (pcm_simd_features() & PCM_SIMD_NEON)
+		return neon_8_to_16(out, in, n);
+#endif
+	return 0;
+}
+
+size_t
+pcm_simd_16_to_24(int32_t *out, const int16_t *in, size_t n)
+{
+#if defined(PCM_SIMD_X86)
+	unsigned features = pcm_simd_features();
+	if (features & PCM_SIMD_AVX2)
+		return avx2_16_to_32_shift(out, in, n, 8);
+	if (features & PCM_SIMD_SSE2)
+		return sse2_16_to_32_shift(out, in, n, 8);
+#elif defined(PCM_SIMD_NEON)
+	if (pcm_simd_features() & PCM_SIMD_NEON)
+		return neon_16_to_24(out, in, n);
+#endif
+	return 0;
+}
+
+size_t
+pcm_simd_16_to_32(int32_t *out, const int16_t *in, size_t n)
+{
+#if defined(PCM_SIMD_X86)
+	unsigned features = pcm_simd_features();
+	if (features & PCM_SIMD_AVX2)
+		return avx2_16_to_32_shift(out, in, n, 16);
+	if (features & PCM_SIMD_SSE2)
+		return sse2_16_to_32_shift(out, in, n, 16);
+#elif defined(PCM_SIMD_NEON)
+	if (pcm_simd_features() & PCM_SIMD_NEON)
+		return neon_16_to_32(out, in, n);
+#endif
+	return 0;
+}
+
+size_t
+pcm_simd_24_to_32(int32_t *out, const int32_t *in, size_t n)
+{
+#if defined(PCM_SIMD_X86)
+	unsigned features = pcm_simd_features();
+	if (features & PCM_SIMD_AVX2)
+		return avx2_24_to_32(out, in, n);
+	if (features & PCM_SIMD_SSE2)
+		return sse2_24_to_32(out, in, n);
+#elif defined(PCM_SIMD_NEON)
+	if (pcm_simd_features() & PCM_SIMD_NEON)
+		return neon_24_to_32(out, in, n);
+#endif
+	return 0;
+}
+
+size_t
+pcm_simd_32_to_24(int32_t *out, const int32_t *in, size_t n)
+{
+#if defined(PCM_SIMD_X86)
+	unsigned features = pcm_simd_features();
+	if (features & PCM_SIMD_AVX2)
+		return avx2_32_to_24(out, in, n);
+	if (features & PCM_SIMD_SSE2)
+		return sse2_32_to_24(out, in, n);
+#elif defined(PCM_SIMD_NEON)
+	if (pcm_simd_features() & PCM_SIMD_NEON)
+		return neon_32_to_24(out, in, n);
+#endif
+	return 0;
+}
+
+size_t
+pcm_simd_16_to_float(float *out, const int16_t *in, size_t n)
+{
+#if defined(PCM_SIMD_X86)
+	unsigned features = pcm_simd_features();
+	if (features & PCM_SIMD_AVX2)
+		return avx2_16_to_float(out, in, n);
+	if (features & PCM_SIMD_SSE2)
+		return sse2_16_to_float(out, in, n);
+#elif defined(PCM_SIMD_NEON)
+	if (pcm_simd_features() & PCM_SIMD_NEON)
+		return neon_16_to_float(out, in, n);
+#endif
+	return 0;
+}
+
+static size_t
+pcm_simd_32_to_float_scaled(float *out, const int32_t *in, size_t n,
+			    float factor)
+{
+#if defined(PCM_SIMD_X86)
+	unsigned features = pcm_simd_features();
+	if (features & PCM_SIMD_AVX2)
+		return avx2_32_to_float_scaled(out, in, n, factor);
+	if (features & PCM_SIMD_SSE2)
+		return sse2_32_to_float_scaled(out, in, n, factor);
+#elif defined(PCM_SIMD_NEON)
+	if (pcm_simd_features() & PCM_SIMD_NEON)
+		return neon_32_to_float_scaled(out, in, n, factor);
+#endif
+	return 0;
+}
+
+size_t
+pcm_simd_24_to_float(float *out, const int32_t *in, size_t n)
+{
+	return pcm_simd_32_to_float_scaled(out, in, n, FACTOR_24_TO_FLOAT);
+}
+
+size_t
+pcm_simd_32_to_float(float *out, const int32_t *in, size_t n)
+{
+	return pcm_simd_32_to_float_scaled(out, in, n, FACTOR_32_TO_FLOAT);
+}
+
+size_t
+pcm_simd_float_to_16(int16_t *out, const float *in, size_t n)
+{
+#if defined(PCM_SIMD_X86)
+	unsigned features = pcm_simd_features();
+	if (features & PCM_SIMD_AVX2)
+		return avx2_float_to_16(out, in, n);
+	if (features & PCM_SIMD_SSE2)
+		return sse2_float_to_16(out, in, n);
+#elif defined(PCM_SIMD_NEON)
+	if (pcm_simd_features() & PCM_SIMD_NEON)
+		return neon_float_to_16(out, in, n);
+#endif
+	return 0;
+}
+
+size_t
+pcm_simd_float_to_24(int32_t *out, const float *in, size_t n)
+{
+#if defined(PCM_SIMD_X86)
+	unsigned features = pcm_simd_features();
+	if (features & PCM_SIMD_AVX2)
+		return avx2_float_to_24(out, in, n);
+	if (features & PCM_SIMD_SSE2)
+		return sse2_float_to_24(out, in, n);
+#elif defined(PCM_SIMD_NEON)
+	if (pcm_simd_features() & PCM_SIMD_NEON)
+		return neon_float_to_24(out, in, n);
+#endif
+	return 0;
+}
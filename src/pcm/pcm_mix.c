@@ -21,6 +21,7 @@
 #include "pcm_mix.h"
 #include "pcm_volume.h"
 #include "pcm_utils.h"
+#include "pcm_simd.h"
 #include "audio_format.h"
 
 #include <glib.h>
@@ -30,6 +31,19 @@
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "pcm"
 
+/**
+ * The add_vol functions draw the dither values for this many samples
+ * at once, and hand them to the SIMD kernels.
+ */
+enum { PCM_MIX_BLOCK = 256 };
+
+static void
+pcm_fill_dither(int32_t *dither, unsigned n)
+{
+	for (unsigned i = 0; i < n; ++i)
+		dither[i] = pcm_volume_dither();
+}
+
 static void
 pcm_add_vol_8(int8_t *buffer1, const int8_t *buffer2,
 	      unsigned num_samples, int volume1, int volume2)
@@ -51,16 +65,28 @@ static void
 pcm_add_vol_16(int16_t *buffer1, const int16_t *buffer2,
 	       unsigned num_samples, int volume1, int volume2)
 {
+	int32_t dither[PCM_MIX_BLOCK];
+
 	while (num_samples > 0) {
-		int32_t sample1 = *buffer1;
-		int32_t sample2 = *buffer2++;
+		unsigned n = MIN(num_samples, PCM_MIX_BLOCK);
+		pcm_fill_dither(dither, n);
 
-		sample1 = ((sample1 * volume1 + sample2 * volume2) +
-			   pcm_volume_dither() + PCM_VOLUME_1 / 2)
-			/ PCM_VOLUME_1;
+		unsigned i = pcm_simd_add_vol_16(buffer1, buffer2, dither, n,
+						 volume1, volume2);
+		for (; i < n; ++i) {
+			int32_t sample1 = buffer1[i];
+			int32_t sample2 = buffer2[i];
 
-		*buffer1++ = pcm_range(sample1, 16);
-		--num_samples;
+			sample1 = ((sample1 * volume1 + sample2 * volume2) +
+				   dither[i] + PCM_VOLUME_1 / 2)
+				/ PCM_VOLUME_1;
+
+			buffer1[i] = pcm_range(sample1, 16);
+		}
+
+		buffer1 += n;
+		buffer2 += n;
+		num_samples -= n;
 	}
 }
 
@@ -68,16 +94,28 @@ static void
 pcm_add_vol_24(int32_t *buffer1, const int32_t *buffer2,
 	       unsigned num_samples, unsigned volume1, unsigned volume2)
 {
+	int32_t dither[PCM_MIX_BLOCK];
+
 	while (num_samples > 0) {
-		int64_t sample1 = *buffer1;
-		int64_t sample2 = *buffer2++;
+		unsigned n = MIN(num_samples, PCM_MIX_BLOCK);
+		pcm_fill_dither(dither, n);
 
-		sample1 = ((sample1 * volume1 + sample2 * volume2) +
-			   pcm_volume_dither() + PCM_VOLUME_1 / 2)
-			/ PCM_VOLUME_1;
+		unsigned i = pcm_simd_add_vol_24(buffer1, buffer2, dither, n,
+						 volume1, volume2);
+		for (; i < n; ++i) {
+			int64_t sample1 = buffer1[i];
+			int64_t sample2 = buffer2[i];
 
-		*buffer1++ = pcm_range(sample1, 24);
-		--num_samples;
+			sample1 = ((sample1 * volume1 + sample2 * volume2) +
+				   dither[i] + PCM_VOLUME_1 / 2)
+				/ PCM_VOLUME_1;
+
+			buffer1[i] = pcm_range(sample1, 24);
+		}
+
+		buffer1 += n;
+		buffer2 += n;
+		num_samples -= n;
 	}
 }
 
@@ -85,16 +123,28 @@ static void
 pcm_add_vol_32(int32_t *buffer1, const int32_t *buffer2,
 	       unsigned num_samples, unsigned volume1, unsigned volume2)
 {
+	int32_t dither[PCM_MIX_BLOCK];
+
 	while (num_samples > 0) {
-		int64_t sample1 = *buffer1;
-		int64_t sample2 = *buffer2++;
+		unsigned n = MIN(num_samples, PCM_MIX_BLOCK);
+		pcm_fill_dither(dither, n);
 
-		sample1 = ((sample1 * volume1 + sample2 * volume2) +
-			   pcm_volume_dither() + PCM_VOLUME_1 / 2)
-			/ PCM_VOLUME_1;
+		unsigned i = pcm_simd_add_vol_32(buffer1, buffer2, dither, n,
+						 volume1, volume2);
+		for (; i < n; ++i) {
+			int64_t sample1 = buffer1[i];
+			int64_t sample2 = buffer2[i];
 
-		*buffer1++ = pcm_range_64(sample1, 32);
-		--num_samples;
+			sample1 = ((sample1 * volume1 + sample2 * volume2) +
+				   dither[i] + PCM_VOLUME_1 / 2)
+				/ PCM_VOLUME_1;
+
+			buffer1[i] = pcm_range_64(sample1, 32);
+		}
+
+		buffer1 += n;
+		buffer2 += n;
+		num_samples -= n;
 	}
 }
 
@@ -102,6 +152,12 @@ static void
 pcm_add_vol_float(float *buffer1, const float *buffer2,
 		  unsigned num_samples, float volume1, float volume2)
 {
+	unsigned n = pcm_simd_add_vol_float(buffer1, buffer2, num_samples,
+					    volume1, volume2);
+	buffer1 += n;
+	buffer2 += n;
+	num_samples -= n;
+
 	while (num_samples > 0) {
 		float sample1 = *buffer1;
 		float sample2 = *buffer2++;
@@ -158,6 +214,11 @@ pcm_add_vol(void *buffer1, const void *buffer2, size_t size,
 static void
 pcm_add_8(int8_t *buffer1, const int8_t *buffer2, unsigned num_samples)
 {
+	unsigned n = pcm_simd_add_8(buffer1, buffer2, num_samples);
+	buffer1 += n;
+	buffer2 += n;
+	num_samples -= n;
+
 	while (num_samples > 0) {
 		int32_t sample1 = *buffer1;
 		int32_t sample2 = *buffer2++;
@@ -172,6 +233,11 @@ pcm_add_8(int8_t *buffer1, const int8_t *buffer2, unsigned num_samples)
 static void
 pcm_add_16(int16_t *buffer1, const int16_t *buffer2, unsigned num_samples)
 {
+	unsigned n = pcm_simd_add_16(buffer1, buffer2, num_samples);
+	buffer1 += n;
+	buffer2 += n;
+	num_samples -= n;
+
 	while (num_samples > 0) {
 		int32_t sample1 = *buffer1;
 		int32_t sample2 = *buffer2++;
@@ -186,6 +252,11 @@ pcm_add_16(int16_t *buffer1, const int16_t *buffer2, unsigned num_samples)
 static void
 pcm_add_24(int32_t *buffer1, const int32_t *buffer2, unsigned num_samples)
 {
+	unsigned n = pcm_simd_add_24(buffer1, buffer2, num_samples);
+	buffer1 += n;
+	buffer2 += n;
+	num_samples -= n;
+
 	while (num_samples > 0) {
 		int64_t sample1 = *buffer1;
 		int64_t sample2 = *buffer2++;
@@ -200,6 +271,11 @@ pcm_add_24(int32_t *buffer1, const int32_t *buffer2, unsigned num_samples)
 static void
 pcm_add_32(int32_t *buffer1, const int32_t *buffer2, unsigned num_samples)
 {
+	unsigned n = pcm_simd_add_32(buffer1, buffer2, num_samples);
+	buffer1 += n;
+	buffer2 += n;
+	num_samples -= n;
+
 	while (num_samples > 0) {
 		int64_t sample1 = *buffer1;
 		int64_t sample2 = *buffer2++;
@@ -214,6 +290,11 @@ pcm_add_32(int32_t *buffer1, const int32_t *buffer2, unsigned num_samples)
 static void
 pcm_add_float(float *buffer1, const float *buffer2, unsigned num_samples)
 {
+	unsigned n = pcm_simd_add_float(buffer1, buffer2, num_samples);
+	buffer1 += n;
+	buffer2 += n;
+	num_samples -= n;
+
 	while (num_samples > 0) {
 		float sample1 = *buffer1;
 		float sample2 = *buffer2++;
@@ -0,0 +1,613 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Vectorized versions of the mixing loops in pcm_mix.c.
+ *
+ * The scalar code divides by PCM_VOLUME_1 with C semantics (rounding
+ * towards zero), the integer kernels add PCM_VOLUME_1 - 1 to negative
+ * values before the arithmetic shift to get the same result.  24 and
+ * 32 bit samples are mixed in double precision, which represents every
+ * intermediate value of the scalar int64 code exactly.
+ */
+
+#include "pcm_simd.h"
+#include "pcm_volume.h"
+
+#if defined(PCM_SIMD_X86)
+#include <immintrin.h>
+#elif defined(PCM_SIMD_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(PCM_SIMD_X86)
+
+#define AVX2 __attribute__((target("avx2")))
+#define SSE2 __attribute__((target("sse2")))
+
+/* add_vol 16: pmaddwd computes sample1 * volume1 + sample2 * volume2 */
+
+SSE2 static inline __m128i
+sse2_div_volume(__m128i x)
+{
+	const __m128i bias = _mm_set1_epi32(PCM_VOLUME_1 - 1);
+	x = _mm_add_epi32(x, _mm_and_si128(_mm_srai_epi32(x, 31), bias));
+	return _mm_srai_epi32(x, 10);
+}
+
+AVX2 static inline __m256i
+avx2_div_volume(__m256i x)
+{
+	const __m256i bias = _mm256_set1_epi32(PCM_VOLUME_1 - 1);
+	x = _mm256_add_epi32(x, _mm256_and_si256(_mm256_srai_epi32(x, 31),
+						 bias));
+	return _mm256_srai_epi32(x, 10);
+}
+
+AVX2 static size_t
+avx2_add_vol_16(int16_t *buffer1, const int16_t *buffer2,
+		const int32_t *dither, size_t n, int volume1, int volume2)
+{
+	const __m256i vol = _mm256_set1_epi32((volume2 << 16) |
+					      (volume1 & 0xffff));
+	const __m256i half = _mm256_set1_epi32(PCM_VOLUME_1 / 2);
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(buffer1 + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(buffer2 + i));
+		__m256i d0 = _mm256_loadu_si256((const __m256i *)(dither + i));
+		__m256i d1 = _mm256_loadu_si256((const __m256i *)(dither + i + 8));
+
+		/* unpack works per 128 bit lane: lo holds samples 0-3
+		 * and 8-11, hi holds 4-7 and 12-15 */
+		__m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), vol);
+		__m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), vol);
+		lo = _mm256_add_epi32(lo, _mm256_add_epi32(
+			_mm256_permute2x128_si256(d0, d1, 0x20), half));
+		hi = _mm256_add_epi32(hi, _mm256_add_epi32(
+			_mm256_permute2x128_si256(d0, d1, 0x31), half));
+
+		/* and packs puts them back in order */
+		__m256i r = _mm256_packs_epi32(avx2_div_volume(lo),
+					       avx2_div_volume(hi));
+		_mm256_storeu_si256((__m256i *)(buffer1 + i), r);
+	}
+	return i;
+}
+
+SSE2 static size_t
+sse2_add_vol_16(int16_t *buffer1, const int16_t *buffer2,
+		const int32_t *dither, size_t n, int volume1, int volume2)
+{
+	const __m128i vol = _mm_set1_epi32((volume2 << 16) |
+					   (volume1 & 0xffff));
+	const __m128i half = _mm_set1_epi32(PCM_VOLUME_1 / 2);
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(buffer1 + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(buffer2 + i));
+		__m128i d0 = _mm_loadu_si128((const __m128i *)(dither + i));
+		__m128i d1 = _mm_loadu_si128((const __m128i *)(dither + i + 4));
+
+		__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), vol);
+		__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), vol);
+		lo = _mm_add_epi32(lo, _mm_add_epi32(d0, half));
+		hi = _mm_add_epi32(hi, _mm_add_epi32(d1, half));
+
+		/* signed saturation is the same as pcm_range(x, 16) */
+		__m128i r = _mm_packs_epi32(sse2_div_volume(lo),
+					    sse2_div_volume(hi));
+		_mm_storeu_si128((__m128i *)(buffer1 + i), r);
+	}
+	return i;
+}
+
+/* add_vol 24/32, in double precision */
+
+AVX2 static size_t
+avx2_add_vol_wide(int32_t *buffer1, const int32_t *buffer2,
+		  const int32_t *dither, size_t n,
+		  int volume1, int volume2, unsigned bits)
+{
+	const __m256d v1 = _mm256_set1_pd(volume1);
+	const __m256d v2 = _mm256_set1_pd(volume2);
+	const __m256d half = _mm256_set1_pd(PCM_VOLUME_1 / 2);
+	const __m256d scale = _mm256_set1_pd(1.0 / PCM_VOLUME_1);
+	const __m256d min = _mm256_set1_pd(-(double)(1ull << (bits - 1)));
+	const __m256d max = _mm256_set1_pd((double)(1ull << (bits - 1)) - 1);
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m256d a = _mm256_cvtepi32_pd(
+			_mm_loadu_si128((const __m128i *)(buffer1 + i)));
+		__m256d b = _mm256_cvtepi32_pd(
+			_mm_loadu_si128((const __m128i *)(buffer2 + i)));
+		__m256d d = _mm256_cvtepi32_pd(
+			_mm_loadu_si128((const __m128i *)(dither + i)));
+
+		__m256d x = _mm256_add_pd(_mm256_mul_pd(a, v1),
+					  _mm256_mul_pd(b, v2));
+		x = _mm256_mul_pd(_mm256_add_pd(x, _mm256_add_pd(d, half)),
+				  scale);
+		/* the bounds are integers, so clamping before truncating
+		   is the same as after */
+		x = _mm256_min_pd(_mm256_max_pd(x, min), max);
+		_mm_storeu_si128((__m128i *)(buffer1 + i),
+				 _mm256_cvttpd_epi32(x));
+	}
+	return i;
+}
+
+SSE2 static size_t
+sse2_add_vol_wide(int32_t *buffer1, const int32_t *buffer2,
+		  const int32_t *dither, size_t n,
+		  int volume1, int volume2, unsigned bits)
+{
+	const __m128d v1 = _mm_set1_pd(volume1);
+	const __m128d v2 = _mm_set1_pd(volume2);
+	const __m128d half = _mm_set1_pd(PCM_VOLUME_1 / 2);
+	const __m128d scale = _mm_set1_pd(1.0 / PCM_VOLUME_1);
+	const __m128d min = _mm_set1_pd(-(double)(1ull << (bits - 1)));
+	const __m128d max = _mm_set1_pd((double)(1ull << (bits - 1)) - 1);
+	size_t i;
+	for (i = 0; i + 2 <= n; i += 2) {
+		__m128d a = _mm_cvtepi32_pd(
+			_mm_loadl_epi64((const __m128i *)(buffer1 + i)));
+		__m128d b = _mm_cvtepi32_pd(
+			_mm_loadl_epi64((const __m128i *)(buffer2 + i)));
+		__m128d d = _mm_cvtepi32_pd(
+			_mm_loadl_epi64((const __m128i *)(dither + i)));
+
+		__m128d x = _mm_add_pd(_mm_mul_pd(a, v1), _mm_mul_pd(b, v2));
+		x = _mm_mul_pd(_mm_add_pd(x, _mm_add_pd(d, half)), scale);
+		x = _mm_min_pd(_mm_max_pd(x, min), max);
+		_mm_storel_epi64((__m128i *)(buffer1 + i), _mm_cvttpd_epi32(x));
+	}
+	return i;
+}
+
+AVX2 static size_t
+avx2_add_vol_float(float *buffer1, const float *buffer2, size_t n,
+		   float volume1, float volume2)
+{
+	const __m256 v1 = _mm256_set1_ps(volume1);
+	const __m256 v2 = _mm256_set1_ps(volume2);
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256 a = _mm256_loadu_ps(buffer1 + i);
+		__m256 b = _mm256_loadu_ps(buffer2 + i);
+		_mm256_storeu_ps(buffer1 + i,
+				 _mm256_add_ps(_mm256_mul_ps(a, v1),
+					       _mm256_mul_ps(b, v2)));
+	}
+	return i;
+}
+
+SSE2 static size_t
+sse2_add_vol_float(float *buffer1, const float *buffer2, size_t n,
+		   float volume1, float volume2)
+{
+	const __m128 v1 = _mm_set1_ps(volume1);
+	const __m128 v2 = _mm_set1_ps(volume2);
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128 a = _mm_loadu_ps(buffer1 + i);
+		__m128 b = _mm_loadu_ps(buffer2 + i);
+		_mm_storeu_ps(buffer1 + i, _mm_add_ps(_mm_mul_ps(a, v1),
+						      _mm_mul_ps(b, v2)));
+	}
+	return i;
+}
+
+/* plain saturating add */
+
+AVX2 static size_t
+avx2_add_8(int8_t *buffer1, const int8_t *buffer2, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 32 <= n; i += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(buffer1 + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(buffer2 + i));
+		_mm256_storeu_si256((__m256i *)(buffer1 + i),
+				    _mm256_adds_epi8(a, b));
+	}
+	return i;
+}
+
+SSE2 static size_t
+sse2_add_8(int8_t *buffer1, const int8_t *buffer2, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(buffer1 + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(buffer2 + i));
+		_mm_storeu_si128((__m128i *)(buffer1 + i), _mm_adds_epi8(a, b));
+	}
+	return i;
+}
+
+AVX2 static size_t
+avx2_add_16(int16_t *buffer1, const int16_t *buffer2, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(buffer1 + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(buffer2 + i));
+		_mm256_storeu_si256((__m256i *)(buffer1 + i),
+				    _mm256_adds_epi16(a, b));
+	}
+	return i;
+}
+
+SSE2 static size_t
+sse2_add_16(int16_t *buffer1, const int16_t *buffer2, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(buffer1 + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(buffer2 + i));
+		_mm_storeu_si128((__m128i *)(buffer1 + i), _mm_adds_epi16(a, b));
+	}
+	return i;
+}
+
+AVX2 static size_t
+avx2_add_24(int32_t *buffer1, const int32_t *buffer2, size_t n)
+{
+	const __m256i min = _mm256_set1_epi32(-(1 << 23));
+	const __m256i max = _mm256_set1_epi32((1 << 23) - 1);
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(buffer1 + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(buffer2 + i));
+		__m256i s = _mm256_add_epi32(a, b);
+		s = _mm256_min_epi32(_mm256_max_epi32(s, min), max);
+		_mm256_storeu_si256((__m256i *)(buffer1 + i), s);
+	}
+	return i;
+}
+
+SSE2 static size_t
+sse2_add_24(int32_t *buffer1, const int32_t *buffer2, size_t n)
+{
+	const __m128i min = _mm_set1_epi32(-(1 << 23));
+	const __m128i max = _mm_set1_epi32((1 << 23) - 1);
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(buffer1 + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(buffer2 + i));
+		__m128i s = _mm_add_epi32(a, b);
+		__m128i over = _mm_cmpgt_epi32(s, max);
+		s = _mm_or_si128(_mm_andnot_si128(over, s),
+				 _mm_and_si128(over, max));
+		__m128i under = _mm_cmplt_epi32(s, min);
+		s = _mm_or_si128(_mm_andnot_si128(under, s),
+				 _mm_and_si128(under, min));
+		_mm_storeu_si128((__m128i *)(buffer1 + i), s);
+	}
+	return i;
+}
+
+/* 32 bit saturation: the sum overflowed if both operands have the
+ * same sign and the sum has a different one; the saturated value is
+ * INT32_MAX or INT32_MIN depending on the sign of the operands */
+
+AVX2 static size_t
+avx2_add_32(int32_t *buffer1, const int32_t *buffer2, size_t n)
+{
+	const __m256i int_max = _mm256_set1_epi32(INT32_MAX);
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(buffer1 + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(buffer2 + i));
+		__m256i s = _mm256_add_epi32(a, b);
+		__m256i overflow = _mm256_srai_epi32(_mm256_andnot_si256(
+			_mm256_xor_si256(a, b), _mm256_xor_si256(a, s)), 31);
+		__m256i sat = _mm256_xor_si256(_mm256_srai_epi32(a, 31),
+					       int_max);
+		s = _mm256_blendv_epi8(s, sat, overflow);
+		_mm256_storeu_si256((__m256i *)(buffer1 + i), s);
+	}
+	return i;
+}
+
+SSE2 static size_t
+sse2_add_32(int32_t *buffer1, const int32_t *buffer2, size_t n)
+{
+	const __m128i int_max = _mm_set1_epi32(INT32_MAX);
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(buffer1 + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(buffer2 + i));
+		__m128i s = _mm_add_epi32(a, b);
+		__m128i overflow = _mm_srai_epi32(_mm_andnot_si128(
+			_mm_xor_si128(a, b), _mm_xor_si128(a, s)), 31);
+		__m128i sat = _mm_xor_si128(_mm_srai_epi32(a, 31), int_max);
+		s = _mm_or_si128(_mm_andnot_si128(overflow, s),
+				 _mm_and_si128(overflow, sat));
+		_mm_storeu_si128((__m128i *)(buffer1 + i), s);
+	}
+	return i;
+}
+
+AVX2 static size_t
+avx2_add_float(float *buffer1, const float *buffer2, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(buffer1 + i,
+				 _mm256_add_ps(_mm256_loadu_ps(buffer1 + i),
+					       _mm256_loadu_ps(buffer2 + i)));
+	return i;
+}
+
+SSE2 static size_t
+sse2_add_float(float *buffer1, const float *buffer2, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4)
+		_mm_storeu_ps(buffer1 + i,
+			      _mm_add_ps(_mm_loadu_ps(buffer1 + i),
+					 _mm_loadu_ps(buffer2 + i)));
+	return i;
+}
+
+#elif defined(PCM_SIMD_NEON)
+
+static size_t
+neon_add_vol_16(int16_t *buffer1, const int16_t *buffer2,
+		const int32_t *dither, size_t n, int volume1, int volume2)
+{
+	const int32x4_t half = vdupq_n_s32(PCM_VOLUME_1 / 2);
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		int32x4_t x = vmull_n_s16(vld1_s16(buffer1 + i), volume1);
+		x = vmlal_n_s16(x, vld1_s16(buffer2 + i), volume2);
+		x = vaddq_s32(x, vaddq_s32(vld1q_s32(dither + i), half));
+
+		/* round towards zero like the scalar division */
+		uint32x4_t negative = vshrq_n_u32(vreinterpretq_u32_s32(x), 31);
+		x = vaddq_s32(x, vreinterpretq_s32_u32(
+			vmulq_n_u32(negative, PCM_VOLUME_1 - 1)));
+		vst1_s16(buffer1 + i, vqmovn_s32(vshrq_n_s32(x, 10)));
+	}
+	return i;
+}
+
+static size_t
+neon_add_vol_float(float *buffer1, const float *buffer2, size_t n,
+		   float volume1, float volume2)
+{
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		float32x4_t a = vmulq_n_f32(vld1q_f32(buffer1 + i), volume1);
+		float32x4_t b = vmulq_n_f32(vld1q_f32(buffer2 + i), volume2);
+		vst1q_f32(buffer1 + i, vaddq_f32(a, b));
+	}
+	return i;
+}
+
+static size_t
+neon_add_8(int8_t *buffer1, const int8_t *buffer2, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16)
+		vst1q_s8(buffer1 + i, vqaddq_s8(vld1q_s8(buffer1 + i),
+						vld1q_s8(buffer2 + i)));
+	return i;
+}
+
+static size_t
+neon_add_16(int16_t *buffer1, const int16_t *buffer2, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8)
+		vst1q_s16(buffer1 + i, vqaddq_s16(vld1q_s16(buffer1 + i),
+						  vld1q_s16(buffer2 + i)));
+	return i;
+}
+
+static size_t
+neon_add_24(int32_t *buffer1, const int32_t *buffer2, size_t n)
+{
+	const int32x4_t min = vdupq_n_s32(-(1 << 23));
+	const int32x4_t max = vdupq_n_s32((1 << 23) - 1);
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		int32x4_t s = vaddq_s32(vld1q_s32(buffer1 + i),
+					vld1q_s32(buffer2 + i));
+		vst1q_s32(buffer1 + i, vminq_s32(vmaxq_s32(s, min), max));
+	}
+	return i;
+}
+
+static size_t
+neon_add_32(int32_t *buffer1, const int32_t *buffer2, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4)
+		vst1q_s32(buffer1 + i, vqaddq_s32(vld1q_s32(buffer1 + i),
+						  vld1q_s32(buffer2 + i)));
+	return i;
+}
+
+static size_t
+neon_add_float(float *buffer1, const float *buffer2, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4)
+		vst1q_f32(buffer1 + i, vaddq_f32(vld1q_f32(buffer1 + i),
+						 vld1q_f32(buffer2 + i)));
+	return i;
+}
+
+#endif
+
+size_t
+pcm_simd_add_vol_16(int16_t *buffer1, const int16_t *buffer2,
+		    const int32_t *dither, size_t n,
+		    int volume1, int volume2)
+{
+#if defined(PCM_SIMD_X86)
+	unsigned features = pcm_simd_features();
+	if (features & PCM_SIMD_AVX2)
+		return avx2_add_vol_16(buffer1, buffer2, dither, n,
+				       volume1, volume2);
+	if (features & PCM_SIMD_SSE2)
+		return sse2_add_vol_16(buffer1, buffer2, dither, n,
+				       volume1, volume2);
+#elif defined(PCM_SIMD_NEON)
+	if (pcm_simd_features() & PCM_SIMD_NEON)
+		return neon_add_vol_16(buffer1, buffer2, dither, n,
+				       volume1, volume2);
+#endif
+	return 0;
+}
+
+size_t
+pcm_simd_add_vol_24(int32_t *buffer1, const int32_t *buffer2,
+		    const int32_t *dither, size_t n,
+		    int volume1, int volume2)
+{
+#if defined(PCM_SIMD_X86)
+	unsigned features = pcm_simd_features();
+	if (features & PCM_SIMD_AVX2)
+		return avx2_add_vol_wide(buffer1, buffer2, dither, n,
+					 volume1, volume2, 24);
+	if (features & PCM_SIMD_SSE2)
+		return sse2_add_vol_wide(buffer1, buffer2, dither, n,
+					 volume1, volume2, 24);
+#endif
+	return 0;
+}
+
+size_t
+pcm_simd_add_vol_32(int32_t *buffer1, const int32_t *buffer2,
+		    const int32_t *dither, size_t n,
+		    int volume1, int volume2)
+{
+#if defined(PCM_SIMD_X86)
+	unsigned features = pcm_simd_features();
+	if (features & PCM_SIMD_AVX2)
+		return avx2_add_vol_wide(buffer1, buffer2, dither, n,
+					 volume1, volume2, 32);
+	if (features & PCM_SIMD_SSE2)
+		return sse2_add_vol_wide(buffer1, buffer2, dither, n,
+					 volume1, volume2, 32);
+#endif
+	return 0;
+}
+
+size_t
+pcm_simd_add_vol_float(float *buffer1, const float *buffer2, size_t n,
+		       float volume1, float volume2)
+{
+#if defined(PCM_SIMD_X86)
+	unsigned features = pcm_simd_features();
+	if (features & PCM_SIMD_AVX2)
+		return avx2_add_vol_float(buffer1, buffer2, n,
+					  volume1, volume2);
+	if (features & PCM_SIMD_SSE2)
+		return sse2_add_vol_float(buffer1, buffer2, n,
+					  volume1, volume2);
+#elif defined(PCM_SIMD_NEON)
+	if (pcm_simd_features() & PCM_SIMD_NEON)
+		return neon_add_vol_float(buffer1, buffer2, n,
+					  volume1, volume2);
+#endif
+	return 0;
+}
+
+size_t
+pcm_simd_add_8(int8_t *buffer1, const int8_t *buffer2, size_t n)
+{
+#if defined(PCM_SIMD_X86)
+	unsigned features = pcm_simd_features();
+	if (features & PCM_SIMD_AVX2)
+		return avx2_add_8(buffer1, buffer2, n);
+	if (features & PCM_SIMD_SSE2)
+		return sse2_add_8(buffer1, buffer2, n);
+#elif defined(PCM_SIMD_NEON)
+	if (pcm_simd_features() & PCM_SIMD_NEON)
+		return neon_add_8(buffer1, buffer2, n);
+#endif
+	return 0;
+}
+
+size_t
+pcm_simd_add_16(int16_t *buffer1, const int16_t *buffer2, size_t n)
+{
+#if defined(PCM_SIMD_X86)
+	unsigned features = pcm_simd_features();
+	if (features & PCM_SIMD_AVX2)
+		return avx2_add_16(buffer1, buffer2, n);
+	if (features & PCM_SIMD_SSE2)
+		return sse2_add_16(buffer1, buffer2, n);
+#elif defined(PCM_SIMD_NEON)
+	if (pcm_simd_features() & PCM_SIMD_NEON)
+		return neon_add_16(buffer1, buffer2, n);
+#endif
+	return 0;
+}
+
+size_t
+pcm_simd_add_24(int32_t *buffer1, const int32_t *buffer2, size_t n)
+{
+#if defined(PCM_SIMD_X86)
+	unsigned features = pcm_simd_features();
+	if (features & PCM_SIMD_AVX2)
+		return avx2_add_24(buffer1, buffer2, n);
+	if (features & PCM_SIMD_SSE2)
+		return sse2_add_24(buffer1, buffer2, n);
+#elif defined(PCM_SIMD_NEON)
+	if (pcm_simd_features() & PCM_SIMD_NEON)
+		return neon_add_24(buffer1, buffer2, n);
+#endif
+	return 0;
+}
+
+size_t
+pcm_simd_add_32(int32_t *buffer1, const int32_t *buffer2, size_t n)
+{
+#if defined(PCM_SIMD_X86)
+	unsigned features = pcm_simd_features();
+	if (features & PCM_SIMD_AVX2)
+		return avx2_add_32(buffer1, buffer2, n);
+	if (features & PCM_SIMD_SSE2)
+		return sse2_add_32(buffer1, buffer2, n);
+#elif defined(PCM_SIMD_NEON)
+	if (pcm_simd_features() & PCM_SIMD_NEON)
+		return neon_add_32(buffer1, buffer2, n);
+#endif
+	return 0;
+}
+
+size_t
+pcm_simd_add_float(float *buffer1, const float *buffer2, size_t n)
+{
+#if defined(PCM_SIMD_X86)
+	unsigned features = pcm_simd_features();
+	if (features & PCM_SIMD_AVX2)
+		return avx2_add_float(buffer1, buffer2, n);
+	if (features & PCM_SIMD_SSE2)
+		return sse2_add_float(buffer1, buffer2, n);
+#elif defined(PCM_SIMD_NEON)
+	if (pcm_simd_features() & PCM_SIMD_NEON)
+		return neon_add_float(buffer1, buffer2, n);
+#endif
+	return 0;
+}
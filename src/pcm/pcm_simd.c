@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "pcm_simd.h"
+
+#include <stdatomic.h>
+
+enum {
+	/** marks #pcm_simd_cpu as valid, even if it has no features */
+	PCM_SIMD_DETECTED = 0x80000000u,
+};
+
+/**
+ * The features of this CPU, detected by the first
+ * pcm_simd_features() call; 0 before that.
+ */
+static atomic_uint pcm_simd_cpu;
+
+static unsigned pcm_simd_mask = ~0u;
+
+static unsigned
+pcm_simd_detect(void)
+{
+	unsigned features = 0;
+
+#if defined(PCM_SIMD_X86)
+	if (__builtin_cpu_supports("sse2"))
+		features |= PCM_SIMD_SSE2;
+	if (__builtin_cpu_supports("avx2"))
+		features |= PCM_SIMD_AVX2;
+#elif defined(PCM_SIMD_NEON)
+	features |= PCM_SIMD_NEON;
+#endif
+
+	return features;
+}
+
+unsigned
+pcm_simd_features(void)
+{
+	unsigned cpu = atomic_load_explicit(&pcm_simd_cpu,
+					    memory_order_relaxed);
+	if (cpu == 0) {
+		/* racing threads detect the same features */
+		cpu = pcm_simd_detect() | PCM_SIMD_DETECTED;
+		atomic_store_explicit(&pcm_simd_cpu, cpu,
+				      memory_order_relaxed);
+	}
+
+	return cpu & pcm_simd_mask & ~PCM_SIMD_DETECTED;
+}
+
+void
+pcm_simd_restrict(unsigned mask)
+{
+	pcm_simd_mask = mask;
+}
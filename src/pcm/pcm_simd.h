@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Vectorized PCM kernels, picked at runtime by CPU feature detection.
+ *
+ * Every kernel converts a prefix of the input which is a multiple of
+ * its vector width, and returns the number of samples it has
+ * processed.  The caller finishes the remaining samples with the
+ * scalar code, which stays the reference implementation: the kernels
+ * must produce bit-exact results.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+# define PCM_SIMD_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# define PCM_SIMD_NEON
+#endif
+
+enum pcm_simd_flags {
+	PCM_SIMD_SSE2 = 0x1,
+	PCM_SIMD_AVX2 = 0x2,
+	PCM_SIMD_NEON = 0x4,
+};
+
+/**
+ * Returns the instruction set extensions available to the PCM kernels,
+ * a combination of #pcm_simd_flags.
+ */
+unsigned
+pcm_simd_features(void);
+
+/**
+ * Restricts the instruction set extensions the PCM kernels may use.
+ * Pass 0 to force the scalar reference code.  This is meant for tests
+ * and benchmarks, and must not be called while other threads are
+ * converting samples.
+ */
+void
+pcm_simd_restrict(unsigned mask);
+
+size_t
+pcm_simd_8_to_16(int16_t *out, const int8_t *in, size_t n);
+
+size_t
+pcm_simd_16_to_24(int32_t *out, const int16_t *in, size_t n);
+
+size_t
+pcm_simd_16_to_32(int32_t *out, const int16_t *in, size_t n);
+
+size_t
+pcm_simd_24_to_32(int32_t *out, const int32_t *in, size_t n);
+
+size_t
+pcm_simd_32_to_24(int32_t *out, const int32_t *in, size_t n);
+
+size_t
+pcm_simd_16_to_float(float *out, const int16_t *in, size_t n);
+
+size_t
+pcm_simd_24_to_float(float *out, const int32_t *in, size_t n);
+
+size_t
+pcm_simd_32_to_float(float *out, const int32_t *in, size_t n);
+
+size_t
+pcm_simd_float_to_16(int16_t *out, const float *in, size_t n);
+
+size_t
+pcm_simd_float_to_24(int32_t *out, const float *in, size_t n);
+
+/*
+ * Mixing kernels for pcm_mix.c.  The add_vol kernels take the volume
+ * dither values from the caller, so they consume the dither PRNG in
+ * the same order as the scalar code.
+ */
+
+size_t
+pcm_simd_add_vol_16(int16_t *buffer1, const int16_t *buffer2,
+		    const int32_t *dither, size_t n,
+		    int volume1, int volume2);
+
+size_t
+pcm_simd_add_vol_24(int32_t *buffer1, const int32_t *buffer2,
+		    const int32_t *dither, size_t n,
+		    int volume1, int volume2);
+
+size_t
+pcm_simd_add_vol_32(int32_t *buffer1, const int32_t *buffer2,
+		    const int32_t *dither, size_t n,
+		    int volume1, int volume2);
+
+size_t
+pcm_simd_add_vol_float(float *buffer1, const float *buffer2, size_t n,
+		       float volume1, float volume2);
+
+size_t
+pcm_simd_add_8(int8_t *buffer1, const int8_t *buffer2, size_t n);
+
+size_t
+pcm_simd_add_16(int16_t *buffer1, const int16_t *buffer2, size_t n);
+
+size_t
+pcm_simd_add_24(int32_t *buffer1, const int32_t *buffer2, size_t n);
+
+size_t
+pcm_simd_add_32(int32_t *buffer1, const int32_t *buffer2, size_t n);
+
+size_t
+pcm_simd_add_float(float *buffer1, const float *buffer2, size_t n);
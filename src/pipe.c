@@ -19,40 +19,90 @@
  */
 
 #include "pipe.h"
-#include "buffer.h"
 #include "c11thread.h"
-#include "chunk.h"
 #include "compiler.h"
 #include "config.h"
+#include "futex.h"
 #include "macros.h"
 #include "poison.h"
-#include "sem.h"
+#include "tag.h"
+#include "audio_format.h"
 
 #include <assert.h>
+#include <string.h>
+#include <stdatomic.h>
 
+/*
+ * The pipe is a bounded single-producer/single-consumer ring over
+ * chunk_pool.  Chunk number n (counting from the creation of the pipe)
+ * lives in chunk_pool[n % capacity].  The writer owns everything in
+ * [tail, head + capacity), the readers own [head, tail).
+ *
+ * Only the writer advances tail.  A reader which drops the last
+ * reference to a chunk tries to claim the head chunk by swapping its
+ * reference count from 0 to #CHUNK_DEAD; whoever wins shifts it out
+ * and goes on with the following chunks until it finds one which is
+ * still referenced.  Neither side needs a lock.
+ */
 struct audio_pipe {
-	/** the first chunk */
-	struct audio_chunk *head;
+	/** sequence number of the oldest chunk in the pipe */
+	atomic_size_t head;
+
+	/** sequence number one past the newest published chunk */
+	atomic_size_t tail;
 
-	/** a pointer to the tail of the chunk */
-	struct audio_chunk **tail_r;
+	size_t capacity;
 
-	size_t size, capacity;
+	/**
+	 * Bumped every time a chunk is returned to the writer; the
+	 * writer sleeps on this word when the ring is full.
+	 */
+	atomic_uint space_seq;
 
-	mtx_t mutex;
+	/** set while the writer is (about to be) sleeping on space_seq */
+	atomic_bool writer_waiting;
 
-	xsem_t sem;
+	struct audio_chunk *chunk_pool;
 
-	struct audio_chunk *available, *chunk_pool;
+	/** payload size of each chunk */
+	size_t chunk_size;
 
+	/** backing memory of all chunk payloads */
+	char *data_pool;
+
+	/** the chunk being filled by the writer, not yet published */
 	struct audio_chunk *current;
 
-	struct audio_format *format;
+	struct audio_format audio_format;
 };
 
+/**
+ * The reference count of a chunk which is being shifted out of the
+ * pipe; it can't be referenced anymore.
+ */
+#define CHUNK_DEAD (-1)
+
+unsigned audio_chunk_time = DEFAULT_CHUNK_TIME;
+
+size_t audio_chunk_size(const struct audio_format *af) {
+	const size_t frame_size = audio_format_frame_size(af);
+	size_t size = audio_format_time_to_size(af) * audio_chunk_time / 1000;
+
+	if (size > CHUNK_SIZE_MAX)
+		size = CHUNK_SIZE_MAX;
+	if (size < CHUNK_SIZE)
+		size = CHUNK_SIZE;
+
+	return size - size % frame_size;
+}
+
 static inline void
-audio_chunk_init(struct audio_chunk *chunk)
+audio_chunk_init(struct audio_chunk *chunk, size_t seq)
 {
+	/* a reader with a stale head may still try to reference the
+	 * previous occupant of this slot, see audio_pipe_get_head() */
+	atomic_store(&chunk->ref_count, 0);
+	chunk->seq = seq;
 	chunk->other = NULL;
 	chunk->length = 0;
 	chunk->tag = NULL;
@@ -66,23 +116,58 @@ audio_chunk_free(struct audio_chunk *chunk)
 		tag_free(chunk->tag);
 }
 
+static inline struct audio_chunk *
+audio_pipe_slot(const struct audio_pipe *p, size_t seq)
+{
+	return &p->chunk_pool[seq % p->capacity];
+}
+
+/* Give one slot back to the writer, wake it up if it is waiting */
+static void audio_pipe_wake_writer(struct audio_pipe *p) {
+	atomic_fetch_add_explicit(&p->space_seq, 1, memory_order_release);
+	if (atomic_load(&p->writer_waiting))
+		xfutex_wake(&p->space_seq, 1);
+}
+
 void
 audio_pipe_flush(struct audio_pipe *p) {
-	if (audio_chunk_is_empty(p->current))
+	if (p->current == NULL || audio_chunk_is_empty(p->current))
 		// Current chunk is empty
 		// Nothing needed to be done
 		return;
 
-	mtx_lock(&p->mutex);
+	assert(p->current->seq == atomic_load(&p->tail));
 
-	p->current->next = NULL;
-	*p->tail_r = p->current;
-	p->tail_r = &p->current->next;
+	/* publish the chunk, the release pairs with the acquire loads
+	 * of tail on the reader side */
+	atomic_store_explicit(&p->tail, p->current->seq + 1,
+	                      memory_order_release);
+	p->current = NULL;
+}
 
-	p->size++;
+/* Wait until the slot for the next chunk is free and claim it */
+static struct audio_chunk *audio_pipe_claim(struct audio_pipe *p) {
+	size_t tail = atomic_load_explicit(&p->tail, memory_order_relaxed);
+
+	for (;;) {
+		unsigned seq = atomic_load_explicit(&p->space_seq,
+		                                    memory_order_acquire);
+		size_t head = atomic_load_explicit(&p->head,
+		                                   memory_order_acquire);
+		if (tail - head < p->capacity)
+			break;
+
+		atomic_store(&p->writer_waiting, true);
+		/* re-check after announcing ourselves, the reader might
+		 * have freed a slot in between */
+		if (atomic_load(&p->head) == head)
+			xfutex_wait(&p->space_seq, seq);
+		atomic_store(&p->writer_waiting, false);
+	}
 
-	p->current = NULL;
-	mtx_unlock(&p->mutex);
+	struct audio_chunk *chunk = audio_pipe_slot(p, tail);
+	audio_chunk_init(chunk, tail);
+	return chunk;
 }
 
 /*
@@ -92,47 +177,41 @@ audio_pipe_flush(struct audio_pipe *p) {
  * Written might not be immediately available to outputs, call
  * audio_pipe_flush if needed.
  */
-void
-audio_pipe_write_sync(struct audio_pipe *p, float time, strcut audio_format *fmt,
-                      uint16_t bit_rate, size_t length, void *data) {
-	const size_t frame_size = audio_format_frame_size(audio_format);
+size_t
+audio_pipe_write_sync(struct audio_pipe *p,
+		      const struct audio_format *fmt,
+		      float data_time, uint16_t bit_rate,
+		      size_t length, void *data) {
+	const size_t frame_size = audio_format_frame_size(fmt);
+	struct audio_chunk *chunk;
 	size_t num_frames;
 
-	assert(audio_format_equals(fmt, p->format));
+	assert(audio_format_equals(fmt, &p->audio_format));
 
-	bool retry = false;
-	do {
-		if (!p->current) {
-			if (!p->available)
-				xsem_wait(&p->sem);
-			mtx_lock(&p->mutex);
-			assert(p->available);
-			p->current = p->available;
-			audio_chunk_init(p->current);
-			p->available = p->available->next;
-			mtx_unlock(&p->mutex);
-		}
+	for (;;) {
+		if (!p->current)
+			p->current = audio_pipe_claim(p);
 
-		struct audio_chunk *chunk = p->current;
+		chunk = p->current;
 
 		if (chunk->length == 0) {
 			/* if the chunk is empty, nobody has set bitRate and
 			   times yet */
 
 			chunk->bit_rate = bit_rate;
-			chunk->times = time;
+			chunk->times = data_time;
 		}
 
-		assert(frame_size <= sizeof(chunk->data));
-		assert(length > frame_size);
-		num_frames = (sizeof(chunk->data) - chunk->length) / frame_size;
+		assert(frame_size <= p->chunk_size);
+		assert(length >= frame_size);
+		num_frames = (p->chunk_size - chunk->length) / frame_size;
 
-		if (num_frames == 0) {
-			// Current chunk if full, flush it and try again
-			audio_pipe_flush(p);
-			retry = true;
-		}
-	} while(retry);
+		if (num_frames != 0)
+			break;
+
+		// Current chunk if full, flush it and try again
+		audio_pipe_flush(p);
+	}
 
 	if (num_frames > length / frame_size)
 		num_frames = length / frame_size;
@@ -149,32 +228,41 @@ audio_pipe_write_sync(struct audio_pipe *p, float time, strcut audio_format *fmt
 	return ret;
 }
 
-struct audio_pipe *audio_pipe_new(size_t nchunks) {
+struct audio_pipe *audio_pipe_new(const struct audio_format *af,
+				  size_t buffer_size) {
 	struct audio_pipe *mp = tmalloc(struct audio_pipe, 1);
+	size_t nchunks;
 
-	mp->head = NULL;
-	mp->tail_r = &mp->head;
-	mp->size = 0;
-	mtx_init(&mp->mutex, mtx_plain);
+	assert(audio_format_valid(af));
 
-	mp->chunk_pool = tmalloc(struct music_chunk, nchunks);
-	mp->capacity = nchunks;
+	mp->audio_format = *af;
+	mp->chunk_size = audio_chunk_size(af);
 
-	// Chain the chunks
-	for (size_t i = 0; i < nchunks - 1; i++)
-		mp->chunk_pool[i].next = &mp->chunk_pool[i + 1];
+	nchunks = buffer_size / mp->chunk_size;
+	if (nchunks < 2)
+		/* one for the writer, one for the outputs */
+		nchunks = 2;
 
-	mp->chunk_pool[nchunks - 1].next = NULL;
-	mp->available = &mp->chunk_pool[0];
+	atomic_init(&mp->head, 0);
+	atomic_init(&mp->tail, 0);
+	atomic_init(&mp->space_seq, 0);
+	atomic_init(&mp->writer_waiting, false);
+
+	mp->chunk_pool = tmalloc(struct audio_chunk, nchunks);
+	mp->data_pool = malloc(nchunks * mp->chunk_size);
+	mp->capacity = nchunks;
+	mp->current = NULL;
+
+	for (size_t i = 0; i < nchunks; i++)
+		mp->chunk_pool[i].data = mp->data_pool + i * mp->chunk_size;
 
 	return mp;
 }
 
 void audio_pipe_free(struct audio_pipe *p) {
-	if (p->head)
-		audio_pipe_clear(p);
+	audio_pipe_clear(p);
 
-	mtx_destroy(&p->mutex);
+	free(p->data_pool);
 	free(p->chunk_pool);
 	free(p);
 }
@@ -190,124 +278,175 @@ bool audio_pipe_check_format(const struct audio_pipe *pipe,
 	       audio_format_equals(&pipe->audio_format, audio_format);
 }
 
-bool audio_pipe_contains(struct audio_pipe *mp, const struct music_chunk *chunk) {
-	mtx_lock(&mp->mutex);
-
-	for (const struct music_chunk *i = mp->head; i != NULL; i = i->next) {
-		if (i == chunk) {
-			mtx_unlock(&mp->mutex);
-			return true;
-		}
-	}
+bool audio_pipe_contains(struct audio_pipe *mp, const struct audio_chunk *chunk) {
+	if (chunk < mp->chunk_pool || chunk >= mp->chunk_pool + mp->capacity)
+		return false;
 
-	mtx_unlock(&mp->mutex);
-
-	return false;
+	size_t head = atomic_load(&mp->head), tail = atomic_load(&mp->tail);
+	return chunk->seq >= head && chunk->seq < tail;
 }
 
 #endif
 
-/** Remove one chunk from head and free it
- *  p->mutex should be held
+/** Remove one chunk from head and hand its slot back to the writer.
+ *  Must only be called by the reader which marked the head chunk as
+ *  #CHUNK_DEAD.
  */
-static void audio_pipe_shift(struct audio_pipe *p) {
-	struct music_chunk *chunk;
-
-	chunk = mp->head;
-	if (chunk != NULL) {
-		assert(!music_chunk_is_empty(chunk));
-
-		mp->head = chunk->next;
-		--mp->size;
-
-		if (mp->head == NULL) {
-			assert(mp->size == 0);
-			assert(mp->tail_r == &chunk->next);
-
-			mp->tail_r = &mp->head;
-		} else {
-			assert(mp->size > 0);
-			assert(mp->tail_r != &chunk->next);
-		}
-
-		if (chunk->other != NULL) {
-			audio_chunk_free(chunk->other);
-			poison_undefined(chunk->other, sizeof(*chunk->other));
-			chunk->other->next = p->available;
-			p->available = chunk->other;
-		}
+static void audio_pipe_shift(struct audio_pipe *p, struct audio_chunk *chunk) {
+	assert(!audio_chunk_is_empty(chunk));
+	assert(chunk->seq == atomic_load(&p->head));
+	assert(atomic_load(&chunk->ref_count) == CHUNK_DEAD);
+
+	if (chunk->other != NULL) {
+		/* the other chunk is owned by the pipe it came from,
+		 * only drop our reference to its tag */
+		audio_chunk_free(chunk->other);
+		chunk->other = NULL;
+	}
 
-		audio_chunk_free(chunk);
-		poison_undefined(chunk, sizeof(*chunk));
-		chunk->next = mp->available;
-		mp->available = chunk;
+	size_t seq = chunk->seq;
+	audio_chunk_free(chunk);
+	poison_undefined(chunk->data, p->chunk_size);
 
-		xsem_post(p->sem);
-	}
+	atomic_store_explicit(&p->head, seq + 1, memory_order_release);
+	audio_pipe_wake_writer(p);
 }
 
+/* Must not be called while output threads are still reading the pipe */
 void audio_pipe_clear(struct audio_pipe *p) {
-	mtx_lock(&p->mutex);
-	p->size = 0;
+	size_t head = atomic_load(&p->head), tail = atomic_load(&p->tail);
 
-	int freed = 0;
-	struct audio_chunk *chunk = p->head;
-	while (chunk != NULL) {
+	for (size_t i = head; i != tail; i++) {
+		struct audio_chunk *chunk = audio_pipe_slot(p, i);
 		if (chunk->other) {
 			audio_chunk_free(chunk->other);
-			chunk->other->next = p->available;
-			p->available = chunk->other;
 			chunk->other = NULL;
-			freed++;
 		}
 		audio_chunk_free(chunk);
-		chunk = chunk->next;
-		freed++;
 	}
 
-	// Attach the whole pipe onto the available list
-	*p->tail_r = p->available;
-	p->available = p->head;
-
-	p->head = NULL;
-	p->tail_r = &p->head;
+	if (p->current != NULL) {
+		audio_chunk_free(p->current);
+		p->current = NULL;
+	}
 
-	xsem_post_n(&p->sem, freed);
-	mtx_unlock(&p->mutex);
+	atomic_store(&p->head, tail);
+	if (head != tail)
+		audio_pipe_wake_writer(p);
 }
 
 size_t audio_pipe_capacity(const struct audio_pipe *mp) { return mp->capacity; }
 
+size_t audio_pipe_chunk_size(const struct audio_pipe *p) { return p->chunk_size; }
+
 unsigned audio_pipe_size(struct audio_pipe *mp) {
-	mtx_lock(&mp->mutex);
-	unsigned size = mp->size;
-	mtx_unlock(&mp->mutex);
-	return size;
+	size_t tail = atomic_load_explicit(&mp->tail, memory_order_acquire);
+	size_t head = atomic_load_explicit(&mp->head, memory_order_acquire);
+	return tail - head;
+}
+
+/* Shift out all chunks from the head on which aren't referenced
+ * anymore */
+static void audio_pipe_collect(struct audio_pipe *p) {
+	for (;;) {
+		size_t head = atomic_load_explicit(&p->head, memory_order_acquire);
+		if (head == atomic_load_explicit(&p->tail, memory_order_acquire))
+			return;
+
+		struct audio_chunk *chunk = audio_pipe_slot(p, head);
+		int expected = 0;
+		if (!atomic_compare_exchange_strong(&chunk->ref_count,
+		                                    &expected, CHUNK_DEAD)) {
+			if (atomic_load(&p->head) != head)
+				/* stale head, try again */
+				continue;
+
+			/* the head chunk is still referenced, or another
+			 * reader is shifting it; either one will come back
+			 * here when it is done */
+			return;
+		}
+
+		if (atomic_load(&p->head) != head) {
+			/* the slot was shifted and reused by the writer
+			 * after we loaded head; undo and try again */
+			expected = CHUNK_DEAD;
+			atomic_compare_exchange_strong(&chunk->ref_count,
+			                               &expected, 0);
+			continue;
+		}
+
+		audio_pipe_shift(p, chunk);
+	}
 }
 
-struct audio_chunk *audio_pipe_next(struct audio_pipe *p, struct audio_chunk *c) {
-	if (!c)
+/* Drop a reference to @c, and shift out every chunk which isn't
+ * referenced anymore if it was the last one */
+static void audio_pipe_unref(struct audio_pipe *p, struct audio_chunk *c) {
+	if (atomic_fetch_sub(&c->ref_count, 1) == 1)
+		audio_pipe_collect(p);
+}
+
+const struct audio_chunk *
+audio_pipe_next(struct audio_pipe *p, const struct audio_chunk *cc) {
+	if (!cc)
 		return audio_pipe_get_head(p);
 
-	mtx_lock(&p->mutex);
+	struct audio_chunk *c = audio_pipe_slot(p, cc->seq);
+	assert(c == cc);
 
-	c->ref_count--;
-	if (c->next)
-		c->next->ref_count++;
+	size_t tail = atomic_load_explicit(&p->tail, memory_order_acquire);
+	if (c->seq + 1 == tail)
+		/* reached the tail, keep our reference */
+		return NULL;
+
+	/* take the new reference before dropping the old one, so the
+	 * next chunk can't become the head and be shifted under us */
+	struct audio_chunk *next = audio_pipe_slot(p, c->seq + 1);
+	int count = atomic_load(&next->ref_count);
+	do {
+		/* the next chunk can't be shifted while we hold @c, but
+		 * a reader with a stale head might have marked it for a
+		 * moment, see audio_pipe_collect() */
+		while (count == CHUNK_DEAD)
+			count = atomic_load(&next->ref_count);
+	} while (!atomic_compare_exchange_weak(&next->ref_count,
+	                                       &count, count + 1));
+	audio_pipe_unref(p, c);
+
+	return next;
+}
 
-	if (p->head->ref_count == 0)
-		audio_pipe_shift(p);
+void
+audio_pipe_release(struct audio_pipe *p, const struct audio_chunk *cc) {
+	struct audio_chunk *c = audio_pipe_slot(p, cc->seq);
+	assert(c == cc);
 
-	mtx_unlock(&p->mutex);
-	return c->next;
+	audio_pipe_unref(p, c);
 }
 
 // Return the current head of the pipe
-struct audio_chunk *audio_pipe_get_head(struct audio_pipe *p) {
-	mtx_lock(&p->mutex);
-	if (p->head)
-		p->head->ref_count++;
-	mtx_unlock(&p->mutex);
-
-	return p->head;
+const struct audio_chunk *audio_pipe_get_head(struct audio_pipe *p) {
+	for (;;) {
+		size_t head = atomic_load_explicit(&p->head, memory_order_acquire);
+		size_t tail = atomic_load_explicit(&p->tail, memory_order_acquire);
+		if (head == tail)
+			return NULL;
+
+		struct audio_chunk *chunk = audio_pipe_slot(p, head);
+		int count = atomic_load(&chunk->ref_count);
+		if (count == CHUNK_DEAD ||
+		    !atomic_compare_exchange_weak(&chunk->ref_count,
+		                                  &count, count + 1))
+			/* being shifted out, try the new head */
+			continue;
+
+		if (atomic_load(&p->head) == head)
+			return chunk;
+
+		/* lost the race against a shift, and the writer has
+		 * reused the slot already; our reference might have
+		 * kept another reader from shifting it */
+		audio_pipe_unref(p, chunk);
+	}
 }
@@ -25,13 +25,29 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
 
 #ifndef NDEBUG
 struct audio_format;
 #endif
 
+/** the smallest (and the default) chunk payload size */
 #define CHUNK_SIZE (4096)
 
+/** the upper bound for the chunk payload size */
+#define CHUNK_SIZE_MAX (256 * 1024)
+
+/** default amount of audio per chunk, in milliseconds */
+#define DEFAULT_CHUNK_TIME (20)
+
+/**
+ * The amount of audio (in milliseconds) a chunk should hold.  The
+ * actual payload size is picked per audio format when a pipe is
+ * created, see audio_chunk_size().
+ */
+extern unsigned audio_chunk_time;
+
 struct audio_format;
 
 /**
@@ -44,10 +60,10 @@ struct audio_chunk {
 	 *  output threads will hold read only reference
 	 *  to chunks
 	 */
-	int ref_count;
+	atomic_int ref_count;
 
-	/** the next chunk in a linked list */
-	struct audio_chunk *next;
+	/** position of this chunk in the pipe's ring sequence */
+	size_t seq;
 
 	/**
 	 * An optional chunk which should be mixed into this chunk.
@@ -62,7 +78,7 @@ struct audio_chunk {
 	float mix_ratio;
 
 	/** number of bytes stored in this chunk */
-	uint16_t length;
+	uint32_t length;
 
 	/** current bit rate of the source file */
 	uint16_t bit_rate;
@@ -91,8 +107,11 @@ struct audio_chunk {
 	 */
 	unsigned replay_gain_serial;
 
-	/** the data (probably PCM) */
-	char data[CHUNK_SIZE];
+	/**
+	 * the data (probably PCM), audio_pipe_chunk_size() bytes
+	 * owned by the pipe
+	 */
+	char *data;
 };
 /**
  * A queue of #audio_chunk objects.  One party appends chunks at the
@@ -100,11 +119,30 @@ struct audio_chunk {
  */
 struct audio_pipe;
 
+/**
+ * Returns the chunk payload size for the given audio format: enough
+ * for #audio_chunk_time milliseconds, rounded down to whole frames,
+ * and kept between #CHUNK_SIZE and #CHUNK_SIZE_MAX.
+ */
+MPD_PURE
+size_t audio_chunk_size(const struct audio_format *af);
+
 /**
  * Creates a new #audio_pipe object.  It is empty.
+ *
+ * @param af the audio format of all data written to this pipe
+ * @param buffer_size the total number of bytes the pipe can hold;
+ * this is divided into chunks of audio_chunk_size() bytes
  */
 MPD_MALLOC
-struct audio_pipe *audio_pipe_new(void);
+struct audio_pipe *audio_pipe_new(const struct audio_format *af,
+				  size_t buffer_size);
+
+/**
+ * Returns the payload size of each chunk in this pipe.
+ */
+MPD_PURE
+size_t audio_pipe_chunk_size(const struct audio_pipe *p);
 
 /**
  * Frees the object.  It must be empty now.
@@ -133,7 +171,6 @@ audio_chunk_is_empty(const struct audio_chunk *chunk)
  * Returns the first #audio_chunk from the pipe.  Returns NULL if the
  * pipe is empty.
  */
-MPD_PURE
 const struct audio_chunk *audio_pipe_get_head(struct audio_pipe *p);
 
 /**
@@ -147,8 +184,21 @@ static inline bool audio_pipe_empty(struct audio_pipe *p) {
 	return audio_pipe_size(p) == 0;
 }
 
-MPD_PURE const struct audio_chunk *
-audio_pipe_next(struct audio_pipe *, const struct audio_chunk *);
+/**
+ * Moves the caller's reference from @c to the chunk following it.
+ * If @c is NULL, a reference to the head is returned.  If there is
+ * no chunk after @c yet, NULL is returned and the reference to @c is
+ * kept, so the caller can try again later with the same chunk.
+ */
+const struct audio_chunk *
+audio_pipe_next(struct audio_pipe *, const struct audio_chunk *c);
+
+/**
+ * Drops the caller's reference to @c, which was obtained with
+ * audio_pipe_get_head() or audio_pipe_next().
+ */
+void
+audio_pipe_release(struct audio_pipe *p, const struct audio_chunk *c);
 
 
 /******************************************************************************
@@ -20,6 +20,7 @@
 #include "config.h"
 #include "player_control.h"
 #include "decoder_control.h"
+#include "pipe.h"
 #include "path.h"
 #include "log.h"
 #include "tag.h"
@@ -36,11 +37,11 @@
 #include <stdlib.h>
 
 struct player_control *
-pc_new(unsigned buffer_chunks, unsigned int buffered_before_play)
+pc_new(size_t buffer_size, size_t buffered_before_play)
 {
 	struct player_control *pc = tmalloc(struct player_control, 1);
 
-	pc->buffer_chunks = buffer_chunks;
+	pc->buffer_size = buffer_size;
 	pc->buffered_before_play = buffered_before_play;
 
 	mtx_init(&pc->mutex, mtx_plain);
@@ -66,6 +67,32 @@ pc_free(struct player_control *pc)
 	free(pc);
 }
 
+/**
+ * Returns the chunk size for the audio format, or #CHUNK_SIZE while
+ * the decoder has not yet announced it.
+ */
+static size_t
+pc_chunk_size(const struct audio_format *af)
+{
+	return audio_format_defined(af)
+		? audio_chunk_size(af)
+		: CHUNK_SIZE;
+}
+
+unsigned
+pc_buffer_chunks(const struct player_control *pc,
+		 const struct audio_format *af)
+{
+	return pc->buffer_size / pc_chunk_size(af);
+}
+
+unsigned
+pc_buffered_before_play(const struct player_control *pc,
+			const struct audio_format *af)
+{
+	return pc->buffered_before_play / pc_chunk_size(af);
+}
+
 void
 pc_song_deleted(struct player_control *pc, const struct song *song)
 {
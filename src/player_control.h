@@ -21,6 +21,7 @@
 #define MPD_PLAYER_H
 
 #include "audio_format.h"
+#include "compiler.h"
 #include "c11thread.h"
 
 #include <stdint.h>
@@ -83,9 +84,11 @@ struct player_status {
 };
 
 struct player_control {
-	unsigned buffer_chunks;
+	/** the size of the decoded audio buffer in bytes */
+	size_t buffer_size;
 
-	unsigned int buffered_before_play;
+	/** the number of bytes to decode before playback starts */
+	size_t buffered_before_play;
 
 	/** the handle of the player thread, or NULL if the player
 	    thread isn't running */
@@ -134,11 +137,28 @@ struct player_control {
 };
 
 struct player_control *
-pc_new(unsigned buffer_chunks, unsigned buffered_before_play);
+pc_new(size_t buffer_size, size_t buffered_before_play);
 
 void
 pc_free(struct player_control *pc);
 
+/**
+ * Returns the number of chunks the decoded audio buffer holds.  The
+ * chunk size depends on the audio format, see audio_chunk_size().
+ */
+MPD_PURE
+unsigned
+pc_buffer_chunks(const struct player_control *pc,
+		 const struct audio_format *af);
+
+/**
+ * Returns the number of chunks to decode before playback starts.
+ */
+MPD_PURE
+unsigned
+pc_buffered_before_play(const struct player_control *pc,
+			const struct audio_format *af);
+
 /**
  * Locks the #player_control object.
  */
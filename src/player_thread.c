@@ -421,7 +421,8 @@ player_send_silence(struct player *player)
 
 	audio_pipe_flush(player->pipe);
 
-	audio_pipe_write_sync(player->pipe, -1, &player->play_audio_format, 0, CHUNK_SIZE);
+	audio_pipe_write_sync(player->pipe, &player->play_audio_format, -1, 0,
+			      audio_pipe_chunk_size(player->pipe), NULL);
 
 	return true;
 }
@@ -796,8 +797,9 @@ play_next_chunk(struct player *player)
 	   with each chunk; it is more efficient to make it decode a
 	   larger block at a time */
 	if (!decoder_is_idle(dc) &&
-	    music_pipe_size(dc->pipe) <= (pc->buffered_before_play +
-					 music_buffer_size(player_buffer) * 3) / 4)
+	    music_pipe_size(dc->pipe) <=
+	    (pc_buffered_before_play(pc, &dc->out_audio_format) +
+	     pc_buffer_chunks(pc, &dc->out_audio_format) * 3) / 4)
 		decoder_signal(dc);
 
 	return true;
@@ -908,7 +910,8 @@ static void do_play(struct player_control *pc, struct decoder_control *dc)
 			   until the buffer is large enough, to
 			   prevent stuttering on slow machines */
 
-			if (music_pipe_size(player.pipe) < pc->buffered_before_play &&
+			if (music_pipe_size(player.pipe) <
+			    pc_buffered_before_play(pc, &dc->out_audio_format) &&
 			    !decoder_is_idle(dc)) {
 				/* not enough decoded buffer space yet */
 
@@ -977,8 +980,8 @@ static void do_play(struct player_control *pc, struct decoder_control *dc)
 						dc->mixramp_prev_end,
 						&dc->out_audio_format,
 						&player.play_audio_format,
-						music_buffer_size(player_buffer) -
-						pc->buffered_before_play);
+						pc_buffer_chunks(pc, &dc->out_audio_format) -
+						pc_buffered_before_play(pc, &dc->out_audio_format));
 			if (player.cross_fade_chunks > 0) {
 				player.xfade = XFADE_ENABLED;
 				player.cross_fading = false;
@@ -1064,7 +1067,7 @@ player_task(void *arg)
 	struct decoder_control *dc = dc_new(pc);
 	decoder_thread_start(dc);
 
-	player_buffer = music_buffer_new(pc->buffer_chunks);
+	player_buffer = music_buffer_new(pc->buffer_size / CHUNK_SIZE);
 
 	player_lock(pc);
 
@@ -1110,7 +1113,7 @@ player_task(void *arg)
 			   music_chunk objects by freeing the
 			   music_buffer */
 			music_buffer_free(player_buffer);
-			player_buffer = music_buffer_new(pc->buffer_chunks);
+			player_buffer = music_buffer_new(pc->buffer_size / CHUNK_SIZE);
 #endif
 
 			break;
@@ -27,6 +27,8 @@
 #include "conf.h"
 #include "stored_playlist.h"
 #include "idle.h"
+#include "mapper.h"
+#include "input_prefetch.h"
 
 #include <assert.h>
 #include <stdlib.h>
@@ -116,6 +118,48 @@ playlist_song_started(struct playlist *playlist, struct player_control *pc)
 	idle_add(IDLE_PLAYER);
 }
 
+/**
+ * Tells input_prefetch which songs will be played after the current
+ * one.
+ *
+ * @param next_order the order number of the next song, or -1
+ */
+static void
+playlist_prefetch(const struct playlist *playlist, int next_order)
+{
+	unsigned depth = input_prefetch_depth();
+	if (depth == 0)
+		return;
+
+	char *uris[depth];
+	unsigned n = 0;
+
+	for (int order = next_order; order >= 0 && n < depth;) {
+		const struct song *song =
+			queue_get_order(&playlist->queue, order);
+
+		/* the same URI the decoder thread will open */
+		char *uri = song_is_file(song)
+			? map_song_fs(song)
+			: song_get_uri(song);
+		if (uri != NULL)
+			uris[n++] = uri;
+
+		int following = queue_next_order(&playlist->queue, order);
+		if (following == order || following == next_order)
+			/* "single" mode, or "repeat" has wrapped
+			   around */
+			break;
+
+		order = following;
+	}
+
+	input_prefetch_schedule((const char *const *)uris, n);
+
+	for (unsigned i = 0; i < n; ++i)
+		free(uris[i]);
+}
+
 const struct song *
 playlist_get_queued_song(struct playlist *playlist)
 {
@@ -179,6 +223,8 @@ playlist_update_queued_song(struct playlist *playlist,
 		else
 			playlist->queued = next_order;
 	}
+
+	playlist_prefetch(playlist, next_order);
 }
 
 void
@@ -26,6 +26,7 @@
 #include "playlist_internal.h"
 #include "player_control.h"
 #include "idle.h"
+#include "input_prefetch.h"
 
 #include <glib.h>
 
@@ -43,6 +44,9 @@ playlist_stop(struct playlist *playlist, struct player_control *pc)
 	playlist->queued = -1;
 	playlist->playing = false;
 
+	/* don't keep the next songs open */
+	input_prefetch_schedule(NULL, 0);
+
 	if (playlist->queue.random) {
 		/* shuffle the playlist, so the next playback will
 		   result in a new random order */
@@ -317,6 +317,43 @@ playlist_delete(struct playlist *playlist, struct player_control *pc,
 	return MPD_SUCCESS;
 }
 
+/**
+ * Deletes a range of songs which does not contain the current song,
+ * moving the following items only once.
+ */
+static void
+playlist_delete_songs(struct playlist *playlist, struct player_control *pc,
+		      unsigned start, unsigned end)
+{
+	struct queue *queue = &playlist->queue;
+
+	if (start >= end)
+		return;
+
+	for (unsigned i = start; i < end; ++i) {
+		const struct song *song = queue_get(queue, i);
+		if (!song_in_database(song))
+			pc_song_deleted(pc, song);
+	}
+
+	int current_position = playlist->current >= 0
+		? (int)queue_order_to_position(queue, playlist->current)
+		: -1;
+	assert(current_position < (int)start || current_position >= (int)end);
+
+	queue_delete_range(queue, start, end);
+
+	/* update the "current" variable */
+
+	if (current_position >= 0) {
+		if (current_position >= (int)end)
+			current_position -= end - start;
+
+		playlist->current =
+			queue_position_to_order(queue, current_position);
+	}
+}
+
 int
 playlist_delete_range(struct playlist *playlist, struct player_control *pc,
 		      unsigned start, unsigned end)
@@ -334,9 +371,20 @@ playlist_delete_range(struct playlist *playlist, struct player_control *pc,
 
 	queued = playlist_get_queued_song(playlist);
 
-	do {
-		playlist_delete_internal(playlist, pc, --end, &queued);
-	} while (end != start);
+	int current_position = playlist->current >= 0
+		? (int)queue_order_to_position(&playlist->queue,
+					       playlist->current)
+		: -1;
+
+	if (current_position >= (int)start && current_position < (int)end) {
+		/* delete the current song last, so
+		   playlist_delete_internal() picks the next song from
+		   what remains */
+		playlist_delete_songs(playlist, pc, current_position + 1, end);
+		playlist_delete_songs(playlist, pc, start, current_position);
+		playlist_delete_internal(playlist, pc, start, &queued);
+	} else
+		playlist_delete_songs(playlist, pc, start, end);
 
 	playlist_increment_version(playlist);
 	playlist_update_queued_song(playlist, pc, queued);
@@ -80,6 +80,7 @@ playlist_vector_add(struct list_head *pv,
 
 	struct playlist_metadata *pm = playlist_metadata_new(name, mtime);
 	list_add_tail(&pm->siblings, pv);
+	db_modified();
 }
 
 bool
@@ -111,5 +112,6 @@ playlist_vector_remove(struct list_head *pv, const char *name)
 
 	list_del(&pm->siblings);
 	playlist_metadata_free(pm);
+	db_modified();
 	return true;
 }
@@ -22,23 +22,41 @@
 #include "song.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 /**
  * Generate a non-existing id number.
  */
 static unsigned
-queue_generate_id(const struct queue *queue)
+queue_generate_id(struct queue *queue)
 {
-	static unsigned cur = (unsigned)-1;
+	const unsigned capacity = queue->max_length * QUEUE_HASH_MULT;
 
-	do {
-		cur++;
+	/* there are QUEUE_HASH_MULT times more ids than items */
+	assert(queue->num_free_ids > 0);
 
-		if (cur >= queue->max_length * QUEUE_HASH_MULT)
-			cur = 0;
-	} while (queue->id_to_position[cur] != -1);
+	unsigned id = queue->free_ids[queue->free_ids_head];
+	queue->free_ids_head = (queue->free_ids_head + 1) % capacity;
+	--queue->num_free_ids;
 
-	return cur;
+	assert(queue->id_to_position[id] == -1);
+	return id;
+}
+
+/**
+ * Return an id to the pool of unused ids.
+ */
+static void
+queue_release_id(struct queue *queue, unsigned id)
+{
+	const unsigned capacity = queue->max_length * QUEUE_HASH_MULT;
+
+	assert(queue->num_free_ids < capacity);
+
+	queue->id_to_position[id] = -1;
+	queue->free_ids[(queue->free_ids_head + queue->num_free_ids) %
+			capacity] = id;
+	++queue->num_free_ids;
 }
 
 int
@@ -58,6 +76,128 @@ queue_next_order(const struct queue *queue, unsigned order)
 		return -1;
 }
 
+enum {
+	/**
+	 * Ranges of the same version which are at most this many
+	 * positions apart are merged into one change record.
+	 */
+	QUEUE_CHANGES_GAP = 16,
+};
+
+/**
+ * Records that the positions from @start to @end (excluding) have
+ * been modified in the current version.
+ */
+static void
+queue_log_changes(struct queue *queue, unsigned start, unsigned end)
+{
+	assert(start < end);
+
+	if (queue->num_changes > 0) {
+		struct queue_change *last =
+			&queue->changes[(queue->changes_head +
+					 queue->num_changes - 1) %
+					QUEUE_CHANGES_MAX];
+
+		/* merge with the previous record if it is close, or
+		   if the log is full (the result is checked with
+		   queue_song_newer() anyway) */
+		if (last->version == queue->version &&
+		    (queue->num_changes == QUEUE_CHANGES_MAX ||
+		     (start <= last->end + QUEUE_CHANGES_GAP &&
+		      end + QUEUE_CHANGES_GAP >= last->start))) {
+			if (start < last->start)
+				last->start = start;
+			if (end > last->end)
+				last->end = end;
+			return;
+		}
+	}
+
+	if (queue->num_changes == QUEUE_CHANGES_MAX) {
+		/* overwrite the oldest record */
+		const struct queue_change *oldest =
+			&queue->changes[queue->changes_head];
+		if (oldest->version >= queue->changes_version)
+			queue->changes_version = oldest->version + 1;
+
+		queue->changes_head = (queue->changes_head + 1) %
+			QUEUE_CHANGES_MAX;
+		--queue->num_changes;
+	}
+
+	queue->changes[(queue->changes_head + queue->num_changes) %
+		       QUEUE_CHANGES_MAX] = (struct queue_change){
+		.version = queue->version,
+		.start = start,
+		.end = end,
+	};
+	++queue->num_changes;
+}
+
+/**
+ * Marks the item at the specified position as modified in the
+ * current version.
+ */
+static void
+queue_touch(struct queue *queue, unsigned position)
+{
+	queue->items[position].version = queue->version;
+	queue_log_changes(queue, position, position + 1);
+}
+
+static int
+queue_change_compare(const void *a, const void *b)
+{
+	const struct queue_change *x = a, *y = b;
+
+	return x->start < y->start ? -1 : x->start > y->start;
+}
+
+int
+queue_get_changes(const struct queue *queue, uint32_t version,
+		  struct queue_change *ranges)
+{
+	if (version < queue->changes_version || version > queue->version)
+		return -1;
+
+	unsigned n = 0;
+	for (unsigned i = 0; i < queue->num_changes; ++i) {
+		const struct queue_change *change =
+			&queue->changes[(queue->changes_head + i) %
+					QUEUE_CHANGES_MAX];
+		if (change->version < version)
+			continue;
+
+		/* the queue may have become shorter since */
+		unsigned end = change->end < queue->length
+			? change->end : queue->length;
+		if (change->start < end)
+			ranges[n++] = (struct queue_change){
+				.version = change->version,
+				.start = change->start,
+				.end = end,
+			};
+	}
+
+	if (n == 0)
+		return 0;
+
+	qsort(ranges, n, sizeof(ranges[0]), queue_change_compare);
+
+	/* merge overlapping ranges */
+	unsigned m = 0;
+	for (unsigned i = 1; i < n; ++i) {
+		if (ranges[i].start <= ranges[m].end) {
+			if (ranges[i].end > ranges[m].end)
+				ranges[m].end = ranges[i].end;
+		} else
+			ranges[++m] = ranges[i];
+	}
+
+	return m + 1;
+}
+
 void
 queue_increment_version(struct queue *queue)
 {
@@ -70,6 +210,12 @@ queue_increment_version(struct queue *queue)
 			queue->items[i].version = 0;
 
 		queue->version = 1;
+
+		/* items with version 0 are always "newer", which the
+		   change log cannot express; it stays unused until
+		   the queue is cleared */
+		queue->num_changes = 0;
+		queue->changes_version = UINT32_MAX;
 	}
 }
 
@@ -81,7 +227,7 @@ queue_modify(struct queue *queue, unsigned order)
 	assert(order < queue->length);
 
 	position = queue->order[order];
-	queue->items[position].version = queue->version;
+	queue_touch(queue, position);
 
 	queue_increment_version(queue);
 }
@@ -92,22 +238,26 @@ queue_modify_all(struct queue *queue)
 	for (unsigned i = 0; i < queue->length; i++)
 		queue->items[i].version = queue->version;
 
+	if (queue->length > 0)
+		queue_log_changes(queue, 0, queue->length);
+
 	queue_increment_version(queue);
 }
 
 unsigned
 queue_append(struct queue *queue, struct song *song, uint8_t priority)
 {
-	unsigned id = queue_generate_id(queue);
-
 	assert(!queue_is_full(queue));
 
+	unsigned id = queue_generate_id(queue);
+
 	queue->items[queue->length] = (struct queue_item){
 		.song = song,
 		.id = id,
 		.version = queue->version,
 		.priority = priority,
 	};
+	queue_log_changes(queue, queue->length, queue->length + 1);
 
 	queue->order[queue->length] = queue->length;
 	queue->id_to_position[id] = queue->length;
@@ -128,8 +278,8 @@ queue_swap(struct queue *queue, unsigned position1, unsigned position2)
 	queue->items[position1] = queue->items[position2];
 	queue->items[position2] = tmp;
 
-	queue->items[position1].version = queue->version;
-	queue->items[position2].version = queue->version;
+	queue_touch(queue, position1);
+	queue_touch(queue, position2);
 
 	queue->id_to_position[id1] = position2;
 	queue->id_to_position[id2] = position1;
@@ -141,7 +291,7 @@ queue_move_song_to(struct queue *queue, unsigned from, unsigned to)
 	unsigned from_id = queue->items[from].id;
 
 	queue->items[to] = queue->items[from];
-	queue->items[to].version = queue->version;
+	queue_touch(queue, to);
 	queue->id_to_position[from_id] = to;
 }
 
@@ -164,7 +314,7 @@ queue_move(struct queue *queue, unsigned from, unsigned to)
 
 	queue->id_to_position[item.id] = to;
 	queue->items[to] = item;
-	queue->items[to].version = queue->version;
+	queue_touch(queue, to);
 
 	/* now deal with order */
 
@@ -184,29 +334,41 @@ queue_move(struct queue *queue, unsigned from, unsigned to)
 void
 queue_move_range(struct queue *queue, unsigned start, unsigned end, unsigned to)
 {
-	struct queue_item items[end - start];
-	// Copy the original block [start,end-1]
-	for (unsigned i = start; i < end; i++)
-		items[i - start] = queue->items[i];
-
-	// If to > start, we need to move to-start items to start, starting from end
-	for (unsigned i = end; i < end + to - start; i++)
-		queue_move_song_to(queue, i, start + i - end);
+	const unsigned count = end - start;
+	if (to == start || count == 0)
+		return;
 
-	// If to < start, we need to move start-to items to newend (= end + to - start), starting from to
-	// This is the same as moving items from start-1 to to (decreasing), with start-1 going to end-1
-	// We have to iterate in this order to avoid writing over something we haven't yet moved
-	for (unsigned i = start - 1; i >= to && i != G_MAXUINT; i--)
-		queue_move_song_to(queue, i, i + end - start);
+	struct queue_item *items = g_new(struct queue_item, count);
+	// Copy the original block [start,end-1]
+	memcpy(items, &queue->items[start], count * sizeof(items[0]));
+
+	// Shift the items between the old and the new location in one go
+	unsigned lo, hi;
+	if (to > start) {
+		// move to-start items from end down to start
+		memmove(&queue->items[start], &queue->items[end],
+			(to - start) * sizeof(items[0]));
+		lo = start;
+		hi = to + count;
+	} else {
+		// move start-to items from to up to to+count
+		memmove(&queue->items[to + count], &queue->items[to],
+			(start - to) * sizeof(items[0]));
+		lo = to;
+		hi = end;
+	}
 
 	// Copy the original block back in, starting at to.
-	for (unsigned i = start; i< end; i++)
-	{
-		queue->id_to_position[items[i-start].id] = to + i - start;
-		queue->items[to + i - start] = items[i-start];
-		queue->items[to + i - start].version = queue->version;
+	memcpy(&queue->items[to], items, count * sizeof(items[0]));
+	g_free(items);
+
+	for (unsigned i = lo; i < hi; i++) {
+		queue->id_to_position[queue->items[i].id] = i;
+		queue->items[i].version = queue->version;
 	}
 
+	queue_log_changes(queue, lo, hi);
+
 	if (queue->random) {
 		// Update the positions in the queue.
 		// Note that the ranges for these cases are the same as the ranges of
@@ -248,41 +410,65 @@ queue_move_order(struct queue *queue, unsigned from_order, unsigned to_order)
 }
 
 void
-queue_delete(struct queue *queue, unsigned position)
+queue_delete_range(struct queue *queue, unsigned start, unsigned end)
 {
-	struct song *song;
-	unsigned id, order;
+	assert(start <= end);
+	assert(end <= queue->length);
 
-	assert(position < queue->length);
+	const unsigned count = end - start;
+	if (count == 0)
+		return;
 
-	song = queue_get(queue, position);
-	if (!song_in_database(song))
-		song_free(song);
+	for (unsigned i = start; i < end; i++) {
+		struct queue_item *item = &queue->items[i];
 
-	id = queue_position_to_id(queue, position);
-	order = queue_position_to_order(queue, position);
+		if (!song_in_database(item->song))
+			song_free(item->song);
 
-	--queue->length;
+		queue_release_id(queue, item->id);
+	}
 
-	/* release the song id */
+	/* move the following items down */
 
-	queue->id_to_position[id] = -1;
+	const unsigned old_length = queue->length;
+	queue->length -= count;
 
-	/* delete song from songs array */
+	memmove(&queue->items[start], &queue->items[end],
+		(old_length - end) * sizeof(queue->items[0]));
 
-	for (unsigned i = position; i < queue->length; i++)
-		queue_move_song_to(queue, i + 1, i);
+	for (unsigned i = start; i < queue->length; i++) {
+		queue->id_to_position[queue->items[i].id] = i;
+		queue->items[i].version = queue->version;
+	}
+
+	if (start < queue->length)
+		queue_log_changes(queue, start, queue->length);
 
-	/* delete the entry from the order array */
+	if (!queue->random)
+		/* the order is the identity, and stays so */
+		return;
 
-	for (unsigned i = order; i < queue->length; i++)
-		queue->order[i] = queue->order[i + 1];
+	/* drop the deleted entries from the order array, and
+	   renumber the rest */
 
-	/* readjust values in the order array */
+	unsigned n = 0;
+	for (unsigned i = 0; i < old_length; i++) {
+		unsigned position = queue->order[i];
+		if (position < start)
+			queue->order[n++] = position;
+		else if (position >= end)
+			queue->order[n++] = position - count;
+	}
 
-	for (unsigned i = 0; i < queue->length; i++)
-		if (queue->order[i] > position)
-			--queue->order[i];
+	assert(n == queue->length);
+}
+
+void
+queue_delete(struct queue *queue, unsigned position)
+{
+	assert(position < queue->length);
+
+	queue_delete_range(queue, position, position + 1);
 }
 
 void
@@ -294,10 +480,14 @@ queue_clear(struct queue *queue)
 		if (!song_in_database(item->song))
 			song_free(item->song);
 
-		queue->id_to_position[item->id] = -1;
+		queue_release_id(queue, item->id);
 	}
 
 	queue->length = 0;
+
+	/* no item is older than the current version now */
+	queue->num_changes = 0;
+	queue->changes_version = queue->version;
 }
 
 void
@@ -311,14 +501,25 @@ queue_init(struct queue *queue, unsigned max_length)
 	queue->single = false;
 	queue->consume = false;
 
+	queue->changes_head = 0;
+	queue->num_changes = 0;
+	queue->changes_version = 1;
+
 	queue->items = tmalloc(struct queue_item, max_length);
 	queue->order = malloc(sizeof(queue->order[0]) *
 				  max_length);
 	queue->id_to_position = malloc(sizeof(queue->id_to_position[0]) *
 				       max_length * QUEUE_HASH_MULT);
 
-	for (unsigned i = 0; i < max_length * QUEUE_HASH_MULT; ++i)
+	queue->free_ids = malloc(sizeof(queue->free_ids[0]) *
+				 max_length * QUEUE_HASH_MULT);
+	queue->free_ids_head = 0;
+	queue->num_free_ids = max_length * QUEUE_HASH_MULT;
+
+	for (unsigned i = 0; i < max_length * QUEUE_HASH_MULT; ++i) {
 		queue->id_to_position[i] = -1;
+		queue->free_ids[i] = i;
+	}
 
 	queue->rand = g_rand_new();
 }
@@ -331,6 +532,7 @@ queue_finish(struct queue *queue)
 	free(queue->items);
 	free(queue->order);
 	free(queue->id_to_position);
+	free(queue->free_ids);
 
 	g_rand_free(queue->rand);
 }
@@ -526,7 +728,7 @@ queue_set_priority(struct queue *queue, unsigned position, uint8_t priority,
 	if (old_priority == priority)
 		return false;
 
-	item->version = queue->version;
+	queue_touch(queue, position);
 	item->priority = priority;
 
 	if (!queue->random)
@@ -34,6 +34,9 @@ enum {
 	 * number space
 	 */
 	QUEUE_HASH_MULT = 4,
+
+	/** the number of records in the queue's change log */
+	QUEUE_CHANGES_MAX = 256,
 };
 
 /**
@@ -57,6 +60,16 @@ struct queue_item {
 	uint8_t priority;
 };
 
+/**
+ * A range of positions which have been modified in one version.
+ */
+struct queue_change {
+	uint32_t version;
+
+	/** the range of positions (the end is excluding) */
+	unsigned start, end;
+};
+
 /**
  * A queue of songs.  This is the backend of the playlist: it contains
  * an ordered list of songs.
@@ -86,6 +99,18 @@ struct queue {
 	/** map song ids to positions */
 	int *id_to_position;
 
+	/**
+	 * A ring of unused song ids.  Released ids are appended at
+	 * the end, so an id is reused as late as possible.
+	 */
+	unsigned *free_ids;
+
+	/** the index of the next id to be allocated in #free_ids */
+	unsigned free_ids_head;
+
+	/** the number of ids in #free_ids */
+	unsigned num_free_ids;
+
 	/** repeat playback when the end of the queue has been
 	    reached? */
 	bool repeat;
@@ -101,6 +126,24 @@ struct queue {
 
 	/** random number generator for shuffle and random mode */
 	GRand *rand;
+
+	/**
+	 * A ring of the most recent changes, so "plchanges" does not
+	 * need to look at every item, see queue_get_changes().
+	 */
+	struct queue_change changes[QUEUE_CHANGES_MAX];
+
+	/** the index of the oldest record in #changes */
+	unsigned changes_head;
+
+	/** the number of records in #changes */
+	unsigned num_changes;
+
+	/**
+	 * #changes holds all changes of this version and later.
+	 * Older records have been overwritten.
+	 */
+	uint32_t changes_version;
 };
 
 static inline unsigned
@@ -182,6 +225,10 @@ queue_position_to_order(const struct queue *queue, unsigned position)
 {
 	assert(position < queue->length);
 
+	if (!queue->random)
+		/* the order is the identity */
+		return position;
+
 	for (unsigned i = 0;; ++i) {
 		assert(i < queue->length);
 
@@ -234,6 +281,21 @@ queue_song_newer(const struct queue *queue, unsigned position,
 		queue->items[position].version == 0;
 }
 
+/**
+ * Determines the positions which have been modified since the
+ * specified version from the change log.  The result may contain
+ * positions whose items are not newer; check them with
+ * queue_song_newer().
+ *
+ * @param ranges an array of QUEUE_CHANGES_MAX ranges, which
+ * receives sorted and disjoint ranges
+ * @return the number of ranges, or -1 if the change log does not go
+ * back to this version (the caller must check all positions then)
+ */
+int
+queue_get_changes(const struct queue *queue, uint32_t version,
+		  struct queue_change *ranges);
+
 /**
  * Initialize a queue object.
  */
@@ -323,6 +385,17 @@ queue_move_range(struct queue *queue, unsigned start, unsigned end, unsigned to)
 void
 queue_delete(struct queue *queue, unsigned position);
 
+/**
+ * Removes a range of songs from the playlist.  Unlike calling
+ * queue_delete() for each song, this moves the following items only
+ * once.
+ *
+ * @param start the position of the first song (including)
+ * @param end the position of the last song (excluding)
+ */
+void
+queue_delete_range(struct queue *queue, unsigned start, unsigned end);
+
 /**
  * Removes all songs from the playlist.
  */
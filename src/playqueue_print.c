@@ -75,20 +75,38 @@ void
 queue_print_changes_info(struct client *client, const struct queue *queue,
 			 uint32_t version)
 {
-	for (unsigned i = 0; i < queue_length(queue); i++) {
-		if (queue_song_newer(queue, i, version))
-			queue_print_song_info(client, queue, i);
+	struct queue_change ranges[QUEUE_CHANGES_MAX];
+	int n = queue_get_changes(queue, version, ranges);
+	if (n < 0) {
+		/* the change log is too short, look at all items */
+		n = 1;
+		ranges[0].start = 0;
+		ranges[0].end = queue_length(queue);
 	}
+
+	for (int r = 0; r < n; ++r)
+		for (unsigned i = ranges[r].start; i < ranges[r].end; i++)
+			if (queue_song_newer(queue, i, version))
+				queue_print_song_info(client, queue, i);
 }
 
 void
 queue_print_changes_position(struct client *client, const struct queue *queue,
 			     uint32_t version)
 {
-	for (unsigned i = 0; i < queue_length(queue); i++)
-		if (queue_song_newer(queue, i, version))
-			client_printf(client, "cpos: %i\nId: %i\n",
-				      i, queue_position_to_id(queue, i));
+	struct queue_change ranges[QUEUE_CHANGES_MAX];
+	int n = queue_get_changes(queue, version, ranges);
+	if (n < 0) {
+		n = 1;
+		ranges[0].start = 0;
+		ranges[0].end = queue_length(queue);
+	}
+
+	for (int r = 0; r < n; ++r)
+		for (unsigned i = ranges[r].start; i < ranges[r].end; i++)
+			if (queue_song_newer(queue, i, version))
+				client_printf(client, "cpos: %i\nId: %i\n",
+					      i, queue_position_to_id(queue, i));
 }
 
 void
@@ -23,8 +23,8 @@
 
 #include <assert.h>
 
-const char *current_command;
-int command_list_num;
+_Thread_local const char *current_command;
+_Thread_local int command_list_num;
 
 void
 command_success(struct client *client)
@@ -25,8 +25,10 @@
 
 struct client;
 
-extern const char *current_command;
-extern int command_list_num;
+/* per thread, because read-only commands may run in a worker thread,
+   see client_worker.c */
+extern _Thread_local const char *current_command;
+extern _Thread_local int command_list_num;
 
 void
 command_success(struct client *client);
@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define LOG_DOMAIN "reactor"
+
+#include "log.h"
+#include "config.h"
+#include "reactor.h"
+#include "mpd_error.h"
+
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#else
+#include "glib_socket.h"
+#endif
+
+/** watches passed to reactor_schedule() */
+static LIST_HEAD(ready_watches);
+static guint ready_source_id;
+
+static gboolean
+reactor_ready_event(gpointer data)
+{
+	LIST_HEAD(ready);
+
+	(void)data;
+
+	ready_source_id = 0;
+
+	/* watches scheduled by the callbacks run on the next
+	   iteration */
+	list_splice_init(&ready_watches, &ready);
+
+	while (!list_empty(&ready)) {
+		struct reactor_watch *watch =
+			list_first_entry(&ready, struct reactor_watch,
+					 ready_siblings);
+		unsigned events = watch->scheduled;
+
+		list_del_init(&watch->ready_siblings);
+		watch->scheduled = 0;
+		watch->callback(watch, events);
+	}
+
+	return false;
+}
+
+void
+reactor_schedule(struct reactor_watch *watch, unsigned events)
+{
+	watch->scheduled |= events;
+
+	if (list_empty(&watch->ready_siblings))
+		list_add_tail(&watch->ready_siblings, &ready_watches);
+
+	if (ready_source_id == 0)
+		ready_source_id = g_idle_add(reactor_ready_event, NULL);
+}
+
+static void
+reactor_unschedule(struct reactor_watch *watch)
+{
+	list_del_init(&watch->ready_siblings);
+	watch->scheduled = 0;
+}
+
+#ifdef __linux__
+
+enum {
+	/** the maximum number of events per epoll_wait() call */
+	REACTOR_MAX_EVENTS = 256,
+};
+
+static int epoll_fd = -1;
+static guint epoll_source_id;
+
+/**
+ * The events being dispatched by reactor_epoll_event().
+ * reactor_remove() clears the entries of watches removed meanwhile.
+ */
+static struct epoll_event *dispatching;
+static int num_dispatching;
+
+static unsigned
+reactor_events_from_epoll(uint32_t events)
+{
+	unsigned result = 0;
+
+	if (events & (EPOLLIN | EPOLLRDHUP))
+		result |= REACTOR_READ;
+	if (events & EPOLLOUT)
+		result |= REACTOR_WRITE;
+	if (events & (EPOLLERR | EPOLLHUP))
+		result |= REACTOR_HANGUP;
+
+	return result;
+}
+
+static gboolean
+reactor_epoll_event(GIOChannel *source, GIOCondition condition,
+		    gpointer data)
+{
+	struct epoll_event events[REACTOR_MAX_EVENTS];
+
+	(void)source;
+	(void)condition;
+	(void)data;
+
+	int n = epoll_wait(epoll_fd, events, G_N_ELEMENTS(events), 0);
+	if (n < 0) {
+		if (errno != EINTR)
+			log_warning("epoll_wait() failed: %s", strerror(errno));
+		return true;
+	}
+
+	dispatching = events;
+	num_dispatching = n;
+
+	for (int i = 0; i < n; ++i) {
+		struct reactor_watch *watch = events[i].data.ptr;
+		if (watch == NULL)
+			/* removed by a previous callback */
+			continue;
+
+		watch->callback(watch,
+				reactor_events_from_epoll(events[i].events));
+	}
+
+	dispatching = NULL;
+	num_dispatching = 0;
+
+	return true;
+}
+
+void
+reactor_init(void)
+{
+	assert(epoll_fd < 0);
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0)
+		MPD_ERROR("epoll_create1() failed: %s", strerror(errno));
+
+	GIOChannel *channel = g_io_channel_unix_new(epoll_fd);
+	epoll_source_id = g_io_add_watch(channel, G_IO_IN,
+					 reactor_epoll_event, NULL);
+	g_io_channel_unref(channel);
+}
+
+void
+reactor_deinit(void)
+{
+	if (ready_source_id != 0) {
+		g_source_remove(ready_source_id);
+		ready_source_id = 0;
+	}
+
+	if (epoll_fd < 0)
+		return;
+
+	g_source_remove(epoll_source_id);
+	close(epoll_fd);
+	epoll_fd = -1;
+}
+
+void
+reactor_add(struct reactor_watch *watch, int fd, unsigned events,
+	    reactor_callback_t callback)
+{
+	assert(epoll_fd >= 0);
+	assert(fd >= 0);
+	assert(callback != NULL);
+
+	watch->fd = fd;
+	watch->events = events;
+	watch->callback = callback;
+	watch->scheduled = 0;
+	INIT_LIST_HEAD(&watch->ready_siblings);
+
+	/* register for everything once; the owner keeps track of
+	   what it has consumed, so changing the interest never needs
+	   a system call */
+	struct epoll_event event = {
+		.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+		.data.ptr = watch,
+	};
+
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+		log_warning("epoll_ctl() failed: %s", strerror(errno));
+}
+
+void
+reactor_set_events(struct reactor_watch *watch, unsigned events)
+{
+	watch->events = events;
+}
+
+void
+reactor_remove(struct reactor_watch *watch)
+{
+	assert(watch->fd >= 0);
+
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, watch->fd, NULL);
+
+	for (int i = 0; i < num_dispatching; ++i)
+		if (dispatching[i].data.ptr == watch)
+			dispatching[i].data.ptr = NULL;
+
+	reactor_unschedule(watch);
+	watch->fd = -1;
+}
+
+#else
+
+static gboolean
+reactor_glib_event(GIOChannel *source, GIOCondition condition,
+		   gpointer data)
+{
+	struct reactor_watch *watch = data;
+	unsigned events = 0;
+
+	(void)source;
+
+	if (condition & G_IO_IN)
+		events |= REACTOR_READ;
+	if (condition & G_IO_OUT)
+		events |= REACTOR_WRITE;
+	if (condition & (G_IO_ERR | G_IO_HUP))
+		events |= REACTOR_HANGUP;
+
+	watch->callback(watch, events);
+	return true;
+}
+
+static void
+reactor_glib_add(struct reactor_watch *watch)
+{
+	GIOCondition condition = G_IO_ERR | G_IO_HUP;
+	if (watch->events & REACTOR_READ)
+		condition |= G_IO_IN;
+	if (watch->events & REACTOR_WRITE)
+		condition |= G_IO_OUT;
+
+	GIOChannel *channel = g_io_channel_new_socket(watch->fd);
+	watch->source_id = g_io_add_watch(channel, condition,
+					  reactor_glib_event, watch);
+	g_io_channel_unref(channel);
+}
+
+void
+reactor_init(void)
+{
+}
+
+void
+reactor_deinit(void)
+{
+	if (ready_source_id != 0) {
+		g_source_remove(ready_source_id);
+		ready_source_id = 0;
+	}
+}
+
+void
+reactor_add(struct reactor_watch *watch, int fd, unsigned events,
+	    reactor_callback_t callback)
+{
+	assert(fd >= 0);
+	assert(callback != NULL);
+
+	watch->fd = fd;
+	watch->events = events;
+	watch->callback = callback;
+	watch->scheduled = 0;
+	INIT_LIST_HEAD(&watch->ready_siblings);
+
+	reactor_glib_add(watch);
+}
+
+void
+reactor_set_events(struct reactor_watch *watch, unsigned events)
+{
+	if (events == watch->events)
+		return;
+
+	watch->events = events;
+	g_source_remove(watch->source_id);
+	reactor_glib_add(watch);
+}
+
+void
+reactor_remove(struct reactor_watch *watch)
+{
+	assert(watch->fd >= 0);
+
+	g_source_remove(watch->source_id);
+	reactor_unschedule(watch);
+	watch->fd = -1;
+}
+
+#endif
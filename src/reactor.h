@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * Readiness notification for sockets served by the main thread,
+ * integrated into the GLib main loop.
+ *
+ * On Linux, all sockets are registered in one epoll instance, edge
+ * triggered, so a socket costs one epoll_ctl() call for its whole
+ * lifetime and the main loop only polls the epoll descriptor.
+ * Elsewhere, every socket gets its own GLib watch.
+ *
+ * Because of the edge triggered mode, an owner must read or write
+ * until the socket reports EAGAIN, and remember readiness it did not
+ * consume.  If it stops early to let others run, it calls
+ * reactor_schedule() to continue on the next main loop iteration.
+ * The callback may receive events it is not interested in.
+ */
+
+#pragma once
+
+#include "util/list.h"
+
+#include <glib.h>
+
+enum {
+	REACTOR_READ = 0x1,
+	REACTOR_WRITE = 0x2,
+
+	/** an error or hangup; always reported */
+	REACTOR_HANGUP = 0x4,
+};
+
+struct reactor_watch;
+
+typedef void (*reactor_callback_t)(struct reactor_watch *watch,
+				   unsigned events);
+
+struct reactor_watch {
+	int fd;
+
+	/** the events the owner is waiting for */
+	unsigned events;
+
+	reactor_callback_t callback;
+
+	/** events passed to reactor_schedule() */
+	unsigned scheduled;
+
+	/** in the list of scheduled watches, see reactor_schedule() */
+	struct list_head ready_siblings;
+
+#ifndef __linux__
+	guint source_id;
+#endif
+};
+
+void
+reactor_init(void);
+
+void
+reactor_deinit(void);
+
+/**
+ * Starts watching a socket.  The watch must remain valid until
+ * reactor_remove().
+ */
+void
+reactor_add(struct reactor_watch *watch, int fd, unsigned events,
+	    reactor_callback_t callback);
+
+/**
+ * Changes the events the owner is waiting for.
+ */
+void
+reactor_set_events(struct reactor_watch *watch, unsigned events);
+
+/**
+ * Stops watching the socket.  Call this before closing it.
+ */
+void
+reactor_remove(struct reactor_watch *watch);
+
+/**
+ * Invokes the callback with @events on the next main loop iteration,
+ * whether or not the socket becomes ready again.
+ */
+void
+reactor_schedule(struct reactor_watch *watch, unsigned events);
@@ -0,0 +1,785 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define LOG_DOMAIN "scan_cache"
+
+#include "log.h"
+#include "config.h" /* must be first for large file support */
+#include "scan_cache.h"
+#include "conf.h"
+#include "tag.h"
+#include "tag_internal.h"
+#include "fd_util.h"
+#include "open.h"
+#include "c11thread.h"
+#include "err.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SCAN_CACHE_FORMAT_PREFIX "scan_cache: "
+#define SCAN_CACHE_TAG_PREFIX "tag: "
+#define SCAN_CACHE_INFO_END "end"
+
+enum {
+	SCAN_CACHE_FORMAT = 2,
+
+	/** the size of the buffer used to read a tag region */
+	SCAN_CACHE_BUFFER_SIZE = 64 * 1024,
+
+	/**
+	 * The number of bytes at the end of a file which are always
+	 * covered by the fingerprint, for ID3v1 and APE footers.
+	 */
+	SCAN_CACHE_TAIL_SIZE = 4 * 1024,
+
+	/**
+	 * The maximum number of FLAC metadata blocks, MP4 atoms or
+	 * Ogg pages examined before giving up on a file.
+	 */
+	SCAN_CACHE_MAX_STRUCTURES = 1024,
+
+	/** initial number of buckets, must be a power of two */
+	SCAN_CACHE_MIN_BUCKETS = 1024,
+};
+
+struct scan_cache_entry {
+	uint64_t device, inode;
+	uint64_t size;
+	int64_t mtime;
+	uint64_t fingerprint;
+
+	/** is this bucket occupied? */
+	bool used;
+
+	/** has the file been seen since scan_cache_begin()? */
+	bool seen;
+};
+
+/** the path of the cache file, NULL if the cache is disabled */
+static char *cache_path;
+
+/** protects all following variables */
+static mtx_t cache_mutex;
+
+/** an open addressing hash table with linear probing */
+static struct scan_cache_entry *cache_buckets;
+static size_t cache_mask, cache_count;
+
+/** has the cache been modified since it was loaded or saved? */
+static bool cache_dirty;
+
+static inline size_t
+calc_hash(uint64_t device, uint64_t inode)
+{
+	uint64_t hash = inode ^ (device * 0x9e3779b97f4a7c15ull);
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	return (size_t)hash;
+}
+
+/**
+ * Returns the bucket of the specified file, or the empty bucket where
+ * it would be inserted.
+ */
+static struct scan_cache_entry *
+scan_cache_bucket(uint64_t device, uint64_t inode)
+{
+	size_t i = calc_hash(device, inode) & cache_mask;
+
+	while (cache_buckets[i].used &&
+	       (cache_buckets[i].device != device ||
+		cache_buckets[i].inode != inode))
+		i = (i + 1) & cache_mask;
+
+	return &cache_buckets[i];
+}
+
+/**
+ * Rebuilds the hash table with the specified number of buckets.
+ * Entries which were not seen are dropped if #prune is set.
+ */
+static void
+scan_cache_rehash(size_t size, bool prune)
+{
+	struct scan_cache_entry *old = cache_buckets;
+	size_t old_size = old != NULL ? cache_mask + 1 : 0;
+
+	cache_buckets = calloc(size, sizeof(cache_buckets[0]));
+	cache_mask = size - 1;
+	cache_count = 0;
+
+	for (size_t i = 0; i < old_size; ++i) {
+		if (!old[i].used || (prune && !old[i].seen))
+			continue;
+
+		*scan_cache_bucket(old[i].device, old[i].inode) = old[i];
+		++cache_count;
+	}
+
+	free(old);
+}
+
+/**
+ * Looks up a file, and adds an entry for it if there is none.  The
+ * caller must lock the #cache_mutex.
+ */
+static struct scan_cache_entry *
+scan_cache_make(uint64_t device, uint64_t inode)
+{
+	/* keep the load factor below 3/4 */
+	if ((cache_count + 1) * 4 > (cache_mask + 1) * 3)
+		scan_cache_rehash((cache_mask + 1) * 2, false);
+
+	struct scan_cache_entry *entry = scan_cache_bucket(device, inode);
+	if (!entry->used) {
+		entry->used = true;
+		entry->device = device;
+		entry->inode = inode;
+		++cache_count;
+	}
+
+	return entry;
+}
+
+/**
+ * The state of a fingerprint calculation, see calc_fingerprint().
+ */
+struct fingerprint {
+	int fd;
+	uint64_t size;
+	uint64_t hash;
+	unsigned char *buffer;
+};
+
+static bool
+read_at(const struct fingerprint *fp, uint64_t offset,
+	void *buffer, size_t length)
+{
+	if (offset > fp->size || length > fp->size - offset)
+		return false;
+
+	return pread(fp->fd, buffer, length, offset) == (ssize_t)length;
+}
+
+static void
+fingerprint_mix(struct fingerprint *fp, const unsigned char *data,
+		size_t length)
+{
+	uint64_t hash = fp->hash;
+	size_t i = 0;
+
+	for (; i + 8 <= length; i += 8) {
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+		hash ^= hash >> 32;
+	}
+
+	for (; i < length; ++i)
+		hash = (hash ^ data[i]) * 0x100000001b3ull;
+
+	fp->hash = hash;
+}
+
+/**
+ * Adds a region of the file (its position and its contents) to the
+ * fingerprint.
+ */
+static bool
+fingerprint_region(struct fingerprint *fp, uint64_t offset, uint64_t length)
+{
+	if (offset > fp->size || length > fp->size - offset)
+		return false;
+
+	uint64_t position[2] = { offset, length };
+	fingerprint_mix(fp, (const unsigned char *)position,
+			sizeof(position));
+
+	while (length > 0) {
+		size_t nbytes = length < SCAN_CACHE_BUFFER_SIZE
+			? (size_t)length : SCAN_CACHE_BUFFER_SIZE;
+		if (!read_at(fp, offset, fp->buffer, nbytes))
+			return false;
+
+		fingerprint_mix(fp, fp->buffer, nbytes);
+		offset += nbytes;
+		length -= nbytes;
+	}
+
+	return true;
+}
+
+static inline uint32_t
+read_be32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+		((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint32_t
+read_le32(const unsigned char *p)
+{
+	return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) |
+		((uint32_t)p[1] << 8) | p[0];
+}
+
+/**
+ * Parses the size of an ID3v2 header or footer, including the header
+ * and the footer.  Returns 0 if this is not a valid one.
+ */
+static uint64_t
+id3v2_tag_size(const unsigned char *header, const char *magic)
+{
+	if (memcmp(header, magic, 3) != 0 ||
+	    ((header[6] | header[7] | header[8] | header[9]) & 0x80) != 0)
+		return 0;
+
+	uint64_t size = ((uint64_t)header[6] << 21) | (header[7] << 14) |
+		(header[8] << 7) | header[9];
+	size += 10;
+	if (header[5] & 0x10)
+		/* footer present */
+		size += 10;
+
+	return size;
+}
+
+/**
+ * Adds the FLAC metadata blocks starting at @offset (after the
+ * "fLaC" marker) to the fingerprint; they contain the stream info,
+ * the Vorbis comments and the pictures.
+ */
+static bool
+fingerprint_flac(struct fingerprint *fp, uint64_t offset)
+{
+	uint64_t end = offset + 4;
+
+	for (unsigned i = 0; i < SCAN_CACHE_MAX_STRUCTURES; ++i) {
+		unsigned char header[4];
+		if (!read_at(fp, end, header, sizeof(header)))
+			return false;
+
+		end += sizeof(header) +
+			(((uint32_t)header[1] << 16) | (header[2] << 8) |
+			 header[3]);
+
+		if (header[0] & 0x80)
+			/* the last metadata block */
+			return fingerprint_region(fp, offset, end - offset);
+	}
+
+	return false;
+}
+
+/**
+ * Adds the MP4 "moov" atom to the fingerprint; it contains the
+ * "ilst" tags and the track information, and may be anywhere in the
+ * file.
+ */
+static bool
+fingerprint_mp4(struct fingerprint *fp, uint64_t offset)
+{
+	for (unsigned i = 0;
+	     i < SCAN_CACHE_MAX_STRUCTURES && offset < fp->size; ++i) {
+		unsigned char header[16];
+		if (!read_at(fp, offset, header, 8))
+			return false;
+
+		uint64_t size = read_be32(header);
+		if (size == 1) {
+			/* 64 bit size */
+			if (!read_at(fp, offset + 8, header + 8, 8))
+				return false;
+
+			size = ((uint64_t)read_be32(header + 8) << 32) |
+				read_be32(header + 12);
+		} else if (size == 0)
+			/* extends to the end of the file */
+			size = fp->size - offset;
+
+		if (size < 8)
+			return false;
+
+		if (memcmp(header + 4, "moov", 4) == 0)
+			return fingerprint_region(fp, offset, size);
+
+		offset += size;
+	}
+
+	return false;
+}
+
+/**
+ * Adds the Ogg pages up to the one which completes the second packet
+ * to the fingerprint; the first packet is the codec header, the
+ * second one contains the Vorbis comments.
+ */
+static bool
+fingerprint_ogg(struct fingerprint *fp, uint64_t offset)
+{
+	uint64_t end = offset;
+	unsigned packets = 0;
+
+	for (unsigned i = 0; i < SCAN_CACHE_MAX_STRUCTURES; ++i) {
+		unsigned char header[27 + 255];
+		if (!read_at(fp, end, header, 27) ||
+		    memcmp(header, "OggS", 4) != 0)
+			return false;
+
+		unsigned num_segments = header[26];
+		if (!read_at(fp, end + 27, header + 27, num_segments))
+			return false;
+
+		end += 27 + num_segments;
+		for (unsigned j = 0; j < num_segments; ++j) {
+			unsigned lacing = header[27 + j];
+			end += lacing;
+			if (lacing < 255)
+				/* end of a packet */
+				++packets;
+		}
+
+		if (packets >= 2)
+			return fingerprint_region(fp, offset, end - offset);
+	}
+
+	return false;
+}
+
+/**
+ * Adds the tags at the end of the file to the fingerprint: an ID3v1
+ * tag, an APEv2 tag, or an appended ID3v2 tag.  The last few
+ * kilobytes are always covered, larger tags are added as a whole.
+ */
+static bool
+fingerprint_tail(struct fingerprint *fp)
+{
+	uint64_t offset = fp->size > SCAN_CACHE_TAIL_SIZE
+		? fp->size - SCAN_CACHE_TAIL_SIZE : 0;
+	if (!fingerprint_region(fp, offset, fp->size - offset))
+		return false;
+
+	/* the footer is at the end of the file, or followed by a 128
+	   byte ID3v1 tag */
+	for (uint64_t id3v1 = 0; id3v1 <= 128; id3v1 += 128) {
+		if (fp->size < id3v1)
+			break;
+
+		uint64_t end = fp->size - id3v1;
+		unsigned char footer[32];
+		if (end < sizeof(footer) ||
+		    !read_at(fp, end - sizeof(footer), footer, sizeof(footer)))
+			continue;
+
+		uint64_t size = 0;
+		if (memcmp(footer, "APETAGEX", 8) == 0) {
+			size = read_le32(footer + 12);
+			if (read_le32(footer + 20) & 0x80000000)
+				/* header present */
+				size += 32;
+		} else
+			size = id3v2_tag_size(footer + sizeof(footer) - 10,
+					      "3DI");
+
+		if (size > end - offset && size <= end)
+			return fingerprint_region(fp, end - size, size);
+	}
+
+	return true;
+}
+
+/**
+ * Calculates a fingerprint over the size of the file and the regions
+ * where its tags are stored: a leading ID3v2 tag, the FLAC metadata
+ * blocks, the MP4 "moov" atom or the first Ogg packets, and the tags
+ * at the end of the file.  This does not need a decoder plugin.
+ *
+ * Fails if the tag region of the file cannot be located, because
+ * edits outside a fixed region would go unnoticed.  Such files are
+ * always parsed again.
+ */
+static bool
+calc_fingerprint(const char *path_fs, uint64_t size, uint64_t *result)
+{
+	int fd = open_cloexec(path_fs, O_RDONLY|O_BINARY, 0);
+	if (fd < 0)
+		return false;
+
+	struct fingerprint fp = {
+		.fd = fd,
+		.size = size,
+		.hash = size ^ 0xcbf29ce484222325ull,
+		.buffer = malloc(SCAN_CACHE_BUFFER_SIZE),
+	};
+
+	uint64_t offset = 0;
+	unsigned char header[10];
+	bool success = read_at(&fp, 0, header, sizeof(header));
+
+	bool id3v2 = false;
+	if (success) {
+		uint64_t tag_size = id3v2_tag_size(header, "ID3");
+		if (tag_size > 0) {
+			id3v2 = true;
+			success = fingerprint_region(&fp, 0, tag_size) &&
+				read_at(&fp, tag_size, header, 8);
+			offset = tag_size;
+		}
+	}
+
+	if (success) {
+		if (memcmp(header, "fLaC", 4) == 0)
+			success = fingerprint_flac(&fp, offset);
+		else if (memcmp(header + 4, "ftyp", 4) == 0)
+			success = fingerprint_mp4(&fp, offset);
+		else if (memcmp(header, "OggS", 4) == 0)
+			success = fingerprint_ogg(&fp, offset);
+		else
+			/* an MPEG stream has no tags except the ID3v2
+			   tag in front and the tags at the end */
+			success = id3v2 ||
+				(header[0] == 0xff && (header[1] & 0xe0) == 0xe0);
+	}
+
+	success = success && fingerprint_tail(&fp);
+
+	close(fd);
+	free(fp.buffer);
+
+	if (success)
+		*result = fp.hash;
+	return success;
+}
+
+bool
+scan_cache_enabled(void)
+{
+	return cache_path != NULL;
+}
+
+bool
+scan_cache_unchanged(const char *path_fs, const struct stat *st,
+		     bool verify)
+{
+	if (cache_path == NULL)
+		return false;
+
+	mtx_lock(&cache_mutex);
+
+	struct scan_cache_entry *entry =
+		scan_cache_bucket(st->st_dev, st->st_ino);
+	if (!entry->used || entry->size != (uint64_t)st->st_size) {
+		mtx_unlock(&cache_mutex);
+		return false;
+	}
+
+	entry->seen = true;
+
+	if (entry->mtime == st->st_mtime && !verify) {
+		mtx_unlock(&cache_mutex);
+		return true;
+	}
+
+	uint64_t fingerprint = entry->fingerprint;
+	bool same_mtime = entry->mtime == st->st_mtime;
+	mtx_unlock(&cache_mutex);
+
+	/* read the file without holding the lock */
+	uint64_t current;
+	if (!calc_fingerprint(path_fs, st->st_size, &current) ||
+	    current != fingerprint)
+		return false;
+
+	if (!same_mtime) {
+		/* remember the new time stamp, so the next update
+		   does not need to read the file again */
+		mtx_lock(&cache_mutex);
+		entry = scan_cache_make(st->st_dev, st->st_ino);
+		entry->mtime = st->st_mtime;
+		cache_dirty = true;
+		mtx_unlock(&cache_mutex);
+	}
+
+	return true;
+}
+
+void
+scan_cache_store(const char *path_fs, const struct stat *st)
+{
+	if (cache_path == NULL)
+		return;
+
+	uint64_t fingerprint;
+	if (!calc_fingerprint(path_fs, st->st_size, &fingerprint))
+		return;
+
+	mtx_lock(&cache_mutex);
+
+	struct scan_cache_entry *entry =
+		scan_cache_make(st->st_dev, st->st_ino);
+	entry->size = st->st_size;
+	entry->mtime = st->st_mtime;
+	entry->fingerprint = fingerprint;
+	entry->seen = true;
+	cache_dirty = true;
+
+	mtx_unlock(&cache_mutex);
+}
+
+void
+scan_cache_mark(const struct stat *st)
+{
+	if (cache_path == NULL)
+		return;
+
+	mtx_lock(&cache_mutex);
+
+	struct scan_cache_entry *entry =
+		scan_cache_bucket(st->st_dev, st->st_ino);
+	if (entry->used)
+		entry->seen = true;
+
+	mtx_unlock(&cache_mutex);
+}
+
+void
+scan_cache_begin(void)
+{
+	if (cache_path == NULL)
+		return;
+
+	mtx_lock(&cache_mutex);
+
+	for (size_t i = 0; i <= cache_mask; ++i)
+		cache_buckets[i].seen = false;
+
+	mtx_unlock(&cache_mutex);
+}
+
+void
+scan_cache_end(void)
+{
+	if (cache_path == NULL)
+		return;
+
+	mtx_lock(&cache_mutex);
+
+	size_t old_count = cache_count;
+	scan_cache_rehash(cache_mask + 1, true);
+	if (cache_count != old_count) {
+		log_debug("forgot %zu files", old_count - cache_count);
+		cache_dirty = true;
+	}
+
+	mtx_unlock(&cache_mutex);
+}
+
+/**
+ * Reads and checks the header of the cache file.  The cache is only
+ * valid if the same tag types were enabled when it was written.
+ */
+static bool
+scan_cache_load_header(FILE *file)
+{
+	char line[256];
+	bool tags[TAG_NUM_OF_ITEM_TYPES];
+	int format = 0;
+
+	memset(tags, false, sizeof(tags));
+
+	while (fgets(line, sizeof(line), file) != NULL) {
+		line[strcspn(line, "\n")] = 0;
+
+		if (strcmp(line, SCAN_CACHE_INFO_END) == 0) {
+			if (format != SCAN_CACHE_FORMAT)
+				return false;
+
+			for (unsigned i = 0; i < TAG_NUM_OF_ITEM_TYPES; ++i)
+				if (tags[i] == ignore_tag_items[i])
+					return false;
+
+			return true;
+		}
+
+		if (strncmp(line, SCAN_CACHE_FORMAT_PREFIX,
+			    sizeof(SCAN_CACHE_FORMAT_PREFIX) - 1) == 0) {
+			format = atoi(line +
+				      sizeof(SCAN_CACHE_FORMAT_PREFIX) - 1);
+		} else if (strncmp(line, SCAN_CACHE_TAG_PREFIX,
+				   sizeof(SCAN_CACHE_TAG_PREFIX) - 1) == 0) {
+			const char *name =
+				line + sizeof(SCAN_CACHE_TAG_PREFIX) - 1;
+			enum tag_type type = tag_name_parse(name);
+			if (type == TAG_NUM_OF_ITEM_TYPES)
+				return false;
+
+			tags[type] = true;
+		} else
+			return false;
+	}
+
+	return false;
+}
+
+static void
+scan_cache_load(void)
+{
+	FILE *file = fopen(cache_path, "r");
+	if (file == NULL) {
+		if (errno != ENOENT)
+			log_warning("Failed to open %s: %s",
+				    cache_path, strerror(errno));
+		return;
+	}
+
+	if (!scan_cache_load_header(file)) {
+		log_info("Discarding %s, because the tag configuration "
+			 "has changed", cache_path);
+		fclose(file);
+		return;
+	}
+
+	char line[256];
+	while (fgets(line, sizeof(line), file) != NULL) {
+		uint64_t device, inode, size, fingerprint;
+		int64_t mtime;
+
+		if (sscanf(line, "%" SCNx64 " %" SCNx64 " %" SCNx64
+			   " %" SCNd64 " %" SCNx64,
+			   &device, &inode, &size, &mtime,
+			   &fingerprint) != 5) {
+			log_warning("Malformed line in %s", cache_path);
+			break;
+		}
+
+		struct scan_cache_entry *entry =
+			scan_cache_make(device, inode);
+		entry->size = size;
+		entry->mtime = mtime;
+		entry->fingerprint = fingerprint;
+	}
+
+	fclose(file);
+
+	log_debug("loaded %zu files", cache_count);
+}
+
+int
+scan_cache_save(void)
+{
+	if (cache_path == NULL)
+		return MPD_SUCCESS;
+
+	mtx_lock(&cache_mutex);
+
+	if (!cache_dirty) {
+		mtx_unlock(&cache_mutex);
+		return MPD_SUCCESS;
+	}
+
+	/* write a new file and replace the old one, so a crash does
+	   not leave a truncated cache behind */
+	size_t length = strlen(cache_path);
+	char *tmp_path = malloc(length + 5);
+	memcpy(tmp_path, cache_path, length);
+	memcpy(tmp_path + length, ".tmp", 5);
+
+	FILE *file = fopen(tmp_path, "w");
+	if (file == NULL) {
+		mtx_unlock(&cache_mutex);
+		log_warning("Failed to create %s: %s",
+			    tmp_path, strerror(errno));
+		free(tmp_path);
+		return -MPD_ACCESS;
+	}
+
+	fprintf(file, SCAN_CACHE_FORMAT_PREFIX "%u\n", SCAN_CACHE_FORMAT);
+	for (unsigned i = 0; i < TAG_NUM_OF_ITEM_TYPES; ++i)
+		if (!ignore_tag_items[i])
+			fprintf(file, SCAN_CACHE_TAG_PREFIX "%s\n",
+				tag_item_names[i]);
+	fprintf(file, SCAN_CACHE_INFO_END "\n");
+
+	for (size_t i = 0; i <= cache_mask; ++i) {
+		const struct scan_cache_entry *entry = &cache_buckets[i];
+		if (!entry->used)
+			continue;
+
+		fprintf(file, "%" PRIx64 " %" PRIx64 " %" PRIx64
+			" %" PRId64 " %" PRIx64 "\n",
+			entry->device, entry->inode, entry->size,
+			entry->mtime, entry->fingerprint);
+	}
+
+	cache_dirty = false;
+	mtx_unlock(&cache_mutex);
+
+	bool success = fflush(file) == 0 && !ferror(file);
+	success = fclose(file) == 0 && success;
+
+	if (!success || rename(tmp_path, cache_path) < 0) {
+		log_warning("Failed to write %s: %s",
+			    cache_path, strerror(errno));
+		unlink(tmp_path);
+		free(tmp_path);
+
+		mtx_lock(&cache_mutex);
+		cache_dirty = true;
+		mtx_unlock(&cache_mutex);
+		return -MPD_ACCESS;
+	}
+
+	free(tmp_path);
+	return MPD_SUCCESS;
+}
+
+void
+scan_cache_global_init(void)
+{
+	char *path = config_dup_path(CONF_SCAN_CACHE);
+	if (IS_ERR_OR_NULL(path))
+		return;
+
+	cache_path = path;
+	mtx_init(&cache_mutex, mtx_plain);
+	scan_cache_rehash(SCAN_CACHE_MIN_BUCKETS, false);
+	scan_cache_load();
+	cache_dirty = false;
+}
+
+void
+scan_cache_global_finish(void)
+{
+	if (cache_path == NULL)
+		return;
+
+	free(cache_buckets);
+	cache_buckets = NULL;
+	mtx_destroy(&cache_mutex);
+	free(cache_path);
+	cache_path = NULL;
+}
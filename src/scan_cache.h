@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * The scan cache remembers a fingerprint of the tag region of each
+ * song file, keyed by its device and inode number.  When only the
+ * modification time of a file has changed (after copying a library
+ * without preserving time stamps, for example), the fingerprint shows
+ * that the tags are still the same, and the update does not need to
+ * parse them again.  Files whose tag region cannot be located (an
+ * unknown container, for example) are always parsed.
+ *
+ * The cache is saved to the file configured with "scan_cache", and is
+ * disabled without that setting.  All functions may be called from
+ * the worker threads of a parallel update.
+ */
+
+#ifndef MPD_SCAN_CACHE_H
+#define MPD_SCAN_CACHE_H
+
+#include <stdbool.h>
+#include <sys/stat.h>
+
+void
+scan_cache_global_init(void);
+
+void
+scan_cache_global_finish(void);
+
+bool
+scan_cache_enabled(void);
+
+/**
+ * Checks whether the tags of a file are the same as when
+ * scan_cache_store() was last called for it.  If the size and the
+ * modification time are unchanged, this is assumed without reading
+ * the file, unless #verify is set.  Otherwise, the fingerprint is
+ * calculated and compared.
+ *
+ * @param path_fs the path of the file in file system encoding
+ * @param st stat() information on the file
+ */
+bool
+scan_cache_unchanged(const char *path_fs, const struct stat *st,
+		     bool verify);
+
+/**
+ * Remembers the fingerprint of a file whose tags were just parsed.
+ */
+void
+scan_cache_store(const char *path_fs, const struct stat *st);
+
+/**
+ * Marks a file as still existing, so scan_cache_end() keeps its
+ * entry.
+ */
+void
+scan_cache_mark(const struct stat *st);
+
+/**
+ * Called before an update of the whole music directory.
+ */
+void
+scan_cache_begin(void);
+
+/**
+ * Called after an update of the whole music directory; forgets all
+ * files which were not seen since scan_cache_begin().
+ */
+void
+scan_cache_end(void);
+
+/**
+ * Writes the cache to its file, if it has been modified.
+ *
+ * @return MPD_SUCCESS or a negative error code
+ */
+int
+scan_cache_save(void);
+
+#endif
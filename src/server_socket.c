@@ -147,6 +147,14 @@ get_remote_uid(int fd)
 #endif
 }
 
+enum {
+	/**
+	 * The maximum number of connections accepted in one
+	 * server_socket_in_event() call.
+	 */
+	SERVER_SOCKET_MAX_ACCEPT = 64,
+};
+
 static gboolean
 server_socket_in_event(GIOChannel *source,
 		       GIOCondition condition,
@@ -154,19 +162,33 @@ server_socket_in_event(GIOChannel *source,
 {
 	struct one_socket *s = data;
 
-	struct sockaddr_storage address;
-	size_t address_length = sizeof(address);
-	int fd = accept_cloexec_nonblock(s->fd, (struct sockaddr*)&address,
-					 &address_length);
-	if (fd >= 0) {
+	(void)source;
+	(void)condition;
+
+	/* drain the backlog instead of waking up once per
+	   connection; the rest is accepted on the next iteration */
+	for (unsigned i = 0; i < SERVER_SOCKET_MAX_ACCEPT; ++i) {
+		struct sockaddr_storage address;
+		size_t address_length = sizeof(address);
+		int fd = accept_cloexec_nonblock(s->fd,
+						 (struct sockaddr*)&address,
+						 &address_length);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				log_warning("accept() failed: %s",
+					    strerror(errno));
+			break;
+		}
+
 		if (socket_keepalive(fd))
 			log_warning("Could not set TCP keepalive option: %s",
 				  strerror(errno));
 		s->parent->callback(fd, (const struct sockaddr*)&address,
 				    address_length, get_remote_uid(fd),
 				    s->parent->callback_ctx);
-	} else {
-		log_warning("accept() failed: %s", strerror(errno));
 	}
 
 	return true;
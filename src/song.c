@@ -46,6 +46,8 @@ song_alloc(const char *uri, struct directory *parent)
 	song->parent = parent;
 	song->mtime = 0;
 	song->start_ms = song->end_ms = 0;
+	song->tag_index_slots = NULL;
+	song->db_order = 0;
 
 	return song;
 }
@@ -67,6 +69,8 @@ song_file_new(const char *path, struct directory *parent)
 struct song *
 song_replace_uri(struct song *old_song, const char *uri)
 {
+	assert(old_song->tag_index_slots == NULL);
+
 	struct song *new_song = song_alloc(uri, old_song->parent);
 	new_song->tag = old_song->tag;
 	new_song->mtime = old_song->mtime;
@@ -79,6 +83,8 @@ song_replace_uri(struct song *old_song, const char *uri)
 void
 song_free(struct song *song)
 {
+	assert(song->tag_index_slots == NULL);
+
 	if (song->tag)
 		tag_free(song->tag);
 	free(song);
@@ -55,6 +55,24 @@ struct song {
 	 */
 	unsigned end_ms;
 
+	/**
+	 * For each item of #tag, the position of this song in the
+	 * #tag_index posting of that item.  NULL if this song is not
+	 * in the tag index.
+	 *
+	 * This attribute is protected with the global #db_mutex.
+	 */
+	unsigned *tag_index_slots;
+
+	/**
+	 * The position of this song in a directory_walk() of the
+	 * whole database, see song_array_sort_db_order().  Only valid
+	 * while #db_generation has not changed since it was assigned.
+	 *
+	 * This attribute is protected with the global #db_mutex.
+	 */
+	unsigned db_order;
+
 	char uri[sizeof(int)];
 };
 
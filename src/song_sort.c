@@ -20,6 +20,8 @@
 #include "config.h"
 #include "song_sort.h"
 #include "song.h"
+#include "directory.h"
+#include "db_lock.h"
 #include "util/list.h"
 #include "util/list_sort.h"
 #include "tag.h"
@@ -89,10 +91,8 @@ compare_tag_item(const struct tag *a, const struct tag *b, enum tag_type type)
 
 /* Only used for sorting/searchin a songvec, not general purpose compares */
 static int
-song_cmp(void *priv, struct list_head *_a, struct list_head *_b)
+song_compare(const struct song *a, const struct song *b)
 {
-	const struct song *a = (const struct song *)_a;
-	const struct song *b = (const struct song *)_b;
 	int ret;
 
 	/* first sort by album */
@@ -114,8 +114,84 @@ song_cmp(void *priv, struct list_head *_a, struct list_head *_b)
 	return g_utf8_collate(a->uri, b->uri);
 }
 
+static int
+song_cmp(void *priv, struct list_head *_a, struct list_head *_b)
+{
+	return song_compare((const struct song *)_a, (const struct song *)_b);
+}
+
 void
 song_list_sort(struct list_head *songs)
 {
 	list_sort(NULL, songs, song_cmp);
 }
+
+/**
+ * The #db_generation at which the songs have last been numbered by
+ * song_db_order_update().  Protected with the #db_mutex.
+ */
+static unsigned db_order_generation;
+static bool db_order_valid;
+
+/**
+ * Numbers the songs below @directory in directory_walk() order,
+ * starting with @n.  Returns the next free number.
+ */
+static unsigned
+directory_number_songs(struct directory *directory, unsigned n)
+{
+	struct song *song;
+	directory_for_each_song(song, directory)
+		song->db_order = n++;
+
+	struct directory *child;
+	directory_for_each_child(child, directory)
+		n = directory_number_songs(child, n);
+
+	return n;
+}
+
+/**
+ * Renumbers all songs in the tree of @song if a song or directory
+ * has been added, removed or reordered since the last call.
+ */
+static void
+song_db_order_update(const struct song *song)
+{
+	unsigned generation = atomic_load_explicit(&db_generation,
+						   memory_order_relaxed);
+	if (db_order_valid && generation == db_order_generation)
+		return;
+
+	struct directory *root = song->parent;
+	while (root->parent != NULL)
+		root = root->parent;
+
+	directory_number_songs(root, 0);
+
+	db_order_generation = generation;
+	db_order_valid = true;
+}
+
+static int
+song_cmp_db_order(const void *_a, const void *_b)
+{
+	const struct song *a = *(const struct song *const *)_a;
+	const struct song *b = *(const struct song *const *)_b;
+
+	return a->db_order < b->db_order
+		? -1
+		: a->db_order > b->db_order;
+}
+
+void
+song_array_sort_db_order(struct song **songs, unsigned length)
+{
+	assert(holding_db_lock());
+
+	if (length == 0)
+		return;
+
+	song_db_order_update(songs[0]);
+	qsort(songs, length, sizeof(songs[0]), song_cmp_db_order);
+}
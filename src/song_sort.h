@@ -21,8 +21,16 @@
 #define MPD_SONG_SORT_H
 
 struct list_head;
+struct song;
 
 void
 song_list_sort(struct list_head *songs);
 
+/**
+ * Sorts an array of songs in the database by the order in which
+ * directory_walk() visits them.  Caller must lock the #db_mutex.
+ */
+void
+song_array_sort_db_order(struct song **songs, unsigned length);
+
 #endif
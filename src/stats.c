@@ -20,13 +20,13 @@
 #include "config.h"
 #include "stats.h"
 #include "database.h"
-#include "db_visitor.h"
 #include "tag.h"
-#include "song.h"
+#include "tag_index.h"
 #include "client.h"
 #include "player_control.h"
-#include "strset.h"
 #include "client_internal.h"
+#include "trigram_index.h"
+#include "db_lock.h"
 
 struct stats stats;
 
@@ -40,70 +40,21 @@ void stats_global_finish(void)
 	g_timer_destroy(stats.timer);
 }
 
-struct visit_data {
-	struct strset *artists;
-	struct strset *albums;
-};
-
-static void
-visit_tag(struct visit_data *data, const struct tag *tag)
-{
-	if (tag->time > 0)
-		stats.song_duration += tag->time;
-
-	for (unsigned i = 0; i < tag->num_items; ++i) {
-		const struct tag_item *item = tag->items[i];
-
-		switch (item->type) {
-		case TAG_ARTIST:
-			strset_add(data->artists, item->value);
-			break;
-
-		case TAG_ALBUM:
-			strset_add(data->albums, item->value);
-			break;
-
-		default:
-			break;
-		}
-	}
-}
-
-static int
-collect_stats_song(struct song *song, void *_data)
-{
-	struct visit_data *data = _data;
-
-	++stats.song_count;
-
-	if (song->tag != NULL)
-		visit_tag(data, song->tag);
-
-	return MPD_SUCCESS;
-}
-
-static const struct db_visitor collect_stats_visitor = {
-	.song = collect_stats_song,
-};
-
+/**
+ * Copies the counters from the tag index, which keeps them up to date
+ * while songs are added to and removed from the database, so this
+ * does not need to walk the database.
+ */
 void stats_update(void)
 {
-	struct visit_data data;
-
-	stats.song_count = 0;
-	stats.song_duration = 0;
-	stats.artist_count = 0;
+	db_lock();
 
-	data.artists = strset_new();
-	data.albums = strset_new();
+	stats.song_count = tag_index_count_songs();
+	stats.song_duration = tag_index_total_time();
+	stats.artist_count = tag_index_count_values(TAG_ARTIST);
+	stats.album_count = tag_index_count_values(TAG_ALBUM);
 
-	db_walk("", &collect_stats_visitor, &data);
-
-	stats.artist_count = strset_size(data.artists);
-	stats.album_count = strset_size(data.albums);
-
-	strset_free(data.artists);
-	strset_free(data.albums);
+	db_unlock();
 }
 
 int stats_print(struct client *client)
@@ -123,5 +74,15 @@ int stats_print(struct client *client)
 		      (long)(pc_get_total_play_time(client->player_control) + 0.5),
 		      stats.song_duration,
 		      (long)db_get_mtime());
+
+	if (trigram_index_enabled()) {
+		db_lock();
+		size_t memory = trigram_index_memory();
+		db_unlock();
+
+		client_printf(client, "search_index_memory: %lu\n",
+			      (unsigned long)memory);
+	}
+
 	return 0;
 }
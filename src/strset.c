@@ -29,7 +29,7 @@
 
 struct strset_slot {
 	struct strset_slot *next;
-	const char *value;
+	char *value;
 };
 
 struct strset {
@@ -65,8 +65,11 @@ void strset_free(struct strset *set)
 	for (i = 0; i < NUM_SLOTS; ++i) {
 		struct strset_slot *slot = set->slots[i].next, *next;
 
+		free(set->slots[i].value);
+
 		while (slot != NULL) {
 			next = slot->next;
+			free(slot->value);
 			free(slot);
 			slot = next;
 		}
@@ -85,7 +88,7 @@ void strset_add(struct strset *set, const char *value)
 		/* empty slot - put into base_slot */
 		assert(base_slot->next == NULL);
 
-		base_slot->value = value;
+		base_slot->value = strdup(value);
 		++set->size;
 		return;
 	}
@@ -98,7 +101,7 @@ void strset_add(struct strset *set, const char *value)
 	/* insert it into the slot chain */
 	slot = tmalloc(struct strset_slot, 1);
 	slot->next = base_slot->next;
-	slot->value = value;
+	slot->value = strdup(value);
 	base_slot->next = slot;
 	++set->size;
 }
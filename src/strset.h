@@ -22,8 +22,9 @@
  * library, and it stores them as a set of unique strings.  You can
  * get the size of the set, and you can enumerate through all values.
  *
- * It is important to note that the strset does not copy the string
- * values - it stores the exact pointers it was given in strset_add().
+ * The strset stores a copy of each value, so the strings passed to
+ * strset_add() need not outlive the call, e.g. tag values which are
+ * only valid while the #db_mutex is held.
  */
 
 #pragma once
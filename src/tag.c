@@ -37,7 +37,11 @@
  */
 #define BULK_MAX 64
 
-static struct {
+/**
+ * The bulk list is per thread, so several threads may build tags
+ * concurrently (e.g. when loading the database in parallel).
+ */
+static _Thread_local struct {
 #ifndef NDEBUG
 	bool busy;
 #endif
@@ -169,9 +173,7 @@ static void tag_delete_item(struct tag *tag, unsigned idx)
 	assert(idx < tag->num_items);
 	tag->num_items--;
 
-	g_mutex_lock(tag_pool_lock);
 	tag_pool_put_item(tag->items[idx]);
-	g_mutex_unlock(tag_pool_lock);
 
 	if (tag->num_items - idx > 0) {
 		memmove(tag->items + idx, tag->items + idx + 1,
@@ -203,10 +205,8 @@ void tag_free(struct tag *tag)
 
 	assert(tag != NULL);
 
-	g_mutex_lock(tag_pool_lock);
 	for (i = tag->num_items; --i >= 0; )
 		tag_pool_put_item(tag->items[i]);
-	g_mutex_unlock(tag_pool_lock);
 
 	if (tag->items == bulk.items) {
 #ifndef NDEBUG
@@ -232,10 +232,8 @@ struct tag *tag_dup(const struct tag *tag)
 	ret->num_items = tag->num_items;
 	ret->items = ret->num_items > 0 ? malloc(items_size(tag)) : NULL;
 
-	g_mutex_lock(tag_pool_lock);
 	for (unsigned i = 0; i < tag->num_items; i++)
 		ret->items[i] = tag_pool_dup_item(tag->items[i]);
-	g_mutex_unlock(tag_pool_lock);
 
 	return ret;
 }
@@ -256,8 +254,6 @@ tag_merge(const struct tag *base, const struct tag *add)
 	ret->num_items = base->num_items + add->num_items;
 	ret->items = ret->num_items > 0 ? malloc(items_size(ret)) : NULL;
 
-	g_mutex_lock(tag_pool_lock);
-
 	/* copy all items from "add" */
 
 	for (unsigned i = 0; i < add->num_items; ++i)
@@ -271,8 +267,6 @@ tag_merge(const struct tag *base, const struct tag *add)
 		if (!tag_has_type(add, base->items[i]->type))
 			ret->items[n++] = tag_pool_dup_item(base->items[i]);
 
-	g_mutex_unlock(tag_pool_lock);
-
 	assert(n <= ret->num_items);
 
 	if (n < ret->num_items) {
@@ -503,9 +497,7 @@ tag_add_item_internal(struct tag *tag, enum tag_type type,
 		       items_size(tag) - sizeof(struct tag_item *));
 	}
 
-	g_mutex_lock(tag_pool_lock);
 	tag->items[i] = tag_pool_get_item(type, value, len);
-	g_mutex_unlock(tag_pool_lock);
 
 	free(p);
 }
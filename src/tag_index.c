@@ -0,0 +1,400 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "tag_index.h"
+#include "song.h"
+#include "directory.h"
+#include "db_lock.h"
+#include "locate.h"
+#include "song_sort.h"
+
+#include <glib.h>
+
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* marks a duplicate item within one song's tag, which is not indexed */
+#define SLOT_NONE UINT_MAX
+
+/**
+ * The songs which carry one (type, value) pair.  The hash key is the
+ * value of the interned #tag_item, which lives as long as at least
+ * one song in the entry refers to it.
+ */
+struct tag_index_entry {
+	const struct tag_item *item;
+
+	struct song **songs;
+	unsigned length, capacity;
+};
+
+static bool active;
+
+/** one table per tag type: value -> struct tag_index_entry */
+static GHashTable *values[TAG_NUM_OF_ITEM_TYPES];
+
+static unsigned total_songs;
+
+/** the sum of the durations of all indexed songs, in seconds */
+static unsigned long total_time;
+
+/** the number of songs with at least one item of each type */
+static unsigned with_type[TAG_NUM_OF_ITEM_TYPES];
+
+static void
+tag_index_entry_free(gpointer data)
+{
+	struct tag_index_entry *entry = data;
+
+	free(entry->songs);
+	g_free(entry);
+}
+
+static struct tag_index_entry *
+tag_index_entry_get(const struct tag_item *item)
+{
+	GHashTable *table = values[item->type];
+	struct tag_index_entry *entry =
+		g_hash_table_lookup(table, item->value);
+	if (entry != NULL) {
+		assert(entry->item == item);
+		return entry;
+	}
+
+	entry = g_new(struct tag_index_entry, 1);
+	entry->item = item;
+	entry->songs = NULL;
+	entry->length = entry->capacity = 0;
+	g_hash_table_insert(table, (gpointer)(uintptr_t)item->value, entry);
+	return entry;
+}
+
+/**
+ * Returns the position of the first occurrence of @item within the
+ * tag.
+ */
+static unsigned
+tag_find_item(const struct tag *tag, const struct tag_item *item)
+{
+	for (unsigned i = 0; i < tag->num_items; i++)
+		if (tag->items[i] == item)
+			return i;
+
+	assert(false);
+	return 0;
+}
+
+void
+tag_index_add_song(struct song *song)
+{
+	assert(holding_db_lock());
+	assert(song->tag_index_slots == NULL);
+
+	if (!active)
+		return;
+
+	const struct tag *tag = song->tag;
+	unsigned num_items = tag != NULL ? tag->num_items : 0;
+	bool seen[TAG_NUM_OF_ITEM_TYPES] = { false };
+
+	/* allocate at least one slot, a non-NULL pointer marks the
+	   song as indexed */
+	song->tag_index_slots = malloc(sizeof(song->tag_index_slots[0]) *
+				       (num_items > 0 ? num_items : 1));
+	++total_songs;
+
+	if (tag != NULL && tag->time > 0)
+		total_time += tag->time;
+
+	for (unsigned i = 0; i < num_items; i++) {
+		const struct tag_item *item = tag->items[i];
+
+		if (tag_find_item(tag, item) != i) {
+			/* the same item twice in one tag */
+			song->tag_index_slots[i] = SLOT_NONE;
+			continue;
+		}
+
+		if (!seen[item->type]) {
+			seen[item->type] = true;
+			++with_type[item->type];
+		}
+
+		struct tag_index_entry *entry = tag_index_entry_get(item);
+		if (entry->length == entry->capacity) {
+			entry->capacity = entry->capacity > 0
+				? entry->capacity * 2 : 4;
+			entry->songs = realloc(entry->songs,
+					       sizeof(entry->songs[0]) *
+					       entry->capacity);
+		}
+
+		song->tag_index_slots[i] = entry->length;
+		entry->songs[entry->length++] = song;
+	}
+}
+
+void
+tag_index_remove_song(struct song *song)
+{
+	assert(holding_db_lock());
+
+	if (song->tag_index_slots == NULL)
+		return;
+
+	const struct tag *tag = song->tag;
+	unsigned num_items = tag != NULL ? tag->num_items : 0;
+	bool seen[TAG_NUM_OF_ITEM_TYPES] = { false };
+
+	for (unsigned i = 0; i < num_items; i++) {
+		unsigned slot = song->tag_index_slots[i];
+		if (slot == SLOT_NONE)
+			continue;
+
+		const struct tag_item *item = tag->items[i];
+		if (!seen[item->type]) {
+			seen[item->type] = true;
+			--with_type[item->type];
+		}
+
+		struct tag_index_entry *entry =
+			g_hash_table_lookup(values[item->type], item->value);
+		assert(entry != NULL);
+		assert(slot < entry->length);
+		assert(entry->songs[slot] == song);
+
+		if (--entry->length == 0) {
+			g_hash_table_remove(values[item->type], item->value);
+			continue;
+		}
+
+		/* move the last song into the hole, and tell it its
+		   new position */
+		struct song *last = entry->songs[entry->length];
+		if (last != song) {
+			entry->songs[slot] = last;
+			last->tag_index_slots[tag_find_item(last->tag, item)] =
+				slot;
+		}
+	}
+
+	free(song->tag_index_slots);
+	song->tag_index_slots = NULL;
+	--total_songs;
+
+	if (tag != NULL && tag->time > 0)
+		total_time -= tag->time;
+}
+
+void
+tag_index_remove_directory(struct directory *directory)
+{
+	assert(holding_db_lock());
+
+	if (!active)
+		return;
+
+	struct song *song;
+	directory_for_each_song(song, directory)
+		tag_index_remove_song(song);
+
+	struct directory *child;
+	directory_for_each_child(child, directory)
+		tag_index_remove_directory(child);
+}
+
+static void
+tag_index_add_directory(struct directory *directory)
+{
+	struct song *song;
+	directory_for_each_song(song, directory)
+		tag_index_add_song(song);
+
+	struct directory *child;
+	directory_for_each_child(child, directory)
+		tag_index_add_directory(child);
+}
+
+void
+tag_index_build(struct directory *root)
+{
+	assert(holding_db_lock());
+	assert(!active);
+
+	for (unsigned i = 0; i < TAG_NUM_OF_ITEM_TYPES; i++) {
+		values[i] = g_hash_table_new_full(g_str_hash, g_str_equal,
+						  NULL, tag_index_entry_free);
+		with_type[i] = 0;
+	}
+
+	total_songs = 0;
+	total_time = 0;
+	active = true;
+
+	tag_index_add_directory(root);
+}
+
+void
+tag_index_clear(struct directory *root)
+{
+	assert(holding_db_lock());
+
+	if (!active)
+		return;
+
+	tag_index_remove_directory(root);
+	assert(total_songs == 0);
+	assert(total_time == 0);
+
+	for (unsigned i = 0; i < TAG_NUM_OF_ITEM_TYPES; i++) {
+		assert(g_hash_table_size(values[i]) == 0);
+		g_hash_table_destroy(values[i]);
+		values[i] = NULL;
+	}
+
+	active = false;
+}
+
+bool
+tag_index_active(void)
+{
+	return active;
+}
+
+struct song *const *
+tag_index_lookup(enum tag_type type, const char *value, unsigned *length_r)
+{
+	assert(holding_db_lock());
+	assert(active);
+	assert(type < TAG_NUM_OF_ITEM_TYPES);
+
+	const struct tag_index_entry *entry =
+		g_hash_table_lookup(values[type], value);
+	if (entry == NULL) {
+		*length_r = 0;
+		return NULL;
+	}
+
+	*length_r = entry->length;
+	return entry->songs;
+}
+
+bool
+tag_index_candidates(const struct locate_item_list *criteria,
+		     struct song ***songs_r, unsigned *length_r)
+{
+	assert(holding_db_lock());
+
+	if (!active)
+		return false;
+
+	const struct tag_index_entry *best = NULL;
+	bool found = false;
+
+	for (unsigned i = 0; i < criteria->length; i++) {
+		const struct locate_item *item = &criteria->items[i];
+
+		/* an empty needle also matches songs without the
+		   tag, which are not in any posting */
+		if (item->tag < 0 || item->tag >= TAG_NUM_OF_ITEM_TYPES ||
+		    *item->needle == 0)
+			continue;
+
+		const struct tag_index_entry *entry =
+			g_hash_table_lookup(values[item->tag], item->needle);
+		if (!found || entry == NULL ||
+		    (best != NULL && entry->length < best->length)) {
+			best = entry;
+			found = true;
+		}
+
+		if (best == NULL)
+			/* no song can match */
+			break;
+	}
+
+	if (!found)
+		return false;
+
+	struct song **songs = NULL;
+	unsigned length = best != NULL ? best->length : 0;
+	if (length > 0) {
+		songs = malloc(sizeof(songs[0]) * length);
+		memcpy(songs, best->songs, sizeof(songs[0]) * length);
+		song_array_sort_db_order(songs, length);
+	}
+
+	*songs_r = songs;
+	*length_r = length;
+	return true;
+}
+
+void
+tag_index_for_each_value(enum tag_type type,
+			 void (*callback)(const char *value, void *ctx),
+			 void *ctx)
+{
+	assert(holding_db_lock());
+	assert(active);
+	assert(type < TAG_NUM_OF_ITEM_TYPES);
+
+	GHashTableIter iter;
+	gpointer key, value;
+
+	g_hash_table_iter_init(&iter, values[type]);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+		callback(key, ctx);
+}
+
+unsigned
+tag_index_count_missing(enum tag_type type)
+{
+	assert(holding_db_lock());
+	assert(active);
+	assert(type < TAG_NUM_OF_ITEM_TYPES);
+
+	return total_songs - with_type[type];
+}
+
+unsigned
+tag_index_count_songs(void)
+{
+	assert(holding_db_lock());
+
+	return total_songs;
+}
+
+unsigned long
+tag_index_total_time(void)
+{
+	assert(holding_db_lock());
+
+	return total_time;
+}
+
+unsigned
+tag_index_count_values(enum tag_type type)
+{
+	assert(holding_db_lock());
+	assert(type < TAG_NUM_OF_ITEM_TYPES);
+
+	return active ? g_hash_table_size(values[type]) : 0;
+}
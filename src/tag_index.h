@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * An inverted index over the tags of all songs in the database: for
+ * every (tag type, value) pair, the list of songs carrying it.  It
+ * allows exact "find", "count" and "list" queries without scanning
+ * the whole database.
+ *
+ * The index is protected by the #db_mutex.  It is built once after
+ * the database has been loaded, and then kept up to date by
+ * directory_add_song(), directory_remove_song() and
+ * directory_delete().
+ */
+
+#pragma once
+
+#include "tag.h"
+#include "compiler.h"
+
+#include <stdbool.h>
+
+struct song;
+struct directory;
+struct locate_item_list;
+
+/**
+ * Indexes all songs below @root and activates the index.
+ *
+ * Caller must lock the #db_mutex.
+ */
+void
+tag_index_build(struct directory *root);
+
+/**
+ * Deactivates the index and forgets all songs below @root.
+ *
+ * Caller must lock the #db_mutex.
+ */
+void
+tag_index_clear(struct directory *root);
+
+/**
+ * Has the index been built, i.e. does it reflect the database?
+ */
+MPD_PURE
+bool
+tag_index_active(void);
+
+/**
+ * Adds a song which was just attached to the database.  Does nothing
+ * if the index is not active.
+ *
+ * Caller must lock the #db_mutex.
+ */
+void
+tag_index_add_song(struct song *song);
+
+/**
+ * Removes a song from the index, e.g. before it is removed from the
+ * database or before its tag is modified.  Does nothing if the song is
+ * not indexed.
+ *
+ * Caller must lock the #db_mutex.
+ */
+void
+tag_index_remove_song(struct song *song);
+
+/**
+ * Removes all songs below @directory from the index.
+ *
+ * Caller must lock the #db_mutex.
+ */
+void
+tag_index_remove_directory(struct directory *directory);
+
+/**
+ * Returns the (unordered) songs which have a tag item of @type with
+ * exactly @value, or NULL if there are none.  The array is valid until
+ * the #db_mutex is released.
+ *
+ * Caller must lock the #db_mutex.
+ */
+struct song *const *
+tag_index_lookup(enum tag_type type, const char *value, unsigned *length_r);
+
+/**
+ * Looks up the smallest posting for the exact-match criteria in
+ * @criteria.  Returns false if the index cannot narrow down the
+ * query.  On success, the candidates are returned as an array (to be
+ * freed by the caller) in database order; they still have to be
+ * checked with locate_song_match().
+ *
+ * Caller must lock the #db_mutex.
+ */
+bool
+tag_index_candidates(const struct locate_item_list *criteria,
+		     struct song ***songs_r, unsigned *length_r);
+
+/**
+ * Invokes @callback for each distinct value of @type.
+ *
+ * Caller must lock the #db_mutex.
+ */
+void
+tag_index_for_each_value(enum tag_type type,
+			 void (*callback)(const char *value, void *ctx),
+			 void *ctx);
+
+/**
+ * Returns the number of indexed songs which have no tag item of
+ * @type.
+ *
+ * Caller must lock the #db_mutex.
+ */
+MPD_PURE
+unsigned
+tag_index_count_missing(enum tag_type type);
+
+/**
+ * Returns the number of indexed songs, i.e. all songs in the
+ * database while the index is active.
+ *
+ * Caller must lock the #db_mutex.
+ */
+MPD_PURE
+unsigned
+tag_index_count_songs(void);
+
+/**
+ * Returns the sum of the durations of all indexed songs in seconds.
+ *
+ * Caller must lock the #db_mutex.
+ */
+MPD_PURE
+unsigned long
+tag_index_total_time(void);
+
+/**
+ * Returns the number of distinct values of @type.  This is kept up
+ * to date with the index, so it does not need to walk the database.
+ *
+ * Caller must lock the #db_mutex.
+ */
+MPD_PURE
+unsigned
+tag_index_count_values(enum tag_type type);
@@ -19,46 +19,97 @@
 
 #include "config.h"
 #include "tag_pool.h"
+#include "c11thread.h"
+
+#include <glib.h>
 
 #include <assert.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
-GMutex *tag_pool_lock = NULL;
+/**
+ * The pool is split into 2^SHARD_BITS independent open-addressing
+ * tables, selected by the upper bits of the hash, each protected by
+ * its own lock.
+ */
+#define SHARD_BITS 6
+#define NUM_SHARDS (1u << SHARD_BITS)
 
-#define NUM_SLOTS 4096
+/** initial number of buckets in each shard, must be a power of two */
+#define SHARD_MIN_BUCKETS 256
 
 struct slot {
-	struct slot *next;
-	unsigned char ref;
+	atomic_uint ref;
+	uint32_t hash;
+	uint32_t length;
+
+	/**
+	 * The value converted with g_utf8_casefold(), for
+	 * case-insensitive substring search.  It is stored in the
+	 * same allocation behind the value, or points to the value
+	 * itself if folding does not change it.
+	 */
+	const char *folded;
+
 	struct tag_item item;
-} mpd_packed;
+};
 
-static struct slot *slots[NUM_SLOTS];
+/**
+ * One bucket of a shard table.  The hash and the length are kept
+ * next to the pointer, so a probe only dereferences a slot when both
+ * match.
+ */
+struct bucket {
+	uint32_t hash;
+	uint32_t length;
+	struct slot *slot;
+};
 
-static inline unsigned
-calc_hash_n(enum tag_type type, const char *p, size_t length)
-{
-	unsigned hash = 5381;
+struct shard {
+	mtx_t mutex;
 
-	assert(p != NULL);
+	/** the bucket array; NULL until the first insertion */
+	struct bucket *buckets;
 
-	while (length-- > 0)
-		hash = (hash << 5) + hash + *p++;
+	/** number of buckets minus one */
+	size_t mask;
 
-	return hash ^ type;
-}
+	/** number of occupied buckets */
+	size_t count;
+} __attribute__((aligned(64)));
+
+static struct shard shards[NUM_SHARDS];
 
-static inline unsigned
-calc_hash(enum tag_type type, const char *p)
+/**
+ * FNV-1a over the value, with a final avalanche step so both the
+ * upper (shard) and the lower (bucket) bits are usable.
+ */
+static inline uint32_t
+calc_hash(enum tag_type type, const char *p, size_t length)
 {
-	unsigned hash = 5381;
+	uint32_t hash = 2166136261u ^ (uint32_t)type;
 
 	assert(p != NULL);
 
-	while (*p != 0)
-		hash = (hash << 5) + hash + *p++;
+	while (length-- > 0) {
+		hash ^= (unsigned char)*p++;
+		hash *= 16777619u;
+	}
+
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35u;
+	hash ^= hash >> 16;
+	return hash;
+}
 
-	return hash ^ type;
+static inline struct shard *
+hash_to_shard(uint32_t hash)
+{
+	return &shards[hash >> (32 - SHARD_BITS)];
 }
 
 static inline struct slot *
@@ -67,53 +118,159 @@ tag_item_to_slot(struct tag_item *item)
 	return (struct slot*)(((char*)item) - offsetof(struct slot, item));
 }
 
-static struct slot *slot_alloc(struct slot *next,
-			       enum tag_type type,
-			       const char *value, int length)
+static struct slot *
+slot_alloc(uint32_t hash, enum tag_type type,
+	   const char *value, size_t length)
 {
 	struct slot *slot;
+	char *folded = g_utf8_casefold(value, length);
+	size_t folded_size = strlen(folded) + 1;
+	bool same = folded_size == length + 1 &&
+		memcmp(folded, value, length) == 0;
 
-	slot = malloc(sizeof(*slot) + length + 1);
-	slot->next = next;
-	slot->ref = 1;
+	slot = malloc(sizeof(*slot) + length + 1 + (same ? 0 : folded_size));
+	atomic_init(&slot->ref, 1);
+	slot->hash = hash;
+	slot->length = length;
 	slot->item.type = type;
 	memcpy(slot->item.value, value, length);
 	slot->item.value[length] = 0;
+
+	if (same) {
+		slot->folded = slot->item.value;
+	} else {
+		char *p = slot->item.value + length + 1;
+		memcpy(p, folded, folded_size);
+		slot->folded = p;
+	}
+
+	g_free(folded);
 	return slot;
 }
 
+/**
+ * Doubles the bucket array of a shard (or allocates the initial
+ * one).  The caller must hold the shard lock.
+ */
+static void
+shard_grow(struct shard *shard)
+{
+	struct bucket *old = shard->buckets;
+	size_t old_size = old != NULL ? shard->mask + 1 : 0;
+	size_t size = old != NULL ? old_size * 2 : SHARD_MIN_BUCKETS;
+
+	shard->buckets = calloc(size, sizeof(shard->buckets[0]));
+	shard->mask = size - 1;
+
+	for (size_t i = 0; i < old_size; ++i) {
+		if (old[i].slot == NULL)
+			continue;
+
+		size_t j = old[i].hash & shard->mask;
+		while (shard->buckets[j].slot != NULL)
+			j = (j + 1) & shard->mask;
+		shard->buckets[j] = old[i];
+	}
+
+	free(old);
+}
+
+/**
+ * Removes the bucket at index @i, shifting following members of the
+ * probe sequence back so lookups never need tombstones.  The caller
+ * must hold the shard lock.
+ */
+static void
+shard_remove(struct shard *shard, size_t i)
+{
+	struct bucket *buckets = shard->buckets;
+	size_t mask = shard->mask;
+	size_t j = i;
+
+	while (true) {
+		j = (j + 1) & mask;
+		if (buckets[j].slot == NULL)
+			break;
+
+		/* move the bucket at j into the hole at i unless its
+		   home position lies cyclically within (i, j] */
+		size_t home = buckets[j].hash & mask;
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			buckets[i] = buckets[j];
+			i = j;
+		}
+	}
+
+	buckets[i].slot = NULL;
+	--shard->count;
+}
+
 void tag_pool_init(void)
 {
-	g_assert(tag_pool_lock == NULL);
-	tag_pool_lock = g_mutex_new();
+	for (unsigned i = 0; i < NUM_SHARDS; ++i)
+		mtx_init(&shards[i].mutex, mtx_plain);
 }
 
 void tag_pool_deinit(void)
 {
-	g_assert(tag_pool_lock != NULL);
-	g_mutex_free(tag_pool_lock);
-	tag_pool_lock = NULL;
+	for (unsigned i = 0; i < NUM_SHARDS; ++i) {
+		struct shard *shard = &shards[i];
+
+		if (shard->buckets != NULL) {
+			for (size_t j = 0; j <= shard->mask; ++j)
+				free(shard->buckets[j].slot);
+			free(shard->buckets);
+		}
+
+		shard->buckets = NULL;
+		shard->mask = 0;
+		shard->count = 0;
+		mtx_destroy(&shard->mutex);
+	}
 }
 
 struct tag_item *
 tag_pool_get_item(enum tag_type type, const char *value, size_t length)
 {
-	struct slot **slot_p, *slot;
-
-	slot_p = &slots[calc_hash_n(type, value, length) % NUM_SLOTS];
-	for (slot = *slot_p; slot != NULL; slot = slot->next) {
-		if (slot->item.type == type &&
-		    length == strlen(slot->item.value) &&
-		    memcmp(value, slot->item.value, length) == 0 &&
-		    slot->ref < 0xff) {
-			assert(slot->ref > 0);
-			++slot->ref;
-			return &slot->item;
+	uint32_t hash = calc_hash(type, value, length);
+	struct shard *shard = hash_to_shard(hash);
+	struct slot *slot;
+	size_t i;
+
+	mtx_lock(&shard->mutex);
+
+	if (shard->buckets != NULL) {
+		for (i = hash & shard->mask;
+		     (slot = shard->buckets[i].slot) != NULL;
+		     i = (i + 1) & shard->mask) {
+			if (shard->buckets[i].hash == hash &&
+			    shard->buckets[i].length == length &&
+			    slot->item.type == type &&
+			    memcmp(value, slot->item.value, length) == 0) {
+				atomic_fetch_add_explicit(&slot->ref, 1,
+							  memory_order_relaxed);
+				mtx_unlock(&shard->mutex);
+				return &slot->item;
+			}
 		}
 	}
 
-	slot = slot_alloc(*slot_p, type, value, length);
-	*slot_p = slot;
+	/* keep the load factor below 3/4 */
+	if (shard->buckets == NULL ||
+	    (shard->count + 1) * 4 > (shard->mask + 1) * 3)
+		shard_grow(shard);
+
+	for (i = hash & shard->mask; shard->buckets[i].slot != NULL;
+	     i = (i + 1) & shard->mask)
+		;
+
+	slot = slot_alloc(hash, type, value, length);
+	shard->buckets[i].hash = hash;
+	shard->buckets[i].length = length;
+	shard->buckets[i].slot = slot;
+	++shard->count;
+
+	mtx_unlock(&shard->mutex);
 	return &slot->item;
 }
 
@@ -121,42 +278,73 @@ struct tag_item *tag_pool_dup_item(struct tag_item *item)
 {
 	struct slot *slot = tag_item_to_slot(item);
 
-	assert(slot->ref > 0);
+	/* the caller holds a reference, so the slot cannot be
+	   released concurrently; no need for the shard lock */
+	unsigned old = atomic_fetch_add_explicit(&slot->ref, 1,
+						 memory_order_relaxed);
+	assert(old > 0);
+	(void)old;
 
-	if (slot->ref < 0xff) {
-		++slot->ref;
-		return item;
-	} else {
-		/* the reference counter overflows above 0xff;
-		   duplicate the item, and start with 1 */
-		size_t length = strlen(item->value);
-		struct slot **slot_p =
-			&slots[calc_hash_n(item->type, item->value,
-					   length) % NUM_SLOTS];
-		slot = slot_alloc(*slot_p, item->type,
-				  item->value, strlen(item->value));
-		*slot_p = slot;
-		return &slot->item;
-	}
+	return item;
 }
 
 void tag_pool_put_item(struct tag_item *item)
 {
-	struct slot **slot_p, *slot;
+	struct slot *slot = tag_item_to_slot(item);
+	struct shard *shard = hash_to_shard(slot->hash);
 
-	slot = tag_item_to_slot(item);
-	assert(slot->ref > 0);
-	--slot->ref;
+	/* drop references which are not the last one without
+	   locking; the last one must be released under the shard
+	   lock, because tag_pool_get_item() may resurrect it */
+	unsigned ref = atomic_load_explicit(&slot->ref, memory_order_relaxed);
+	while (ref > 1)
+		if (atomic_compare_exchange_weak_explicit(&slot->ref, &ref,
+							  ref - 1,
+							  memory_order_release,
+							  memory_order_relaxed))
+			return;
 
-	if (slot->ref > 0)
+	mtx_lock(&shard->mutex);
+
+	if (atomic_fetch_sub_explicit(&slot->ref, 1,
+				      memory_order_acq_rel) > 1) {
+		/* somebody took a new reference meanwhile */
+		mtx_unlock(&shard->mutex);
 		return;
+	}
 
-	for (slot_p = &slots[calc_hash(item->type, item->value) % NUM_SLOTS];
-	     *slot_p != slot;
-	     slot_p = &(*slot_p)->next) {
-		assert(*slot_p != NULL);
+	size_t i = slot->hash & shard->mask;
+	while (shard->buckets[i].slot != slot) {
+		assert(shard->buckets[i].slot != NULL);
+		i = (i + 1) & shard->mask;
 	}
 
-	*slot_p = slot->next;
+	shard_remove(shard, i);
+
+	mtx_unlock(&shard->mutex);
+
 	free(slot);
 }
+
+const char *
+tag_pool_item_folded(const struct tag_item *item)
+{
+	const struct slot *slot = (const struct slot *)
+		((const char *)item - offsetof(struct slot, item));
+
+	return slot->folded;
+}
+
+size_t
+tag_pool_count(void)
+{
+	size_t n = 0;
+
+	for (unsigned i = 0; i < NUM_SHARDS; ++i) {
+		mtx_lock(&shards[i].mutex);
+		n += shards[i].count;
+		mtx_unlock(&shards[i].mutex);
+	}
+
+	return n;
+}
@@ -22,19 +22,39 @@
 
 #include "tag.h"
 
-#include <glib.h>
-
-extern GMutex *tag_pool_lock;
+#include <stddef.h>
 
 struct tag_item;
 
+/**
+ * Initializes the tag pool.  The pool is internally synchronized (one
+ * lock per shard), callers need no locking of their own.
+ */
 void tag_pool_init(void);
 
 void tag_pool_deinit(void);
 
+/**
+ * Returns an interned #tag_item with the specified type and value,
+ * holding a new reference on it.
+ */
 struct tag_item *
 tag_pool_get_item(enum tag_type type, const char *value, size_t length);
 
+/**
+ * Returns the casefolded (see g_utf8_casefold()) value of an interned
+ * item.  It is computed once when the item enters the pool, and lives
+ * as long as the item.
+ */
+const char *
+tag_pool_item_folded(const struct tag_item *item);
+
+/**
+ * Returns the number of distinct items currently in the pool.
+ */
+size_t
+tag_pool_count(void);
+
 struct tag_item *tag_pool_dup_item(struct tag_item *item);
 
 void tag_pool_put_item(struct tag_item *item);
@@ -0,0 +1,428 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define LOG_DOMAIN "trigram_index"
+
+#include "log.h"
+#include "config.h"
+#include "trigram_index.h"
+#include "locate.h"
+#include "song.h"
+#include "directory.h"
+#include "db_visitor.h"
+#include "db_lock.h"
+#include "tag.h"
+#include "tag_pool.h"
+
+#include <glib.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Trigrams are hashed into 2^BUCKET_BITS posting lists.  Collisions
+ * only add false positives, which are removed by the verification.
+ */
+#define BUCKET_BITS 18
+#define NUM_BUCKETS (1u << BUCKET_BITS)
+
+struct trigram_snapshot {
+	/** all songs, in database order; postings refer to indexes */
+	struct song **songs;
+	unsigned num_songs;
+
+	/** posting list i is postings[offsets[i]..offsets[i+1]] */
+	uint32_t *offsets;
+	uint32_t *postings;
+};
+
+static bool enabled;
+
+/** the current snapshot; NULL if it was invalidated */
+static struct trigram_snapshot *current;
+
+static inline uint32_t
+trigram_bucket(const char *p)
+{
+	uint32_t trigram = (uint32_t)(unsigned char)p[0] |
+		(uint32_t)(unsigned char)p[1] << 8 |
+		(uint32_t)(unsigned char)p[2] << 16;
+
+	return (trigram * 2654435761u) >> (32 - BUCKET_BITS);
+}
+
+/**
+ * A growable array of 32 bit integers.
+ */
+struct u32_vector {
+	uint32_t *data;
+	size_t length, capacity;
+};
+
+static void
+u32_vector_push(struct u32_vector *v, uint32_t value)
+{
+	if (v->length == v->capacity) {
+		v->capacity = v->capacity > 0 ? v->capacity * 2 : 256;
+		v->data = realloc(v->data, v->capacity * sizeof(v->data[0]));
+	}
+
+	v->data[v->length++] = value;
+}
+
+static void
+add_trigrams(struct u32_vector *v, const char *s)
+{
+	size_t length = strlen(s);
+
+	for (size_t i = 0; i + 3 <= length; ++i)
+		u32_vector_push(v, trigram_bucket(s + i));
+}
+
+static int
+compare_u32(const void *_a, const void *_b)
+{
+	uint32_t a = *(const uint32_t *)_a, b = *(const uint32_t *)_b;
+	return a < b ? -1 : a > b;
+}
+
+/**
+ * Sorts the range [start, v->length) and removes duplicates from it.
+ */
+static void
+sort_unique(struct u32_vector *v, size_t start)
+{
+	uint32_t *p = v->data + start;
+	size_t n = v->length - start;
+
+	if (n == 0)
+		return;
+
+	qsort(p, n, sizeof(p[0]), compare_u32);
+
+	size_t j = 0;
+	for (size_t i = 1; i < n; ++i)
+		if (p[i] != p[j])
+			p[++j] = p[i];
+
+	v->length = start + j + 1;
+}
+
+struct collect_data {
+	struct song **songs;
+	unsigned num_songs, capacity;
+};
+
+static int
+collect_song(struct song *song, void *ctx)
+{
+	struct collect_data *data = ctx;
+
+	if (data->num_songs == data->capacity) {
+		data->capacity = data->capacity > 0
+			? data->capacity * 2 : 1024;
+		data->songs = realloc(data->songs, data->capacity *
+				      sizeof(data->songs[0]));
+	}
+
+	data->songs[data->num_songs++] = song;
+	return MPD_SUCCESS;
+}
+
+static const struct db_visitor collect_visitor = {
+	.song = collect_song,
+};
+
+/**
+ * Builds a snapshot from the songs collected with #collect_visitor,
+ * and takes over their array.  The tree is not accessed.
+ */
+static struct trigram_snapshot *
+trigram_snapshot_build(struct collect_data data)
+{
+
+	/* the forward index: the distinct buckets of each song */
+	struct u32_vector buckets = { .data = NULL };
+	uint32_t *song_offsets = malloc((data.num_songs + 1) *
+					sizeof(song_offsets[0]));
+
+	for (unsigned i = 0; i < data.num_songs; ++i) {
+		const struct song *song = data.songs[i];
+		size_t start = buckets.length;
+
+		song_offsets[i] = start;
+
+		char *uri = song_get_uri(song);
+		char *folded = g_utf8_casefold(uri, -1);
+		add_trigrams(&buckets, folded);
+		g_free(folded);
+		free(uri);
+
+		if (song->tag != NULL)
+			for (unsigned j = 0; j < song->tag->num_items; ++j)
+				add_trigrams(&buckets,
+					     tag_pool_item_folded(song->tag->items[j]));
+
+		sort_unique(&buckets, start);
+	}
+
+	song_offsets[data.num_songs] = buckets.length;
+
+	/* invert it */
+	struct trigram_snapshot *snapshot = g_new(struct trigram_snapshot, 1);
+	snapshot->songs = data.songs;
+	snapshot->num_songs = data.num_songs;
+	snapshot->offsets = calloc(NUM_BUCKETS + 1,
+				   sizeof(snapshot->offsets[0]));
+	snapshot->postings = malloc((buckets.length > 0 ? buckets.length : 1) *
+				    sizeof(snapshot->postings[0]));
+
+	for (size_t i = 0; i < buckets.length; ++i)
+		++snapshot->offsets[buckets.data[i] + 1];
+
+	for (unsigned i = 0; i < NUM_BUCKETS; ++i)
+		snapshot->offsets[i + 1] += snapshot->offsets[i];
+
+	/* songs are visited in ascending order, so each posting list
+	   is sorted */
+	uint32_t *fill = malloc(NUM_BUCKETS * sizeof(fill[0]));
+	memcpy(fill, snapshot->offsets, NUM_BUCKETS * sizeof(fill[0]));
+
+	for (unsigned i = 0; i < data.num_songs; ++i)
+		for (uint32_t j = song_offsets[i]; j < song_offsets[i + 1]; ++j)
+			snapshot->postings[fill[buckets.data[j]]++] = i;
+
+	free(fill);
+	free(song_offsets);
+	free(buckets.data);
+
+	return snapshot;
+}
+
+static void
+trigram_snapshot_free(struct trigram_snapshot *snapshot)
+{
+	free(snapshot->songs);
+	free(snapshot->offsets);
+	free(snapshot->postings);
+	g_free(snapshot);
+}
+
+static size_t
+trigram_snapshot_memory(const struct trigram_snapshot *snapshot)
+{
+	return sizeof(*snapshot) +
+		snapshot->num_songs * sizeof(snapshot->songs[0]) +
+		(NUM_BUCKETS + 1) * sizeof(snapshot->offsets[0]) +
+		snapshot->offsets[NUM_BUCKETS] * sizeof(snapshot->postings[0]);
+}
+
+void
+trigram_index_enable(struct directory *root)
+{
+	assert(holding_db_lock());
+	assert(!enabled);
+	assert(current == NULL);
+
+	struct collect_data data = { .songs = NULL };
+	directory_walk(root, true, &collect_visitor, &data);
+
+	enabled = true;
+	current = trigram_snapshot_build(data);
+
+	log_debug("indexed %u songs, %zu bytes",
+		  current->num_songs, trigram_snapshot_memory(current));
+}
+
+void
+trigram_index_disable(void)
+{
+	assert(holding_db_lock());
+
+	trigram_index_invalidate();
+	enabled = false;
+}
+
+bool
+trigram_index_enabled(void)
+{
+	return enabled;
+}
+
+void
+trigram_index_invalidate(void)
+{
+	assert(holding_db_lock());
+
+	if (current != NULL) {
+		trigram_snapshot_free(current);
+		current = NULL;
+	}
+}
+
+void
+trigram_index_update(struct directory *root)
+{
+	if (!enabled)
+		return;
+
+	db_lock();
+
+	while (enabled && current == NULL) {
+		/* walk the tree with the lock held: the main thread
+		   may reorder it with directory_sort() */
+		struct collect_data data = { .songs = NULL };
+		directory_walk(root, true, &collect_visitor, &data);
+		unsigned generation =
+			atomic_load_explicit(&db_generation,
+					     memory_order_relaxed);
+		db_unlock();
+
+		/* the update thread is the only one which frees songs
+		   or replaces their tags, so the collected songs may
+		   be read without the lock */
+		struct trigram_snapshot *snapshot =
+			trigram_snapshot_build(data);
+
+		db_lock();
+
+		if (current != NULL || !enabled ||
+		    generation != atomic_load_explicit(&db_generation,
+						       memory_order_relaxed)) {
+			/* the tree has changed meanwhile, and the
+			   snapshot may not be in database order */
+			trigram_snapshot_free(snapshot);
+			continue;
+		}
+
+		current = snapshot;
+		log_debug("indexed %u songs, %zu bytes",
+			  snapshot->num_songs,
+			  trigram_snapshot_memory(snapshot));
+	}
+
+	db_unlock();
+}
+
+/**
+ * Removes all entries from the sorted array @candidates which do not
+ * occur in the sorted @posting.  Returns the new length.
+ */
+static unsigned
+intersect(uint32_t *candidates, unsigned length,
+	  const uint32_t *posting, unsigned posting_length)
+{
+	unsigned n = 0, j = 0;
+
+	for (unsigned i = 0; i < length && j < posting_length; ++i) {
+		uint32_t value = candidates[i];
+
+		if (posting_length - j > 8 * (length - i)) {
+			/* the posting is much longer; skip ahead with
+			   a binary search */
+			unsigned low = j, high = posting_length;
+			while (low < high) {
+				unsigned middle = low + (high - low) / 2;
+				if (posting[middle] < value)
+					low = middle + 1;
+				else
+					high = middle;
+			}
+			j = low;
+		} else {
+			while (j < posting_length && posting[j] < value)
+				++j;
+		}
+
+		if (j < posting_length && posting[j] == value)
+			candidates[n++] = value;
+	}
+
+	return n;
+}
+
+bool
+trigram_index_candidates(const struct locate_item_list *criteria,
+			 struct song ***songs_r, unsigned *length_r)
+{
+	assert(holding_db_lock());
+
+	if (current == NULL)
+		return false;
+
+	/* collect the buckets of all needles; every candidate must
+	   be in all of them */
+	struct u32_vector buckets = { .data = NULL };
+	for (unsigned i = 0; i < criteria->length; ++i)
+		add_trigrams(&buckets, criteria->items[i].needle);
+
+	if (buckets.length == 0)
+		/* all needles are too short */
+		return false;
+
+	sort_unique(&buckets, 0);
+
+	/* start with the shortest posting list */
+	const uint32_t *offsets = current->offsets;
+	size_t shortest = 0;
+	for (size_t i = 1; i < buckets.length; ++i) {
+		uint32_t b = buckets.data[i], s = buckets.data[shortest];
+		if (offsets[b + 1] - offsets[b] < offsets[s + 1] - offsets[s])
+			shortest = i;
+	}
+
+	uint32_t s = buckets.data[shortest];
+	unsigned length = offsets[s + 1] - offsets[s];
+	uint32_t *candidates = malloc((length > 0 ? length : 1) *
+				      sizeof(candidates[0]));
+	memcpy(candidates, current->postings + offsets[s],
+	       length * sizeof(candidates[0]));
+
+	for (size_t i = 0; i < buckets.length && length > 0; ++i) {
+		uint32_t b = buckets.data[i];
+		if (i != shortest)
+			length = intersect(candidates, length,
+					   current->postings + offsets[b],
+					   offsets[b + 1] - offsets[b]);
+	}
+
+	free(buckets.data);
+
+	struct song **songs = NULL;
+	if (length > 0) {
+		songs = malloc(length * sizeof(songs[0]));
+		for (unsigned i = 0; i < length; ++i)
+			songs[i] = current->songs[candidates[i]];
+	}
+
+	free(candidates);
+
+	*songs_r = songs;
+	*length_r = length;
+	return true;
+}
+
+size_t
+trigram_index_memory(void)
+{
+	assert(holding_db_lock());
+
+	return current != NULL ? trigram_snapshot_memory(current) : 0;
+}
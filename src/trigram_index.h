@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * An optional trigram index for case-insensitive substring search
+ * ("search", "searchadd").  For every trigram (three consecutive
+ * bytes) of the casefolded tag values and URI of a song, it stores
+ * the list of songs containing it, so a query only has to verify the
+ * songs which contain all trigrams of its needles.
+ *
+ * The index is an immutable snapshot of the database.  Any
+ * modification of the database drops it, and the update thread
+ * builds a new one when it is done.  Until then, searches fall back
+ * to scanning the database.
+ *
+ * The snapshot is protected by the #db_mutex.
+ */
+
+#pragma once
+
+#include "compiler.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct song;
+struct directory;
+struct locate_item_list;
+
+/**
+ * Enables the index and builds the first snapshot of the tree below
+ * @root.
+ *
+ * Caller must lock the #db_mutex.
+ */
+void
+trigram_index_enable(struct directory *root);
+
+/**
+ * Disables the index and frees its memory.
+ *
+ * Caller must lock the #db_mutex.
+ */
+void
+trigram_index_disable(void);
+
+MPD_PURE
+bool
+trigram_index_enabled(void);
+
+/**
+ * Drops the snapshot because the database is about to be modified.
+ *
+ * Caller must lock the #db_mutex.
+ */
+void
+trigram_index_invalidate(void);
+
+/**
+ * Builds a new snapshot of the tree below @root if the index is
+ * enabled and the old one has been dropped.  This is meant to be
+ * called by the update thread after it has finished modifying the
+ * database.  The songs are collected with the #db_mutex held, but
+ * indexed without it; if the tree changes meanwhile, the snapshot is
+ * discarded and built again.
+ */
+void
+trigram_index_update(struct directory *root);
+
+/**
+ * Looks up the songs which may match all items of the (casefolded)
+ * search @criteria.  Returns false if the index cannot narrow down the
+ * query, e.g. because it is disabled or all needles are shorter than
+ * three bytes.  On success, the candidates are returned as an array
+ * (to be freed by the caller) in database order; they still have to
+ * be checked with locate_song_search().
+ *
+ * Caller must lock the #db_mutex.
+ */
+bool
+trigram_index_candidates(const struct locate_item_list *criteria,
+			 struct song ***songs_r, unsigned *length_r);
+
+/**
+ * Returns the number of bytes allocated by the current snapshot, or
+ * 0 if there is none.
+ *
+ * Caller must lock the #db_mutex.
+ */
+MPD_PURE
+size_t
+trigram_index_memory(void);
@@ -23,6 +23,7 @@
 #include "update_walk.h"
 #include "update_remove.h"
 #include "update.h"
+#include "scan_cache.h"
 #include "database.h"
 #include "mapper.h"
 #include "playlist.h"
@@ -64,6 +65,12 @@ isUpdatingDB(void)
 	return (progress != UPDATE_PROGRESS_IDLE) ? update_task_id : 0;
 }
 
+void
+update_get_progress(unsigned *directories, unsigned *files)
+{
+	update_walk_progress(directories, files);
+}
+
 static void * update_task(void *_path)
 {
 	const char *path = _path;
@@ -81,6 +88,10 @@ static void * update_task(void *_path)
 			log_warning("Failed to save database");
 	}
 
+	/* the scan cache may have learned new time stamps even if
+	   the database is unchanged */
+	scan_cache_save();
+
 	if (*path != 0)
 		log_debug("finished: %s", path);
 	else
@@ -176,10 +187,12 @@ void update_global_init(void)
 
 	update_remove_global_init();
 	update_walk_global_init();
+	scan_cache_global_init();
 }
 
 void update_global_finish(void)
 {
+	scan_cache_global_finish();
 	update_walk_global_finish();
 	update_remove_global_finish();
 }
@@ -31,6 +31,13 @@ void update_global_finish(void);
 unsigned
 isUpdatingDB(void);
 
+/**
+ * Returns the number of directories and files which the running
+ * update has visited so far.
+ */
+void
+update_get_progress(unsigned *directories, unsigned *files);
+
 /**
  * Add this path to the database update queue.
  *
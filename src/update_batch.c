@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h" /* must be first for large file support */
+#include "update_batch.h"
+#include "update_internal.h"
+#include "update_remove.h"
+#include "db_lock.h"
+#include "directory.h"
+#include "song.h"
+
+#include <assert.h>
+
+void
+update_batch_init(struct update_batch *batch, struct directory *directory)
+{
+	batch->directory = directory;
+	batch->num_added = 0;
+	batch->num_replaced = 0;
+	batch->num_touched = 0;
+	batch->num_removed = 0;
+}
+
+void
+update_batch_add(struct update_batch *batch, struct song *song)
+{
+	assert(batch->num_added < UPDATE_BATCH_MAX);
+	assert(song->parent == batch->directory);
+
+	batch->added[batch->num_added++] = song;
+}
+
+void
+update_batch_replace(struct update_batch *batch, struct song *song,
+		     struct song *update)
+{
+	assert(batch->num_replaced < UPDATE_BATCH_MAX);
+	assert(song->parent == batch->directory);
+
+	batch->replaced[batch->num_replaced].song = song;
+	batch->replaced[batch->num_replaced].update = update;
+	++batch->num_replaced;
+}
+
+void
+update_batch_touch(struct update_batch *batch, struct song *song,
+		   time_t mtime)
+{
+	assert(batch->num_touched < UPDATE_BATCH_MAX);
+	assert(song->parent == batch->directory);
+
+	batch->touched[batch->num_touched].song = song;
+	batch->touched[batch->num_touched].mtime = mtime;
+	++batch->num_touched;
+}
+
+void
+update_batch_remove(struct update_batch *batch, struct song *song)
+{
+	assert(batch->num_removed < UPDATE_BATCH_MAX);
+	assert(song->parent == batch->directory);
+
+	batch->removed[batch->num_removed++] = song;
+}
+
+void
+update_batch_commit(struct update_batch *batch)
+{
+	struct directory *directory = batch->directory;
+
+	if (batch->num_added == 0 && batch->num_replaced == 0 &&
+	    batch->num_touched == 0 && batch->num_removed == 0)
+		return;
+
+	db_lock();
+
+	for (unsigned i = 0; i < batch->num_added; ++i)
+		directory_add_song(directory, batch->added[i]);
+
+	for (unsigned i = 0; i < batch->num_replaced; ++i) {
+		struct song *update = batch->replaced[i].update;
+
+		/* swap the tags; the old one is freed with the
+		   temporary song object below */
+		update->tag = directory_replace_song_tag(directory,
+							 batch->replaced[i].song,
+							 update->tag,
+							 update->mtime);
+	}
+
+	for (unsigned i = 0; i < batch->num_touched; ++i)
+		batch->touched[i].song->mtime = batch->touched[i].mtime;
+
+	/* first, prevent traversers in main task from getting the
+	   removed songs */
+	for (unsigned i = 0; i < batch->num_removed; ++i)
+		directory_remove_song(directory, batch->removed[i]);
+
+	db_unlock();
+
+	for (unsigned i = 0; i < batch->num_replaced; ++i)
+		song_free(batch->replaced[i].update);
+
+	for (unsigned i = 0; i < batch->num_removed; ++i) {
+		struct song *song = batch->removed[i];
+
+		/* now take it out of the playlist (in the main_task),
+		   and free it when all references are gone */
+		update_remove_song(song);
+		song_free(song);
+	}
+
+	modified = true;
+
+	update_batch_init(batch, directory);
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_UPDATE_BATCH_H
+#define MPD_UPDATE_BATCH_H
+
+#include <time.h>
+
+struct directory;
+struct song;
+
+enum {
+	/**
+	 * The maximum number of files handled by one batch.  Each
+	 * file stages at most one modification.
+	 */
+	UPDATE_BATCH_MAX = 32,
+};
+
+/**
+ * Modifications of the songs in one directory, which the update
+ * thread prepares without holding the #db_mutex, and publishes in one
+ * short critical section with update_batch_commit().  This way,
+ * clients reading the database do not wait for the update thread
+ * several times per file.
+ */
+struct update_batch {
+	struct directory *directory;
+
+	unsigned num_added, num_replaced, num_touched, num_removed;
+
+	/** new songs which are not in the directory yet */
+	struct song *added[UPDATE_BATCH_MAX];
+
+	/**
+	 * Songs in the directory whose tag has changed, each with a
+	 * temporary song object holding the new tag.
+	 */
+	struct {
+		struct song *song, *update;
+	} replaced[UPDATE_BATCH_MAX];
+
+	/** songs whose tags are unchanged, with a new modification time */
+	struct {
+		struct song *song;
+		time_t mtime;
+	} touched[UPDATE_BATCH_MAX];
+
+	/** songs which shall be removed from the directory */
+	struct song *removed[UPDATE_BATCH_MAX];
+};
+
+void
+update_batch_init(struct update_batch *batch, struct directory *directory);
+
+/**
+ * Stages a new song, which was loaded with song_file_load().
+ */
+void
+update_batch_add(struct update_batch *batch, struct song *song);
+
+/**
+ * Stages new meta data for a song in the directory.  The tag and the
+ * modification time of #update replace those of #song, and #update is
+ * freed.
+ */
+void
+update_batch_replace(struct update_batch *batch, struct song *song,
+		     struct song *update);
+
+/**
+ * Stages a new modification time for a song in the directory whose
+ * tags have not changed.
+ */
+void
+update_batch_touch(struct update_batch *batch, struct song *song,
+		   time_t mtime);
+
+/**
+ * Stages the removal of a song in the directory.
+ */
+void
+update_batch_remove(struct update_batch *batch, struct song *song);
+
+/**
+ * Publishes all staged modifications to the database, and empties
+ * the batch.
+ */
+void
+update_batch_commit(struct update_batch *batch);
+
+#endif
@@ -23,8 +23,14 @@
 #include "log.h"
 
 #include <stdbool.h>
+#include <stdatomic.h>
 
 extern bool walk_discard;
-extern bool modified;
+
+/**
+ * Set when the walk has changed the database.  Atomic because the
+ * parallel walk modifies it from several worker threads.
+ */
+extern atomic_bool modified;
 
 #endif
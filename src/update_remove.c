@@ -69,7 +69,7 @@ song_remove_event(void)
 	/* clear "removed_song" and send signal to update thread */
 	g_mutex_lock(remove_mutex);
 	removed_song = NULL;
-	g_cond_signal(remove_cond);
+	g_cond_broadcast(remove_cond);
 	g_mutex_unlock(remove_mutex);
 }
 
@@ -92,15 +92,20 @@ update_remove_global_finish(void)
 void
 update_remove_song(const struct song *song)
 {
-	assert(removed_song == NULL);
+	g_mutex_lock(remove_mutex);
+
+	/* the worker threads of a parallel update take turns */
+	while (removed_song != NULL)
+		g_cond_wait(remove_cond, remove_mutex);
 
 	removed_song = song;
+	g_mutex_unlock(remove_mutex);
 
 	event_pipe_emit(PIPE_EVENT_DELETE);
 
 	g_mutex_lock(remove_mutex);
 
-	while (removed_song != NULL)
+	while (removed_song == song)
 		g_cond_wait(remove_cond, remove_mutex);
 
 	g_mutex_unlock(remove_mutex);
@@ -24,93 +24,119 @@
 #include "update_song.h"
 #include "update_internal.h"
 #include "update_io.h"
-#include "update_db.h"
 #include "update_container.h"
-#include "db_lock.h"
+#include "update_batch.h"
+#include "scan_cache.h"
 #include "directory.h"
 #include "song.h"
 #include "decoder_list.h"
 #include "decoder_plugin.h"
+#include "mapper.h"
 
 #include <glib.h>
 
+#include <stdlib.h>
 #include <unistd.h>
 
+/**
+ * Loads the tags of a new or modified song file, and stages the
+ * result in the batch.
+ *
+ * @return true if the file is a song
+ */
+static bool
+update_song_load(struct update_batch *batch, const char *name,
+		 struct song *song)
+{
+	struct directory *directory = batch->directory;
+
+	if (song == NULL) {
+		log_debug("reading %s/%s",
+			directory_get_path(directory), name);
+		song = song_file_load(name, directory);
+		if (song == NULL) {
+			log_debug("ignoring unrecognized file %s/%s",
+				directory_get_path(directory), name);
+			return false;
+		}
+
+		update_batch_add(batch, song);
+		log_info("added %s/%s",
+			  directory_get_path(directory), name);
+		return true;
+	}
+
+	log_info("updating %s/%s",
+		  directory_get_path(directory), name);
+
+	/* load the new tag into a temporary song object; the song in
+	   the database keeps its old tag until the batch is
+	   committed */
+	struct song *update = song_file_load(name, directory);
+	if (update == NULL) {
+		log_debug("deleting unrecognized file %s/%s",
+			directory_get_path(directory), name);
+		update_batch_remove(batch, song);
+		return false;
+	}
+
+	update_batch_replace(batch, song, update);
+	return true;
+}
+
 static void
-update_song_file2(struct directory *directory,
+update_song_file2(struct update_batch *batch,
 		  const char *name, const struct stat *st,
-		  const struct decoder_plugin *plugin)
+		  const struct decoder_plugin *plugin, struct song *song)
 {
-	db_lock();
-	struct song *song = directory_get_song(directory, name);
-	db_unlock();
+	struct directory *directory = batch->directory;
 
 	if (!directory_child_access(directory, name, R_OK)) {
 		log_warning("no read permissions on %s/%s",
 			  directory_get_path(directory), name);
-		if (song != NULL) {
-			db_lock();
-			delete_song(directory, song);
-			db_unlock();
-		}
+		if (song != NULL)
+			update_batch_remove(batch, song);
 
 		return;
 	}
 
-	if (!(song != NULL && st->st_mtime == song->mtime &&
-	      !walk_discard) &&
-	    update_container_file(directory, name, st, plugin)) {
-		if (song != NULL) {
-			db_lock();
-			delete_song(directory, song);
-			db_unlock();
-		}
-
+	if (song != NULL && st->st_mtime == song->mtime && !walk_discard) {
+		/* not modified */
+		scan_cache_mark(st);
 		return;
 	}
 
-	if (song == NULL) {
-		log_debug("reading %s/%s",
-			directory_get_path(directory), name);
-		song = song_file_load(name, directory);
-		if (song == NULL) {
-			log_debug("ignoring unrecognized file %s/%s",
-				directory_get_path(directory), name);
-			return;
-		}
-
-		db_lock();
-		directory_add_song(directory, song);
-		db_unlock();
+	char *path_fs = scan_cache_enabled()
+		? map_directory_child_fs(directory, name)
+		: NULL;
 
-		modified = true;
-		log_info("added %s/%s",
-			  directory_get_path(directory), name);
-	} else if (st->st_mtime != song->mtime || walk_discard) {
-		log_info("updating %s/%s",
+	if (song != NULL && path_fs != NULL &&
+	    scan_cache_unchanged(path_fs, st, walk_discard)) {
+		/* only the time stamp has changed (or this is a
+		   "rescan"), the tags are still the same */
+		log_debug("unchanged %s/%s",
 			  directory_get_path(directory), name);
-		if (!song_file_update(song)) {
-			log_debug("deleting unrecognized file %s/%s",
-				directory_get_path(directory), name);
-			db_lock();
-			delete_song(directory, song);
-			db_unlock();
-		}
+		if (st->st_mtime != song->mtime)
+			update_batch_touch(batch, song, st->st_mtime);
+	} else if (update_container_file(directory, name, st, plugin)) {
+		if (song != NULL)
+			update_batch_remove(batch, song);
+	} else if (update_song_load(batch, name, song) && path_fs != NULL)
+		scan_cache_store(path_fs, st);
 
-		modified = true;
-	}
+	free(path_fs);
 }
 
 bool
-update_song_file(struct directory *directory,
+update_song_file(struct update_batch *batch,
 		 const char *name, const char *suffix,
-		 const struct stat *st)
+		 const struct stat *st, struct song *song)
 {
 	const struct decoder_plugin *plugin =
 		decoder_plugin_from_suffix(suffix, NULL);
 	if (plugin == NULL)
 		return false;
 
-	update_song_file2(directory, name, st, plugin);
+	update_song_file2(batch, name, st, plugin, song);
 	return true;
 }
@@ -23,11 +23,20 @@
 #include <stdbool.h>
 #include <sys/stat.h>
 
-struct directory;
+struct update_batch;
+struct song;
 
+/**
+ * Updates a song file in the batch's directory.  Changes of the
+ * song list are staged in the batch.
+ *
+ * @param song the song object of this file in the database (looked
+ * up by the caller), or NULL if there is none
+ * @return false if there is no decoder plugin for this file type
+ */
 bool
-update_song_file(struct directory *directory,
+update_song_file(struct update_batch *batch,
 		 const char *name, const char *suffix,
-		 const struct stat *st);
+		 const struct stat *st, struct song *song);
 
 #endif
@@ -20,15 +20,19 @@
 #include "log.h"
 #include "config.h" /* must be first for large file support */
 #include "update_walk.h"
+#include "update_internal.h"
 #include "update_io.h"
 #include "update_db.h"
 #include "update_song.h"
+#include "update_batch.h"
+#include "scan_cache.h"
 #include "update_archive.h"
 #include "database.h"
 #include "db_lock.h"
 #include "exclude.h"
 #include "directory.h"
 #include "song.h"
+#include "trigram_index.h"
 #include "playlist_vector.h"
 #include "uri.h"
 #include "mapper.h"
@@ -37,6 +41,9 @@
 #include "conf.h"
 #include "file_utils.h"
 #include "macros.h"
+#include "mpd_error.h"
+#include "c11thread.h"
+#include "util/list.h"
 
 #include <glib.h>
 
@@ -53,7 +60,82 @@
 #define G_LOG_DOMAIN "update"
 
 bool walk_discard;
-bool modified;
+atomic_bool modified;
+
+enum {
+	DEFAULT_UPDATE_THREADS = 1,
+	MAX_UPDATE_THREADS = 64,
+};
+
+/** the configured number of threads for the parallel walk */
+static unsigned walk_threads;
+
+/** progress counters, see update_walk_progress() */
+static atomic_uint walk_directories, walk_files;
+
+struct walk_file {
+	char *name;
+	struct stat st;
+
+	/** the song object of this file, see walk_run_job() */
+	struct song *song;
+};
+
+/**
+ * A unit of work for the walk: either a directory which shall be
+ * scanned, or a batch of regular files found in one directory, whose
+ * tags shall be loaded.  Directory jobs are only used by the parallel
+ * walk.
+ */
+struct walk_job {
+	struct list_head siblings;
+
+	struct directory *directory;
+
+	/** stat() information on the directory (directory jobs only) */
+	struct stat st;
+
+	/** the number of files; 0 means this is a directory job */
+	unsigned num_files;
+
+	/** allocated only for file jobs, see walk_job_new() */
+	struct walk_file files[];
+};
+
+/**
+ * The worker threads of a parallel walk.  Directories are scanned
+ * breadth-first: each scanned directory submits its sub directories
+ * and its regular files as new jobs to the end of the queue.
+ *
+ * Each directory object is only modified by the job which scans it,
+ * by the file jobs it has submitted and by its sub directory jobs
+ * (when they are deleted); all of them modify it with the #db_mutex
+ * held.  The unlocked reads in update_directory() happen before any
+ * of the other jobs is submitted.
+ */
+struct walk_pool {
+	/** protects all following attributes */
+	mtx_t mutex;
+
+	/** signalled when a job is submitted or the pool quits */
+	cnd_t cond;
+
+	/** signalled when #pending drops to zero */
+	cnd_t idle_cond;
+
+	struct list_head jobs;
+
+	/** the number of jobs which are queued or running */
+	unsigned pending;
+
+	bool quit;
+
+	unsigned num_threads;
+	thrd_t threads[MAX_UPDATE_THREADS];
+};
+
+/** the pool of the current walk, or NULL if the walk is serial */
+static struct walk_pool *walk_pool;
 
 #ifndef WIN32
 
@@ -70,6 +152,12 @@ static bool follow_outside_symlinks;
 void
 update_walk_global_init(void)
 {
+	walk_threads = config_get_positive(CONF_UPDATE_THREADS,
+					   DEFAULT_UPDATE_THREADS);
+	if (walk_threads > MAX_UPDATE_THREADS)
+		MPD_ERROR("too many %s: %u", CONF_UPDATE_THREADS,
+			  walk_threads);
+
 #ifndef WIN32
 	follow_inside_symlinks =
 		config_get_bool(CONF_FOLLOW_INSIDE_SYMLINKS,
@@ -86,6 +174,85 @@ update_walk_global_finish(void)
 {
 }
 
+void
+update_walk_progress(unsigned *directories, unsigned *files)
+{
+	*directories = atomic_load_explicit(&walk_directories,
+					    memory_order_relaxed);
+	*files = atomic_load_explicit(&walk_files, memory_order_relaxed);
+}
+
+static struct walk_job *
+walk_job_new(struct directory *directory, unsigned max_files)
+{
+	struct walk_job *job =
+		malloc(sizeof(*job) + max_files * sizeof(job->files[0]));
+	job->directory = directory;
+	job->num_files = 0;
+	return job;
+}
+
+static void
+walk_run_job(struct walk_job *job);
+
+/**
+ * Runs the job on the worker threads of a parallel walk, or right
+ * away in a serial walk.
+ */
+static void
+walk_submit(struct walk_job *job)
+{
+	struct walk_pool *pool = walk_pool;
+
+	if (pool == NULL) {
+		walk_run_job(job);
+		free(job);
+		return;
+	}
+
+	mtx_lock(&pool->mutex);
+	++pool->pending;
+	list_add_tail(&job->siblings, &pool->jobs);
+	cnd_signal(&pool->cond);
+	mtx_unlock(&pool->mutex);
+}
+
+/**
+ * Submits a job which scans the specified directory, and deletes it
+ * if that fails.
+ */
+static void
+walk_submit_directory(struct directory *directory, const struct stat *st)
+{
+	struct walk_job *job = walk_job_new(directory, 0);
+	job->st = *st;
+
+	walk_submit(job);
+}
+
+/**
+ * Adds a regular file to the batch of the directory which is being
+ * scanned.  The batch is submitted when it is full; the caller
+ * submits the rest.
+ */
+static void
+walk_defer_file(struct walk_job **batch_r, struct directory *directory,
+		const char *name, const struct stat *st)
+{
+	struct walk_job *batch = *batch_r;
+	if (batch == NULL)
+		*batch_r = batch = walk_job_new(directory, UPDATE_BATCH_MAX);
+
+	struct walk_file *file = &batch->files[batch->num_files++];
+	file->name = strdup(name);
+	file->st = *st;
+
+	if (batch->num_files == UPDATE_BATCH_MAX) {
+		walk_submit(batch);
+		*batch_r = NULL;
+	}
+}
+
 static void
 directory_set_stat(struct directory *dir, const struct stat *st)
 {
@@ -143,22 +310,25 @@ purge_deleted_from_directory(struct directory *directory)
 		modified = true;
 	}
 
+	struct update_batch batch;
+	update_batch_init(&batch, directory);
+
 	struct song *song, *ns;
 	directory_for_each_song_safe(song, ns, directory) {
 		char *path;
 		struct stat st;
 		if ((path = map_song_fs(song)) == NULL ||
 		    stat(path, &st) < 0 || !S_ISREG(st.st_mode)) {
-			db_lock();
-			delete_song(directory, song);
-			db_unlock();
-
-			modified = true;
+			update_batch_remove(&batch, song);
+			if (batch.num_removed == UPDATE_BATCH_MAX)
+				update_batch_commit(&batch);
 		}
 
 		free(path);
 	}
 
+	update_batch_commit(&batch);
+
 	struct playlist_metadata *pm, *np;
 	directory_for_each_playlist_safe(pm, np, directory) {
 		if (!directory_child_is_regular(directory, pm->name)) {
@@ -223,16 +393,19 @@ update_playlist_file2(struct directory *directory,
 }
 
 static bool
-update_regular_file(struct directory *directory,
-		    const char *name, const struct stat *st)
+update_regular_file(struct update_batch *batch,
+		    const char *name, const struct stat *st,
+		    struct song *song)
 {
+	atomic_fetch_add_explicit(&walk_files, 1, memory_order_relaxed);
+
 	const char *suffix = uri_get_suffix(name);
 	if (suffix == NULL)
 		return false;
 
-	return update_song_file(directory, name, suffix, st) ||
-		update_archive_file(directory, name, suffix, st) ||
-		update_playlist_file2(directory, name, suffix, st);
+	return update_song_file(batch, name, suffix, st, song) ||
+		update_archive_file(batch->directory, name, suffix, st) ||
+		update_playlist_file2(batch->directory, name, suffix, st);
 }
 
 static bool
@@ -245,7 +418,9 @@ update_directory_child(struct directory *directory,
 	assert(strchr(name, '/') == NULL);
 
 	if (S_ISREG(st->st_mode)) {
-		update_regular_file(directory, name, st);
+		struct walk_job *batch = NULL;
+		walk_defer_file(&batch, directory, name, st);
+		walk_submit(batch);
 	} else if (S_ISDIR(st->st_mode)) {
 		if (find_inode_ancestor(directory, st->st_ino, st->st_dev))
 			return;
@@ -257,7 +432,9 @@ update_directory_child(struct directory *directory,
 
 		assert(directory == subdir->parent);
 
-		if (!update_directory(subdir, st)) {
+		if (walk_pool != NULL)
+			walk_submit_directory(subdir, st);
+		else if (!update_directory(subdir, st)) {
 			db_lock();
 			delete_directory(subdir);
 			db_unlock();
@@ -357,6 +534,9 @@ update_directory(struct directory *directory, const struct stat *st)
 
 	directory_set_stat(directory, st);
 
+	atomic_fetch_add_explicit(&walk_directories, 1,
+				  memory_order_relaxed);
+
 	char *path_fs = map_directory_fs(directory);
 	if (path_fs == NULL)
 		return false;
@@ -380,6 +560,10 @@ update_directory(struct directory *directory, const struct stat *st)
 
 	purge_deleted_from_directory(directory);
 
+	/* regular files are collected here and handled in batches,
+	   by the worker threads in a parallel walk */
+	struct walk_job *batch = NULL;
+
 	struct dirent *ent;
 	while ((ent = readdir(dir))) {
 		char *utf8;
@@ -394,19 +578,26 @@ update_directory(struct directory *directory, const struct stat *st)
 			continue;
 
 		if (skip_symlink(directory, utf8)) {
-			modified |= delete_name_in(directory, utf8);
+			if (delete_name_in(directory, utf8))
+				modified = true;
 			free(utf8);
 			continue;
 		}
 
-		if (stat_directory_child(directory, utf8, &st2) == 0)
-			update_directory_child(directory, utf8, &st2);
+		if (stat_directory_child(directory, utf8, &st2) != 0) {
+			if (delete_name_in(directory, utf8))
+				modified = true;
+		} else if (S_ISREG(st2.st_mode))
+			walk_defer_file(&batch, directory, utf8, &st2);
 		else
-			modified |= delete_name_in(directory, utf8);
+			update_directory_child(directory, utf8, &st2);
 
 		free(utf8);
 	}
 
+	if (batch != NULL)
+		walk_submit(batch);
+
 	exclude_list_free(exclude_list);
 
 	closedir(dir);
@@ -416,6 +607,161 @@ update_directory(struct directory *directory, const struct stat *st)
 	return true;
 }
 
+static void
+walk_run_job(struct walk_job *job)
+{
+	struct directory *directory = job->directory;
+
+	if (job->num_files == 0) {
+		if (!update_directory(directory, &job->st) &&
+		    directory->parent != NULL) {
+			db_lock();
+			delete_directory(directory);
+			db_unlock();
+		}
+
+		return;
+	}
+
+	/* look up all songs in one critical section; only this job
+	   adds or removes songs with these names */
+	db_lock();
+	for (unsigned i = 0; i < job->num_files; ++i)
+		job->files[i].song =
+			directory_get_song(directory, job->files[i].name);
+	db_unlock();
+
+	struct update_batch batch;
+	update_batch_init(&batch, directory);
+
+	for (unsigned i = 0; i < job->num_files; ++i) {
+		struct walk_file *file = &job->files[i];
+
+		update_regular_file(&batch, file->name, &file->st,
+				    file->song);
+		free(file->name);
+	}
+
+	update_batch_commit(&batch);
+}
+
+static int
+walk_worker_thread(void *arg)
+{
+	struct walk_pool *pool = arg;
+
+	mtx_lock(&pool->mutex);
+
+	while (true) {
+		if (list_empty(&pool->jobs)) {
+			if (pool->quit)
+				break;
+
+			cnd_wait(&pool->cond, &pool->mutex);
+			continue;
+		}
+
+		struct walk_job *job =
+			list_first_entry(&pool->jobs, struct walk_job,
+					 siblings);
+		list_del(&job->siblings);
+		mtx_unlock(&pool->mutex);
+
+		walk_run_job(job);
+		free(job);
+
+		mtx_lock(&pool->mutex);
+		if (--pool->pending == 0)
+			cnd_broadcast(&pool->idle_cond);
+	}
+
+	mtx_unlock(&pool->mutex);
+	return 0;
+}
+
+/**
+ * Starts the worker threads of a parallel walk.  On failure, the
+ * walk stays serial.
+ */
+static void
+walk_pool_start(unsigned num_threads)
+{
+	assert(walk_pool == NULL);
+
+	struct walk_pool *pool = tmalloc(struct walk_pool, 1);
+	mtx_init(&pool->mutex, mtx_plain);
+	cnd_init(&pool->cond);
+	cnd_init(&pool->idle_cond);
+	INIT_LIST_HEAD(&pool->jobs);
+	pool->pending = 0;
+	pool->quit = false;
+
+	for (unsigned i = 0; i < num_threads; ++i) {
+		if (thrd_create(&pool->threads[pool->num_threads],
+				walk_worker_thread, pool) != thrd_success) {
+			log_warning("Failed to start update thread");
+			break;
+		}
+
+		++pool->num_threads;
+	}
+
+	if (pool->num_threads == 0) {
+		cnd_destroy(&pool->idle_cond);
+		cnd_destroy(&pool->cond);
+		mtx_destroy(&pool->mutex);
+		free(pool);
+		return;
+	}
+
+	walk_pool = pool;
+}
+
+/**
+ * Waits until all jobs of the parallel walk are finished, and stops
+ * the worker threads.
+ */
+static void
+walk_pool_finish(void)
+{
+	struct walk_pool *pool = walk_pool;
+
+	mtx_lock(&pool->mutex);
+	while (pool->pending > 0)
+		cnd_wait(&pool->idle_cond, &pool->mutex);
+
+	pool->quit = true;
+	cnd_broadcast(&pool->cond);
+	mtx_unlock(&pool->mutex);
+
+	for (unsigned i = 0; i < pool->num_threads; ++i)
+		thrd_join(pool->threads[i], NULL);
+
+	walk_pool = NULL;
+
+	cnd_destroy(&pool->idle_cond);
+	cnd_destroy(&pool->cond);
+	mtx_destroy(&pool->mutex);
+	free(pool);
+}
+
+/**
+ * Fills in the missing stat() information of a directory and its
+ * ancestors, which find_inode_ancestor() would otherwise do from the
+ * worker threads of a parallel walk.
+ */
+static void
+walk_stat_ancestors(struct directory *directory)
+{
+#ifndef G_OS_WIN32
+	for (; directory != NULL; directory = directory->parent)
+		if (!directory->have_stat)
+			update_directory_stat(directory);
+#else
+	(void)directory;
+#endif
+}
+
 static struct directory *
 directory_make_child_checked(struct directory *parent, const char *name_utf8)
 {
@@ -481,12 +827,15 @@ update_uri(const char *uri)
 
 	char *name = strdup_basename(uri);
 
+	if (walk_pool != NULL)
+		walk_stat_ancestors(parent);
+
 	struct stat st;
 	if (!skip_symlink(parent, name) &&
 	    stat_directory_child(parent, name, &st) == 0)
 		update_directory_child(parent, name, &st);
-	else
-		modified |= delete_name_in(parent, name);
+	else if (delete_name_in(parent, name))
+		modified = true;
 
 	free(name);
 }
@@ -496,16 +845,40 @@ update_walk(const char *path, bool discard)
 {
 	walk_discard = discard;
 	modified = false;
+	atomic_store_explicit(&walk_directories, 0, memory_order_relaxed);
+	atomic_store_explicit(&walk_files, 0, memory_order_relaxed);
+
+	bool full = isRootDirectory(path);
+	if (full)
+		scan_cache_begin();
+
+	if (walk_threads > 1)
+		walk_pool_start(walk_threads);
 
-	if (!isRootDirectory(path)) {
+	if (!full) {
 		update_uri(path);
 	} else {
 		struct directory *directory = db_get_root();
 		struct stat st;
 
-		if (stat_directory(directory, &st) == 0)
-			update_directory(directory, &st);
+		if (stat_directory(directory, &st) == 0) {
+			if (walk_pool != NULL)
+				walk_submit_directory(directory, &st);
+			else
+				update_directory(directory, &st);
+		}
 	}
 
+	if (walk_pool != NULL)
+		walk_pool_finish();
+
+	if (full)
+		/* forget the files which were not seen */
+		scan_cache_end();
+
+	/* the database is final now; index it again if it was
+	   modified */
+	trigram_index_update(db_get_root());
+
 	return modified;
 }
@@ -28,6 +28,13 @@ update_walk_global_init(void);
 void
 update_walk_global_finish(void);
 
+/**
+ * Returns the number of directories and regular files visited by the
+ * current (or the last) walk.  May be called from any thread.
+ */
+void
+update_walk_progress(unsigned *directories, unsigned *files);
+
 /**
  * Returns true if the database was modified.
  */
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Pushes a fixed amount of audio through an audio pipe, once with the
+ * old fixed 4 kB chunks and once with the per format chunk size, and
+ * reports the number of chunks and the pipe overhead per second of
+ * audio.
+ */
+
+#include "config.h"
+#include "pipe.h"
+#include "audio_format.h"
+#include "bench_time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define SECONDS 60
+
+static void
+bench(const char *name, const struct audio_format *af, unsigned chunk_time)
+{
+	static char data[CHUNK_SIZE_MAX];
+	const struct audio_chunk *c = NULL, *next;
+	size_t total = audio_format_time_to_size(af) * SECONDS;
+	unsigned long nchunks = 0;
+
+	audio_chunk_time = chunk_time;
+	struct audio_pipe *p = audio_pipe_new(af, 4 * CHUNK_SIZE_MAX);
+	size_t chunk_size = audio_pipe_chunk_size(p);
+
+	uint64_t start = now_ns();
+	while (total >= chunk_size) {
+		total -= audio_pipe_write_sync(p, af, 0, 0, chunk_size, data);
+		audio_pipe_flush(p);
+
+		/* what an output does for every chunk */
+		next = audio_pipe_next(p, c);
+		if (next != NULL) {
+			c = next;
+			if (c->tag != NULL || c->replay_gain_serial != 0 ||
+			    c->times < 0)
+				abort();
+			nchunks++;
+		}
+	}
+	uint64_t elapsed = now_ns() - start;
+
+	printf("%-10s %-12s chunk %6zu bytes, %8lu chunks, "
+	       "%.1f ns/chunk, %.1f us per second of audio\n",
+	       name, chunk_time ? "adaptive" : "fixed", chunk_size, nchunks,
+	       (double)elapsed / nchunks, elapsed / 1e3 / SECONDS);
+
+	audio_pipe_clear(p);
+	audio_pipe_free(p);
+}
+
+int main(void)
+{
+	static const struct audio_format cd = {
+		.sample_rate = 44100,
+		.format = SAMPLE_FORMAT_S16,
+		.channels = 2,
+	};
+	static const struct audio_format dsd256 = {
+		/* DSD "sample rate" is in bytes per channel */
+		.sample_rate = 44100 * 256 / 8,
+		.format = SAMPLE_FORMAT_DSD,
+		.channels = 2,
+	};
+
+	bench("44.1k/16", &cd, 0);
+	bench("44.1k/16", &cd, DEFAULT_CHUNK_TIME);
+	bench("DSD256", &dsd256, 0);
+	bench("DSD256", &dsd256, DEFAULT_CHUNK_TIME);
+	return 0;
+}
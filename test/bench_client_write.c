@@ -0,0 +1,315 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Benchmark for the client response path: writes "listallinfo"-style
+ * output to a local socket which is drained by a reader thread, and
+ * reports bytes/sec.  The previous implementation (fixed 16 kB
+ * send buffer, vsnprintf() into a malloc()ed temporary, one
+ * malloc()ed deferred buffer per flush) is kept here as a
+ * reference.
+ */
+
+#include "config.h"
+#include "client_internal.h"
+#include "c11thread.h"
+#include "bench_time.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+static unsigned long num_songs = 200000;
+
+size_t client_max_output_buffer_size = 64 * 1024 * 1024;
+
+static bool expired;
+
+bool
+client_is_expired(G_GNUC_UNUSED const struct client *client)
+{
+	return expired;
+}
+
+void
+client_set_expired(G_GNUC_UNUSED struct client *client)
+{
+	expired = true;
+}
+
+struct reader {
+	int fd;
+	unsigned long long bytes;
+};
+
+static int
+reader_thread(void *arg)
+{
+	struct reader *r = arg;
+	static char buffer[65536];
+	ssize_t nbytes;
+
+	while ((nbytes = read(r->fd, buffer, sizeof(buffer))) > 0)
+		r->bytes += nbytes;
+	return 0;
+}
+
+static void
+wait_writable(int fd)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+	poll(&pfd, 1, -1);
+}
+
+/* the old implementation */
+
+struct old_deferred_buffer {
+	size_t size;
+	char data[sizeof(long)];
+};
+
+struct old_client {
+	int fd;
+	GQueue *deferred_send;
+	char send_buf[16384];
+	size_t send_buf_used;
+};
+
+static void
+old_write_deferred(struct old_client *client)
+{
+	while (!g_queue_is_empty(client->deferred_send)) {
+		struct old_deferred_buffer *buf =
+			g_queue_peek_head(client->deferred_send);
+		ssize_t ret = write(client->fd, buf->data, buf->size);
+		if (ret <= 0)
+			break;
+
+		if ((size_t)ret < buf->size) {
+			buf->size -= ret;
+			memmove(buf->data, buf->data + ret, buf->size);
+			break;
+		}
+
+		free(buf);
+		g_queue_pop_head(client->deferred_send);
+	}
+}
+
+static void
+old_defer_output(struct old_client *client, const void *data, size_t length)
+{
+	struct old_deferred_buffer *buf =
+		malloc(sizeof(*buf) - sizeof(buf->data) + length);
+	buf->size = length;
+	memcpy(buf->data, data, length);
+	g_queue_push_tail(client->deferred_send, buf);
+}
+
+static void
+old_write_output(struct old_client *client)
+{
+	if (client->send_buf_used == 0)
+		return;
+
+	if (!g_queue_is_empty(client->deferred_send)) {
+		old_defer_output(client, client->send_buf,
+				 client->send_buf_used);
+		old_write_deferred(client);
+	} else {
+		ssize_t ret = write(client->fd, client->send_buf,
+				    client->send_buf_used);
+		if (ret < 0)
+			ret = 0;
+		if ((size_t)ret < client->send_buf_used)
+			old_defer_output(client, client->send_buf + ret,
+					 client->send_buf_used - ret);
+	}
+
+	client->send_buf_used = 0;
+}
+
+static void
+old_write(struct old_client *client, const char *buffer, size_t buflen)
+{
+	while (buflen > 0) {
+		size_t copylen = sizeof(client->send_buf) -
+			client->send_buf_used;
+		if (copylen > buflen)
+			copylen = buflen;
+
+		memcpy(client->send_buf + client->send_buf_used, buffer,
+		       copylen);
+		buflen -= copylen;
+		client->send_buf_used += copylen;
+		buffer += copylen;
+		if (client->send_buf_used >= sizeof(client->send_buf))
+			old_write_output(client);
+	}
+}
+
+static void G_GNUC_PRINTF(2, 3)
+old_printf(struct old_client *client, const char *fmt, ...)
+{
+	va_list args, tmp;
+	int length;
+	char *buffer;
+
+	va_start(args, fmt);
+	va_copy(tmp, args);
+	length = vsnprintf(NULL, 0, fmt, tmp);
+	va_end(tmp);
+
+	buffer = malloc(length + 1);
+	vsnprintf(buffer, length + 1, fmt, args);
+	old_write(client, buffer, length);
+	free(buffer);
+	va_end(args);
+}
+
+static void
+old_song(struct old_client *client, unsigned long i)
+{
+	old_printf(client, "file: %s/album%lu/%02lu - track.flac\n",
+		   "artist", i / 12, i % 12);
+	old_printf(client, "Last-Modified: %s\n", "2011-03-14T12:00:00Z");
+	old_printf(client, "Time: %lu\n", 180 + i % 200);
+	old_printf(client, "%s: %s %lu\n", "Artist", "Artist", i / 120);
+	old_printf(client, "%s: %s %lu\n", "Album", "Album", i / 12);
+	old_printf(client, "%s: %s %lu\n", "Title", "Title", i);
+	old_printf(client, "%s: %lu\n", "Track", i % 12 + 1);
+	old_printf(client, "%s: %s\n", "Genre", "Rock");
+	old_printf(client, "%s: %lu\n", "Date", 1970 + i % 40);
+}
+
+static uint64_t
+bench_old(int fd)
+{
+	struct old_client client = {
+		.fd = fd,
+		.deferred_send = g_queue_new(),
+	};
+
+	uint64_t start = now_ns();
+
+	for (unsigned long i = 0; i < num_songs; i++)
+		old_song(&client, i);
+	old_printf(&client, "OK\n");
+	old_write_output(&client);
+
+	while (!g_queue_is_empty(client.deferred_send)) {
+		wait_writable(fd);
+		old_write_deferred(&client);
+	}
+
+	uint64_t elapsed = now_ns() - start;
+	g_queue_free(client.deferred_send);
+	return elapsed;
+}
+
+/* the pooled page queue */
+
+static void
+new_song(struct client *client, unsigned long i)
+{
+	client_printf(client, "file: %s/album%lu/%02lu - track.flac\n",
+		      "artist", i / 12, i % 12);
+	client_printf(client, "Last-Modified: %s\n", "2011-03-14T12:00:00Z");
+	client_printf(client, "Time: %lu\n", 180 + i % 200);
+	client_printf(client, "%s: %s %lu\n", "Artist", "Artist", i / 120);
+	client_printf(client, "%s: %s %lu\n", "Album", "Album", i / 12);
+	client_printf(client, "%s: %s %lu\n", "Title", "Title", i);
+	client_printf(client, "%s: %lu\n", "Track", i % 12 + 1);
+	client_printf(client, "%s: %s\n", "Genre", "Rock");
+	client_printf(client, "%s: %lu\n", "Date", 1970 + i % 40);
+}
+
+static uint64_t
+bench_new(int fd)
+{
+	struct client *client = g_new0(struct client, 1);
+	client->channel = g_io_channel_unix_new(fd);
+	client->last_activity = g_timer_new();
+
+	uint64_t start = now_ns();
+
+	for (unsigned long i = 0; i < num_songs; i++)
+		new_song(client, i);
+	client_puts(client, "OK\n");
+	client_write_output(client);
+
+	while (client_has_deferred_output(client) && !expired) {
+		wait_writable(fd);
+		client_write_deferred(client);
+	}
+
+	uint64_t elapsed = now_ns() - start;
+
+	client_output_clear(client);
+	g_timer_destroy(client->last_activity);
+	g_io_channel_unref(client->channel);
+	g_free(client);
+	client_output_pool_deinit();
+	return elapsed;
+}
+
+static void
+run(const char *name, uint64_t (*f)(int fd))
+{
+	int fds[2];
+	struct reader r = { .bytes = 0 };
+	thrd_t reader;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+		perror("socketpair");
+		exit(EXIT_FAILURE);
+	}
+
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+	r.fd = fds[1];
+	thrd_create(&reader, reader_thread, &r);
+
+	uint64_t elapsed = f(fds[0]);
+	close(fds[0]);
+	thrd_join(reader, NULL);
+	close(fds[1]);
+
+	printf("%-8s %8.1f MB/s (%llu bytes)\n", name,
+	       r.bytes * 1e3 / elapsed, r.bytes);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 2) {
+		fprintf(stderr, "Usage: bench_client_write [NUM_SONGS]\n");
+		return 1;
+	}
+
+	if (argc > 1)
+		num_songs = strtoul(argv[1], NULL, 10);
+
+	run("old", bench_old);
+	run("pooled", bench_new);
+	return 0;
+}
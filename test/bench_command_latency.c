@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Load generator for mixed concurrent commands: a few clients loop
+ * over slow database queries while one client loops over "status",
+ * all against a running MPD.  Reports latency percentiles per
+ * command; with command_threads > 0, "status" should no longer wait
+ * for the queries of the other clients.
+ */
+
+#include "bench_time.h"
+
+#include <netdb.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define MAX_SAMPLES 100000
+
+struct command_stats {
+	const char *line;
+
+	pthread_mutex_t mutex;
+	size_t n;
+	uint64_t samples[MAX_SAMPLES];
+};
+
+static struct command_stats heavy_commands[] = {
+	{ .line = "list artist\n" },
+	{ .line = "list album\n" },
+	{ .line = "count artist \"\"\n" },
+	{ .line = "lsinfo\n" },
+};
+
+static struct command_stats status_command = { .line = "status\n" };
+
+static const char *host, *port;
+static volatile bool running = true;
+
+static int
+connect_mpd(void)
+{
+	struct addrinfo hints = { .ai_socktype = SOCK_STREAM }, *ai;
+	int ret = getaddrinfo(host, port, &hints, &ai);
+	if (ret != 0) {
+		fprintf(stderr, "%s: %s\n", host, gai_strerror(ret));
+		exit(1);
+	}
+
+	int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	if (fd < 0 || connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+		perror("connect");
+		exit(1);
+	}
+
+	freeaddrinfo(ai);
+	return fd;
+}
+
+/* Reads until the response is complete; the data is discarded */
+static void
+read_response(int fd)
+{
+	static __thread char buffer[65536];
+	char line[4];
+	size_t length = 0;
+
+	while (true) {
+		ssize_t nbytes = recv(fd, buffer, sizeof(buffer), 0);
+		if (nbytes <= 0) {
+			fprintf(stderr, "connection closed\n");
+			exit(1);
+		}
+
+		/* the response ends with a line "OK" or "ACK ..." */
+		for (ssize_t i = 0; i < nbytes; ++i) {
+			if (buffer[i] != '\n') {
+				if (length < sizeof(line))
+					line[length] = buffer[i];
+				++length;
+				continue;
+			}
+
+			if ((length == 2 && memcmp(line, "OK", 2) == 0) ||
+			    (length >= 3 && memcmp(line, "ACK", 3) == 0))
+				return;
+
+			length = 0;
+		}
+	}
+}
+
+static void
+run_command(int fd, struct command_stats *stats)
+{
+	uint64_t start = now_ns();
+	send(fd, stats->line, strlen(stats->line), MSG_NOSIGNAL);
+	read_response(fd);
+	uint64_t t = now_ns() - start;
+
+	pthread_mutex_lock(&stats->mutex);
+	if (stats->n < MAX_SAMPLES)
+		stats->samples[stats->n++] = t;
+	pthread_mutex_unlock(&stats->mutex);
+}
+
+static void *
+heavy_thread(void *arg)
+{
+	unsigned i = (unsigned)(uintptr_t)arg;
+	int fd = connect_mpd();
+	char greeting[64];
+	recv(fd, greeting, sizeof(greeting), 0);
+
+	while (running) {
+		run_command(fd, &heavy_commands[i]);
+		i = (i + 1) % (sizeof(heavy_commands) /
+			       sizeof(heavy_commands[0]));
+	}
+
+	close(fd);
+	return NULL;
+}
+
+static void *
+status_thread(void *arg)
+{
+	(void)arg;
+	int fd = connect_mpd();
+	char greeting[64];
+	recv(fd, greeting, sizeof(greeting), 0);
+
+	while (running) {
+		run_command(fd, &status_command);
+		usleep(1000);
+	}
+
+	close(fd);
+	return NULL;
+}
+
+static int
+compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static void
+print_stats(struct command_stats *stats)
+{
+	size_t n = stats->n;
+	if (n == 0)
+		return;
+
+	qsort(stats->samples, n, sizeof(stats->samples[0]), compare_u64);
+
+	char name[32];
+	snprintf(name, sizeof(name), "%.*s", (int)strcspn(stats->line, "\n"),
+		 stats->line);
+	printf("%-20s %7zu  p50 %9.2f ms  p90 %9.2f ms  p99 %9.2f ms  "
+	       "max %9.2f ms\n", name, n,
+	       stats->samples[n / 2] / 1e6, stats->samples[n * 9 / 10] / 1e6,
+	       stats->samples[n * 99 / 100] / 1e6, stats->samples[n - 1] / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3 || argc > 5) {
+		fprintf(stderr,
+			"Usage: bench_command_latency HOST PORT [SECONDS] [HEAVY_CLIENTS]\n");
+		return 1;
+	}
+
+	host = argv[1];
+	port = argv[2];
+	unsigned seconds = argc > 3 ? strtoul(argv[3], NULL, 10) : 10;
+	unsigned num_heavy = argc > 4 ? strtoul(argv[4], NULL, 10) : 4;
+
+	const unsigned num_commands =
+		sizeof(heavy_commands) / sizeof(heavy_commands[0]);
+	for (unsigned i = 0; i < num_commands; ++i)
+		pthread_mutex_init(&heavy_commands[i].mutex, NULL);
+	pthread_mutex_init(&status_command.mutex, NULL);
+
+	pthread_t *threads = calloc(num_heavy + 1, sizeof(*threads));
+	for (unsigned i = 0; i < num_heavy; ++i)
+		pthread_create(&threads[i], NULL, heavy_thread,
+			       (void *)(uintptr_t)(i % num_commands));
+	pthread_create(&threads[num_heavy], NULL, status_thread, NULL);
+
+	sleep(seconds);
+	running = false;
+
+	for (unsigned i = 0; i <= num_heavy; ++i)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	printf("%u heavy clients, %u seconds\n", num_heavy, seconds);
+	print_stats(&status_command);
+	for (unsigned i = 0; i < num_commands; ++i)
+		print_stats(&heavy_commands[i]);
+	return 0;
+}
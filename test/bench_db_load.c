@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Start-up benchmark for the simple database: builds a synthetic
+ * library, saves it in the text format, in the indexed text format
+ * loaded by several threads and in the binary format, then measures
+ * how long opening (loading) each file takes.
+ */
+
+#include "config.h"
+#include "db/simple_db_plugin.h"
+#include "db_plugin.h"
+#include "db_lock.h"
+#include "directory.h"
+#include "song.h"
+#include "tag.h"
+#include "tag_pool.h"
+#include "conf.h"
+#include "bench_time.h"
+
+#include <glib.h>
+
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define SONGS_PER_ALBUM 12
+#define ALBUMS_PER_ARTIST 4
+
+static unsigned long num_songs = 400000;
+static unsigned num_threads = 4;
+
+static struct db *
+bench_db_new(const char *path, const char *format, unsigned threads)
+{
+	char buffer[16];
+
+	snprintf(buffer, sizeof(buffer), "%u", threads);
+
+	struct config_param *param = config_new_param("database", 0);
+	config_add_block_param(param, "path", path, 0);
+	config_add_block_param(param, "format", format, 0);
+	config_add_block_param(param, "load_threads", buffer, 0);
+
+	struct db *db = db_plugin_new(&simple_db_plugin, param);
+	config_param_free(param);
+	return db;
+}
+
+static void
+fill_library(struct directory *root)
+{
+	char buf[64];
+
+	db_lock();
+
+	for (unsigned long i = 0; i < num_songs; ++i) {
+		unsigned long album = i / SONGS_PER_ALBUM;
+		unsigned long artist = album / ALBUMS_PER_ARTIST;
+
+		snprintf(buf, sizeof(buf), "Artist %lu", artist);
+		struct directory *artist_dir =
+			directory_make_child(root, buf);
+
+		snprintf(buf, sizeof(buf), "Album %lu", album);
+		struct directory *album_dir =
+			directory_make_child(artist_dir, buf);
+		album_dir->mtime = 1300000000 + album;
+
+		snprintf(buf, sizeof(buf), "%02lu - Track %lu.flac",
+			 i % SONGS_PER_ALBUM + 1, i);
+		struct song *song = song_file_new(buf, album_dir);
+		song->mtime = 1300000000 + i;
+
+		struct tag *tag = song->tag = tag_new();
+		tag->time = 180 + i % 240;
+
+		tag_begin_add(tag);
+		snprintf(buf, sizeof(buf), "Artist %lu", artist);
+		tag_add_item(tag, TAG_ARTIST, buf);
+		tag_add_item(tag, TAG_ALBUM_ARTIST, buf);
+		snprintf(buf, sizeof(buf), "Album %lu", album);
+		tag_add_item(tag, TAG_ALBUM, buf);
+		snprintf(buf, sizeof(buf), "Track number %lu", i);
+		tag_add_item(tag, TAG_TITLE, buf);
+		snprintf(buf, sizeof(buf), "%lu", i % SONGS_PER_ALBUM + 1);
+		tag_add_item(tag, TAG_TRACK, buf);
+		snprintf(buf, sizeof(buf), "Genre %lu", album % 150);
+		tag_add_item(tag, TAG_GENRE, buf);
+		snprintf(buf, sizeof(buf), "%lu", 1960 + album % 60);
+		tag_add_item(tag, TAG_DATE, buf);
+		tag_end_add(tag);
+
+		directory_add_song(album_dir, song);
+	}
+
+	db_unlock();
+}
+
+static void
+bench_format(const char *path, const char *format, unsigned threads)
+{
+	/* create the file */
+
+	unlink(path);
+
+	struct db *db = bench_db_new(path, format, threads);
+	if (db == NULL || db_plugin_open(db) != MPD_SUCCESS) {
+		fprintf(stderr, "failed to create database %s\n", path);
+		exit(EXIT_FAILURE);
+	}
+
+	fill_library(simple_db_get_root(db));
+
+	uint64_t t = now_ns();
+	if (simple_db_save(db) != MPD_SUCCESS) {
+		fprintf(stderr, "failed to save database %s\n", path);
+		exit(EXIT_FAILURE);
+	}
+	uint64_t save = now_ns() - t;
+
+	db_plugin_close(db);
+	db_plugin_free(db);
+
+	/* load it again */
+
+	db = bench_db_new(path, format, threads);
+	t = now_ns();
+	if (db_plugin_open(db) != MPD_SUCCESS) {
+		fprintf(stderr, "failed to load database %s\n", path);
+		exit(EXIT_FAILURE);
+	}
+	uint64_t load = now_ns() - t;
+
+	db_plugin_close(db);
+	db_plugin_free(db);
+
+	struct stat st;
+	stat(path, &st);
+
+	printf("%-6s %2u thread(s): %lu songs, %8.1f MB, "
+	       "save %7.1f ms, load %7.1f ms\n",
+	       format, threads, num_songs, st.st_size / 1e6,
+	       save / 1e6, load / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2 || argc > 4) {
+		fprintf(stderr,
+			"Usage: bench_db_load DIRECTORY [NSONGS [NTHREADS]]\n");
+		return 1;
+	}
+
+	if (argc > 2)
+		num_songs = strtoul(argv[2], NULL, 10);
+	if (argc > 3)
+		num_threads = strtoul(argv[3], NULL, 10);
+
+	g_thread_init(NULL);
+	tag_pool_init();
+	config_global_init();
+	tag_lib_init();
+
+	char *text_path = g_build_filename(argv[1], "bench_db.txt", NULL);
+	char *binary_path = g_build_filename(argv[1], "bench_db.bin", NULL);
+
+	bench_format(text_path, "text", 1);
+	if (num_threads > 1)
+		bench_format(text_path, "text", num_threads);
+	bench_format(binary_path, "binary", 1);
+
+	unlink(text_path);
+	unlink(binary_path);
+	g_free(text_path);
+	g_free(binary_path);
+
+	config_global_finish();
+	tag_pool_deinit();
+	return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Benchmark for name lookups in flat directories: fills one
+ * directory with 1k, 10k and 100k songs and sub directories (or the
+ * sizes given on the command line) and times directory_get_song(),
+ * directory_get_child() and directory_lookup_song() against the
+ * linear list scan they used to be.
+ */
+
+#include "config.h"
+#include "directory.h"
+#include "song.h"
+#include "db_lock.h"
+#include "bench_time.h"
+
+#include <glib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* number of lookups timed per size */
+#define NLOOKUPS 100000
+
+/* The old lookup: a strcmp() scan of the list */
+static struct song *
+scan_song(const struct directory *directory, const char *name)
+{
+	struct song *song;
+	directory_for_each_song(song, directory)
+		if (strcmp(song->uri, name) == 0)
+			return song;
+	return NULL;
+}
+
+static void
+bench(unsigned size)
+{
+	char buf[64];
+
+	db_lock();
+
+	struct directory *root = directory_new_root();
+	struct directory *flat = directory_new_child(root, "flat");
+
+	uint64_t t = now_ns();
+	for (unsigned i = 0; i < size; ++i) {
+		snprintf(buf, sizeof(buf), "Episode %u.mp3", i);
+		directory_add_song(flat, song_file_new(buf, flat));
+
+		snprintf(buf, sizeof(buf), "Folder %u", i);
+		directory_make_child(flat, buf);
+	}
+	t = now_ns() - t;
+	printf("%7u entries: fill %8.1f ms\n", size, t / 1e6);
+
+	/* the names to look up, chosen up front so formatting does
+	   not count */
+	char (*names)[64] = malloc(NLOOKUPS * sizeof(*names));
+	char (*uris)[64] = malloc(NLOOKUPS * sizeof(*uris));
+	char (*folders)[64] = malloc(NLOOKUPS * sizeof(*folders));
+	srand(size);
+	for (unsigned i = 0; i < NLOOKUPS; ++i) {
+		unsigned n = rand() % size;
+		snprintf(names[i], sizeof(names[i]), "Episode %u.mp3", n);
+		snprintf(uris[i], sizeof(uris[i]), "flat/Episode %u.mp3", n);
+		snprintf(folders[i], sizeof(folders[i]), "Folder %u", n);
+	}
+
+	unsigned found = 0;
+
+	t = now_ns();
+	for (unsigned i = 0; i < NLOOKUPS; ++i)
+		found += directory_get_song(flat, names[i]) != NULL;
+	t = now_ns() - t;
+	printf("%17s %8.1f ns/lookup\n", "get_song", (double)t / NLOOKUPS);
+
+	t = now_ns();
+	for (unsigned i = 0; i < NLOOKUPS; ++i)
+		found += directory_get_child(flat, folders[i]) != NULL;
+	t = now_ns() - t;
+	printf("%17s %8.1f ns/lookup\n", "get_child", (double)t / NLOOKUPS);
+
+	t = now_ns();
+	for (unsigned i = 0; i < NLOOKUPS; ++i)
+		found += directory_lookup_song(root, uris[i]) != NULL;
+	t = now_ns() - t;
+	printf("%17s %8.1f ns/lookup\n", "lookup_song", (double)t / NLOOKUPS);
+
+	/* the scan is slow; time fewer lookups */
+	unsigned nscan = NLOOKUPS / (size / 1000 + 1);
+	t = now_ns();
+	for (unsigned i = 0; i < nscan; ++i)
+		found += scan_song(flat, names[i]) != NULL;
+	t = now_ns() - t;
+	printf("%17s %8.1f ns/lookup\n", "list scan", (double)t / nscan);
+
+	if (found != 3 * NLOOKUPS + nscan)
+		fprintf(stderr, "lookup failed\n");
+
+	directory_free(root);
+	db_unlock();
+
+	free(names);
+	free(uris);
+	free(folders);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1) {
+		for (int i = 1; i < argc; ++i)
+			bench(strtoul(argv[i], NULL, 10));
+	} else {
+		bench(1000);
+		bench(10000);
+		bench(100000);
+	}
+
+	return 0;
+}
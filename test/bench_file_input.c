@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Benchmark for the file input plugin: reads a file the way a decoder
+ * does (fixed size blocks, optionally with some "decoding" work per
+ * block) with plain read(), with readahead and with mmap, on a cold
+ * and on a warm page cache.
+ *
+ * The cold runs drop the file from the page cache with
+ * POSIX_FADV_DONTNEED first, which only works for clean pages.
+ */
+
+#include "config.h"
+#include "input/file.h"
+#include "input_plugin.h"
+#include "conf.h"
+#include "err.h"
+#include "bench_time.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static size_t block_size = 4096;
+
+/* microseconds of busy work per block, simulating the decoder */
+static unsigned decode_us;
+
+static void
+drop_cache(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return;
+
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+static void
+decode(void)
+{
+	if (decode_us == 0)
+		return;
+
+	uint64_t until = now_ns() + decode_us * 1000ull;
+	while (now_ns() < until) {
+	}
+}
+
+static void
+configure(const char *readahead, const char *mmap)
+{
+	struct config_param *param = config_new_param(NULL, 0);
+	config_add_block_param(param, "readahead", readahead, 0);
+	config_add_block_param(param, "mmap", mmap, 0);
+
+	input_plugin_file.init(param);
+	config_param_free(param);
+}
+
+static void
+bench(const char *path, const char *name, bool cold)
+{
+	char *buffer = malloc(block_size);
+	uint64_t worst = 0;
+
+	if (cold)
+		drop_cache(path);
+
+	uint64_t start = now_ns();
+	struct input_stream *is = input_plugin_file.open(path);
+	if (is == NULL || IS_ERR(is)) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		exit(1);
+	}
+
+	off_t total = 0;
+	for (;;) {
+		uint64_t t = now_ns();
+		ssize_t nbytes = input_plugin_file.read(is, buffer, block_size);
+		t = now_ns() - t;
+		if (t > worst)
+			worst = t;
+
+		if (nbytes <= 0)
+			break;
+
+		total += nbytes;
+		decode();
+	}
+
+	input_plugin_file.close(is);
+	uint64_t elapsed = now_ns() - start;
+
+	printf("%-16s %-4s %8.1f MiB/s, worst read %8.1f us\n",
+	       name, cold ? "cold" : "warm",
+	       total * 1e9 / elapsed / (1024 * 1024), worst / 1e3);
+	free(buffer);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2 || argc > 4) {
+		fprintf(stderr,
+			"Usage: bench_file_input FILE [BLOCK_SIZE] [DECODE_US]\n");
+		return 1;
+	}
+
+	const char *path = argv[1];
+	if (argc > 2)
+		block_size = strtoul(argv[2], NULL, 10);
+	if (argc > 3)
+		decode_us = strtoul(argv[3], NULL, 10);
+
+	static const struct {
+		const char *name, *readahead, *mmap;
+	} modes[] = {
+		{ "read", "0", "no" },
+		{ "read+readahead", "4096", "no" },
+		{ "mmap+readahead", "4096", "yes" },
+	};
+
+	for (unsigned i = 0; i < G_N_ELEMENTS(modes); ++i) {
+		configure(modes[i].readahead, modes[i].mmap);
+		bench(path, modes[i].name, true);
+		bench(path, modes[i].name, false);
+	}
+
+	return 0;
+}
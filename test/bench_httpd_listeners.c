@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Load generator for the httpd output: opens many loopback
+ * connections to the stream of a running MPD and reads from all of
+ * them for a while.  Reports the throughput per listener and, given
+ * the PID of MPD, the CPU time MPD spent per listener (from
+ * /proc/PID/stat).
+ *
+ * Start playback with an httpd output enabled, raise "max_clients"
+ * and the file descriptor limit (ulimit -n) before running this with
+ * many listeners.
+ */
+
+#include "bench_time.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+struct listener {
+	int fd;
+
+	/** the number of bytes received, including the headers */
+	uint64_t received;
+};
+
+static int
+connect_httpd(const char *host, const char *port)
+{
+	struct addrinfo hints = { .ai_socktype = SOCK_STREAM }, *ai;
+	int ret = getaddrinfo(host, port, &hints, &ai);
+	if (ret != 0) {
+		fprintf(stderr, "%s: %s\n", host, gai_strerror(ret));
+		exit(1);
+	}
+
+	int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	if (fd < 0 || connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+		perror("connect");
+		exit(1);
+	}
+
+	freeaddrinfo(ai);
+
+	static const char request[] =
+		"GET / HTTP/1.1\r\n"
+		"Icy-MetaData: 1\r\n"
+		"\r\n";
+	if (send(fd, request, sizeof(request) - 1, MSG_NOSIGNAL) !=
+	    (ssize_t)sizeof(request) - 1) {
+		perror("send");
+		exit(1);
+	}
+
+	return fd;
+}
+
+/* Returns the user+system CPU time of a process in clock ticks */
+static uint64_t
+process_cpu_ticks(const char *pid)
+{
+	char path[64], buffer[1024];
+	snprintf(path, sizeof(path), "/proc/%s/stat", pid);
+
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		perror(path);
+		exit(1);
+	}
+
+	size_t length = fread(buffer, 1, sizeof(buffer) - 1, file);
+	fclose(file);
+	buffer[length] = 0;
+
+	/* skip "pid (comm)", the name may contain spaces */
+	const char *p = strrchr(buffer, ')');
+	unsigned long utime, stime;
+	if (p == NULL ||
+	    sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+		   "%lu %lu", &utime, &stime) != 2) {
+		fprintf(stderr, "failed to parse %s\n", path);
+		exit(1);
+	}
+
+	return utime + stime;
+}
+
+/* Reads everything available; returns false on disconnect */
+static bool
+listener_read(struct listener *l)
+{
+	char buffer[65536];
+
+	while (true) {
+		ssize_t nbytes = recv(l->fd, buffer, sizeof(buffer),
+				      MSG_DONTWAIT);
+		if (nbytes < 0 && errno == EAGAIN)
+			return true;
+		if (nbytes <= 0)
+			return false;
+
+		l->received += nbytes;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3 || argc > 6) {
+		fprintf(stderr,
+			"Usage: bench_httpd_listeners HOST PORT [LISTENERS] "
+			"[SECONDS] [MPD_PID]\n");
+		return 1;
+	}
+
+	const char *host = argv[1], *port = argv[2];
+	unsigned num_listeners = argc > 3 ? strtoul(argv[3], NULL, 10) : 500;
+	unsigned seconds = argc > 4 ? strtoul(argv[4], NULL, 10) : 10;
+	const char *pid = argc > 5 ? argv[5] : NULL;
+
+	struct listener *listeners = calloc(num_listeners, sizeof(*listeners));
+	int epfd = epoll_create1(0);
+
+	for (unsigned i = 0; i < num_listeners; ++i) {
+		listeners[i].fd = connect_httpd(host, port);
+
+		struct epoll_event event = {
+			.events = EPOLLIN,
+			.data.ptr = &listeners[i],
+		};
+		epoll_ctl(epfd, EPOLL_CTL_ADD, listeners[i].fd, &event);
+	}
+
+	/* skip the ramp-up: MPD sends the first pages in a burst */
+	uint64_t warmup_end = now_ns() + 1000000000ull;
+	while (now_ns() < warmup_end) {
+		struct epoll_event events[256];
+		int count = epoll_wait(epfd, events, 256, 100);
+		for (int j = 0; j < count; ++j)
+			listener_read(events[j].data.ptr);
+	}
+
+	for (unsigned i = 0; i < num_listeners; ++i)
+		listeners[i].received = 0;
+
+	uint64_t cpu_start = pid != NULL ? process_cpu_ticks(pid) : 0;
+	uint64_t start = now_ns(), end = start + seconds * 1000000000ull;
+	unsigned disconnected = 0;
+
+	while (now_ns() < end) {
+		struct epoll_event events[256];
+		int count = epoll_wait(epfd, events, 256, 100);
+		for (int j = 0; j < count; ++j) {
+			struct listener *l = events[j].data.ptr;
+			if (!listener_read(l)) {
+				epoll_ctl(epfd, EPOLL_CTL_DEL, l->fd, NULL);
+				++disconnected;
+			}
+		}
+	}
+
+	double elapsed = (now_ns() - start) / 1e9;
+
+	uint64_t total = 0, min = UINT64_MAX;
+	for (unsigned i = 0; i < num_listeners; ++i) {
+		total += listeners[i].received;
+		if (listeners[i].received < min)
+			min = listeners[i].received;
+	}
+
+	printf("%u listeners, %.1f s: %.1f kB/s per listener (min %.1f), "
+	       "%u disconnected\n",
+	       num_listeners, elapsed,
+	       total / elapsed / num_listeners / 1e3, min / elapsed / 1e3,
+	       disconnected);
+
+	if (pid != NULL) {
+		double cpu = (double)(process_cpu_ticks(pid) - cpu_start) /
+			sysconf(_SC_CLK_TCK);
+		printf("MPD: %.1f%% CPU, %.3f%% CPU per listener\n",
+		       cpu / elapsed * 100,
+		       cpu / elapsed * 100 / num_listeners);
+	}
+
+	for (unsigned i = 0; i < num_listeners; ++i)
+		close(listeners[i].fd);
+	close(epfd);
+	free(listeners);
+	return 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Load generator for idle notifications: opens many connections to
+ * a running MPD which all wait in "idle options", then toggles
+ * "repeat" on a separate connection and measures how long each idle
+ * client takes to receive its "changed: options" response.  Reports
+ * min/median/p99/max latency over all rounds.
+ *
+ * Raise "max_connections" in mpd.conf and the file descriptor limit
+ * (ulimit -n) before running this with many clients.
+ */
+
+#include "bench_time.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+struct idle_client {
+	int fd;
+
+	/** has the client received "OK" for the current round? */
+	bool done;
+
+	size_t length;
+	char buffer[256];
+};
+
+static int
+connect_mpd(const char *host, const char *port)
+{
+	struct addrinfo hints = { .ai_socktype = SOCK_STREAM }, *ai;
+	int ret = getaddrinfo(host, port, &hints, &ai);
+	if (ret != 0) {
+		fprintf(stderr, "%s: %s\n", host, gai_strerror(ret));
+		exit(1);
+	}
+
+	int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	if (fd < 0 || connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+		perror("connect");
+		exit(1);
+	}
+
+	freeaddrinfo(ai);
+	return fd;
+}
+
+static void
+send_line(int fd, const char *line)
+{
+	size_t length = strlen(line);
+	if (send(fd, line, length, MSG_NOSIGNAL) != (ssize_t)length) {
+		perror("send");
+		exit(1);
+	}
+}
+
+/* Blocks until a line starting with "OK" or "ACK" has been received */
+static void
+wait_ok(int fd)
+{
+	char buffer[256];
+	size_t length = 0;
+
+	while (true) {
+		ssize_t nbytes = recv(fd, buffer + length,
+				      sizeof(buffer) - 1 - length, 0);
+		if (nbytes <= 0) {
+			fprintf(stderr, "connection closed\n");
+			exit(1);
+		}
+
+		length += nbytes;
+		buffer[length] = 0;
+		if (strncmp(buffer, "OK", 2) == 0 ||
+		    strstr(buffer, "\nOK") != NULL)
+			return;
+		if (strstr(buffer, "ACK") != NULL) {
+			fprintf(stderr, "%s", buffer);
+			exit(1);
+		}
+		if (length >= sizeof(buffer) - 1)
+			length = 0;
+	}
+}
+
+/* Consumes input; returns true when the idle response is complete */
+static bool
+idle_client_read(struct idle_client *c)
+{
+	while (true) {
+		ssize_t nbytes = recv(c->fd, c->buffer + c->length,
+				      sizeof(c->buffer) - 1 - c->length,
+				      MSG_DONTWAIT);
+		if (nbytes < 0 && errno == EAGAIN)
+			return false;
+		if (nbytes <= 0) {
+			fprintf(stderr, "idle client disconnected\n");
+			exit(1);
+		}
+
+		c->length += nbytes;
+		c->buffer[c->length] = 0;
+		if (strstr(c->buffer, "OK\n") != NULL) {
+			c->length = 0;
+			return true;
+		}
+	}
+}
+
+static int
+compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3 || argc > 5) {
+		fprintf(stderr,
+			"Usage: bench_idle_clients HOST PORT [CLIENTS] [ROUNDS]\n");
+		return 1;
+	}
+
+	const char *host = argv[1], *port = argv[2];
+	unsigned num_clients = argc > 3 ? strtoul(argv[3], NULL, 10) : 1000;
+	unsigned rounds = argc > 4 ? strtoul(argv[4], NULL, 10) : 20;
+
+	struct idle_client *clients = calloc(num_clients, sizeof(*clients));
+	uint64_t *latencies = malloc(sizeof(*latencies) *
+				     num_clients * rounds);
+	int epfd = epoll_create1(0);
+
+	for (unsigned i = 0; i < num_clients; ++i) {
+		clients[i].fd = connect_mpd(host, port);
+		wait_ok(clients[i].fd);
+		send_line(clients[i].fd, "idle options\n");
+
+		struct epoll_event event = {
+			.events = EPOLLIN,
+			.data.ptr = &clients[i],
+		};
+		epoll_ctl(epfd, EPOLL_CTL_ADD, clients[i].fd, &event);
+	}
+
+	int control = connect_mpd(host, port);
+	wait_ok(control);
+
+	/* let the server process all "idle" commands */
+	usleep(500000);
+
+	size_t n = 0;
+	for (unsigned round = 0; round < rounds; ++round) {
+		for (unsigned i = 0; i < num_clients; ++i)
+			clients[i].done = false;
+
+		uint64_t start = now_ns();
+		send_line(control, round % 2 == 0
+			  ? "repeat 1\n" : "repeat 0\n");
+		wait_ok(control);
+
+		unsigned remaining = num_clients;
+		while (remaining > 0) {
+			struct epoll_event events[256];
+			int count = epoll_wait(epfd, events, 256, 10000);
+			if (count <= 0) {
+				fprintf(stderr, "timeout, %u clients missing\n",
+					remaining);
+				return 1;
+			}
+
+			uint64_t t = now_ns();
+			for (int j = 0; j < count; ++j) {
+				struct idle_client *c = events[j].data.ptr;
+				if (c->done || !idle_client_read(c))
+					continue;
+
+				c->done = true;
+				latencies[n++] = t - start;
+				--remaining;
+			}
+		}
+
+		for (unsigned i = 0; i < num_clients; ++i)
+			send_line(clients[i].fd, "idle options\n");
+		usleep(100000);
+	}
+
+	qsort(latencies, n, sizeof(*latencies), compare_u64);
+	printf("%u clients, %u rounds: min %.1f us, median %.1f us, "
+	       "p99 %.1f us, max %.1f us\n",
+	       num_clients, rounds, latencies[0] / 1e3,
+	       latencies[n / 2] / 1e3, latencies[n * 99 / 100] / 1e3,
+	       latencies[n - 1] / 1e3);
+
+	for (unsigned i = 0; i < num_clients; ++i)
+		close(clients[i].fd);
+	close(control);
+	close(epfd);
+	free(clients);
+	free(latencies);
+	return 0;
+}
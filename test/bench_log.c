@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Benchmark for the cost of a log call in the calling thread: with the
+ * level disabled, and enabled with the asynchronous writer (output goes
+ * to /dev/null).  The previous implementation (format with vasprintf(),
+ * copy to add the prefix, then check the level in the handler) is kept
+ * here as a reference.
+ */
+
+#define LOG_DOMAIN "bench"
+
+#include "log.h"
+#include "config.h"
+#include "bench_time.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static unsigned long num_calls = 1000000;
+
+/* the old implementation */
+
+static void __attribute__ ((format(printf, 2, 3)))
+old_log_meta(int log_level, const char *fmt, ...)
+{
+	char *buf;
+	va_list args;
+	va_start(args, fmt);
+
+	if (vasprintf(&buf, fmt, args) < 0)
+		abort();
+	va_end(args);
+
+	char *buf2 = (char *)malloc(strlen(buf)+strlen(LOG_PREFIX)+1);
+	strcpy(buf2, LOG_PREFIX);
+	strcpy(buf2+strlen(LOG_PREFIX), buf);
+
+	log_handler(log_level, buf2);
+	free(buf);
+	free(buf2);
+}
+
+static void
+report(const char *name, uint64_t elapsed)
+{
+	printf("%-24s %8.1f ns/call\n", name, (double)elapsed / num_calls);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 2) {
+		fprintf(stderr, "Usage: bench_log [NUM_CALLS]\n");
+		return 1;
+	}
+
+	if (argc > 1)
+		num_calls = strtoul(argv[1], NULL, 10);
+
+	/* all output goes to /dev/null; the results are printed on
+	   stdout */
+	if (freopen("/dev/null", "w", stderr) == NULL)
+		return 1;
+
+	log_early_init(false);
+
+	uint64_t t = now_ns();
+	for (unsigned long i = 0; i < num_calls; ++i)
+		old_log_meta(LOG_DEBUG, "disabled %lu %s", i, "message");
+	report("old, disabled:", now_ns() - t);
+
+	t = now_ns();
+	for (unsigned long i = 0; i < num_calls; ++i)
+		log_debug("disabled %lu %s", i, "message");
+	report("new, disabled:", now_ns() - t);
+
+	t = now_ns();
+	for (unsigned long i = 0; i < num_calls; ++i)
+		old_log_meta(LOG_INFO, "enabled %lu %s", i, "message");
+	report("old, enabled (sync):", now_ns() - t);
+
+	t = now_ns();
+	for (unsigned long i = 0; i < num_calls; ++i)
+		log_info("enabled %lu %s", i, "message");
+	report("new, enabled (sync):", now_ns() - t);
+
+	/* start the writer thread, as after daemonizing */
+	setup_log_output(true);
+
+	t = now_ns();
+	for (unsigned long i = 0; i < num_calls; ++i)
+		log_info("enabled %lu %s", i, "message");
+	report("new, enabled (async):", now_ns() - t);
+
+	log_deinit();
+	return 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Throughput of every sample format conversion, in samples per
+ * second, with the scalar code and with the best SIMD kernels.
+ */
+
+#include "config.h"
+#include "pcm/pcm_format.h"
+#include "pcm/pcm_buffer.h"
+#include "pcm/pcm_dither.h"
+#include "pcm/pcm_simd.h"
+#include "audio_format.h"
+#include "bench_time.h"
+
+#include <stdio.h>
+
+/* about one chunk worth of samples */
+enum { N = 4096 / 4, ROUNDS = 20000 };
+
+static double
+run(enum sample_format src_format, enum sample_format dest_format,
+    const void *src)
+{
+	static struct pcm_dither dither;
+	struct pcm_buffer buffer;
+	size_t src_size = N * sample_format_size(src_format), dest_size;
+
+	pcm_buffer_init(&buffer);
+	pcm_dither_24_init(&dither);
+
+	uint64_t start = now_ns();
+	for (unsigned i = 0; i < ROUNDS; ++i) {
+		switch (dest_format) {
+		case SAMPLE_FORMAT_S16:
+			pcm_convert_to_16(&buffer, &dither, src_format, src,
+					  src_size, &dest_size);
+			break;
+		case SAMPLE_FORMAT_S24_P32:
+			pcm_convert_to_24(&buffer, src_format, src, src_size,
+					  &dest_size);
+			break;
+		case SAMPLE_FORMAT_S32:
+			pcm_convert_to_32(&buffer, src_format, src, src_size,
+					  &dest_size);
+			break;
+		default:
+			pcm_convert_to_float(&buffer, src_format, src,
+					     src_size, &dest_size);
+			break;
+		}
+	}
+	uint64_t elapsed = now_ns() - start;
+
+	pcm_buffer_deinit(&buffer);
+	return (double)N * ROUNDS * 1e9 / elapsed;
+}
+
+int main(void)
+{
+	static const enum sample_format formats[] = {
+		SAMPLE_FORMAT_S8,
+		SAMPLE_FORMAT_S16,
+		SAMPLE_FORMAT_S24_P32,
+		SAMPLE_FORMAT_S32,
+		SAMPLE_FORMAT_FLOAT,
+	};
+	static int32_t src[N];
+	const unsigned features = pcm_simd_features();
+
+	printf("SIMD features:%s%s%s\n",
+	       features & PCM_SIMD_SSE2 ? " sse2" : "",
+	       features & PCM_SIMD_AVX2 ? " avx2" : "",
+	       features & PCM_SIMD_NEON ? " neon" : "");
+
+	for (unsigned d = 1; d < sizeof(formats) / sizeof(formats[0]); ++d) {
+		for (unsigned s = 0; s < sizeof(formats) / sizeof(formats[0]); ++s) {
+			if (s == d)
+				continue;
+
+			pcm_simd_restrict(0);
+			double scalar = run(formats[s], formats[d], src);
+			pcm_simd_restrict(~0u);
+			double simd = run(formats[s], formats[d], src);
+
+			printf("%-4s -> %-4s  scalar %8.1f Msamples/s  "
+			       "simd %8.1f Msamples/s  (x%.2f)\n",
+			       sample_format_to_string(formats[s]),
+			       sample_format_to_string(formats[d]),
+			       scalar / 1e6, simd / 1e6, simd / scalar);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Throughput of pcm_mix() for every sample format it handles, both
+ * for cross-fading (a mix ratio) and MixRamp (plain add), with the
+ * scalar code and with the SIMD kernels.
+ */
+
+#include "config.h"
+#include "pcm/pcm_mix.h"
+#include "pcm/pcm_simd.h"
+#include "audio_format.h"
+#include "bench_time.h"
+
+#include <math.h>
+#include <stdio.h>
+
+enum { N = 4096, ROUNDS = 20000 };
+
+static double
+run(enum sample_format format, float portion1)
+{
+	static int32_t a[N], b[N];
+	const size_t size = N * sample_format_size(format);
+
+	uint64_t start = now_ns();
+	for (unsigned i = 0; i < ROUNDS; ++i)
+		pcm_mix(a, b, size, format, portion1);
+	uint64_t elapsed = now_ns() - start;
+
+	return (double)N * ROUNDS * 1e9 / elapsed;
+}
+
+int main(void)
+{
+	static const enum sample_format formats[] = {
+		SAMPLE_FORMAT_S8,
+		SAMPLE_FORMAT_S16,
+		SAMPLE_FORMAT_S24_P32,
+		SAMPLE_FORMAT_S32,
+		SAMPLE_FORMAT_FLOAT,
+	};
+	static const float portions[] = { 0.5, NAN };
+
+	for (unsigned i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+		for (unsigned j = 0; j < 2; ++j) {
+			pcm_simd_restrict(0);
+			double scalar = run(formats[i], portions[j]);
+			pcm_simd_restrict(~0u);
+			double simd = run(formats[i], portions[j]);
+
+			printf("%-4s %-9s scalar %8.1f Msamples/s  "
+			       "simd %8.1f Msamples/s  (x%.2f)\n",
+			       sample_format_to_string(formats[i]),
+			       isnan(portions[j]) ? "mixramp" : "crossfade",
+			       scalar / 1e6, simd / 1e6, simd / scalar);
+		}
+	}
+
+	return 0;
+}
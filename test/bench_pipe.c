@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Micro benchmark for the audio pipe: one writer thread pushes chunks,
+ * one reader thread consumes them.  Reports chunks/sec and the worst
+ * case time the writer spent blocked waiting for a free chunk.
+ *
+ * The "locked" variant is the previous design (linked list protected
+ * by a mutex, writer woken through a semaphore), kept here as a
+ * reference.
+ */
+
+#include "config.h"
+#include "pipe.h"
+#include "audio_format.h"
+#include "c11thread.h"
+#include "sem.h"
+#include "bench_time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NCHUNKS 64
+
+static unsigned long total_chunks = 1000000;
+
+static const struct audio_format bench_format = {
+	.sample_rate = 192000,
+	.format = SAMPLE_FORMAT_S32,
+	.channels = 2,
+};
+
+/* The old mutex + semaphore pipe */
+
+struct locked_chunk {
+	struct locked_chunk *next;
+	char data[CHUNK_SIZE];
+};
+
+struct locked_pipe {
+	struct locked_chunk *head, **tail_r, *available;
+	mtx_t mutex;
+	struct xsem_t sem;
+	struct locked_chunk pool[NCHUNKS];
+};
+
+static void
+locked_pipe_init(struct locked_pipe *p)
+{
+	p->head = NULL;
+	p->tail_r = &p->head;
+	for (int i = 0; i < NCHUNKS - 1; i++)
+		p->pool[i].next = &p->pool[i + 1];
+	p->pool[NCHUNKS - 1].next = NULL;
+	p->available = &p->pool[0];
+	mtx_init(&p->mutex, mtx_plain);
+	xsem_init(&p->sem, NCHUNKS);
+}
+
+static void
+locked_pipe_push(struct locked_pipe *p, const char *data)
+{
+	xsem_wait(&p->sem);
+
+	mtx_lock(&p->mutex);
+	struct locked_chunk *c = p->available;
+	p->available = c->next;
+	mtx_unlock(&p->mutex);
+
+	memcpy(c->data, data, sizeof(c->data));
+
+	mtx_lock(&p->mutex);
+	c->next = NULL;
+	*p->tail_r = c;
+	p->tail_r = &c->next;
+	mtx_unlock(&p->mutex);
+}
+
+static bool
+locked_pipe_shift(struct locked_pipe *p)
+{
+	mtx_lock(&p->mutex);
+	struct locked_chunk *c = p->head;
+	if (c == NULL) {
+		mtx_unlock(&p->mutex);
+		return false;
+	}
+
+	p->head = c->next;
+	if (p->head == NULL)
+		p->tail_r = &p->head;
+	c->next = p->available;
+	p->available = c;
+	mtx_unlock(&p->mutex);
+
+	xsem_post(&p->sem);
+	return true;
+}
+
+static int
+locked_reader(void *arg)
+{
+	struct locked_pipe *p = arg;
+	unsigned long n = 0;
+
+	while (n < total_chunks)
+		if (locked_pipe_shift(p))
+			n++;
+		else
+			thrd_yield();
+	return 0;
+}
+
+static void
+bench_locked(void)
+{
+	static struct locked_pipe p;
+	static char data[CHUNK_SIZE];
+	uint64_t worst = 0;
+	thrd_t reader;
+
+	locked_pipe_init(&p);
+	thrd_create(&reader, locked_reader, &p);
+
+	uint64_t start = now_ns();
+	for (unsigned long i = 0; i < total_chunks; i++) {
+		uint64_t t = now_ns();
+		locked_pipe_push(&p, data);
+		t = now_ns() - t;
+		if (t > worst)
+			worst = t;
+	}
+	thrd_join(reader, NULL);
+	uint64_t elapsed = now_ns() - start;
+
+	printf("locked:   %.0f chunks/sec, worst writer wakeup %.1f us\n",
+	       total_chunks * 1e9 / elapsed, worst / 1e3);
+}
+
+/* The lock-free ring */
+
+static int
+ring_reader(void *arg)
+{
+	struct audio_pipe *p = arg;
+	const struct audio_chunk *c = NULL, *next;
+	unsigned long n = 0;
+
+	while (n < total_chunks) {
+		next = audio_pipe_next(p, c);
+		if (next == NULL) {
+			thrd_yield();
+			continue;
+		}
+		c = next;
+		n++;
+	}
+	return 0;
+}
+
+static void
+bench_ring(void)
+{
+	static char data[CHUNK_SIZE];
+
+	/* compare with the old pipe using the same chunk size */
+	audio_chunk_time = 0;
+
+	struct audio_pipe *p = audio_pipe_new(&bench_format,
+					      NCHUNKS * CHUNK_SIZE);
+	uint64_t worst = 0;
+	thrd_t reader;
+
+	thrd_create(&reader, ring_reader, p);
+
+	uint64_t start = now_ns();
+	for (unsigned long i = 0; i < total_chunks; i++) {
+		uint64_t t = now_ns();
+		audio_pipe_write_sync(p, &bench_format, 0, 0,
+				      sizeof(data), data);
+		audio_pipe_flush(p);
+		t = now_ns() - t;
+		if (t > worst)
+			worst = t;
+	}
+	thrd_join(reader, NULL);
+	uint64_t elapsed = now_ns() - start;
+
+	printf("lockfree: %.0f chunks/sec, worst writer wakeup %.1f us\n",
+	       total_chunks * 1e9 / elapsed, worst / 1e3);
+
+	audio_pipe_free(p);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 2) {
+		fprintf(stderr, "Usage: bench_pipe [NCHUNKS]\n");
+		return 1;
+	}
+
+	if (argc > 1)
+		total_chunks = strtoul(argv[1], NULL, 10);
+
+	bench_locked();
+	bench_ring();
+	return 0;
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Benchmark for queue operations on large queues: appending, deleting
+ * ranges and single songs, moving ranges and shuffling, at 10k, 100k
+ * and 1M entries (or the sizes given on the command line).
+ */
+
+#include "config.h"
+#include "playqueue.h"
+#include "song.h"
+#include "bench_time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* number of operations timed for the per-operation benchmarks */
+#define NOPS 1000
+
+void
+song_free(G_GNUC_UNUSED struct song *song)
+{
+}
+
+static void
+fill(struct queue *queue, struct song *song)
+{
+	while (!queue_is_full(queue))
+		queue_append(queue, song, 0);
+}
+
+static void
+bench(unsigned length)
+{
+	/* songs which look like they are in the database, so the
+	   queue does not free them */
+	static struct song song;
+	song.parent = (struct directory *)&song;
+
+	struct queue queue;
+	queue_init(&queue, length);
+
+	uint64_t t = now_ns();
+	fill(&queue, &song);
+	t = now_ns() - t;
+	printf("%8u: append     %8.1f ns/song\n", length,
+	       (double)t / length);
+
+	/* delete the queue in chunks, as "delete START:END" does */
+	unsigned chunk = length / 10;
+	t = now_ns();
+	while (!queue_is_empty(&queue))
+		queue_delete_range(&queue, 0, queue_length(&queue) < chunk
+				   ? queue_length(&queue) : chunk);
+	t = now_ns() - t;
+	printf("%8u: delete     %8.1f ns/song (ranges of %u)\n", length,
+	       (double)t / length, chunk);
+
+	/* "deleteid" of single songs near the front */
+	fill(&queue, &song);
+	t = now_ns();
+	for (unsigned i = 0; i < NOPS; ++i)
+		queue_delete(&queue, i % queue_length(&queue));
+	t = now_ns() - t;
+	printf("%8u: deleteid   %8.1f us/op\n", length,
+	       (double)t / NOPS / 1e3);
+
+	/* "move" of ranges across the whole queue */
+	fill(&queue, &song);
+	unsigned count = length / 100 + 1;
+	t = now_ns();
+	for (unsigned i = 0; i < NOPS; ++i) {
+		unsigned start = rand() % (length - count);
+		unsigned to = rand() % (length - count);
+		queue_move_range(&queue, start, start + count, to);
+	}
+	t = now_ns() - t;
+	printf("%8u: move       %8.1f us/op (ranges of %u)\n", length,
+	       (double)t / NOPS / 1e3, count);
+
+	queue.random = true;
+	t = now_ns();
+	queue_shuffle_order(&queue);
+	t = now_ns() - t;
+	printf("%8u: shuffle    %8.1f ms\n", length, t / 1e6);
+
+	t = now_ns();
+	for (unsigned i = 0; i < NOPS; ++i)
+		queue_delete(&queue, rand() % queue_length(&queue));
+	t = now_ns() - t;
+	printf("%8u: delete rnd %8.1f us/op (random mode)\n", length,
+	       (double)t / NOPS / 1e3);
+
+	queue_finish(&queue);
+}
+
+int main(int argc, char **argv)
+{
+	static const unsigned default_sizes[] = { 10000, 100000, 1000000 };
+
+	if (argc > 1) {
+		for (int i = 1; i < argc; ++i) {
+			unsigned length = strtoul(argv[i], NULL, 10);
+			if (length < 2 * NOPS) {
+				fprintf(stderr, "Usage: bench_queue [LENGTH...]\n"
+					"LENGTH must be at least %u\n", 2 * NOPS);
+				return 1;
+			}
+
+			bench(length);
+		}
+	} else
+		for (unsigned i = 0; i < G_N_ELEMENTS(default_sizes); ++i)
+			bench(default_sizes[i]);
+
+	return 0;
+}
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Benchmark for "search any TERM": builds a synthetic library and runs
+ * case-insensitive substring queries over it, once the old way
+ * (casefolding the URI and every tag value of every song on each
+ * query), once with locate_song_search(), which uses the casefolded
+ * values precomputed by the tag pool, and once narrowed down by the
+ * trigram index.
+ */
+
+#include "config.h"
+#include "locate.h"
+#include "db_lock.h"
+#include "db_visitor.h"
+#include "directory.h"
+#include "song.h"
+#include "tag.h"
+#include "tag_pool.h"
+#include "trigram_index.h"
+#include "bench_time.h"
+
+#include <glib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SONGS_PER_ALBUM 12
+#define ALBUMS_PER_ARTIST 4
+
+static unsigned long num_songs = 200000;
+static unsigned num_queries = 20;
+
+static const char *const terms[] = {
+	"track number 1234", "genre 7", "album 99", "zzz", "flac",
+};
+
+static void
+fill_library(struct directory *root)
+{
+	char buf[64];
+
+	for (unsigned long i = 0; i < num_songs; ++i) {
+		unsigned long album = i / SONGS_PER_ALBUM;
+		unsigned long artist = album / ALBUMS_PER_ARTIST;
+
+		snprintf(buf, sizeof(buf), "Artist %lu", artist);
+		struct directory *artist_dir =
+			directory_make_child(root, buf);
+
+		snprintf(buf, sizeof(buf), "Album %lu", album);
+		struct directory *album_dir =
+			directory_make_child(artist_dir, buf);
+
+		snprintf(buf, sizeof(buf), "%02lu - Track %lu.flac",
+			 i % SONGS_PER_ALBUM + 1, i);
+		struct song *song = song_file_new(buf, album_dir);
+
+		struct tag *tag = song->tag = tag_new();
+		tag->time = 180 + i % 240;
+
+		tag_begin_add(tag);
+		snprintf(buf, sizeof(buf), "Artist %lu", artist);
+		tag_add_item(tag, TAG_ARTIST, buf);
+		snprintf(buf, sizeof(buf), "Album %lu", album);
+		tag_add_item(tag, TAG_ALBUM, buf);
+		snprintf(buf, sizeof(buf), "Track Number %lu", i);
+		tag_add_item(tag, TAG_TITLE, buf);
+		snprintf(buf, sizeof(buf), "Genre %lu", album % 150);
+		tag_add_item(tag, TAG_GENRE, buf);
+		tag_end_add(tag);
+
+		directory_add_song(album_dir, song);
+	}
+}
+
+/* the previous implementation, allocating on every comparison */
+
+static bool
+old_search(const struct song *song, const char *str)
+{
+	char *uri = song_get_uri(song);
+	char *p = g_utf8_casefold(uri, -1);
+	free(uri);
+
+	bool ret = strstr(p, str) != NULL;
+	g_free(p);
+	if (ret || song->tag == NULL)
+		return ret;
+
+	for (unsigned i = 0; i < song->tag->num_items && !ret; i++) {
+		char *duplicate =
+			g_utf8_casefold(song->tag->items[i]->value, -1);
+		if (*str && strstr(duplicate, str))
+			ret = true;
+		g_free(duplicate);
+	}
+
+	return ret;
+}
+
+enum search_mode {
+	SEARCH_CASEFOLD,
+	SEARCH_PRECOMPUTED,
+	SEARCH_TRIGRAM,
+};
+
+struct search_data {
+	const struct locate_item_list *criteria;
+	enum search_mode mode;
+	unsigned long matches;
+};
+
+static int
+search_visitor_song(struct song *song, void *ctx)
+{
+	struct search_data *data = ctx;
+	bool match = data->mode == SEARCH_CASEFOLD
+		? old_search(song, data->criteria->items[0].needle)
+		: locate_song_search(song, data->criteria);
+
+	if (match)
+		++data->matches;
+	return MPD_SUCCESS;
+}
+
+static const struct db_visitor search_visitor = {
+	.song = search_visitor_song,
+};
+
+static void
+search_trigram(struct search_data *data)
+{
+	struct song **songs;
+	unsigned length;
+
+	if (!trigram_index_candidates(data->criteria, &songs, &length)) {
+		fprintf(stderr, "trigram index not usable\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (unsigned i = 0; i < length; i++)
+		search_visitor_song(songs[i], data);
+
+	free(songs);
+}
+
+static unsigned long
+bench(const char *name, const struct directory *root, enum search_mode mode)
+{
+	struct search_data data = { .mode = mode };
+
+	uint64_t t = now_ns();
+	for (unsigned i = 0; i < num_queries; i++) {
+		struct locate_item_list *criteria = locate_item_list_new(1);
+		criteria->items[0].tag = LOCATE_TAG_ANY_TYPE;
+		criteria->items[0].needle =
+			g_utf8_casefold(terms[i % G_N_ELEMENTS(terms)], -1);
+		data.criteria = criteria;
+
+		if (mode == SEARCH_TRIGRAM)
+			search_trigram(&data);
+		else
+			directory_walk(root, true, &search_visitor, &data);
+
+		g_free(criteria->items[0].needle);
+		criteria->items[0].needle = NULL;
+		locate_item_list_free(criteria);
+	}
+	uint64_t elapsed = now_ns() - t;
+
+	printf("%s %.2f queries/sec, %.0f songs/sec\n", name,
+	       num_queries * 1e9 / elapsed,
+	       (double)num_queries * num_songs * 1e9 / elapsed);
+	return data.matches;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 2) {
+		fprintf(stderr, "Usage: bench_search [NUM_SONGS]\n");
+		return 1;
+	}
+
+	if (argc > 1)
+		num_songs = strtoul(argv[1], NULL, 10);
+
+	tag_pool_init();
+
+	struct directory *root = directory_new_root();
+
+	db_lock();
+	fill_library(root);
+
+	uint64_t t = now_ns();
+	trigram_index_enable(root);
+	printf("trigram index: %.1f ms to build, %zu bytes\n",
+	       (now_ns() - t) / 1e6, trigram_index_memory());
+
+	unsigned long old_matches = bench("casefold:   ", root,
+					  SEARCH_CASEFOLD);
+	unsigned long new_matches = bench("precomputed:", root,
+					  SEARCH_PRECOMPUTED);
+	unsigned long trigram_matches = bench("trigram:    ", root,
+					      SEARCH_TRIGRAM);
+
+	if (old_matches != new_matches || old_matches != trigram_matches) {
+		fprintf(stderr, "result mismatch: %lu, %lu, %lu\n",
+			old_matches, new_matches, trigram_matches);
+		return 1;
+	}
+
+	trigram_index_disable();
+	db_unlock();
+
+	directory_free(root);
+	tag_pool_deinit();
+	return 0;
+}
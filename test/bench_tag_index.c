@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Query benchmark for the tag index: builds a synthetic library and
+ * compares exact "find" queries answered from the tag index with the
+ * full database scan they replace.
+ */
+
+#include "config.h"
+#include "tag_index.h"
+#include "locate.h"
+#include "db_lock.h"
+#include "db_visitor.h"
+#include "directory.h"
+#include "song.h"
+#include "tag.h"
+#include "tag_pool.h"
+#include "bench_time.h"
+
+#include <glib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SONGS_PER_ALBUM 12
+#define ALBUMS_PER_ARTIST 4
+
+static unsigned long num_songs = 200000;
+static unsigned num_queries = 200;
+
+static void
+fill_library(struct directory *root)
+{
+	char buf[64];
+
+	for (unsigned long i = 0; i < num_songs; ++i) {
+		unsigned long album = i / SONGS_PER_ALBUM;
+		unsigned long artist = album / ALBUMS_PER_ARTIST;
+
+		snprintf(buf, sizeof(buf), "Artist %lu", artist);
+		struct directory *artist_dir =
+			directory_make_child(root, buf);
+
+		snprintf(buf, sizeof(buf), "Album %lu", album);
+		struct directory *album_dir =
+			directory_make_child(artist_dir, buf);
+
+		snprintf(buf, sizeof(buf), "%02lu - Track %lu.flac",
+			 i % SONGS_PER_ALBUM + 1, i);
+		struct song *song = song_file_new(buf, album_dir);
+
+		struct tag *tag = song->tag = tag_new();
+		tag->time = 180 + i % 240;
+
+		tag_begin_add(tag);
+		snprintf(buf, sizeof(buf), "Artist %lu", artist);
+		tag_add_item(tag, TAG_ARTIST, buf);
+		snprintf(buf, sizeof(buf), "Album %lu", album);
+		tag_add_item(tag, TAG_ALBUM, buf);
+		snprintf(buf, sizeof(buf), "Track number %lu", i);
+		tag_add_item(tag, TAG_TITLE, buf);
+		snprintf(buf, sizeof(buf), "Genre %lu", album % 150);
+		tag_add_item(tag, TAG_GENRE, buf);
+		tag_end_add(tag);
+
+		directory_add_song(album_dir, song);
+	}
+}
+
+static struct locate_item_list *
+make_query(unsigned i)
+{
+	char buf[64];
+	unsigned long albums = num_songs / SONGS_PER_ALBUM;
+	unsigned long artist = (i * 7919ul) % (albums / ALBUMS_PER_ARTIST);
+
+	struct locate_item_list *criteria = locate_item_list_new(2);
+	snprintf(buf, sizeof(buf), "Artist %lu", artist);
+	criteria->items[0].tag = TAG_ARTIST;
+	criteria->items[0].needle = strdup(buf);
+	snprintf(buf, sizeof(buf), "Genre %lu",
+		 (artist * ALBUMS_PER_ARTIST) % 150);
+	criteria->items[1].tag = TAG_GENRE;
+	criteria->items[1].needle = strdup(buf);
+	return criteria;
+}
+
+struct scan_data {
+	const struct locate_item_list *criteria;
+	unsigned long matches;
+};
+
+static int
+scan_visitor_song(struct song *song, void *ctx)
+{
+	struct scan_data *data = ctx;
+
+	if (locate_song_match(song, data->criteria))
+		++data->matches;
+	return MPD_SUCCESS;
+}
+
+static const struct db_visitor scan_visitor = {
+	.song = scan_visitor_song,
+};
+
+static unsigned long
+query_scan(const struct directory *root,
+	   const struct locate_item_list *criteria)
+{
+	struct scan_data data = { .criteria = criteria };
+	directory_walk(root, true, &scan_visitor, &data);
+	return data.matches;
+}
+
+static unsigned long
+query_index(const struct locate_item_list *criteria)
+{
+	struct song **songs;
+	unsigned length;
+
+	if (!tag_index_candidates(criteria, &songs, &length)) {
+		fprintf(stderr, "tag index not usable\n");
+		exit(EXIT_FAILURE);
+	}
+
+	unsigned long matches = 0;
+	for (unsigned i = 0; i < length; i++)
+		if (locate_song_match(songs[i], criteria))
+			++matches;
+
+	free(songs);
+	return matches;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 2) {
+		fprintf(stderr, "Usage: bench_tag_index [NUM_SONGS]\n");
+		return 1;
+	}
+
+	if (argc > 1)
+		num_songs = strtoul(argv[1], NULL, 10);
+
+	tag_pool_init();
+
+	struct directory *root = directory_new_root();
+
+	db_lock();
+	fill_library(root);
+
+	uint64_t t = now_ns();
+	tag_index_build(root);
+	printf("build:  %.1f ms for %lu songs\n",
+	       (now_ns() - t) / 1e6, num_songs);
+
+	unsigned long scan_matches = 0, index_matches = 0;
+
+	t = now_ns();
+	for (unsigned i = 0; i < num_queries; i++) {
+		struct locate_item_list *criteria = make_query(i);
+		scan_matches += query_scan(root, criteria);
+		locate_item_list_free(criteria);
+	}
+	uint64_t scan_time = now_ns() - t;
+
+	t = now_ns();
+	for (unsigned i = 0; i < num_queries; i++) {
+		struct locate_item_list *criteria = make_query(i);
+		index_matches += query_index(criteria);
+		locate_item_list_free(criteria);
+	}
+	uint64_t index_time = now_ns() - t;
+
+	printf("scan:   %.0f queries/sec\n", num_queries * 1e9 / scan_time);
+	printf("index:  %.0f queries/sec\n", num_queries * 1e9 / index_time);
+
+	if (scan_matches != index_matches) {
+		fprintf(stderr, "result mismatch: %lu != %lu\n",
+			scan_matches, index_matches);
+		return 1;
+	}
+
+	tag_index_clear(root);
+	db_unlock();
+
+	directory_free(root);
+	tag_pool_deinit();
+	return 0;
+}
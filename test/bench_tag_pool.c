@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Micro benchmark for the tag pool: interns the tags of a synthetic
+ * library of one million songs (artist, album artist, album, title,
+ * genre, date, track), then releases them again.
+ *
+ * The "chained" variant is the previous design (4096 djb2 buckets
+ * with singly linked chains and a global lock), kept here as a
+ * reference.
+ */
+
+#include "config.h"
+#include "tag_pool.h"
+#include "c11thread.h"
+#include "bench_time.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAGS_PER_SONG 7
+#define MAX_THREADS 16
+
+static unsigned long num_songs = 1000000;
+static unsigned num_threads = 4;
+
+static struct tag_item **items;
+
+/**
+ * Generates the value of tag number @t of song @song.  Roughly 60k
+ * artists, 100k albums, unique titles and a handful of genres and
+ * dates, similar to a large real-world library.
+ */
+static size_t
+song_tag(unsigned long song, unsigned t, enum tag_type *type, char *buf)
+{
+	unsigned long album = song / 10;
+	unsigned long artist = album / 2 + (album * 7) % 3;
+
+	switch (t) {
+	case 0:
+		*type = TAG_ARTIST;
+		return sprintf(buf, "Artist %lu", artist);
+	case 1:
+		*type = TAG_ALBUM_ARTIST;
+		return sprintf(buf, "Artist %lu", album / 2);
+	case 2:
+		*type = TAG_ALBUM;
+		return sprintf(buf, "Album %lu of artist %lu", album, artist);
+	case 3:
+		*type = TAG_TITLE;
+		return sprintf(buf, "Title of song number %lu", song);
+	case 4:
+		*type = TAG_GENRE;
+		return sprintf(buf, "Genre %lu", (album * 2654435761u) % 200);
+	case 5:
+		*type = TAG_DATE;
+		return sprintf(buf, "%lu", 1950 + album % 70);
+	default:
+		*type = TAG_TRACK;
+		return sprintf(buf, "%lu", song % 10 + 1);
+	}
+}
+
+/* The old chained pool */
+
+#define NUM_SLOTS 4096
+
+struct chained_slot {
+	struct chained_slot *next;
+	unsigned char ref;
+	struct tag_item item;
+};
+
+static struct chained_slot *chained_slots[NUM_SLOTS];
+static mtx_t chained_lock;
+
+static unsigned
+chained_hash(enum tag_type type, const char *p, size_t length)
+{
+	unsigned hash = 5381;
+
+	while (length-- > 0)
+		hash = (hash << 5) + hash + *p++;
+
+	return hash ^ type;
+}
+
+static struct tag_item *
+chained_get(enum tag_type type, const char *value, size_t length)
+{
+	struct chained_slot **slot_p, *slot;
+
+	mtx_lock(&chained_lock);
+
+	slot_p = &chained_slots[chained_hash(type, value, length) % NUM_SLOTS];
+	for (slot = *slot_p; slot != NULL; slot = slot->next) {
+		if (slot->item.type == type &&
+		    length == strlen(slot->item.value) &&
+		    memcmp(value, slot->item.value, length) == 0 &&
+		    slot->ref < 0xff) {
+			++slot->ref;
+			mtx_unlock(&chained_lock);
+			return &slot->item;
+		}
+	}
+
+	slot = malloc(sizeof(*slot) + length + 1);
+	slot->next = *slot_p;
+	slot->ref = 1;
+	slot->item.type = type;
+	memcpy(slot->item.value, value, length);
+	slot->item.value[length] = 0;
+	*slot_p = slot;
+
+	mtx_unlock(&chained_lock);
+	return &slot->item;
+}
+
+static void
+chained_put(struct tag_item *item)
+{
+	struct chained_slot **slot_p, *slot;
+
+	mtx_lock(&chained_lock);
+
+	slot = (struct chained_slot *)
+		((char *)item - offsetof(struct chained_slot, item));
+	if (--slot->ref > 0) {
+		mtx_unlock(&chained_lock);
+		return;
+	}
+
+	size_t length = strlen(item->value);
+	for (slot_p = &chained_slots[chained_hash(item->type, item->value,
+						  length) % NUM_SLOTS];
+	     *slot_p != slot; slot_p = &(*slot_p)->next)
+		;
+
+	*slot_p = slot->next;
+	mtx_unlock(&chained_lock);
+	free(slot);
+}
+
+/* Driver */
+
+struct worker {
+	thrd_t thread;
+	unsigned long begin, end;
+	struct tag_item *(*get)(enum tag_type, const char *, size_t);
+	void (*put)(struct tag_item *);
+	bool release;
+};
+
+static int
+worker_run(void *arg)
+{
+	struct worker *w = arg;
+	char buf[64];
+	enum tag_type type;
+
+	for (unsigned long song = w->begin; song < w->end; ++song) {
+		struct tag_item **p = &items[song * TAGS_PER_SONG];
+
+		for (unsigned t = 0; t < TAGS_PER_SONG; ++t) {
+			if (w->release) {
+				w->put(p[t]);
+			} else {
+				size_t length = song_tag(song, t, &type, buf);
+				p[t] = w->get(type, buf, length);
+			}
+		}
+	}
+
+	return 0;
+}
+
+static uint64_t
+run_workers(unsigned n,
+	    struct tag_item *(*get)(enum tag_type, const char *, size_t),
+	    void (*put)(struct tag_item *), bool release)
+{
+	struct worker workers[MAX_THREADS];
+	uint64_t start = now_ns();
+
+	for (unsigned i = 0; i < n; ++i) {
+		workers[i].begin = num_songs * i / n;
+		workers[i].end = num_songs * (i + 1) / n;
+		workers[i].get = get;
+		workers[i].put = put;
+		workers[i].release = release;
+		thrd_create(&workers[i].thread, worker_run, &workers[i]);
+	}
+
+	for (unsigned i = 0; i < n; ++i)
+		thrd_join(workers[i].thread, NULL);
+
+	return now_ns() - start;
+}
+
+static void
+bench(const char *name, unsigned n,
+      struct tag_item *(*get)(enum tag_type, const char *, size_t),
+      void (*put)(struct tag_item *))
+{
+	uint64_t load = run_workers(n, get, put, false);
+	uint64_t release = run_workers(n, get, put, true);
+
+	printf("%-8s %2u thread(s): load %7.1f ms (%5.0f ns/item), "
+	       "release %7.1f ms\n",
+	       name, n, load / 1e6,
+	       (double)load / (num_songs * TAGS_PER_SONG),
+	       release / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 3) {
+		fprintf(stderr, "Usage: bench_tag_pool [NSONGS [NTHREADS]]\n");
+		return 1;
+	}
+
+	if (argc > 1)
+		num_songs = strtoul(argv[1], NULL, 10);
+	if (argc > 2)
+		num_threads = strtoul(argv[2], NULL, 10);
+	if (num_threads < 1 || num_threads > MAX_THREADS)
+		num_threads = 4;
+
+	items = malloc(num_songs * TAGS_PER_SONG * sizeof(items[0]));
+
+	mtx_init(&chained_lock, mtx_plain);
+	tag_pool_init();
+
+	bench("chained", 1, chained_get, chained_put);
+	bench("sharded", 1, tag_pool_get_item, tag_pool_put_item);
+
+	/* one more pass to report the number of distinct values */
+	run_workers(1, tag_pool_get_item, tag_pool_put_item, false);
+	printf("%zu distinct tag items\n", tag_pool_count());
+	run_workers(1, tag_pool_get_item, tag_pool_put_item, true);
+
+	if (num_threads > 1) {
+		bench("chained", num_threads, chained_get, chained_put);
+		bench("sharded", num_threads,
+		      tag_pool_get_item, tag_pool_put_item);
+	}
+
+	tag_pool_deinit();
+	mtx_destroy(&chained_lock);
+	free(items);
+	return 0;
+}
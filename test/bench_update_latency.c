@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Latency test for the database update: starts an update on a
+ * running MPD and sends "lsinfo" and "status" on a second connection
+ * until the update has finished.  Reports the average, 99th
+ * percentile and worst case response time of both commands, which
+ * shows how long clients wait for the update thread to release the
+ * database lock.
+ *
+ * With "rescan", all tags are read again, which is the worst case.
+ * Point URI at a large directory to make "lsinfo" itself expensive.
+ */
+
+#include "bench_time.h"
+
+#include <netdb.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+struct connection {
+	int fd;
+
+	char buffer[65536];
+	size_t start, end;
+};
+
+struct latency {
+	const char *name;
+
+	uint64_t *samples;
+	size_t n, capacity;
+};
+
+static void
+connection_open(struct connection *c, const char *host, const char *port)
+{
+	struct addrinfo hints = { .ai_socktype = SOCK_STREAM }, *ai;
+	int ret = getaddrinfo(host, port, &hints, &ai);
+	if (ret != 0) {
+		fprintf(stderr, "%s: %s\n", host, gai_strerror(ret));
+		exit(1);
+	}
+
+	c->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	if (c->fd < 0 || connect(c->fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+		perror("connect");
+		exit(1);
+	}
+
+	freeaddrinfo(ai);
+	c->start = c->end = 0;
+}
+
+/* Returns the next line of the response, without the newline */
+static const char *
+connection_read_line(struct connection *c)
+{
+	while (true) {
+		char *p = memchr(c->buffer + c->start, '\n',
+				 c->end - c->start);
+		if (p != NULL) {
+			const char *line = c->buffer + c->start;
+			*p = 0;
+			c->start = p + 1 - c->buffer;
+			return line;
+		}
+
+		if (c->start > 0) {
+			memmove(c->buffer, c->buffer + c->start,
+				c->end - c->start);
+			c->end -= c->start;
+			c->start = 0;
+		}
+
+		if (c->end == sizeof(c->buffer)) {
+			fprintf(stderr, "line too long\n");
+			exit(1);
+		}
+
+		ssize_t nbytes = recv(c->fd, c->buffer + c->end,
+				      sizeof(c->buffer) - c->end, 0);
+		if (nbytes <= 0) {
+			fprintf(stderr, "connection closed\n");
+			exit(1);
+		}
+
+		c->end += nbytes;
+	}
+}
+
+static void
+connection_send(struct connection *c, const char *command)
+{
+	size_t length = strlen(command);
+	if (send(c->fd, command, length, MSG_NOSIGNAL) != (ssize_t)length) {
+		perror("send");
+		exit(1);
+	}
+}
+
+/*
+ * Sends a command and reads the whole response.  Returns true if a
+ * line of the response starts with the given prefix.
+ */
+static bool
+connection_command(struct connection *c, const char *command,
+		   const char *prefix)
+{
+	bool found = false;
+
+	connection_send(c, command);
+
+	while (true) {
+		const char *line = connection_read_line(c);
+		if (strcmp(line, "OK") == 0)
+			return found;
+
+		if (strncmp(line, "ACK ", 4) == 0) {
+			fprintf(stderr, "%s", command);
+			fprintf(stderr, "%s\n", line);
+			exit(1);
+		}
+
+		if (prefix != NULL &&
+		    strncmp(line, prefix, strlen(prefix)) == 0)
+			found = true;
+	}
+}
+
+static void
+latency_add(struct latency *l, uint64_t ns)
+{
+	if (l->n == l->capacity) {
+		l->capacity = l->capacity > 0 ? l->capacity * 2 : 1024;
+		l->samples = realloc(l->samples,
+				     l->capacity * sizeof(l->samples[0]));
+	}
+
+	l->samples[l->n++] = ns;
+}
+
+static int
+compare_samples(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static void
+latency_print(struct latency *l)
+{
+	if (l->n == 0)
+		return;
+
+	uint64_t sum = 0;
+	for (size_t i = 0; i < l->n; i++)
+		sum += l->samples[i];
+
+	qsort(l->samples, l->n, sizeof(l->samples[0]), compare_samples);
+
+	printf("%-7s %8zu requests, avg %8.1f us, p99 %8.1f us, "
+	       "max %8.1f us\n",
+	       l->name, l->n, sum / 1e3 / l->n,
+	       l->samples[l->n * 99 / 100] / 1e3,
+	       l->samples[l->n - 1] / 1e3);
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc < 3 || argc > 5) {
+		fprintf(stderr,
+			"Usage: bench_update_latency HOST PORT [URI] "
+			"[update|rescan]\n");
+		return 1;
+	}
+
+	const char *uri = argc > 3 ? argv[3] : "";
+	const char *update = argc > 4 ? argv[4] : "rescan";
+
+	struct connection *control = calloc(1, sizeof(*control));
+	struct connection *reader = calloc(1, sizeof(*reader));
+	connection_open(control, argv[1], argv[2]);
+	connection_open(reader, argv[1], argv[2]);
+
+	/* the greeting */
+	connection_read_line(control);
+	connection_read_line(reader);
+
+	char lsinfo[4096];
+	snprintf(lsinfo, sizeof(lsinfo), "lsinfo \"%s\"\n", uri);
+
+	/* warm up, then start the update */
+	connection_command(reader, lsinfo, NULL);
+
+	char command[64];
+	snprintf(command, sizeof(command), "%s\n", update);
+	connection_command(control, command, NULL);
+
+	struct latency lsinfo_latency = { .name = "lsinfo" };
+	struct latency status_latency = { .name = "status" };
+
+	uint64_t start = now_ns();
+	while (true) {
+		uint64_t t = now_ns();
+		connection_command(reader, lsinfo, NULL);
+		latency_add(&lsinfo_latency, now_ns() - t);
+
+		t = now_ns();
+		bool updating = connection_command(reader, "status\n",
+						   "updating_db:");
+		latency_add(&status_latency, now_ns() - t);
+
+		if (!updating)
+			break;
+	}
+
+	printf("update took %.1f s\n", (now_ns() - start) / 1e9);
+	latency_print(&lsinfo_latency);
+	latency_print(&status_latency);
+
+	free(lsinfo_latency.samples);
+	free(status_latency.samples);
+	close(control->fd);
+	close(reader->fd);
+	free(control);
+	free(reader);
+	return 0;
+}
@@ -53,4 +53,28 @@ test_pcm_volume_32(void);
 void
 test_pcm_volume_float(void);
 
+void
+test_pcm_format_16(void);
+
+void
+test_pcm_format_24(void);
+
+void
+test_pcm_format_32(void);
+
+void
+test_pcm_format_float(void);
+
+void
+test_pcm_mix_add(void);
+
+void
+test_pcm_mix_vol_16(void);
+
+void
+test_pcm_mix_vol_24(void);
+
+void
+test_pcm_mix_vol_32(void);
+
 #endif
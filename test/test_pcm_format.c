@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Checks that the vectorized sample conversions produce exactly the
+ * same output as the scalar reference code.
+ */
+
+#include "test_pcm_all.h"
+#include "pcm_format.h"
+#include "pcm_buffer.h"
+#include "pcm_dither.h"
+#include "pcm_simd.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+/* not a multiple of any vector width, so the scalar tail runs too */
+enum { N = 1021 };
+
+static const enum sample_format src_formats[] = {
+	SAMPLE_FORMAT_S8,
+	SAMPLE_FORMAT_S16,
+	SAMPLE_FORMAT_S24_P32,
+	SAMPLE_FORMAT_S32,
+	SAMPLE_FORMAT_FLOAT,
+};
+
+static void
+fill_random(void *buffer, enum sample_format format)
+{
+	switch (format) {
+	case SAMPLE_FORMAT_S8:
+		for (unsigned i = 0; i < N; ++i)
+			((int8_t *)buffer)[i] = g_random_int();
+		break;
+
+	case SAMPLE_FORMAT_S16:
+		for (unsigned i = 0; i < N; ++i)
+			((int16_t *)buffer)[i] = g_random_int();
+		break;
+
+	case SAMPLE_FORMAT_S24_P32:
+		for (unsigned i = 0; i < N; ++i)
+			((int32_t *)buffer)[i] =
+				g_random_int_range(-(1 << 23), 1 << 23);
+		break;
+
+	case SAMPLE_FORMAT_S32:
+		for (unsigned i = 0; i < N; ++i)
+			((int32_t *)buffer)[i] = g_random_int();
+		break;
+
+	case SAMPLE_FORMAT_FLOAT:
+		/* slightly out of range, to exercise the clamping */
+		for (unsigned i = 0; i < N; ++i)
+			((float *)buffer)[i] =
+				g_random_double_range(-1.2, 1.2);
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+}
+
+typedef const void *(*convert_func)(struct pcm_buffer *buffer,
+				    enum sample_format src_format,
+				    const void *src, size_t src_size,
+				    size_t *dest_size_r);
+
+static void
+check_format(convert_func convert)
+{
+	static int32_t src[N];
+	struct pcm_buffer scalar_buffer, simd_buffer;
+
+	pcm_buffer_init(&scalar_buffer);
+	pcm_buffer_init(&simd_buffer);
+
+	for (unsigned i = 0; i < G_N_ELEMENTS(src_formats); ++i) {
+		enum sample_format format = src_formats[i];
+		size_t src_size = N * sample_format_size(format);
+		size_t scalar_size, simd_size;
+
+		fill_random(src, format);
+
+		pcm_simd_restrict(0);
+		const void *scalar = convert(&scalar_buffer, format, src,
+					     src_size, &scalar_size);
+		pcm_simd_restrict(~0u);
+		const void *simd = convert(&simd_buffer, format, src,
+					   src_size, &simd_size);
+
+		g_assert_cmpuint(scalar_size, ==, simd_size);
+		g_assert_cmpint(memcmp(scalar, simd, scalar_size), ==, 0);
+	}
+
+	pcm_buffer_deinit(&scalar_buffer);
+	pcm_buffer_deinit(&simd_buffer);
+}
+
+static struct pcm_dither dither;
+
+static const void *
+convert_to_16(struct pcm_buffer *buffer, enum sample_format src_format,
+	      const void *src, size_t src_size, size_t *dest_size_r)
+{
+	/* the dither keeps state, restart it for every run */
+	pcm_dither_24_init(&dither);
+	return pcm_convert_to_16(buffer, &dither, src_format, src, src_size,
+				 dest_size_r);
+}
+
+static const void *
+convert_to_24(struct pcm_buffer *buffer, enum sample_format src_format,
+	      const void *src, size_t src_size, size_t *dest_size_r)
+{
+	return pcm_convert_to_24(buffer, src_format, src, src_size,
+				 dest_size_r);
+}
+
+static const void *
+convert_to_32(struct pcm_buffer *buffer, enum sample_format src_format,
+	      const void *src, size_t src_size, size_t *dest_size_r)
+{
+	return pcm_convert_to_32(buffer, src_format, src, src_size,
+				 dest_size_r);
+}
+
+static const void *
+convert_to_float(struct pcm_buffer *buffer, enum sample_format src_format,
+		 const void *src, size_t src_size, size_t *dest_size_r)
+{
+	return pcm_convert_to_float(buffer, src_format, src, src_size,
+				    dest_size_r);
+}
+
+void
+test_pcm_format_16(void)
+{
+	check_format(convert_to_16);
+}
+
+void
+test_pcm_format_24(void)
+{
+	check_format(convert_to_24);
+}
+
+void
+test_pcm_format_32(void)
+{
+	check_format(convert_to_32);
+}
+
+void
+test_pcm_format_float(void)
+{
+	check_format(convert_to_float);
+}
@@ -38,5 +38,15 @@ main(int argc, char **argv)
 	g_test_add_func("/pcm/volume/32", test_pcm_volume_32);
 	g_test_add_func("/pcm/volume/float", test_pcm_volume_float);
 
+	g_test_add_func("/pcm/format/16", test_pcm_format_16);
+	g_test_add_func("/pcm/format/24", test_pcm_format_24);
+	g_test_add_func("/pcm/format/32", test_pcm_format_32);
+	g_test_add_func("/pcm/format/float", test_pcm_format_float);
+
+	g_test_add_func("/pcm/mix/add", test_pcm_mix_add);
+	g_test_add_func("/pcm/mix/vol16", test_pcm_mix_vol_16);
+	g_test_add_func("/pcm/mix/vol24", test_pcm_mix_vol_24);
+	g_test_add_func("/pcm/mix/vol32", test_pcm_mix_vol_32);
+
 	g_test_run();
 }
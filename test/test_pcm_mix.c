@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2016 Yuxuan Shui <yshuiv7@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Checks that the vectorized mixing kernels produce exactly the same
+ * output as the scalar code in pcm_mix.c.
+ */
+
+#include "test_pcm_all.h"
+#include "pcm_mix.h"
+#include "pcm_simd.h"
+#include "pcm_volume.h"
+#include "pcm_utils.h"
+
+#include <glib.h>
+
+#include <math.h>
+#include <string.h>
+
+/* not a multiple of any vector width, so the scalar tail runs too */
+enum { N = 1021 };
+
+static void
+fill_random(void *buffer, enum sample_format format)
+{
+	for (unsigned i = 0; i < N; ++i) {
+		switch (format) {
+		case SAMPLE_FORMAT_S8:
+			((int8_t *)buffer)[i] = g_random_int();
+			break;
+		case SAMPLE_FORMAT_S16:
+			((int16_t *)buffer)[i] = g_random_int();
+			break;
+		case SAMPLE_FORMAT_S24_P32:
+			((int32_t *)buffer)[i] =
+				g_random_int_range(-(1 << 23), 1 << 23);
+			break;
+		case SAMPLE_FORMAT_S32:
+			((int32_t *)buffer)[i] = g_random_int();
+			break;
+		case SAMPLE_FORMAT_FLOAT:
+			((float *)buffer)[i] = g_random_double_range(-1, 1);
+			break;
+		default:
+			g_assert_not_reached();
+		}
+	}
+}
+
+/**
+ * Mixes with the scalar code and with SIMD kernels, and compares.
+ * Only deterministic for the formats which don't use dithering in
+ * this mode.
+ */
+static void
+check_mix(enum sample_format format, float portion1)
+{
+	static int32_t a[N], b[N], scalar[N], simd[N];
+	const size_t size = N * sample_format_size(format);
+
+	fill_random(a, format);
+	fill_random(b, format);
+
+	memcpy(scalar, a, size);
+	pcm_simd_restrict(0);
+	g_assert(pcm_mix(scalar, b, size, format, portion1));
+
+	memcpy(simd, a, size);
+	pcm_simd_restrict(~0u);
+	g_assert(pcm_mix(simd, b, size, format, portion1));
+
+	g_assert_cmpint(memcmp(scalar, simd, size), ==, 0);
+}
+
+void
+test_pcm_mix_add(void)
+{
+	check_mix(SAMPLE_FORMAT_S8, NAN);
+	check_mix(SAMPLE_FORMAT_S16, NAN);
+	check_mix(SAMPLE_FORMAT_S24_P32, NAN);
+	check_mix(SAMPLE_FORMAT_S32, NAN);
+	check_mix(SAMPLE_FORMAT_FLOAT, NAN);
+	check_mix(SAMPLE_FORMAT_FLOAT, 0.3);
+}
+
+void
+test_pcm_mix_vol_16(void)
+{
+	int16_t a[N], b[N], out[N];
+	int32_t dither[N];
+
+	fill_random(a, SAMPLE_FORMAT_S16);
+	fill_random(b, SAMPLE_FORMAT_S16);
+	for (unsigned i = 0; i < N; ++i)
+		dither[i] = pcm_volume_dither();
+
+	const int vol1 = g_random_int_range(0, PCM_VOLUME_1 + 1);
+	const int vol2 = PCM_VOLUME_1 - vol1;
+
+	memcpy(out, a, sizeof(out));
+	size_t n = pcm_simd_add_vol_16(out, b, dither, N, vol1, vol2);
+
+	for (unsigned i = 0; i < n; ++i) {
+		int32_t expected = ((a[i] * vol1 + b[i] * vol2) + dither[i] +
+				    PCM_VOLUME_1 / 2) / PCM_VOLUME_1;
+		g_assert_cmpint(out[i], ==, pcm_range(expected, 16));
+	}
+}
+
+static void
+check_mix_vol_wide(enum sample_format format, unsigned bits)
+{
+	int32_t a[N], b[N], out[N];
+	int32_t dither[N];
+
+	fill_random(a, format);
+	fill_random(b, format);
+	for (unsigned i = 0; i < N; ++i)
+		dither[i] = pcm_volume_dither();
+
+	const int vol1 = g_random_int_range(0, PCM_VOLUME_1 + 1);
+	const int vol2 = PCM_VOLUME_1 - vol1;
+
+	memcpy(out, a, sizeof(out));
+	size_t n = bits == 24
+		? pcm_simd_add_vol_24(out, b, dither, N, vol1, vol2)
+		: pcm_simd_add_vol_32(out, b, dither, N, vol1, vol2);
+
+	for (unsigned i = 0; i < n; ++i) {
+		int64_t expected = (((int64_t)a[i] * vol1 +
+				     (int64_t)b[i] * vol2) +
+				    dither[i] + PCM_VOLUME_1 / 2) / PCM_VOLUME_1;
+		g_assert_cmpint(out[i], ==, pcm_range_64(expected, bits));
+	}
+}
+
+void
+test_pcm_mix_vol_24(void)
+{
+	check_mix_vol_wide(SAMPLE_FORMAT_S24_P32, 24);
+}
+
+void
+test_pcm_mix_vol_32(void)
+{
+	check_mix_vol_wide(SAMPLE_FORMAT_S32, 32);
+}
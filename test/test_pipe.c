@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * One writer and two readers running at different speeds.  Every
+ * chunk is filled with its own sequence number; a reader which finds
+ * anything else in a chunk it holds has seen the chunk shifted out
+ * (and poisoned or reused by the writer) under its feet.
+ */
+
+#include "config.h"
+#include "pipe.h"
+#include "audio_format.h"
+#include "c11thread.h"
+#include "tag.h"
+
+#include <glib.h>
+
+#include <assert.h>
+#include <stdlib.h>
+
+#define NUM_CHUNKS 20000
+#define PIPE_CHUNKS 4
+
+void
+tag_free(G_GNUC_UNUSED struct tag *tag)
+{
+}
+
+static const struct audio_format test_format = {
+	.sample_rate = 44100,
+	.format = SAMPLE_FORMAT_S16,
+	.channels = 2,
+};
+
+struct reader {
+	struct audio_pipe *pipe;
+	const struct audio_chunk *chunk;
+
+	/** yield this many times after each chunk */
+	unsigned delay;
+};
+
+static void
+check_chunk(const struct audio_chunk *chunk, uint32_t seq)
+{
+	const uint32_t *p = (const uint32_t *)chunk->data;
+
+	assert(chunk->length % sizeof(*p) == 0);
+	for (size_t i = 0; i < chunk->length / sizeof(*p); ++i)
+		if (p[i] != seq)
+			abort();
+}
+
+static int
+reader_run(void *arg)
+{
+	struct reader *r = arg;
+	uint32_t seq = 0;
+
+	check_chunk(r->chunk, seq);
+
+	while (seq + 1 < NUM_CHUNKS) {
+		const struct audio_chunk *next =
+			audio_pipe_next(r->pipe, r->chunk);
+		if (next == NULL) {
+			thrd_yield();
+			continue;
+		}
+
+		r->chunk = next;
+		++seq;
+
+		for (unsigned i = 0; i < r->delay; ++i)
+			thrd_yield();
+
+		/* check twice: the second pass catches a chunk which
+		   was shifted while we were looking at it */
+		check_chunk(next, seq);
+		thrd_yield();
+		check_chunk(next, seq);
+	}
+
+	return 0;
+}
+
+static void
+write_chunk(struct audio_pipe *pipe, uint32_t seq)
+{
+	const size_t size = audio_pipe_chunk_size(pipe);
+	uint32_t *buffer = g_malloc(size);
+
+	for (size_t i = 0; i < size / sizeof(*buffer); ++i)
+		buffer[i] = seq;
+
+	size_t nbytes = audio_pipe_write_sync(pipe, &test_format, 0, 0,
+					      size, buffer);
+	assert(nbytes == size);
+	(void)nbytes;
+
+	audio_pipe_flush(pipe);
+	g_free(buffer);
+}
+
+int
+main(G_GNUC_UNUSED int argc, G_GNUC_UNUSED char **argv)
+{
+	struct audio_pipe *pipe =
+		audio_pipe_new(&test_format,
+			       PIPE_CHUNKS * audio_chunk_size(&test_format));
+
+	/* both readers start at the first chunk */
+	write_chunk(pipe, 0);
+
+	struct reader readers[2] = {
+		{ .pipe = pipe, .delay = 0 },
+		{ .pipe = pipe, .delay = 3 },
+	};
+
+	thrd_t threads[G_N_ELEMENTS(readers)];
+	for (unsigned i = 0; i < G_N_ELEMENTS(readers); ++i) {
+		readers[i].chunk = audio_pipe_get_head(pipe);
+		assert(readers[i].chunk != NULL);
+	}
+
+	for (unsigned i = 0; i < G_N_ELEMENTS(readers); ++i)
+		if (thrd_create(&threads[i], reader_run,
+				&readers[i]) != thrd_success)
+			abort();
+
+	for (uint32_t seq = 1; seq < NUM_CHUNKS; ++seq)
+		write_chunk(pipe, seq);
+
+	for (unsigned i = 0; i < G_N_ELEMENTS(readers); ++i)
+		thrd_join(threads[i], NULL);
+
+	/* both readers hold the last chunk, everything before it has
+	   been handed back to the writer */
+	assert(audio_pipe_size(pipe) == 1);
+
+	audio_pipe_free(pipe);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+#include "playqueue.h"
+#include "song.h"
+
+#include <stdlib.h>
+
+void
+song_free(G_GNUC_UNUSED struct song *song)
+{
+}
+
+/**
+ * Verifies that every position which queue_song_newer() reports for
+ * the specified version is covered by queue_get_changes().
+ */
+static void
+check_changes(const struct queue *queue, uint32_t version)
+{
+	struct queue_change ranges[QUEUE_CHANGES_MAX];
+	int n = queue_get_changes(queue, version, ranges);
+	if (n < 0)
+		return;
+
+	for (int r = 1; r < n; ++r)
+		assert(ranges[r - 1].end < ranges[r].start);
+
+	int r = 0;
+	for (unsigned i = 0; i < queue_length(queue); ++i) {
+		while (r < n && ranges[r].end <= i)
+			++r;
+
+		if (queue_song_newer(queue, i, version))
+			assert(r < n && ranges[r].start <= i);
+	}
+}
+
+static void
+check_all_versions(const struct queue *queue)
+{
+	for (uint32_t version = 1; version <= queue->version; ++version)
+		check_changes(queue, version);
+}
+
+int
+main(G_GNUC_UNUSED int argc, G_GNUC_UNUSED char **argv)
+{
+	struct song songs[64];
+	for (unsigned i = 0; i < G_N_ELEMENTS(songs); ++i)
+		songs[i].parent = NULL;
+
+	struct queue queue;
+	queue_init(&queue, 64);
+
+	for (unsigned i = 0; i < 32; ++i) {
+		queue_append(&queue, &songs[i], 0);
+		queue_increment_version(&queue);
+	}
+
+	check_all_versions(&queue);
+
+	/* a single modification is reported as a single position */
+
+	uint32_t version = queue.version;
+	queue_swap(&queue, 3, 30);
+	queue_increment_version(&queue);
+
+	struct queue_change ranges[QUEUE_CHANGES_MAX];
+	int n = queue_get_changes(&queue, version, ranges);
+	assert(n == 2);
+	assert(ranges[0].start == 3 && ranges[0].end == 4);
+	assert(ranges[1].start == 30 && ranges[1].end == 31);
+	(void)n;
+
+	/* nothing has changed since the current version */
+
+	assert(queue_get_changes(&queue, queue.version, ranges) == 0);
+
+	/* a future version is not in the log */
+
+	assert(queue_get_changes(&queue, queue.version + 1, ranges) < 0);
+
+	/* random edits */
+
+	srand(42);
+	for (unsigned i = 0; i < 200; ++i) {
+		unsigned length = queue_length(&queue);
+
+		switch (rand() % 6) {
+		case 0:
+			if (!queue_is_full(&queue))
+				queue_append(&queue, &songs[rand() % 64], 0);
+			break;
+
+		case 1:
+			if (length > 1)
+				queue_delete(&queue, rand() % length);
+			break;
+
+		case 2:
+			if (length > 1)
+				queue_move(&queue, rand() % length,
+					   rand() % length);
+			break;
+
+		case 3:
+			if (length > 4)
+				queue_move_range(&queue, 1, 3,
+						 rand() % (length - 2));
+			break;
+
+		case 4:
+			if (length > 1)
+				queue_shuffle_range(&queue, 0, length);
+			break;
+
+		case 5:
+			if (length > 0)
+				queue_set_priority(&queue, rand() % length,
+						   rand() % 256, -1);
+			break;
+		}
+
+		queue_increment_version(&queue);
+		check_all_versions(&queue);
+	}
+
+	/* overrunning the log makes old versions fall back to a full
+	   scan */
+
+	version = queue.version;
+	for (unsigned i = 0; i < QUEUE_CHANGES_MAX * 2; ++i) {
+		queue_swap(&queue, 0, queue_length(&queue) - 1);
+		queue_increment_version(&queue);
+	}
+
+	assert(queue_get_changes(&queue, version, ranges) < 0);
+	assert(queue_get_changes(&queue, queue.version - 1, ranges) > 0);
+	check_all_versions(&queue);
+
+	/* after queue_clear(), the log starts over */
+
+	queue_clear(&queue);
+	version = queue.version;
+	queue_append(&queue, &songs[0], 0);
+	queue_increment_version(&queue);
+	assert(queue_get_changes(&queue, version, ranges) == 1);
+
+	queue_finish(&queue);
+	return 0;
+}